@@ -0,0 +1,602 @@
+/**
+ * @file bench.c
+ *
+ * @version 1.0
+ *
+ * @author Calum Judd Anderson
+ *
+ * @brief Throughput benchmarks for 'lxml.h' over generated corpora
+ *        'bench generate <dir>' writes the corpora, 'bench run <file>' measures one of them as a CSV row
+ *        and 'bench compare <baseline> <results> <percent> [<time percent>]' reports the rows which got worse
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Every allocation made by 'lxml.h' is counted, the standard headers are included first so only
+ * its own calls go through the macros. Counting is not atomic, which is fine as nothing measured here
+ * runs on several threads */
+static unsigned long blxmlAllocs = 0;
+
+static void* blxmlMalloc(size_t size) {
+    ++blxmlAllocs;
+    return malloc(size);
+} /* End of blxmlMalloc */
+
+static void* blxmlCalloc(size_t n, size_t size) {
+    ++blxmlAllocs;
+    return calloc(n, size);
+} /* End of blxmlCalloc */
+
+static void* blxmlRealloc(void *ptr, size_t size) {
+    ++blxmlAllocs;
+    return realloc(ptr, size);
+} /* End of blxmlRealloc */
+
+#define malloc(size) blxmlMalloc(size)
+#define calloc(n, size) blxmlCalloc(n, size)
+#define realloc(ptr, size) blxmlRealloc(ptr, size)
+
+#include "lxml.h"
+
+#undef malloc
+#undef calloc
+#undef realloc
+
+#ifdef LXML_HAVE_POSIX
+#include <sys/resource.h>
+#endif
+
+/* Load, write and free are timed this many times and the fastest kept */
+#ifndef BENCH_RUNS
+#define BENCH_RUNS 5
+#endif
+
+/* The number of 'getImmediateElementByTagName' calls timed */
+#define BENCH_LOOKUPS 100000
+
+/* Where the written documents go */
+#ifdef _WIN32
+#define BENCH_NULL_DEVICE "NUL"
+#else
+#define BENCH_NULL_DEVICE "/dev/null"
+#endif
+
+#define BENCH_MAX_ROWS 64
+#define BENCH_MAX_COLUMNS 32
+#define BENCH_LINE 1024
+
+#define BENCH_HEADER "corpus,bytes,nodes,load_ms,load_mb_s,load_nodes_s,load_allocs,load_rss_kb," \
+                     "write_ms,write_mb_s,write_allocs,lookup_ns,attr_lookup_ns,free_ms"
+
+/* A corpus shape, generated at 'small', 'medium' and 'large' sizes of 'counts' elements */
+struct BenchShape {
+    const char *name;
+    void (*generate)(FILE *fp, unsigned long n, unsigned long *seed);
+    unsigned long counts[3];
+};
+
+/* What a walk over a loaded document collects for the lookup benchmarks */
+struct BenchTree {
+    unsigned long nodes;
+
+    /* The node with the most children */
+    struct XMLNode *widest;
+
+    /* Nodes with attributes, when 'attributed' is not 'NULL' */
+    struct XMLNode **attributed;
+    unsigned long attributedSize;
+};
+
+/* The rows of a CSV written by 'bench run' */
+struct BenchTable {
+    char columns[BENCH_MAX_COLUMNS][32];
+    size_t columnsSize;
+
+    char names[BENCH_MAX_ROWS][64];
+    double values[BENCH_MAX_ROWS][BENCH_MAX_COLUMNS];
+    size_t size;
+};
+
+static int blxmlGenerate(const char *dir);
+static int blxmlRun(const char *path);
+static int blxmlCompare(const char *baselinePath, const char *resultsPath, double threshold, double timeThreshold);
+
+static void blxmlGenerateWide(FILE *fp, unsigned long n, unsigned long *seed);
+static void blxmlGenerateDeep(FILE *fp, unsigned long n, unsigned long *seed);
+static void blxmlGenerateAttrs(FILE *fp, unsigned long n, unsigned long *seed);
+static void blxmlGenerateText(FILE *fp, unsigned long n, unsigned long *seed);
+static void blxmlGenerateComments(FILE *fp, unsigned long n, unsigned long *seed);
+static void blxmlGenerateStruct(FILE *fp, unsigned long n, unsigned long *seed);
+static void blxmlPutWords(FILE *fp, unsigned long words, unsigned long *seed);
+static const char* blxmlWord(unsigned long *seed);
+
+static double blxmlNow();
+static long blxmlPeakRss();
+static enum XMLWalkAction blxmlCollect(void *ctx, struct XMLNode *node, size_t depth);
+static int blxmlReadTable(const char *path, struct BenchTable *table);
+static size_t blxmlColumn(const struct BenchTable *table, const char *name);
+
+static const struct BenchShape blxmlShapes[] = {
+    { "wide", blxmlGenerateWide, { 10000, 100000, 1000000 } },
+    { "deep", blxmlGenerateDeep, { 1000, 10000, 100000 } },
+    { "attrs", blxmlGenerateAttrs, { 2000, 20000, 100000 } },
+    { "text", blxmlGenerateText, { 500, 5000, 30000 } },
+    { "comments", blxmlGenerateComments, { 2000, 20000, 100000 } },
+    { "struct", blxmlGenerateStruct, { 500, 5000, 50000 } }
+};
+
+static const char *const blxmlSizes[] = { "small", "medium", "large" };
+
+/* Lower is better for each of these, the throughputs follow from them. The allocation counts are the
+ * same on every run and machine, the rest are only compared when a threshold is given for them */
+static const char *const blxmlCompared[] = {
+    "load_allocs", "write_allocs"
+};
+
+static const char *const blxmlComparedTimes[] = {
+    "load_ms", "load_rss_kb", "write_ms", "lookup_ns", "attr_lookup_ns", "free_ms"
+};
+
+int main(int argc, char **argv) {
+    int success = FALSE;
+
+    if (3 == argc && 0 == strcmp("generate", argv[1]))
+        success = blxmlGenerate(argv[2]);
+    else if (2 == argc && 0 == strcmp("header", argv[1]))
+        success = (0 <= printf("%s\n", BENCH_HEADER)) ? TRUE : FALSE;
+    else if (3 == argc && 0 == strcmp("run", argv[1]))
+        success = blxmlRun(argv[2]);
+    else if ((5 == argc || 6 == argc) && 0 == strcmp("compare", argv[1]))
+        success = blxmlCompare(argv[2], argv[3], atof(argv[4]), (6 == argc) ? atof(argv[5]) : -1);
+    else
+        fprintf(stderr, "Usage: %s generate <dir> | header | run <file.xml> | compare <baseline.csv> <results.csv> <percent> [<time percent>]\n", argv[0]);
+
+    return (TRUE == success) ? 0 : 1;
+} /* End of main */
+
+/**
+ * @brief Writes every shape at every size to '<dir>/<shape>-<size>.xml'
+ *        Each corpus comes from its own fixed seed so it is the same on every run
+ *
+ * @param  dir     - An existing directory
+ * @return success - 'FALSE' if a file could not be written
+ */
+static int blxmlGenerate(const char *dir) {
+    size_t i = 0, j = 0;
+    int success = TRUE;
+
+    for (; TRUE == success && i < sizeof(blxmlShapes) / sizeof(blxmlShapes[0]); ++i) {
+        for (j = 0; TRUE == success && j < sizeof(blxmlSizes) / sizeof(blxmlSizes[0]); ++j) {
+            unsigned long seed = (unsigned long) (i * 3 + j + 1);
+            char path[512];
+            FILE *fp = NULL;
+
+            sprintf(path, "%.400s/%s-%s.xml", dir, blxmlShapes[i].name, blxmlSizes[j]);
+            fp = fopen(path, "w");
+
+            if (NULL != fp) {
+                fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
+                blxmlShapes[i].generate(fp, blxmlShapes[i].counts[j], &seed);
+
+                success = (0 == ferror(fp)) ? TRUE : FALSE;
+                success &= (0 == fclose(fp)) ? TRUE : FALSE;
+            } else
+                success = FALSE;
+
+            if (FALSE == success)
+                fprintf(stderr, "Could not write '%s'\n", path);
+        }
+    }
+
+    return success;
+} /* End of blxmlGenerate */
+
+/**
+ * @brief Loads, walks, queries, writes and frees the document at 'path' and prints one CSV row
+ *        **Note:** Run each corpus in a process of its own, the peak RSS is that of the process
+ *
+ * @param  path    - The corpus to measure
+ * @return success - 'FALSE' if the corpus could not be loaded or written
+ */
+static int blxmlRun(const char *path) {
+    double load = 1e30, write = 1e30, release = 1e30, lookup = 0, attrLookup = 0, start = 0;
+    unsigned long loadAllocs = 0, writeAllocs = 0, bytes = 0, written = 0, i = 0;
+    struct BenchTree tree = { 0, NULL, NULL, 0 };
+    const char *name = strrchr(path, '/');
+    long rss = -1;
+    int success = TRUE, run = 0;
+
+    name = (NULL != name) ? name + 1 : path;
+
+    for (; TRUE == success && run < BENCH_RUNS; ++run) {
+        struct XMLDocument doc = { 0 };
+        FILE *fp = fopen(path, "r"), *out = NULL;
+        unsigned long allocs = blxmlAllocs;
+
+        if (NULL != fp) {
+            fseek(fp, 0, SEEK_END);
+            bytes = (unsigned long) ftell(fp);
+            rewind(fp);
+
+            start = blxmlNow();
+            doc = XMLDocument_load(fp);
+            load = (blxmlNow() - start < load) ? blxmlNow() - start : load;
+
+            fclose(fp);
+        }
+
+        if (NULL == fp || FALSE == doc.success) {
+            fprintf(stderr, "Could not load '%s'\n", path);
+            success = FALSE;
+        }
+
+        /* Only the first run counts allocations and collects nodes, before anything else adds to the RSS */
+        if (TRUE == success && 0 == run) {
+            loadAllocs = blxmlAllocs - allocs;
+            rss = blxmlPeakRss();
+
+            XMLNode_walk(doc.root, blxmlCollect, NULL, &tree);
+            tree.attributed = malloc(sizeof(struct XMLNode*) * (tree.attributedSize + 1));
+            tree.attributedSize = 0;
+
+            if (NULL != tree.attributed)
+                XMLNode_walk(doc.root, blxmlCollect, NULL, &tree);
+            else
+                success = FALSE;
+        }
+
+        if (TRUE == success && 0 == run) {
+            /* The tag of the last child, which a scan reaches last. Wide nodes build their index
+             * on the first lookup, which is left out so only the lookups themselves are timed */
+            struct XMLNode *widest = (NULL != tree.widest) ? tree.widest : doc.root;
+            char *tag = widest->children.data[widest->children.size - 1]->tag;
+            unsigned long found = 0;
+
+            XMLNode_getImmediateElementByTagName(widest, tag);
+
+            start = blxmlNow();
+            for (i = 0; i < BENCH_LOOKUPS; ++i)
+                found += (NULL != XMLNode_getImmediateElementByTagName(widest, tag)) ? 1 : 0;
+            lookup = (blxmlNow() - start) * 1e6 / BENCH_LOOKUPS;
+
+            /* The last attribute of every node which has any */
+            start = blxmlNow();
+            for (i = 0; i < tree.attributedSize; ++i) {
+                struct XMLAttributeList *attributes = &tree.attributed[i]->attributes;
+
+                found += (NULL != XMLNode_getAttribute(tree.attributed[i], attributes->attribute[attributes->size - 1].key)) ? 1 : 0;
+            }
+            attrLookup = (0 != tree.attributedSize) ? (blxmlNow() - start) * 1e6 / (double) tree.attributedSize : 0;
+
+            success = (BENCH_LOOKUPS + tree.attributedSize == found) ? TRUE : FALSE;
+            written = (unsigned long) XMLNode_serializedLength(doc.root, 0);
+        }
+
+        if (TRUE == success) {
+            out = fopen(BENCH_NULL_DEVICE, "w");
+            allocs = blxmlAllocs;
+
+            start = blxmlNow();
+            success = (NULL != out && TRUE == XMLDocument_write(&doc, out, 0)) ? TRUE : FALSE;
+            write = (blxmlNow() - start < write) ? blxmlNow() - start : write;
+
+            writeAllocs = blxmlAllocs - allocs;
+
+            if (NULL != out)
+                fclose(out);
+        }
+
+        start = blxmlNow();
+        doc.free(&doc);
+        release = (blxmlNow() - start < release) ? blxmlNow() - start : release;
+    }
+
+    if (TRUE == success)
+        printf("%s,%lu,%lu,%.3f,%.2f,%.0f,%lu,%ld,%.3f,%.2f,%lu,%.1f,%.1f,%.3f\n", name, bytes, tree.nodes,
+               load, bytes / 1048576.0 / (load / 1000), tree.nodes / (load / 1000), loadAllocs, rss,
+               write, written / 1048576.0 / (write / 1000), writeAllocs, lookup, attrLookup, release);
+    else
+        fprintf(stderr, "Could not measure '%s'\n", path);
+
+    free(tree.attributed);
+
+    return success;
+} /* End of blxmlRun */
+
+/**
+ * @brief Prints how each compared column of every row in 'resultsPath' changed from 'baselinePath'
+ *        Rows missing from the baseline, or measured on a different corpus, are only reported
+ *
+ * @param  baselinePath  - The CSV the results are compared against
+ * @param  resultsPath   - The CSV of the latest run
+ * @param  threshold     - By how many percent an allocation count may grow before it counts as a regression
+ * @param  timeThreshold - The same for the times and the RSS, which are left out when negative
+ * @return success       - 'FALSE' if any column regressed or a file could not be read
+ */
+static int blxmlCompare(const char *baselinePath, const char *resultsPath, double threshold, double timeThreshold) {
+    static struct BenchTable baseline, results;
+    size_t i = 0, j = 0, k = 0, regressions = 0;
+    size_t compared = sizeof(blxmlCompared) / sizeof(blxmlCompared[0]);
+    size_t timesCompared = (0 <= timeThreshold) ? sizeof(blxmlComparedTimes) / sizeof(blxmlComparedTimes[0]) : 0;
+    int success = blxmlReadTable(baselinePath, &baseline);
+
+    success &= blxmlReadTable(resultsPath, &results);
+
+    if (TRUE == success)
+        printf("corpus,metric,baseline,current,change_percent,status\n");
+
+    for (; TRUE == success && i < results.size; ++i) {
+        size_t row = baseline.size;
+
+        for (j = 0; j < baseline.size; ++j)
+            if (0 == strcmp(results.names[i], baseline.names[j]))
+                row = j;
+
+        if (row == baseline.size)
+            printf("%s,,,,,new\n", results.names[i]);
+        else if (baseline.values[row][blxmlColumn(&baseline, "bytes")] != results.values[i][blxmlColumn(&results, "bytes")])
+            printf("%s,bytes,,,,different corpus\n", results.names[i]);
+        else {
+            for (k = 0; k < compared + timesCompared; ++k) {
+                const char *column = (k < compared) ? blxmlCompared[k] : blxmlComparedTimes[k - compared];
+                size_t b = blxmlColumn(&baseline, column), r = blxmlColumn(&results, column);
+
+                if (b < baseline.columnsSize && r < results.columnsSize) {
+                    double before = baseline.values[row][b], after = results.values[i][r];
+                    double change = (0 != before) ? (after - before) * 100 / before : 0;
+                    int regressed = (change > ((k < compared) ? threshold : timeThreshold)) ? TRUE : FALSE;
+
+                    printf("%s,%s,%g,%g,%.1f,%s\n", results.names[i], column, before, after, change, (TRUE == regressed) ? "regressed" : "ok");
+                    regressions += (TRUE == regressed) ? 1 : 0;
+                }
+            }
+        }
+    }
+
+    if (TRUE == success && 0 <= timeThreshold)
+        fprintf(stderr, "%lu regressions above %.1f%% in allocations or %.1f%% in times\n", (unsigned long) regressions, threshold, timeThreshold);
+    else if (TRUE == success)
+        fprintf(stderr, "%lu regressions above %.1f%% in allocations, times not compared\n", (unsigned long) regressions, threshold);
+
+    return (TRUE == success && 0 == regressions) ? TRUE : FALSE;
+} /* End of blxmlCompare */
+
+/**
+ * @brief A flat list of 'n' records, each with an attribute and a little text
+ */
+static void blxmlGenerateWide(FILE *fp, unsigned long n, unsigned long *seed) {
+    unsigned long i = 0;
+
+    fprintf(fp, "<records>\n");
+    for (; i < n; ++i) {
+        fprintf(fp, "  <record id=\"%lu\">", i);
+        blxmlPutWords(fp, 2, seed);
+        fprintf(fp, "</record>\n");
+    }
+    fprintf(fp, "</records>\n");
+} /* End of blxmlGenerateWide */
+
+/**
+ * @brief 'n' elements each nested in the one before
+ */
+static void blxmlGenerateDeep(FILE *fp, unsigned long n, unsigned long *seed) {
+    unsigned long i = 0;
+
+    for (; i < n; ++i)
+        fprintf(fp, "<level depth=\"%lu\">", i);
+
+    blxmlPutWords(fp, 4, seed);
+
+    for (i = 0; i < n; ++i)
+        fprintf(fp, "</level>");
+    fprintf(fp, "\n");
+} /* End of blxmlGenerateDeep */
+
+/**
+ * @brief 'n' empty elements with sixteen attributes each
+ */
+static void blxmlGenerateAttrs(FILE *fp, unsigned long n, unsigned long *seed) {
+    unsigned long i = 0, j = 0;
+
+    fprintf(fp, "<rows>\n");
+    for (; i < n; ++i) {
+        fprintf(fp, "  <row id=\"%lu\"", i);
+        for (j = 1; j < 16; ++j)
+            fprintf(fp, " column%lu=\"%s\"", j, blxmlWord(seed));
+        fprintf(fp, " />\n");
+    }
+    fprintf(fp, "</rows>\n");
+} /* End of blxmlGenerateAttrs */
+
+/**
+ * @brief 'n' paragraphs of about a kilobyte of text
+ */
+static void blxmlGenerateText(FILE *fp, unsigned long n, unsigned long *seed) {
+    unsigned long i = 0;
+
+    fprintf(fp, "<article>\n");
+    for (; i < n; ++i) {
+        fprintf(fp, "  <p>");
+        blxmlPutWords(fp, 150, seed);
+        fprintf(fp, "</p>\n");
+    }
+    fprintf(fp, "</article>\n");
+} /* End of blxmlGenerateText */
+
+/**
+ * @brief 'n' short elements each after a comment three times its size
+ */
+static void blxmlGenerateComments(FILE *fp, unsigned long n, unsigned long *seed) {
+    unsigned long i = 0;
+
+    fprintf(fp, "<config>\n");
+    for (; i < n; ++i) {
+        fprintf(fp, "  <!-- ");
+        blxmlPutWords(fp, 24, seed);
+        fprintf(fp, " -->\n  <option key=\"k%lu\">%s</option>\n", i, blxmlWord(seed));
+    }
+    fprintf(fp, "</config>\n");
+} /* End of blxmlGenerateComments */
+
+/**
+ * @brief 'n' structs shaped like the one in the README, with eight fields and a description
+ */
+static void blxmlGenerateStruct(FILE *fp, unsigned long n, unsigned long *seed) {
+    static const char *const types[] = { "string", "int", "float", "bool" };
+    unsigned long i = 0, j = 0;
+
+    fprintf(fp, "<schema>\n");
+    for (; i < n; ++i) {
+        fprintf(fp, "<struct name=\"%s%lu\">\n", blxmlWord(seed), i);
+        for (j = 0; j < 8; ++j)
+            fprintf(fp, "    <field name=\"%s\" type=\"%s\" />\n", blxmlWord(seed), types[(*seed >> 16) & 3]);
+        fprintf(fp, "    <description>");
+        blxmlPutWords(fp, 8, seed);
+        fprintf(fp, "</description>\n</struct>\n");
+    }
+    fprintf(fp, "</schema>\n");
+} /* End of blxmlGenerateStruct */
+
+/**
+ * @brief Writes 'words' space separated words to 'fp'
+ */
+static void blxmlPutWords(FILE *fp, unsigned long words, unsigned long *seed) {
+    unsigned long i = 0;
+
+    for (; i < words; ++i)
+        fprintf(fp, (0 != i) ? " %s" : "%s", blxmlWord(seed));
+} /* End of blxmlPutWords */
+
+/**
+ * @brief Picks the next word from a fixed list with a linear congruential generator
+ *        Only the low 32 bits of 'seed' are used so every platform makes the same corpora
+ */
+static const char* blxmlWord(unsigned long *seed) {
+    static const char *const words[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do",
+        "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua", "enim"
+    };
+
+    *seed = (*seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+
+    return words[(*seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+} /* End of blxmlWord */
+
+/**
+ * @brief Obtains a monotonic time in milliseconds, or processor time without POSIX
+ */
+static double blxmlNow() {
+#ifdef LXML_HAVE_POSIX
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) now.tv_sec * 1000 + (double) now.tv_nsec / 1e6;
+#else
+    return (double) clock() * 1000 / CLOCKS_PER_SEC;
+#endif
+} /* End of blxmlNow */
+
+/**
+ * @brief Obtains the peak resident set size of the process in kilobytes, or -1 without POSIX
+ */
+static long blxmlPeakRss() {
+    long rss = -1;
+#ifdef LXML_HAVE_POSIX
+    struct rusage usage;
+
+    if (0 == getrusage(RUSAGE_SELF, &usage))
+        rss = (long) usage.ru_maxrss;
+#ifdef __APPLE__
+    rss /= 1024;
+#endif
+#endif
+
+    return rss;
+} /* End of blxmlPeakRss */
+
+/**
+ * @brief Counts the elements, finds the widest and, once 'tree->attributed' is allocated,
+ *        records those with attributes, see 'XMLNode_walk' for the parameters
+ */
+static enum XMLWalkAction blxmlCollect(void *ctx, struct XMLNode *node, size_t depth) {
+    struct BenchTree *tree = ctx;
+
+    (void) depth;
+
+    if (NULL == tree->attributed) {
+        tree->nodes += (NULL != node->tag) ? 1 : 0;
+
+        if (NULL == tree->widest || node->children.size > tree->widest->children.size)
+            tree->widest = node;
+    }
+
+    if (0 != node->attributes.size) {
+        if (NULL != tree->attributed)
+            tree->attributed[tree->attributedSize] = node;
+        ++tree->attributedSize;
+    }
+
+    return LXML_WALK_CONTINUE;
+} /* End of blxmlCollect */
+
+/**
+ * @brief Reads a CSV written by 'bench header' and 'bench run' into 'table'
+ *
+ * @param  path    - The CSV to read
+ * @param  table   - Filled with the column names and one row per corpus
+ * @return success - 'FALSE' if the file could not be read or has too many rows or columns
+ */
+static int blxmlReadTable(const char *path, struct BenchTable *table) {
+    FILE *fp = fopen(path, "r");
+    char line[BENCH_LINE];
+    int success = (NULL != fp) ? TRUE : FALSE;
+
+    table->columnsSize = table->size = 0;
+
+    while (TRUE == success && NULL != fgets(line, sizeof(line), fp)) {
+        char *field = strtok(line, ",\r\n");
+        size_t column = 0;
+
+        if (0 == table->columnsSize) {
+            for (; NULL != field && column < BENCH_MAX_COLUMNS; ++column, field = strtok(NULL, ",\r\n"))
+                sprintf(table->columns[column], "%.31s", field);
+            table->columnsSize = column;
+        } else if (NULL != field && table->size < BENCH_MAX_ROWS) {
+            sprintf(table->names[table->size], "%.63s", field);
+
+            for (column = 1; column < table->columnsSize; ++column) {
+                field = strtok(NULL, ",\r\n");
+                table->values[table->size][column] = (NULL != field) ? atof(field) : 0;
+            }
+
+            ++table->size;
+        } else if (NULL != field)
+            success = FALSE;
+    }
+
+    if (FALSE == success || 0 == table->columnsSize)
+        fprintf(stderr, "Could not read '%s'\n", path);
+
+    if (NULL != fp)
+        fclose(fp);
+
+    return (TRUE == success && 0 != table->columnsSize) ? TRUE : FALSE;
+} /* End of blxmlReadTable */
+
+/**
+ * @brief Finds the column called 'name' in 'table'
+ *
+ * @return column - Its index or 'table->columnsSize' when there is none
+ */
+static size_t blxmlColumn(const struct BenchTable *table, const char *name) {
+    size_t column = 0;
+
+    while (column < table->columnsSize && 0 != strcmp(name, table->columns[column]))
+        ++column;
+
+    return column;
+} /* End of blxmlColumn */
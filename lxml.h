@@ -6,6 +6,38 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* POSIX is only assumed when the compilation environment advertises it, 'posix_madvise' and
+ * 'fseeko' need POSIX.1-2001, so the strict C89 build, even with '-pthread', falls back to the stdio based loaders */
+#if !defined LXML_NO_POSIX && ((defined _POSIX_C_SOURCE && _POSIX_C_SOURCE >= 200112L) || (defined __APPLE__ && defined __MACH__))
+    #define LXML_HAVE_POSIX
+#endif
+
+#ifdef LXML_HAVE_POSIX
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+#endif
+
+/* Threads are used where POSIX provides them, define 'LXML_NO_THREADS' to build without 'pthread' */
+#if defined LXML_HAVE_POSIX && !defined LXML_NO_THREADS && defined _POSIX_THREADS && _POSIX_THREADS > 0
+    #define LXML_HAVE_THREADS
+    #include <pthread.h>
+#endif
+
+/* Tags are scanned with SSE2, and AVX2 where the CPU has it, unless 'LXML_NO_SIMD' is defined
+ * The strict ANSI builds keep to the portable scalar scanner */
+#if !defined LXML_NO_SIMD && !defined __STRICT_ANSI__ && defined __GNUC__ && defined __SSE2__
+    #define LXML_HAVE_SSE2
+    #include <emmintrin.h>
+
+    #if defined __clang__ || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+        #define LXML_HAVE_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
 /*******************Include End********************/
 
 /*******************Define Start*******************/
@@ -17,7 +49,85 @@
     #define FALSE 0
 #endif
 
-#define LEX_BUF_SIZE 256
+#define LXML_READ_CHUNK_SIZE 65536
+
+/* 'XMLReader_open' reads this much of the stream at a time, the window only grows for longer tags */
+#define LXML_READER_BUFFER_SIZE 65536
+
+/* The longest entity or character reference decoded, '&#x10FFFF;' with room for leading zeros
+ * Longer ones are kept as they are written */
+#define LXML_MAX_REFERENCE_SIZE 32
+
+/* 'XMLNode_walk' keeps this many levels on the stack before moving to the heap */
+#define LXML_WALK_STACK_SIZE 64
+
+/* Writes to a 'FILE*' are gathered into 'LXML_WRITE_BUFFER_SIZE' bytes before each 'fwrite' */
+#define LXML_WRITE_BUFFER_SIZE 65536
+
+/* Returned by 'XMLNode_serializedLength' when the tree could not be walked to the end */
+#define LXML_WRITE_ERROR ((size_t) -1)
+
+/* 'XMLDocument_writeParallel' hands out at most 'LXML_PARALLEL_BLOCK_NODES' siblings at a time
+ * and buffers at most 'LXML_PARALLEL_WINDOW' blocks per thread ahead of the output */
+#define LXML_PARALLEL_BLOCK_NODES 256
+#define LXML_PARALLEL_WINDOW 2
+
+/* Parallel loads cut the children of the root element into this many runs per thread */
+#define LXML_PARALLEL_LOAD_CHUNKS 4
+
+/* 'XMLDocument_loadMany' reads files up to this size into a buffer each thread reuses, larger ones are mapped */
+#define LXML_SCRATCH_FILE_SIZE (1024 * 1024)
+
+/* Binary snapshots start with 'LXML_SNAPSHOT_MAGIC' and the format 'LXML_SNAPSHOT_VERSION', see 'struct XMLSnapshot'
+ * Every offset is 32 bits so a snapshot holds at most 'LXML_SNAPSHOT_MAX_SIZE' bytes */
+#define LXML_SNAPSHOT_MAGIC "LXMLSNAP"
+#define LXML_SNAPSHOT_VERSION 1
+#define LXML_SNAPSHOT_HEADER_SIZE 32
+#define LXML_SNAPSHOT_NODE_SIZE 20
+#define LXML_SNAPSHOT_MAX_SIZE ((size_t) 0xFFFFFFFCUL)
+
+/* Flags for the 'WithFlags' loaders */
+#define LXML_LOAD_ARENA 0x1
+#define LXML_LOAD_IN_SITU (0x2 | LXML_LOAD_ARENA)
+#define LXML_LOAD_INTERN (0x4 | LXML_LOAD_ARENA)
+#define LXML_LOAD_INDEX 0x8
+#define LXML_LOAD_PARALLEL 0x10
+#define LXML_LOAD_LAZY (0x20 | LXML_LOAD_ARENA)
+
+/* Predicates allowed on a single step of an 'XMLQuery' */
+#define LXML_QUERY_MAX_PREDICATES 8
+
+/* Returned by 'XMLQuery_eval' when the evaluation could not be completed */
+#define LXML_QUERY_ERROR ((size_t) -1)
+
+/* Lists with at least 'LXML_INDEX_MIN_SIZE' entries are hashed on their first lookup */
+#define LXML_INDEX_MIN_SIZE 16
+#define LXML_INDEX_END ((size_t) -1)
+
+/* Name tables start with 'LXML_NAME_TABLE_SIZE' slots and double once half full */
+#define LXML_NAME_TABLE_SIZE 64
+
+/* Arena blocks start at 'LXML_ARENA_BLOCK_SIZE' and double up to 'LXML_ARENA_MAX_BLOCK_SIZE' */
+#define LXML_ARENA_BLOCK_SIZE 65536
+#define LXML_ARENA_MAX_BLOCK_SIZE (4 * 1024 * 1024)
+#define LXML_ARENA_ALIGN 8
+#define LXML_ARENA_ROUND(size) (((size) + (LXML_ARENA_ALIGN - 1)) & ~((size_t) LXML_ARENA_ALIGN - 1))
+
+/* 64-bit file offsets where the platform provides them */
+#ifdef LXML_HAVE_POSIX
+    #define lxmlFseek fseeko
+    #define lxmlFtell ftello
+    typedef off_t lxmlFileOffset;
+#else
+    #define lxmlFseek fseek
+    #define lxmlFtell ftell
+    typedef long lxmlFileOffset;
+#endif
+
+/* Define 'LXML_COMPACT_NODES' before including this header to leave the function
+ * pointers out of every node, attribute and list, which makes a node about 40% smaller.
+ * Call the free functions instead, e.g. 'XMLNode_add(node, child)' rather than
+ * 'node->add(node, child)', they are available in both layouts */
 
 #define IGNORE_WHITESPACE_MAP " \t\n\r\v\f"
 #define IGNORE_WHITESPACE_MAP_SIZE 6
@@ -32,6 +142,63 @@ enum TagType {
     TAG_INLINE
 };
 
+enum XMLParserState {
+    LXML_PARSER_CONTENT,
+    LXML_PARSER_COMMENT,
+    LXML_PARSER_CDATA
+};
+
+/* Byte classes of 'lxmlCharClass', the columns of 'lxmlAttrTransitions' */
+enum XMLCharClass {
+    LXML_CLASS_NAME,
+    LXML_CLASS_SPACE,
+    LXML_CLASS_EQUALS,
+    LXML_CLASS_DQUOTE,
+    LXML_CLASS_SQUOTE,
+    LXML_CLASS_COUNT
+};
+
+/* States of the attribute lexer, those up to the value are the rows of 'lxmlAttrTransitions'
+ * A value is scanned for its closing quote with 'memchr' rather than through the table */
+enum XMLAttrState {
+    LXML_ATTR_SPACE,
+    LXML_ATTR_KEY,
+    LXML_ATTR_AFTER_KEY,
+    LXML_ATTR_EQUALS,
+    LXML_ATTR_DQUOTE_VALUE,
+    LXML_ATTR_SQUOTE_VALUE,
+    LXML_ATTR_DONE,
+    LXML_ATTR_ERROR,
+    LXML_ATTR_ROW_COUNT = LXML_ATTR_DQUOTE_VALUE
+};
+
+/* Returned by the callbacks of 'XMLNode_walk' */
+enum XMLWalkAction {
+    LXML_WALK_CONTINUE,
+    LXML_WALK_SKIP,
+    LXML_WALK_STOP
+};
+
+enum XMLTokenType {
+    LXML_TOKEN_NONE,
+    LXML_TOKEN_DECLARATION,
+    LXML_TOKEN_START,
+    LXML_TOKEN_END,
+    LXML_TOKEN_TEXT,
+    LXML_TOKEN_COMMENT
+};
+
+/* Returned by 'XMLReader_next' */
+enum XMLReaderEvent {
+    LXML_READER_DONE,
+    LXML_READER_ERROR,
+    LXML_READER_DECLARATION,
+    LXML_READER_START,
+    LXML_READER_END,
+    LXML_READER_TEXT,
+    LXML_READER_COMMENT
+};
+
 /*********************Enum End*********************/
 
 /************Struct-Declaration Start**************/
@@ -39,27 +206,45 @@ enum TagType {
 struct XMLAttribute {
     char *key, *value;
 
+#ifndef LXML_COMPACT_NODES
     void (*free)(struct XMLAttribute*);
+#endif
+
+    /* Lengths of 'key' and 'value', 0 when they are only NUL terminated */
+    size_t keyLen, valueLen;
 };
 
 struct XMLAttributeList {
     size_t size, heapSize;
-    struct XMLAttribute **attribute;
 
+    /* Stored by value, so pointers into it are invalidated by further adds */
+    struct XMLAttribute *attribute;
+    struct XMLArena *arena;
+    struct XMLIndex *index;
+
+#ifndef LXML_COMPACT_NODES
     int (*add)(struct XMLAttributeList*, struct XMLAttribute);
     void (*free)(struct XMLAttributeList*);
 
     char* (*getAttributeValue)(struct XMLAttributeList*, char*);
     struct XMLAttribute* (*getAttribute)(struct XMLAttributeList*, char*);
+#endif
 };
 
 struct XMLNodeList {
     size_t size, heapSize;
     struct XMLNode **data;
+    struct XMLArena *arena;
+    struct XMLIndex *index;
+
+    /* The generation of the heap tree the list belongs to, 'NULL' until it has a child */
+    struct XMLGeneration *generation;
 
+#ifndef LXML_COMPACT_NODES
     int (*add)(struct XMLNodeList*, struct XMLNode*, struct XMLNode*);
     struct XMLNode* (*createAndAppend)(struct XMLNodeList*);
     void (*free)(struct XMLNodeList*);
+#endif
 };
 
 struct XMLNode {
@@ -69,6 +254,7 @@ struct XMLNode {
     struct XMLAttributeList attributes;
     struct XMLNodeList children;
 
+#ifndef LXML_COMPACT_NODES
     int (*add)(struct XMLNode*, struct XMLNode*);
     struct XMLNode* (*createAndAppend)(struct XMLNode*);
     void (*free)(struct XMLNode*);
@@ -76,14 +262,429 @@ struct XMLNode {
     char* (*getAttributeValue)(struct XMLNode*, char*);
     struct XMLAttribute* (*getAttribute)(struct XMLNode*, char*);
     struct XMLNode* (*getImmediateElementByTagName)(struct XMLNode*, char*);
+#endif
+
+    /* Lengths of 'tag' and 'inner_text', 0 when they are only NUL terminated
+     * **Note:** Documents loaded with 'LXML_LOAD_IN_SITU' are not NUL terminated */
+    size_t tagLen, innerTextLen;
+
+    /* One past the element of a 'LXML_LOAD_LAZY' document whose children and text
+     * are not built yet, see 'XMLNode_expand', otherwise 0 */
+    size_t lazy;
 };
 
 struct XMLDocument {
     struct XMLNode *root;
+
+    /* 'NULL' when the declaration has no such attribute and "" when its value is empty */
     char *version, *encoding;
     int success;
 
     void (*free)(struct XMLDocument*);
+
+    /* Owns the whole tree when loaded with 'LXML_LOAD_ARENA', otherwise 'NULL' */
+    struct XMLArena *arena;
+
+    /* Built by 'XMLDocument_getElementsByTagName', otherwise 'NULL' */
+    struct XMLTagIndex *tagIndex;
+};
+
+/* Documents loaded with 'LXML_LOAD_ARENA' bump allocate every node, list and
+ * string from a chain of blocks which are released together by 'doc.free' */
+struct XMLArenaBlock {
+    struct XMLArenaBlock *next;
+    size_t size, used;
+};
+
+struct XMLArena {
+    struct XMLArenaBlock *head;
+    size_t blockSize;
+
+    /* The most recent allocation from 'head', which can grow in place */
+    char *last;
+
+    /* The input retained by a 'LXML_LOAD_IN_SITU' or 'LXML_LOAD_LAZY' document */
+    void *input;
+    size_t inputLen;
+    int inputMapped;
+
+    /* Tags and attribute keys of a 'LXML_LOAD_INTERN' document */
+    struct XMLNameTable *names;
+    int ownsNames;
+
+    /* Bumped whenever a node is added to the tree */
+    size_t generation;
+
+    /* The elements of a 'LXML_LOAD_LAZY' document, otherwise 'NULL' */
+    struct XMLLazyIndex *lazy;
+
+    /* Arenas of subtrees parsed on other threads, released along with this one
+     * Nodes added to those subtrees bump the 'generation' of their 'owner' */
+    struct XMLArena *owner, *merged, *nextMerged;
+};
+
+/* Bumped whenever a node is added to a heap tree, every list of the tree shares it
+ * A tree added to another one forwards to the generation of that tree, as merged arenas do to their 'owner' */
+struct XMLGeneration {
+    size_t value, refs;
+    struct XMLGeneration *owner;
+};
+
+/* Documents loaded with 'LXML_LOAD_INTERN' share one copy of every distinct tag
+ * and attribute key, so interned names can be compared by pointer.
+ * A table may be shared by several documents but is not thread safe */
+struct XMLNameTable {
+    /* Open addressed, 'capacity' is a power of two and 'NULL' marks a free slot */
+    const char **slots;
+    size_t size, capacity;
+
+    struct XMLArena *strings;
+
+#ifdef LXML_HAVE_THREADS
+    /* A table private to one thread of a parallel load in front of the document's table,
+     * names missing here are interned into 'shared' under 'lock' and only the pointer is kept */
+    struct XMLNameTable *shared;
+    pthread_mutex_t *lock;
+#endif
+};
+
+/* Maps the tags of a node's children or the keys of its attributes to their positions
+ * Entries appended since the index was built are added on the next lookup */
+struct XMLIndexSlot {
+    const char *name;
+    size_t nameLen, first, last;
+};
+
+struct XMLIndex {
+    /* Open addressed like 'XMLNameTable', a 'NULL' name marks a free slot */
+    struct XMLIndexSlot *slots;
+    size_t size, capacity;
+
+    /* 'next[i]' is the position of the next entry named like entry 'i' or 'LXML_INDEX_END' */
+    size_t *next;
+    size_t count, heapSize;
+};
+
+/* Every element of a document grouped by tag, see 'XMLDocument_getElementsByTagName'
+ * Once built the chains of 'names' are dropped and the 'first' and 'last' of each
+ * slot bound its group in 'nodes' instead */
+struct XMLTagIndex {
+    struct XMLIndex names;
+    struct XMLNode **nodes;
+
+    /* The generation of the tree the index was built from */
+    size_t generation;
+};
+
+/* Callbacks invoked by 'XMLDocument_parseEvents' and 'XMLParser_createWithHandler'
+ * All strings are slices of the input, or decoded copies of text and attribute values
+ * with references, which are only valid during the callback,
+ * any callback may be 'NULL' and returning 'FALSE' stops the parse */
+struct XMLEventHandler {
+    int (*declaration)(void *ctx, const char *version, size_t versionLen, const char *encoding, size_t encodingLen);
+    int (*startElement)(void *ctx, const char *tag, size_t tagLen);
+    int (*attribute)(void *ctx, const char *key, size_t keyLen, const char *value, size_t valueLen);
+    int (*text)(void *ctx, const char *text, size_t len);
+    int (*endElement)(void *ctx, const char *tag, size_t tagLen);
+    int (*comment)(void *ctx, const char *comment, size_t len);
+};
+
+struct XMLToken {
+    enum XMLTokenType type;
+
+    /* Tag name, text or comment */
+    const char *data;
+    size_t dataLen;
+
+    /* Attributes of a start tag or declaration, see 'lxmlNextAttribute' */
+    const char *attrs;
+    size_t attrsLen;
+
+    int selfClosing;
+
+    /* Text from a CDATA section, in which references are not decoded */
+    int cdata;
+};
+
+struct XMLTokenizer {
+    /* NUL separated names of the open elements, used to match end tags */
+    char *names;
+    size_t namesSize, namesHeapSize, depth;
+
+    /* Progress through a partial lexeme so it isn't rescanned on every chunk */
+    size_t scanned;
+    char quote;
+
+    enum XMLParserState state;
+    int error;
+};
+
+struct XMLParser {
+    struct XMLTokenizer tokenizer;
+
+    const struct XMLEventHandler *handler;
+    void *ctx;
+
+    /* Partial lexeme carried over from the previous chunk */
+    char *pending;
+    size_t pendingSize, pendingHeapSize;
+
+    /* The text or attribute value being reported with its references decoded,
+     * for handlers other than that of the DOM which decodes into the document */
+    char *decoded;
+    size_t decodedHeapSize;
+
+    /* The document built by the default handler */
+    struct XMLDocument doc;
+    struct XMLNode *curr_node, *text_node;
+
+    /* Strings are views into the input rather than copies */
+    int inSitu;
+
+    /* The text or attribute value being added is not to be decoded, see 'lxmlDecodeReferences' */
+    int raw;
+
+    /* Wide nodes are indexed once the document is complete */
+    int indexNodes;
+
+    /* A node whose descendants were already indexed by the threads that parsed them */
+    struct XMLNode *indexed;
+
+    /* Takes the name stack of the tokenizer back once the document is complete */
+    struct XMLLoadScratch *scratch;
+};
+
+/* Pulls a document one token at a time, see 'XMLReader_open' and 'XMLReader_openBuffer'
+ * Only a window onto the input and the names of the open elements are held */
+struct XMLReader {
+    struct XMLTokenizer tokenizer;
+
+    /* The token last returned, its strings are slices of 'buf' */
+    struct XMLToken token;
+    enum XMLReaderEvent event;
+    size_t depth;
+
+    /* The input, or a window onto 'fp' which 'buf' points to */
+    FILE *fp;
+    const char *buf;
+    char *window;
+    size_t pos, len, capacity;
+    int eof;
+
+    /* Progress of 'XMLReader_nextAttribute' through the attributes of 'token' */
+    size_t attr;
+
+    /* Text and attribute values with their references decoded, emptied by 'XMLReader_next' */
+    struct XMLArena *decoded;
+
+    /* The end of a self-closing element is returned by the next call */
+    int pendingEnd;
+};
+
+/* Where an element of a 'LXML_LOAD_LAZY' document lies in the input: its content starts at
+ * 'content' and its end tag ends at 'end'. The 'descendants' elements within it follow it */
+struct XMLLazyElement {
+    size_t content, end, descendants;
+};
+
+/* Every element of a 'LXML_LOAD_LAZY' document in document order, the first stands for 'doc.root'
+ * and covers the whole input. Found by one pass over the input which builds nothing */
+struct XMLLazyIndex {
+    const char *buf;
+
+    struct XMLLazyElement *elements;
+    size_t size, heapSize;
+
+    /* How expanded nodes are built, as with 'struct XMLParser' */
+    int inSitu, indexNodes;
+};
+
+/* Memory a thread of 'XMLDocument_loadMany' reuses from one file to the next */
+struct XMLLoadScratch {
+    char *buf;
+    size_t bufSize;
+
+    char *names;
+    size_t namesHeapSize;
+};
+
+/* A document saved by 'XMLDocument_saveBinary', read in place without being rebuilt
+ * Integers are 32 bits little endian and every reference is an offset from the start:
+ *   header - the magic, format version, size, root node, version, encoding and number of nodes
+ *   node   - tag, inner text, parent, number of attributes and of children,
+ *            then the key and value of every attribute and the offset of every child
+ *   string - its length, the bytes and a NUL terminator
+ * Everything is aligned to 4 bytes and a node is written before its strings and children,
+ * so children always follow their parent. Nodes are named by their offset, 0 being none */
+struct XMLSnapshot {
+    const unsigned char *data;
+    size_t size;
+
+    /* The node holding the top level elements, like 'XMLDocument.root' */
+    size_t root, nodes;
+    const char *version, *encoding;
+
+    /* 'data' is released by 'XMLSnapshot_free' with 'free' when 'owned' or 'munmap' when 'mapped' */
+    int owned, mapped;
+};
+
+/* A path compiled by 'XMLQuery_compile', all of it is allocated from 'arena' */
+struct XMLQueryPredicate {
+    /* 1-based position among the candidates reaching this predicate, 0 for an attribute test */
+    size_t position;
+
+    /* Attribute that must be present, with 'value' when it is not 'NULL' */
+    char *key, *value;
+    size_t valueLen;
+};
+
+struct XMLQueryStep {
+    /* 'NULL' matches any name */
+    char *name;
+    size_t nameLen;
+
+    /* Searches every descendant of the context rather than its children */
+    int descendant;
+
+    /* Selects attributes of the context instead of elements, only ever the last step */
+    int attribute;
+
+    struct XMLQueryPredicate *predicates;
+    size_t predicateCount;
+
+    /* Has a position predicate, so candidates are counted per parent */
+    int positional;
+};
+
+struct XMLQuery {
+    struct XMLQueryStep *steps;
+    size_t stepCount;
+
+    /* Evaluated from the topmost ancestor of the context */
+    int absolute;
+
+    struct XMLArena *arena;
+};
+
+/* State threaded through 'lxmlQueryDescendant', 'counts' holds a row of position counts for
+ * each depth of a positional step since positions are counted per parent. The first
+ * 'LXML_WALK_STACK_SIZE' rows are 'stackCounts', deeper ones move to the heap as 'XMLNode_walk' does */
+struct XMLQueryWalk {
+    const struct XMLQuery *query;
+    size_t k;
+    struct XMLQueryEval *eval;
+
+    size_t stackCounts[LXML_WALK_STACK_SIZE * LXML_QUERY_MAX_PREDICATES], *counts, rows;
+};
+
+/* A node being visited by 'XMLNode_walk' and the next of its children to visit */
+struct XMLWalkFrame {
+    struct XMLNode *node;
+    size_t next;
+};
+
+/* State threaded through 'lxmlTagIndexCollect' */
+struct XMLTagIndexCollect {
+    struct XMLIndex *names;
+    struct XMLNode **order;
+    size_t heapSize;
+};
+
+/* Output buffer of the serializer, flushed to 'fp' when set, otherwise
+ * 'buf' holds the whole output. Without 'buf' bytes are only counted */
+struct XMLWriter {
+    char *buf;
+    size_t size, capacity;
+    FILE *fp;
+    int error;
+
+    /* Indentation per level and the number of open elements */
+    int indent, times;
+};
+
+/* An open node of a tree being saved to or rebuilt from an 'XMLSnapshot'
+ * 'node' is the offset of its record and 'next' the child to visit next */
+struct XMLSnapshotFrame {
+    size_t node, next;
+    int started;
+};
+
+/* Builds a snapshot in memory for 'XMLDocument_saveBinary'
+ * Tags and attribute keys are stored once however often they occur */
+struct XMLSnapshotWriter {
+    unsigned char *buf;
+    size_t size, capacity;
+
+    /* Open addressed offsets of the names written so far, 0 marks a free slot */
+    size_t *names;
+    size_t namesSize, namesCapacity;
+
+    /* The record of the open node at every depth */
+    struct XMLSnapshotFrame *frames;
+    size_t framesHeapSize, nodes;
+    int error;
+};
+
+#ifdef LXML_HAVE_THREADS
+/* Shared by the workers of 'XMLDocument_writeParallel', block 'b' is serialized
+ * into 'slots[b % window]' and written out in order once 'ready' */
+struct XMLParallelWriter {
+    struct XMLNode *parent;
+    size_t blockNodes, blocks, window;
+    int indent, times;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next, written;
+    struct XMLWriter *slots;
+    int *ready, error;
+};
+
+/* A run of the root element's children, parsed into the children of the placeholder
+ * 'node' which is allocated from 'arena' for arena documents */
+struct XMLParallelChunk {
+    size_t start, end;
+    struct XMLArena *arena;
+    struct XMLNode *node;
+    int success;
+};
+
+/* Shared by the threads of a parallel load, 'arena' is that of the document */
+struct XMLParallelLoader {
+    const char *buf;
+    struct XMLNode *root;
+    struct XMLArena *arena;
+    int inSitu, indexNodes;
+
+    /* Claims the next chunk and guards the name table of 'arena' */
+    pthread_mutex_t lock;
+    struct XMLParallelChunk *chunks;
+    size_t count, next;
+};
+
+/* The files of 'XMLDocument_loadMany' yet to be loaded by one thread, which takes them
+ * from the front while idle threads steal half of them from the back */
+struct XMLLoadQueue {
+    struct XMLBatchLoad *batch;
+    size_t begin, end;
+    pthread_mutex_t lock;
+};
+
+struct XMLBatchLoad {
+    const char * const *paths;
+    struct XMLDocument *docs;
+    int flags, threads;
+    struct XMLLoadQueue *queues;
+};
+#endif
+
+/* State threaded through 'XMLQuery_eval' */
+struct XMLQueryEval {
+    int (*callback)(void *ctx, struct XMLNode *node, struct XMLAttribute *attr);
+    void *ctx;
+
+    size_t matches;
+    int stopped, failed;
 };
 
 /*************Struct-Declaration End***************/
@@ -94,7 +695,8 @@ struct XMLDocument {
 
 struct XMLAttribute* XMLAttribute_init(char *key, char *value);
 
-static void XMLAttribute_free(struct XMLAttribute *attr);
+void XMLAttribute_free(struct XMLAttribute *attr);
+void XMLAttribute_freeArena(struct XMLAttribute *attr);
 
 /* XML Attribute Functions Prototype End */
 
@@ -102,11 +704,15 @@ static void XMLAttribute_free(struct XMLAttribute *attr);
 
 struct XMLAttributeList  XMLAttributeList_init();
 
-static int XMLAttributeList_add(struct XMLAttributeList *self, struct XMLAttribute attr);
-static void XMLAttributeList_free(struct XMLAttributeList *self);
+int XMLAttributeList_add(struct XMLAttributeList *self, struct XMLAttribute attr);
+int XMLAttributeList_take(struct XMLAttributeList *self, struct XMLAttribute attr);
+void XMLAttributeList_free(struct XMLAttributeList *self);
+static struct XMLAttribute* XMLAttributeList_reserve(struct XMLAttributeList *self);
+static int XMLAttributeList_append(struct XMLAttributeList *self, const char *key, size_t keyLen, const char *value, size_t valueLen, int copy);
 
-static struct XMLAttribute* XMLAttributeList_getAttribute(struct XMLAttributeList *self, char *key);
-static char* XMLAttributeList_getAttributeValue(struct XMLAttributeList *self, char *key);
+struct XMLAttribute* XMLAttributeList_getAttribute(struct XMLAttributeList *self, char *key);
+char* XMLAttributeList_getAttributeValue(struct XMLAttributeList *self, char *key);
+struct XMLAttribute* XMLAttributeList_getAttributeByName(struct XMLAttributeList *self, const char *name);
 
 /* XML Attribute List Functions Prototype End */
 
@@ -114,13 +720,26 @@ static char* XMLAttributeList_getAttributeValue(struct XMLAttributeList *self, c
 
 struct XMLNode* XMLNode_init();
 
-static int XMLNode_add(struct XMLNode *self, struct XMLNode *node);
-static struct XMLNode* XMLNode_createAndAppend(struct XMLNode *self);
-static void XMLNode_free(struct XMLNode *self);
-static struct XMLAttribute* XMLNode_getAttribute(struct XMLNode *node, char *key);
-static char* XMLNode_getAttributeValue(struct XMLNode *node, char *key);
-static struct XMLNode* XMLNode_getImmediateElementByTagName(struct XMLNode *node, char *tagName);
+int XMLNode_add(struct XMLNode *self, struct XMLNode *node);
+struct XMLNode* XMLNode_createAndAppend(struct XMLNode *self);
+void XMLNode_free(struct XMLNode *self);
+struct XMLAttribute* XMLNode_getAttribute(struct XMLNode *node, char *key);
+char* XMLNode_getAttributeValue(struct XMLNode *node, char *key);
+struct XMLNode* XMLNode_getImmediateElementByTagName(struct XMLNode *node, char *tagName);
+struct XMLAttribute* XMLNode_getAttributeByName(struct XMLNode *node, const char *name);
+struct XMLNode* XMLNode_getImmediateElementByName(struct XMLNode *node, const char *name);
+struct XMLNode* XMLNode_getNextImmediateElementByTagName(struct XMLNode *node, char *tagName, size_t *i);
+int XMLNode_buildIndex(struct XMLNode *node);
+void XMLNode_clearIndex(struct XMLNode *node);
+size_t XMLNode_serializedLength(struct XMLNode *node, int indent);
+int XMLNode_walk(struct XMLNode *node, enum XMLWalkAction (*enter)(void *ctx, struct XMLNode *node, size_t depth), enum XMLWalkAction (*leave)(void *ctx, struct XMLNode *node, size_t depth), void *ctx);
+int XMLNode_expand(struct XMLNode *node);
+const char* XMLNode_getInnerText(struct XMLNode *node, size_t *len);
+size_t XMLNode_childCount(struct XMLNode *node);
+struct XMLNode* XMLNode_getChild(struct XMLNode *node, size_t i);
 static struct XMLNode XMLNodeInitStack();
+static enum XMLWalkAction lxmlNodeFreeEnter(void *ctx, struct XMLNode *node, size_t depth);
+static enum XMLWalkAction lxmlNodeFreeLeave(void *ctx, struct XMLNode *node, size_t depth);
 
 /* XML Node Functions Prototype End */
 
@@ -128,31 +747,298 @@ static struct XMLNode XMLNodeInitStack();
 
 struct XMLNodeList XMLNodeList_init();
 
-static int XMLNodeList_add(struct XMLNodeList *self, struct XMLNode *parent, struct XMLNode *node);
-static struct XMLNode* XMLNodeList_createAndAppend(struct XMLNodeList *self);
-static void XMLNodeList_free(struct XMLNodeList *self);
+int XMLNodeList_add(struct XMLNodeList *self, struct XMLNode *parent, struct XMLNode *node);
+static int XMLNodeList_append(struct XMLNodeList *self, struct XMLNode *parent, struct XMLNode *node);
+struct XMLNode* XMLNodeList_createAndAppend(struct XMLNodeList *self);
+void XMLNodeList_free(struct XMLNodeList *self);
+static void lxmlNodeListRelease(struct XMLNodeList *self);
+static int lxmlNodeListJoin(struct XMLNodeList *self, struct XMLNode *node);
+
+static struct XMLGeneration* lxmlGenerationResolve(struct XMLGeneration **generation);
+static void lxmlGenerationSet(struct XMLGeneration **generation, struct XMLGeneration *value);
+static void lxmlGenerationRelease(struct XMLGeneration *generation);
 
 /* XML Node List Functions Prototype End */
 
 /* XML Document Functions Prototype Start */
 
 struct XMLDocument XMLDocument_load(FILE *fp);
+struct XMLDocument XMLDocument_loadBuffer(const char *buf, size_t len);
+struct XMLDocument XMLDocument_loadPath(const char *path);
+#ifdef LXML_HAVE_POSIX
+struct XMLDocument XMLDocument_loadFd(int fd);
+#endif
+struct XMLDocument XMLDocument_loadWithFlags(FILE *fp, int flags);
+struct XMLDocument XMLDocument_loadBufferWithFlags(const char *buf, size_t len, int flags);
+struct XMLDocument XMLDocument_loadPathWithFlags(const char *path, int flags);
+#ifdef LXML_HAVE_POSIX
+struct XMLDocument XMLDocument_loadFdWithFlags(int fd, int flags);
+#endif
+struct XMLDocument XMLDocument_loadBufferWithNames(const char *buf, size_t len, int flags, struct XMLNameTable *names);
+struct XMLDocument XMLDocument_loadBufferParallel(const char *buf, size_t len, int flags, int threads);
+size_t XMLDocument_loadMany(const char * const *paths, size_t n, struct XMLDocument *docs, int threads);
+size_t XMLDocument_loadManyWithFlags(const char * const *paths, size_t n, struct XMLDocument *docs, int threads, int flags);
+struct XMLNameTable* XMLDocument_getNameTable(struct XMLDocument *doc);
+struct XMLNode** XMLDocument_getElementsByTagName(struct XMLDocument *doc, char *tagName, size_t *count);
+void XMLDocument_clearIndex(struct XMLDocument *doc);
 int XMLDocument_writeToPath(struct XMLDocument *doc, const char *path, int indent);
 int XMLDocument_write(struct XMLDocument *doc, FILE *fp, int indent);
+int XMLDocument_writeToBuffer(struct XMLDocument *doc, char **out, size_t *len, int indent);
+int XMLDocument_writeParallel(struct XMLDocument *doc, FILE *fp, int indent, int threads);
+int XMLDocument_saveBinary(struct XMLDocument *doc, const char *path);
+int XMLDocument_saveBinaryToBuffer(struct XMLDocument *doc, char **out, size_t *len);
+struct XMLSnapshot* XMLDocument_openBinary(const char *path);
 
-static void XMLDocument_free(struct XMLDocument *doc);
+void XMLDocument_free(struct XMLDocument *doc);
 
 /* XML Document Functions Prototype End */
 
-static char* lxmlStrdup(const char *str);
-static char* lxmlReadXmlContentsIntoMemory(FILE *fp);
+/* XML Parser Functions Prototype Start */
+
+struct XMLParser* XMLParser_create();
+struct XMLParser* XMLParser_createWithFlags(int flags);
+struct XMLParser* XMLParser_createWithNames(int flags, struct XMLNameTable *names);
+struct XMLParser* XMLParser_createWithHandler(const struct XMLEventHandler *handler, void *ctx);
+int XMLParser_feed(struct XMLParser *parser, const char *buf, size_t len);
+struct XMLDocument XMLParser_finish(struct XMLParser *parser);
+void XMLParser_free(struct XMLParser *parser);
+
+int XMLDocument_parseEvents(const char *buf, size_t len, const struct XMLEventHandler *handler, void *ctx);
+
+static void lxmlParserInit(struct XMLParser *parser, const struct XMLEventHandler *handler, void *ctx);
+static int lxmlParserEnd(struct XMLParser *parser);
+static size_t lxmlParserRun(struct XMLParser *parser, const char *buf, size_t len, int final);
+static int lxmlParserDispatch(struct XMLParser *parser, const struct XMLToken *token);
+static int lxmlParserAppendPending(struct XMLParser *parser, const char *buf, size_t len);
+static int lxmlParserDecode(struct XMLParser *parser, const char **str, size_t *len);
+static struct XMLDocument lxmlLoadBuffer(const char *buf, size_t len, int flags, struct XMLNameTable *names, int threads, struct XMLLoadScratch *scratch);
+static struct XMLDocument lxmlLoadFile(const char *path, int flags, struct XMLLoadScratch *scratch);
+static int lxmlThreadCount();
+static int lxmlRetainsInput(int flags);
+static void lxmlLoadLazy(struct XMLParser *parser, const char *buf, size_t len);
+static int lxmlLazyAppend(struct XMLLazyIndex *lazy, size_t content);
+#ifdef LXML_HAVE_THREADS
+static size_t lxmlLoadParallel(struct XMLParser *parser, const char *buf, size_t len, int threads);
+static void* lxmlParallelLoaderRun(void *arg);
+static void lxmlParallelLoaderParse(struct XMLParallelLoader *loader, struct XMLParallelChunk *chunk, struct XMLNameTable *names);
+static int lxmlParallelLoaderMerge(struct XMLParallelLoader *loader, int success);
+static void* lxmlBatchLoadRun(void *arg);
+static int lxmlBatchLoadSteal(struct XMLLoadQueue *queue);
+#endif
+
+static enum XMLTokenType lxmlTokenizerNext(struct XMLTokenizer *tokenizer, const char *buf, size_t len, size_t *i, int final, struct XMLToken *token);
+static int lxmlTokenizerPushName(struct XMLTokenizer *tokenizer, const char *name, size_t nameLen);
+static int lxmlTokenizerPopName(struct XMLTokenizer *tokenizer, const char *name, size_t nameLen);
+static const char* lxmlTokenizerTopName(const struct XMLTokenizer *tokenizer, size_t *nameLen);
+static int lxmlNextAttribute(const char *attrs, size_t len, size_t *i, const char **key, size_t *keyLen, const char **value, size_t *valueLen);
+
+static int lxmlDomDeclaration(void *ctx, const char *version, size_t versionLen, const char *encoding, size_t encodingLen);
+static int lxmlDomStartElement(void *ctx, const char *tag, size_t tagLen);
+static int lxmlDomAttribute(void *ctx, const char *key, size_t keyLen, const char *value, size_t valueLen);
+static int lxmlDomText(void *ctx, const char *text, size_t len);
+static int lxmlDomEndElement(void *ctx, const char *tag, size_t tagLen);
+static int lxmlDomComment(void *ctx, const char *comment, size_t len);
+
+static const struct XMLEventHandler lxmlDomHandler = {
+    lxmlDomDeclaration, lxmlDomStartElement, lxmlDomAttribute, lxmlDomText, lxmlDomEndElement, lxmlDomComment
+};
+
+/* XML Parser Functions Prototype End */
+
+/* XML Lexer Tables Start */
+
+/* Shorthands for the table below */
+#define LXML_N LXML_CLASS_NAME
+#define LXML_S LXML_CLASS_SPACE
+#define LXML_E LXML_CLASS_EQUALS
+#define LXML_D LXML_CLASS_DQUOTE
+#define LXML_Q LXML_CLASS_SQUOTE
+
+/* The 'XMLCharClass' of every byte, white space is 'IGNORE_WHITESPACE_MAP' */
+static const unsigned char lxmlCharClass[256] = {
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_S, LXML_S, LXML_S, LXML_S, LXML_S, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_S, LXML_N, LXML_D, LXML_N, LXML_N, LXML_N, LXML_N, LXML_Q, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_E, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N,
+    LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N, LXML_N
+};
+
+#undef LXML_N
+#undef LXML_S
+#undef LXML_E
+#undef LXML_D
+#undef LXML_Q
+
+/* 'lxmlAttrTransitions[state][class]' is the state after a byte of 'class' in 'state'
+ * A quote after the equals sign leads out of the table, see 'lxmlNextAttribute' */
+static const unsigned char lxmlAttrTransitions[LXML_ATTR_ROW_COUNT][LXML_CLASS_COUNT] = {
+    /*                          NAME                    SPACE                   EQUALS                  DQUOTE                  SQUOTE */
+    /* LXML_ATTR_SPACE */       { LXML_ATTR_KEY,          LXML_ATTR_SPACE,        LXML_ATTR_ERROR,        LXML_ATTR_ERROR,        LXML_ATTR_ERROR },
+    /* LXML_ATTR_KEY */         { LXML_ATTR_KEY,          LXML_ATTR_AFTER_KEY,    LXML_ATTR_EQUALS,       LXML_ATTR_ERROR,        LXML_ATTR_ERROR },
+    /* LXML_ATTR_AFTER_KEY */   { LXML_ATTR_ERROR,        LXML_ATTR_AFTER_KEY,    LXML_ATTR_EQUALS,       LXML_ATTR_ERROR,        LXML_ATTR_ERROR },
+    /* LXML_ATTR_EQUALS */      { LXML_ATTR_ERROR,        LXML_ATTR_EQUALS,       LXML_ATTR_ERROR,        LXML_ATTR_DQUOTE_VALUE, LXML_ATTR_SQUOTE_VALUE }
+};
 
-static enum TagType lxmlParseAttrs(char *buf, size_t *i, char *lex, size_t *lexi, struct XMLNode *curr_node);
+/* XML Lexer Tables End */
+
+/* XML Arena Functions Prototype Start */
+
+static struct XMLArena* lxmlArenaCreate();
+static void lxmlArenaFree(struct XMLArena *arena);
+static void lxmlArenaReset(struct XMLArena *arena);
+static void* lxmlArenaAlloc(struct XMLArena *arena, size_t size);
+static void* lxmlArenaRealloc(struct XMLArena *arena, void *ptr, size_t oldSize, size_t size);
+static char* lxmlArenaStrndup(struct XMLArena *arena, const char *str, size_t len);
+static char* lxmlArenaStrndupDecoded(struct XMLArena *arena, const char *str, size_t len, size_t *decodedLen);
+static struct XMLNode* lxmlArenaNode(struct XMLArena *arena);
+static int lxmlArenaAttribute(struct XMLArena *arena, struct XMLAttribute *attr, const char *key, size_t keyLen, const char *value, size_t valueLen, int copy);
+
+/* XML Arena Functions Prototype End */
+
+/* XML Name Table Functions Prototype Start */
+
+struct XMLNameTable* XMLNameTable_create();
+const char* XMLNameTable_intern(struct XMLNameTable *names, const char *name, size_t len);
+const char* XMLNameTable_get(struct XMLNameTable *names, const char *name);
+void XMLNameTable_free(struct XMLNameTable *names);
+
+static const char** lxmlNameTableSlot(const char **slots, size_t capacity, const char *name, size_t len);
+static unsigned long lxmlHashName(const char *name, size_t len);
+
+/* XML Name Table Functions Prototype End */
+
+/* XML Index Functions Prototype Start */
+
+static struct XMLIndex* lxmlIndexCreate(struct XMLArena *arena);
+static void lxmlIndexFree(struct XMLArena *arena, struct XMLIndex *index);
+static int lxmlIndexAdd(struct XMLArena *arena, struct XMLIndex *index, const char *name, size_t len);
+static size_t lxmlIndexFind(const struct XMLIndex *index, const char *name, size_t len, size_t from, int chained);
+static struct XMLIndexSlot* lxmlIndexSlot(struct XMLIndexSlot *slots, size_t capacity, const char *name, size_t len);
+static struct XMLIndex* lxmlNodeListIndex(struct XMLNodeList *self, int force);
+static struct XMLIndex* lxmlAttributeListIndex(struct XMLAttributeList *self, int force);
+static void lxmlIndexTree(struct XMLNode *node, struct XMLNode *indexed);
+static enum XMLWalkAction lxmlIndexTreeEnter(void *ctx, struct XMLNode *node, size_t depth);
+static struct XMLTagIndex* lxmlTagIndexCreate(struct XMLNode *root, size_t generation);
+static void lxmlTagIndexFree(struct XMLTagIndex *tagIndex);
+static enum XMLWalkAction lxmlTagIndexCollect(void *ctx, struct XMLNode *node, size_t depth);
+static size_t lxmlTreeGeneration(const struct XMLDocument *doc);
+
+/* XML Index Functions Prototype End */
+
+/* XML Query Functions Prototype Start */
+
+struct XMLQuery* XMLQuery_compile(const char *expr);
+size_t XMLQuery_eval(const struct XMLQuery *query, struct XMLNode *node, int (*callback)(void *ctx, struct XMLNode *node, struct XMLAttribute *attr), void *ctx);
+void XMLQuery_free(struct XMLQuery *query);
+
+static int lxmlQueryParseStep(struct XMLQuery *query, const char *expr, size_t *i, int descendant);
+static int lxmlQueryParsePredicate(struct XMLArena *arena, struct XMLQueryStep *step, const char *expr, size_t *i);
+static size_t lxmlQueryNameLen(const char *expr, size_t i);
+static void lxmlQuerySkipSpace(const char *expr, size_t *i);
+static void lxmlQueryStep(const struct XMLQuery *query, size_t k, struct XMLNode *context, struct XMLQueryEval *eval);
+static void lxmlQueryMatch(const struct XMLQuery *query, size_t k, struct XMLNode *node, struct XMLQueryEval *eval);
+static enum XMLWalkAction lxmlQueryDescendant(void *ctx, struct XMLNode *node, size_t depth);
+static void lxmlQueryAttributes(const struct XMLQueryStep *step, struct XMLNode *node, struct XMLQueryEval *eval);
+static int lxmlQueryPredicates(const struct XMLQueryStep *step, struct XMLNode *node, size_t *counts);
+static int lxmlQueryNameEquals(const char *view, size_t len, const char *name, size_t nameLen);
+
+/* XML Query Functions Prototype End */
+
+/* XML Writer Functions Prototype Start */
+
+static void lxmlWriterPut(struct XMLWriter *writer, const char *str, size_t len);
+static void lxmlWriterPutView(struct XMLWriter *writer, const char *view, size_t len);
+static void lxmlWriterPutEscaped(struct XMLWriter *writer, const char *str, size_t len, char quote);
+static void lxmlWriterIndent(struct XMLWriter *writer, int indent, int times);
+static int lxmlWriterFlush(struct XMLWriter *writer);
+static void lxmlWriteDeclaration(struct XMLWriter *writer, struct XMLDocument *doc);
+static int lxmlWriteNode(struct XMLWriter *writer, struct XMLNode *node, int indent);
+static enum XMLWalkAction lxmlWriteNodeEnter(void *ctx, struct XMLNode *node, size_t depth);
+static enum XMLWalkAction lxmlWriteNodeLeave(void *ctx, struct XMLNode *node, size_t depth);
+#ifdef LXML_HAVE_THREADS
+static void* lxmlParallelWriterRun(void *arg);
+static void lxmlParallelWriterOutput(struct XMLParallelWriter *pw, struct XMLWriter *writer);
+#endif
 
-static int lxmlEndsWith(const char *haystack, const char *needle);
-static int lxmlParseEndOfNode(const char *buf, size_t *bufOffset, char *lex, size_t lexBufSize, size_t *lexi);
+/* XML Writer Functions Prototype End */
+
+/* XML Snapshot Functions Prototype Start */
+
+struct XMLSnapshot* XMLSnapshot_openBuffer(const void *buf, size_t len);
+struct XMLDocument XMLSnapshot_toDocument(const struct XMLSnapshot *snapshot, int flags);
+const char* XMLSnapshot_getTag(const struct XMLSnapshot *snapshot, size_t node, size_t *len);
+const char* XMLSnapshot_getInnerText(const struct XMLSnapshot *snapshot, size_t node, size_t *len);
+size_t XMLSnapshot_getParent(const struct XMLSnapshot *snapshot, size_t node);
+size_t XMLSnapshot_childCount(const struct XMLSnapshot *snapshot, size_t node);
+size_t XMLSnapshot_getChild(const struct XMLSnapshot *snapshot, size_t node, size_t i);
+size_t XMLSnapshot_getImmediateElementByTagName(const struct XMLSnapshot *snapshot, size_t node, const char *tagName);
+size_t XMLSnapshot_attributeCount(const struct XMLSnapshot *snapshot, size_t node);
+int XMLSnapshot_getAttribute(const struct XMLSnapshot *snapshot, size_t node, size_t i, const char **key, size_t *keyLen, const char **value, size_t *valueLen);
+const char* XMLSnapshot_getAttributeValue(const struct XMLSnapshot *snapshot, size_t node, const char *key, size_t *len);
+void XMLSnapshot_free(struct XMLSnapshot *snapshot);
+
+static size_t lxmlSnapshotReserve(struct XMLSnapshotWriter *writer, size_t size);
+static size_t lxmlSnapshotPutString(struct XMLSnapshotWriter *writer, const char *str, size_t len, int intern);
+static size_t* lxmlSnapshotNameSlot(size_t *names, size_t capacity, const unsigned char *buf, const char *name, size_t len);
+static enum XMLWalkAction lxmlSnapshotWriteEnter(void *ctx, struct XMLNode *node, size_t depth);
+static const unsigned char* lxmlSnapshotNode(const struct XMLSnapshot *snapshot, size_t node, size_t *attrs, size_t *children);
+static const char* lxmlSnapshotString(const struct XMLSnapshot *snapshot, size_t offset, size_t *len);
+static int lxmlSnapshotReplay(const struct XMLSnapshot *snapshot, struct XMLParser *parser, struct XMLSnapshotFrame *frame, int root);
+static size_t lxmlSnapshotGet32(const unsigned char *p);
+static void lxmlSnapshotPut32(unsigned char *p, size_t value);
+
+/* XML Snapshot Functions Prototype End */
+
+/* XML Reader Functions Prototype Start */
+
+struct XMLReader* XMLReader_open(FILE *fp);
+struct XMLReader* XMLReader_openBuffer(const char *buf, size_t len);
+enum XMLReaderEvent XMLReader_next(struct XMLReader *reader);
+int XMLReader_skipSubtree(struct XMLReader *reader);
+const char* XMLReader_getName(const struct XMLReader *reader, size_t *len);
+const char* XMLReader_getText(struct XMLReader *reader, size_t *len);
+int XMLReader_nextAttribute(struct XMLReader *reader, const char **key, size_t *keyLen, const char **value, size_t *valueLen);
+const char* XMLReader_getAttributeValue(struct XMLReader *reader, const char *key, size_t *len);
+size_t XMLReader_depth(const struct XMLReader *reader);
+void XMLReader_free(struct XMLReader *reader);
+int XMLDocument_streamElements(FILE *fp, const char *tagName, int (*callback)(void *ctx, struct XMLNode *node), void *ctx);
+
+static struct XMLReader* lxmlReaderCreate(const char *buf, size_t len);
+static enum XMLReaderEvent lxmlReaderRead(struct XMLReader *reader);
+static int lxmlReaderFill(struct XMLReader *reader);
+static int lxmlReaderSkip(struct XMLReader *reader);
+static const char* lxmlReaderDecode(struct XMLReader *reader, const char *str, size_t *len);
+
+/* XML Reader Functions Prototype End */
+
+static char* lxmlStrndup(const char *str, size_t len);
+static char* lxmlReadXmlContentsIntoMemory(FILE *fp);
 
-static void node_out(FILE *file, struct XMLNode *node, const char * const indentation, int indent, int times);
+static int lxmlIsSpace(char c);
+static size_t lxmlViewLen(const char *view, size_t len);
+static int lxmlViewEquals(const char *view, size_t len, const char *str);
+static size_t lxmlFind(const char *buf, size_t len, size_t from, const char *needle, size_t needleLen);
+static size_t lxmlScan3(const char *buf, size_t len, size_t from, char a, char b, char c);
+#ifdef LXML_HAVE_AVX2
+__attribute__((target("avx2"))) static size_t lxmlScan3Avx2(const char *buf, size_t len, size_t from, char a, char b, char c);
+#endif
+static int lxmlFindTagEnd(const char *buf, size_t len, size_t *scan, char *quote);
+static int lxmlFindDeclarationEnd(const char *buf, size_t len, size_t *scan, char *quote);
+static int lxmlParseEndOfNode(const char *buf, size_t len, size_t *i, const char **name, size_t *nameLen);
+static size_t lxmlDecodeReferences(char *dst, const char *src, size_t len);
+static unsigned long lxmlParseReference(const char *ref, size_t len, size_t *refLen);
+static size_t lxmlEncodeUtf8(unsigned long c, char *dst);
 
 /******************Prototype End*******************/
 
@@ -168,29 +1054,11 @@ static void node_out(FILE *file, struct XMLNode *node, const char * const indent
  * @return attr - A new heap allocated 'XMLAttribute'
  */
 struct XMLAttribute* XMLAttribute_init(char *key, char *value) {
-    struct XMLAttribute *attr = calloc(1, sizeof(struct XMLAttribute));
-
-    if (NULL != attr) {
-        attr->free = XMLAttribute_free;
-
-        if (NULL != key && NULL != value) {
-            size_t keylen = strlen(key),
-                   valuelen = strlen(value);
+    struct XMLAttribute *attr = malloc(sizeof(struct XMLAttribute));
 
-            if (0 != keylen && 0 != valuelen) {
-                attr->key = lxmlStrdup(key);
-                attr->value = lxmlStrdup(value);
-
-                if (NULL == attr->key || NULL == attr->value) {
-                    free(attr->key);
-                    free(attr->value);
-                    attr->key = attr->value = NULL;
-
-                    free(attr);
-                    attr = NULL;
-                }
-            }
-        }
+    if (NULL != attr && FALSE == lxmlArenaAttribute(NULL, attr, key, (NULL != key) ? strlen(key) : 0, value, (NULL != value) ? strlen(value) : 0, TRUE)) {
+        free(attr);
+        attr = NULL;
     }
 
     return attr;
@@ -200,12 +1068,31 @@ struct XMLAttribute* XMLAttribute_init(char *key, char *value) {
  * @brief Initialises an 'XMLAttributeList'
  */
 struct XMLAttributeList XMLAttributeList_init() {
-    struct XMLAttributeList list = { 0, 0, 0, XMLAttributeList_add, XMLAttributeList_free, XMLAttributeList_getAttributeValue, XMLAttributeList_getAttribute };
+    struct XMLAttributeList list;
+
+    memset(&list, '\0', sizeof(struct XMLAttributeList));
+
+#ifndef LXML_COMPACT_NODES
+    list.add = XMLAttributeList_add;
+    list.free = XMLAttributeList_free;
+    list.getAttributeValue = XMLAttributeList_getAttributeValue;
+    list.getAttribute = XMLAttributeList_getAttribute;
+#endif
+
     return list;
 } /* End of XMLAttributeList_init */
 
 struct XMLNodeList XMLNodeList_init() {
-    struct XMLNodeList list = { 0, 0, 0, XMLNodeList_add, XMLNodeList_createAndAppend, XMLNodeList_free };
+    struct XMLNodeList list;
+
+    memset(&list, '\0', sizeof(struct XMLNodeList));
+
+#ifndef LXML_COMPACT_NODES
+    list.add = XMLNodeList_add;
+    list.createAndAppend = XMLNodeList_createAndAppend;
+    list.free = XMLNodeList_free;
+#endif
+
     return list;
 } /* End of XMLNodeList_init */
 
@@ -223,161 +1110,568 @@ struct XMLNode* XMLNode_init() {
     return node;
 } /* End of XMLNode_init */
 
+/**
+ * @brief Frees everything 'node' holds, including its descendants, but not 'node' itself
+ *        The tree is walked with 'XMLNode_walk', so its depth is only limited by memory
+ *
+ * @param node - The 'XMLNode' to empty
+ */
 void XMLNode_free(struct XMLNode *node) {
     if (NULL != node) {
-        if (node->tag) {
-            free(node->tag);
-            node->tag = NULL;
-        }
-
-        if (node->inner_text) {
-            free(node->inner_text);
-            node->inner_text = NULL;
-        }
-
-        node->attributes.free(&node->attributes);
-        node->children.free(&node->children);
+        /* Arena nodes are not walked into, so there is no need to expand them */
+        node->lazy = 0;
+        XMLNode_walk(node, lxmlNodeFreeEnter, lxmlNodeFreeLeave, NULL);
         memset(node, '\0', sizeof(struct XMLNode));
     }
 } /* End of XMLNode_free */
 
+/**
+ * @brief Loads an 'XMLDocument' from the file pointer 'fp'
+ *        Seekable files are read into memory before parsing, anything
+ *        else (pipes, sockets, ...) is parsed as it is read
+ *
+ * @param  fp  - The file pointer to read from
+ * @return doc - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
 struct XMLDocument XMLDocument_load(FILE *fp) {
-    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free };
-
-    char *buf = lxmlReadXmlContentsIntoMemory(fp);
-
-    if (NULL != buf) {
-        char lex[LEX_BUF_SIZE+1] = { 0 };
-        size_t i = 0, lexi = 0;
+    return XMLDocument_loadWithFlags(fp, 0);
+} /* End of XMLDocument_load */
 
-        struct XMLNode *curr_node = NULL, *tmp = NULL;
+/**
+ * @brief Loads an 'XMLDocument' from the first 'len' bytes of 'buf'
+ *        **Note:** 'buf' does not need to be NUL terminated
+ *
+ * @param  buf - The XML contents to parse
+ * @param  len - The number of bytes in 'buf'
+ * @return doc - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadBuffer(const char *buf, size_t len) {
+    return XMLDocument_loadBufferWithFlags(buf, len, 0);
+} /* End of XMLDocument_loadBuffer */
 
-        doc.root = XMLNode_init(NULL);
-        curr_node = doc.root;
+/**
+ * @brief Loads an 'XMLDocument' from the file located at 'path'
+ *        **Note:** See 'XMLDocument_loadFd' for implementation where POSIX is available
+ *
+ * @param  path - The path of the file to load
+ * @return doc  - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadPath(const char *path) {
+    return XMLDocument_loadPathWithFlags(path, 0);
+} /* End of XMLDocument_loadPath */
 
-        while ('\0' != buf[i]) {
+#ifdef LXML_HAVE_POSIX
+/**
+ * @brief Loads an 'XMLDocument' from the file descriptor 'fd'
+ *        Regular files are mapped read-only and parsed in place, anything
+ *        else (pipes, sockets, ...) is parsed as it is read
+ *        **Note:** 'fd' is not closed
+ *
+ * @param  fd  - The open file descriptor to read from
+ * @return doc - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadFd(int fd) {
+    return XMLDocument_loadFdWithFlags(fd, 0);
+} /* End of XMLDocument_loadFd */
+#endif /* LXML_HAVE_POSIX */
 
-            if ('<' == buf[i]) {
-                lex[lexi] = '\0';
+/**
+ * @brief As 'XMLDocument_load' with the given 'LXML_LOAD_*' flags
+ *
+ * @param  fp    - The file pointer to read from
+ * @param  flags - 'LXML_LOAD_ARENA' to allocate the whole document from one arena
+ *                 'LXML_LOAD_IN_SITU' to also point into the input, which the document retains
+ * @return doc   - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadWithFlags(FILE *fp, int flags) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
 
-                /* Inner text */
-                if (lexi > 0) {
-                    if (NULL == curr_node) {
-                        fprintf(stderr, "Text outside of document\n");
-                        break;
-                    }
+    lxmlFileOffset start = (NULL != fp) ? lxmlFtell(fp) : -1;
+    char *buf = lxmlReadXmlContentsIntoMemory(fp);
 
-                    if (NULL == curr_node->inner_text)
-                        curr_node->inner_text = lxmlStrdup(lex);
+    if (NULL != buf) {
+        doc = XMLDocument_loadBufferWithFlags(buf, strlen(buf), flags);
 
-                    lexi = 0;
-                }
+        /* In situ and lazy documents point into 'buf' so they take ownership of it */
+        if (TRUE == lxmlRetainsInput(flags) && NULL != doc.arena)
+            doc.arena->input = buf;
+        else
+            free(buf);
+        buf = NULL;
+    } else if (NULL != fp && start >= 0 && start != lxmlFtell(fp)) {
+        /* Streaming from wherever the failed read stopped would parse half a file */
+        fprintf(stderr, "Could not read the file\n");
+    } else if (NULL != fp) {
+        struct XMLParser *parser = XMLParser_createWithFlags(flags);
+        char *chunk = malloc(LXML_READ_CHUNK_SIZE);
+
+        if (NULL != parser && NULL != chunk) {
+            size_t bytesRead = 0;
+
+            while (0 != (bytesRead = fread(chunk, sizeof(char), LXML_READ_CHUNK_SIZE, fp)))
+                if (FALSE == XMLParser_feed(parser, chunk, bytesRead))
+                    break;
 
-                /* End of node */
-                if ('/' == buf[i + 1]) {
-                    i += 2;
+            doc = XMLParser_finish(parser);
+            parser = NULL;
+        }
 
-                    doc.success = lxmlParseEndOfNode(buf, &i, lex, LEX_BUF_SIZE, &lexi);
+        XMLParser_free(parser);
+        free(chunk);
+        chunk = NULL;
+    }
 
-                    if (NULL == curr_node) {
-                        fprintf(stderr, "Already at the root\n");
-                        break;
-                    }
+    return doc;
+} /* End of XMLDocument_loadWithFlags */
 
-                    if (0 != strcmp(NULL == curr_node->tag ? "" : curr_node->tag, lex)) {
-                        fprintf(stderr, "Mismatched tags (%s != %s)\n", curr_node->tag, lex);
-                        break;
-                    }
+/**
+ * @brief As 'XMLDocument_loadBuffer' with the given 'LXML_LOAD_*' flags
+ *        With 'LXML_LOAD_IN_SITU' the strings of the document are views into 'buf'
+ *        instead of copies, so 'buf' must outlive the document
+ *
+ * @param  buf   - The XML contents to parse
+ * @param  len   - The number of bytes in 'buf'
+ * @param  flags - 'LXML_LOAD_ARENA' to allocate the whole document from one arena
+ *                 'LXML_LOAD_IN_SITU' to also point into 'buf' rather than copying
+ *                 'LXML_LOAD_LAZY' to build elements on first access, 'buf' must then outlive the document
+ * @return doc   - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadBufferWithFlags(const char *buf, size_t len, int flags) {
+    return XMLDocument_loadBufferWithNames(buf, len, flags, NULL);
+} /* End of XMLDocument_loadBufferWithFlags */
 
-                    curr_node = curr_node->parent;
-                    i++;
-                    continue;
-                }
+/**
+ * @brief As 'XMLDocument_loadBufferWithFlags' interning tags and attribute keys into 'names'
+ *        so documents loaded with the same table share their names
+ *        **Note:** 'names' must outlive the document, 'NULL' gives the document a table of its own
+ *
+ * @param  buf   - The XML contents to parse
+ * @param  len   - The number of bytes in 'buf'
+ * @param  flags - 'LXML_LOAD_*' flags, 'LXML_LOAD_INTERN' is implied when 'names' is given
+ * @param  names - The 'XMLNameTable' to intern into or 'NULL'
+ * @return doc   - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadBufferWithNames(const char *buf, size_t len, int flags, struct XMLNameTable *names) {
+    return lxmlLoadBuffer(buf, len, flags, names, (0 != (flags & LXML_LOAD_PARALLEL)) ? lxmlThreadCount() : 1, NULL);
+} /* End of XMLDocument_loadBufferWithNames */
 
-                /* Special nodes */
-                if ('!' == buf[i + 1]) {
-                    while (' ' != buf[i]  && '>' != buf[i])
-                        lex[lexi++] = buf[i++];
-                    lex[lexi] = '\0';
-
-                    /* Comments */
-                    if (0 == strcmp(lex, "<!--")) {
-                        lex[lexi] = '\0';
-                        while (FALSE == lxmlEndsWith(lex, "-->")) {
-                            lex[lexi++] = buf[i++];
-                            lex[lexi] = '\0';
-                        }
-                        continue;
-                    }
-                }
+/**
+ * @brief As 'XMLDocument_loadBufferWithFlags' parsing the children of the root element on 'threads' threads
+ *        The document, including 'doc.success', is the same as the one 'XMLDocument_loadBufferWithFlags' builds
+ *        **Note:** Parses serially without 'LXML_HAVE_THREADS' or when 'threads' is below 2
+ *
+ * @param  buf     - The XML contents to parse
+ * @param  len     - The number of bytes in 'buf'
+ * @param  flags   - 'LXML_LOAD_*' flags
+ * @param  threads - The number of threads to parse with, including the calling thread
+ * @return doc     - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadBufferParallel(const char *buf, size_t len, int flags, int threads) {
+    return lxmlLoadBuffer(buf, len, flags, NULL, threads, NULL);
+} /* End of XMLDocument_loadBufferParallel */
 
-                /* Declaration tags */
-                if ('?' == buf[i + 1]) {
-                    while (' ' != buf[i] && '>' != buf[i])
-                        lex[lexi++] = buf[i++];
-                    lex[lexi] = '\0';
+/**
+ * @brief Loads each of the 'n' files in 'paths' into 'docs' on 'threads' threads
+ *        Each thread starts with an equal share of the files and takes over half of
+ *        another thread's remaining files when it runs out, so a few large files do not
+ *        hold up the rest. Small files are read into a buffer each thread reuses
+ *        **Note:** Loads serially without 'LXML_HAVE_THREADS' or when 'threads' is below 2
+ *
+ * @param  paths   - The paths of the files to load
+ * @param  n       - The number of paths
+ * @param  docs    - Receives the 'n' documents in the order of 'paths', check 'docs[i].success'
+ * @param  threads - The number of threads to load with, including the calling thread
+ * @return loaded  - The number of documents loaded successfully
+ */
+size_t XMLDocument_loadMany(const char * const *paths, size_t n, struct XMLDocument *docs, int threads) {
+    return XMLDocument_loadManyWithFlags(paths, n, docs, threads, 0);
+} /* End of XMLDocument_loadMany */
 
-                    /* This is the XML declaration */
-                    if (0 == strcmp(lex, "<?xml")) {
-                        struct XMLNode *desc = XMLNode_init(NULL);
-                        lexi = 0;
+/**
+ * @brief As 'XMLDocument_loadMany' with the given 'LXML_LOAD_*' flags
+ *        **Note:** 'LXML_LOAD_PARALLEL' is ignored, the threads are spread over the files instead
+ *
+ * @param  paths   - The paths of the files to load
+ * @param  n       - The number of paths
+ * @param  docs    - Receives the 'n' documents in the order of 'paths', check 'docs[i].success'
+ * @param  threads - The number of threads to load with, including the calling thread
+ * @param  flags   - 'LXML_LOAD_*' flags applied to every file
+ * @return loaded  - The number of documents loaded successfully
+ */
+size_t XMLDocument_loadManyWithFlags(const char * const *paths, size_t n, struct XMLDocument *docs, int threads, int flags) {
+    size_t loaded = 0, i = 0;
+
+    if (NULL != paths && NULL != docs) {
+        int done = FALSE;
+
+        flags &= ~LXML_LOAD_PARALLEL;
+
+#ifdef LXML_HAVE_THREADS
+        if (threads > 1 && n > 1) {
+            struct XMLBatchLoad batch;
+            pthread_t *workers = NULL;
+            int started = 0, ready = 0;
+
+            batch.paths = paths;
+            batch.docs = docs;
+            batch.flags = flags;
+            batch.threads = ((size_t) threads < n) ? threads : (int) n;
+            batch.queues = calloc((size_t) batch.threads, sizeof(struct XMLLoadQueue));
+            workers = malloc(sizeof(pthread_t) * (size_t) batch.threads);
+
+            /* Contiguous shares, so files listed together are usually loaded together */
+            for (; NULL != batch.queues && NULL != workers && ready < batch.threads; ++ready) {
+                batch.queues[ready].batch = &batch;
+                batch.queues[ready].begin = n * (size_t) ready / (size_t) batch.threads;
+                batch.queues[ready].end = n * (size_t) (ready + 1) / (size_t) batch.threads;
+
+                if (0 != pthread_mutex_init(&batch.queues[ready].lock, NULL))
+                    break;
+            }
 
-                        lxmlParseAttrs(buf, &i, lex, &lexi, desc);
+            if (ready == batch.threads) {
+                for (started = 1; started < batch.threads; ++started)
+                    if (0 != pthread_create(&workers[started], NULL, lxmlBatchLoadRun, &batch.queues[started]))
+                        break;
 
-                        doc.version = desc->getAttributeValue(desc, "version");
-                        doc.encoding = desc->getAttributeValue(desc, "encoding");
+                /* The calling thread works through the first share, the shares of threads which
+                 * could not be started are stolen */
+                lxmlBatchLoadRun(&batch.queues[0]);
 
-                        desc->free(desc);
-                        free(desc);
-                        desc = NULL;
-                        continue;
-                    }
-                }
+                for (i = 1; (int) i < started; ++i)
+                    pthread_join(workers[i], NULL);
 
-                /* Set current node */
-                tmp = curr_node->createAndAppend(curr_node);
+                done = TRUE;
+            }
 
-                if (NULL != tmp) {
-                    enum TagType type = TAG_UNSUPPORTED;
-                    ++i;
-                    /* Start tag */
-                    type = lxmlParseAttrs(buf, &i, lex, &lexi, tmp);
+            while (0 < ready--)
+                pthread_mutex_destroy(&batch.queues[ready].lock);
 
-                    if (TAG_INLINE != type) {
-                        /* Set tag name if none */
-                        lex[lexi] = '\0';
+            free(batch.queues);
+            free(workers);
+        }
+#else
+        (void) threads;
+#endif
 
-                        if (NULL == curr_node->tag)
-                            curr_node->tag = lxmlStrdup(lex);
+        if (FALSE == done) {
+            struct XMLLoadScratch scratch = { 0 };
 
-                        /* Reset lexer */
-                        lexi = 0;
-                        curr_node = tmp;
-                    }
+            for (i = 0; i < n; ++i)
+                docs[i] = lxmlLoadFile(paths[i], flags, &scratch);
 
-                    ++i;
-                    continue;
-                } else {
-                    /* FIXME: Error */
-                    break;
-                }
-            } else {
-                lex[lexi++] = buf[i++];
-            }
+            free(scratch.buf);
+            free(scratch.names);
         }
 
-        if ('\0' == buf[i])
-            doc.success = TRUE;
-
-        free(buf);
-        buf = NULL;
+        for (i = 0; i < n; ++i)
+            loaded += (TRUE == docs[i].success) ? 1 : 0;
     }
 
-    return doc;
-} /* End of XMLDocument_load */
+    return loaded;
+} /* End of XMLDocument_loadManyWithFlags */
 
 /**
- * @brief Writes the given 'XMLDocument' to the prescribed 'path' using the 'indent' to specify white spaces
+ * @brief As 'XMLDocument_loadPath' with the given 'LXML_LOAD_*' flags
+ *
+ * @param  path  - The path of the file to load
+ * @param  flags - 'LXML_LOAD_ARENA' to allocate the whole document from one arena
+ *                 'LXML_LOAD_IN_SITU' to also point into the input, which the document retains
+ * @return doc   - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadPathWithFlags(const char *path, int flags) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+
+    if (NULL != path) {
+#ifdef LXML_HAVE_POSIX
+        int fd = open(path, O_RDONLY);
+
+        if (-1 != fd) {
+            doc = XMLDocument_loadFdWithFlags(fd, flags);
+            close(fd);
+        } else
+            fprintf(stderr, "Could not open file '%s'\n", path);
+#else
+        FILE *fp = fopen(path, "rb");
+
+        if (NULL != fp) {
+            doc = XMLDocument_loadWithFlags(fp, flags);
+            fclose(fp);
+            fp = NULL;
+        } else
+            fprintf(stderr, "Could not open file '%s'\n", path);
+#endif
+    }
+
+    return doc;
+} /* End of XMLDocument_loadPathWithFlags */
+
+#ifdef LXML_HAVE_POSIX
+/**
+ * @brief As 'XMLDocument_loadFd' with the given 'LXML_LOAD_*' flags
+ *
+ * @param  fd    - The open file descriptor to read from
+ * @param  flags - 'LXML_LOAD_ARENA' to allocate the whole document from one arena
+ *                 'LXML_LOAD_IN_SITU' to also point into the input, which the document retains
+ * @return doc   - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLDocument_loadFdWithFlags(int fd, int flags) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+    struct stat st;
+
+    if (0 == fstat(fd, &st)) {
+        size_t len = (size_t) st.st_size;
+        void *map = MAP_FAILED;
+
+        /* 'len' must round trip so files larger than the address space are rejected */
+        if (S_ISREG(st.st_mode) && (off_t) len == st.st_size && 0 != len)
+            map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (MAP_FAILED != map) {
+            posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+            doc = XMLDocument_loadBufferWithFlags((const char*) map, len, flags);
+
+            /* In situ and lazy documents point into the mapping so they take ownership of it */
+            if (TRUE == lxmlRetainsInput(flags) && NULL != doc.arena) {
+                doc.arena->input = map;
+                doc.arena->inputLen = len;
+                doc.arena->inputMapped = TRUE;
+            } else
+                munmap(map, len);
+            map = NULL;
+        } else if (S_ISREG(st.st_mode) && 0 == st.st_size)
+            doc = XMLDocument_loadBufferWithFlags(NULL, 0, flags);
+        else {
+            struct XMLParser *parser = XMLParser_createWithFlags(flags);
+            char *chunk = malloc(LXML_READ_CHUNK_SIZE);
+
+            if (NULL != parser && NULL != chunk) {
+                ssize_t bytesRead = 0;
+
+                while (0 < (bytesRead = read(fd, chunk, LXML_READ_CHUNK_SIZE)))
+                    if (FALSE == XMLParser_feed(parser, chunk, (size_t) bytesRead))
+                        break;
+
+                if (0 > bytesRead)
+                    parser->tokenizer.error = TRUE;
+
+                doc = XMLParser_finish(parser);
+                parser = NULL;
+            }
+
+            XMLParser_free(parser);
+            free(chunk);
+            chunk = NULL;
+        }
+    }
+
+    return doc;
+} /* End of XMLDocument_loadFdWithFlags */
+#endif /* LXML_HAVE_POSIX */
+
+/**
+ * @brief Creates a parser which builds an 'XMLDocument' from chunks of input
+ *        as they arrive, see 'XMLParser_feed' and 'XMLParser_finish'
+ *
+ * @return parser - A 'calloc' 'XMLParser' or 'NULL' when out of memory
+ */
+struct XMLParser* XMLParser_create() {
+    return XMLParser_createWithFlags(0);
+} /* End of XMLParser_create */
+
+/**
+ * @brief As 'XMLParser_create' with the given 'LXML_LOAD_*' flags
+ *        **Note:** Chunks are not retained so 'LXML_LOAD_IN_SITU' copies like 'LXML_LOAD_ARENA'
+ *        and 'LXML_LOAD_LAZY' builds the whole document
+ *
+ * @param  flags  - 'LXML_LOAD_ARENA' to allocate the whole document from one arena
+ * @return parser - A 'calloc' 'XMLParser' or 'NULL' when out of memory
+ */
+struct XMLParser* XMLParser_createWithFlags(int flags) {
+    return XMLParser_createWithNames(flags, NULL);
+} /* End of XMLParser_createWithFlags */
+
+/**
+ * @brief As 'XMLParser_createWithFlags' interning tags and attribute keys into 'names'
+ *        **Note:** 'names' must outlive the document, 'NULL' gives the document a table of its own
+ *
+ * @param  flags  - 'LXML_LOAD_*' flags, 'LXML_LOAD_INTERN' is implied when 'names' is given
+ * @param  names  - The 'XMLNameTable' to intern into or 'NULL'
+ * @return parser - A 'calloc' 'XMLParser' or 'NULL' when out of memory
+ */
+struct XMLParser* XMLParser_createWithNames(int flags, struct XMLNameTable *names) {
+    struct XMLParser *parser = XMLParser_createWithHandler(&lxmlDomHandler, NULL);
+
+    if (NULL != names)
+        flags |= LXML_LOAD_INTERN;
+
+    if (NULL != parser) {
+        struct XMLArena *arena = NULL;
+
+        parser->ctx = parser;
+        parser->indexNodes = (0 != (flags & LXML_LOAD_INDEX)) ? TRUE : FALSE;
+
+        if (0 != (flags & LXML_LOAD_ARENA))
+            arena = parser->doc.arena = lxmlArenaCreate();
+
+        if (NULL != arena && LXML_LOAD_INTERN == (flags & LXML_LOAD_INTERN)) {
+            arena->names = (NULL != names) ? names : XMLNameTable_create();
+            arena->ownsNames = (NULL == names) ? TRUE : FALSE;
+        }
+
+        if (0 == (flags & LXML_LOAD_ARENA) || (NULL != arena && (LXML_LOAD_INTERN != (flags & LXML_LOAD_INTERN) || NULL != arena->names)))
+            parser->doc.root = lxmlArenaNode(arena);
+
+        parser->curr_node = parser->doc.root;
+
+        if (NULL == parser->doc.root) {
+            parser->doc.free(&parser->doc);
+            free(parser);
+            parser = NULL;
+        }
+    }
+
+    return parser;
+} /* End of XMLParser_createWithNames */
+
+/**
+ * @brief Creates a parser which reports chunks of input to 'handler' as they arrive
+ *        instead of building an 'XMLDocument'
+ *        **Note:** Text and comments split across chunks are reported in pieces
+ *
+ * @param  handler - The callbacks to invoke
+ * @param  ctx     - Passed as the first argument of every callback
+ * @return parser  - A 'calloc' 'XMLParser' or 'NULL' when out of memory
+ */
+struct XMLParser* XMLParser_createWithHandler(const struct XMLEventHandler *handler, void *ctx) {
+    struct XMLParser *parser = NULL;
+
+    if (NULL != handler) {
+        parser = calloc(1, sizeof(struct XMLParser));
+
+        if (NULL != parser)
+            lxmlParserInit(parser, handler, ctx);
+    }
+
+    return parser;
+} /* End of XMLParser_createWithHandler */
+
+/**
+ * @brief Parses the next 'len' bytes of the document
+ *        Complete tokens are handled straight away, a token split
+ *        across chunks is kept until the rest of it is fed
+ *
+ * @param  parser  - The 'XMLParser' to feed
+ * @param  buf     - The next chunk of the document, this does not need to be NUL terminated
+ * @param  len     - The number of bytes in 'buf'
+ * @return success - 'FALSE' once the document is known to be malformed
+ */
+int XMLParser_feed(struct XMLParser *parser, const char *buf, size_t len) {
+    int success = FALSE;
+
+    if (NULL != parser && (NULL != buf || 0 == len)) {
+        /* Complete the partial lexeme first, every lexeme ends in '>' */
+        while (0 != parser->pendingSize && 0 != len && FALSE == parser->tokenizer.error) {
+            const char *close = memchr(buf, '>', len);
+            size_t take = (NULL != close) ? (size_t) (close - buf) + 1 : len;
+
+            if (TRUE == lxmlParserAppendPending(parser, buf, take)) {
+                size_t consumed = lxmlParserRun(parser, parser->pending, parser->pendingSize, FALSE);
+
+                parser->pendingSize -= consumed;
+                memmove(parser->pending, parser->pending + consumed, parser->pendingSize);
+            }
+
+            buf += take;
+            len -= take;
+        }
+
+        /* Anything left is parsed directly from 'buf' */
+        if (0 != len && FALSE == parser->tokenizer.error) {
+            size_t consumed = lxmlParserRun(parser, buf, len, FALSE);
+
+            if (consumed < len)
+                lxmlParserAppendPending(parser, buf + consumed, len - consumed);
+        }
+
+        success = (FALSE == parser->tokenizer.error) ? TRUE : FALSE;
+    }
+
+    return success;
+} /* End of XMLParser_feed */
+
+/**
+ * @brief Signals the end of the input and releases 'parser'
+ *        **Note:** 'parser' must not be used after this call
+ *
+ * @param  parser - The 'XMLParser' to finish
+ * @return doc    - The parsed 'XMLDocument', check 'doc.success' for the status
+ *                  'doc.root' is 'NULL' for parsers created with a handler
+ */
+struct XMLDocument XMLParser_finish(struct XMLParser *parser) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+
+    if (NULL != parser) {
+        if (FALSE == parser->tokenizer.error)
+            lxmlParserRun(parser, parser->pending, parser->pendingSize, TRUE);
+
+        doc = parser->doc;
+        doc.success = lxmlParserEnd(parser);
+
+        if (TRUE == doc.success && TRUE == parser->indexNodes)
+            lxmlIndexTree(doc.root, parser->indexed);
+
+        free(parser);
+        parser = NULL;
+    }
+
+    return doc;
+} /* End of XMLParser_finish */
+
+/**
+ * @brief Releases 'parser' along with the partially parsed document
+ *
+ * @param parser - The 'XMLParser' to free
+ */
+void XMLParser_free(struct XMLParser *parser) {
+    if (NULL != parser) {
+        parser->doc.free(&parser->doc);
+
+        lxmlParserEnd(parser);
+        free(parser);
+        parser = NULL;
+    }
+} /* End of XMLParser_free */
+
+/**
+ * @brief Parses 'len' bytes of 'buf' reporting each part of the document to
+ *        'handler' as it is found, without building an 'XMLDocument'
+ *        References in text and attribute values are decoded as 'XMLDocument_load' does
+ *        **Note:** Nothing is allocated per event, strings are slices of 'buf' except those
+ *        with references, which are decoded into a buffer reused for the next
+ *
+ * @param  buf     - The XML contents to parse, this does not need to be NUL terminated
+ * @param  len     - The number of bytes in 'buf'
+ * @param  handler - The callbacks to invoke
+ * @param  ctx     - Passed as the first argument of every callback
+ * @return success - 'FALSE' if the document is malformed or a callback stopped the parse
+ */
+int XMLDocument_parseEvents(const char *buf, size_t len, const struct XMLEventHandler *handler, void *ctx) {
+    int success = FALSE;
+
+    if (NULL != handler && (NULL != buf || 0 == len)) {
+        struct XMLParser parser;
+
+        lxmlParserInit(&parser, handler, ctx);
+        lxmlParserRun(&parser, buf, len, TRUE);
+        success = lxmlParserEnd(&parser);
+    }
+
+    return success;
+} /* End of XMLDocument_parseEvents */
+
+/**
+ * @brief Writes the given 'XMLDocument' to the prescribed 'path' using the 'indent' to specify white spaces
  *
  * @param  doc     - The document to write out
  * @param  path    - The path to write out to
@@ -388,9 +1682,12 @@ int XMLDocument_writeToPath(struct XMLDocument *doc, const char *path, int inden
     int success = FALSE;
     FILE *fp = fopen(path, "w");
 
-    if (NULL != fp)
+    if (NULL != fp) {
         success = XMLDocument_write(doc, fp, indent);
-    else
+
+        if (0 != fclose(fp))
+            success = FALSE;
+    } else
         fprintf(stderr, "Could not open file '%s'\n", path);
 
     return success;
@@ -398,6 +1695,7 @@ int XMLDocument_writeToPath(struct XMLDocument *doc, const char *path, int inden
 
 /**
  * @brief Writes the given 'XMLDocument' to the prescribed 'path' using the 'indent' to specify white spaces
+ *        The output is gathered into 'LXML_WRITE_BUFFER_SIZE' byte blocks before being written to 'fp'
  *
  * @param  doc     - The document to write out
  * @param  fp      - The file pointer to write to
@@ -405,580 +1703,5825 @@ int XMLDocument_writeToPath(struct XMLDocument *doc, const char *path, int inden
  * @return success - A flag indicating the status of the subroutine
  */
 int XMLDocument_write(struct XMLDocument *doc, FILE *fp, int indent) {
-    if (NULL != fp) {
-        fprintf(
-            fp, "<?xml version=\"%s\" encoding=\"%s\" ?>\n",
-            (doc->version) ? doc->version : "1.0",
-            (doc->encoding) ? doc->encoding : "UTF-8"
-        );
-        node_out(fp, doc->root, NULL, indent, 0);
-    }
-    return TRUE;
-} /* End of XMLDocument_write */
+    int success = (NULL != doc) ? TRUE : FALSE;
+
+    if (NULL != doc && NULL != fp) {
+        struct XMLWriter writer = { 0 };
+
+        writer.fp = fp;
+        writer.capacity = LXML_WRITE_BUFFER_SIZE;
+        writer.buf = malloc(writer.capacity);
+
+        if (NULL != writer.buf) {
+            lxmlWriteDeclaration(&writer, doc);
+            if (NULL != doc->root)
+                lxmlWriteNode(&writer, doc->root, indent);
+            success = lxmlWriterFlush(&writer);
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            success = FALSE;
+        }
 
-/********************Public End********************/
+        free(writer.buf);
+    }
 
-/******************Private Start*******************/
+    return success;
+} /* End of XMLDocument_write */
 
 /**
- * @brief Frees the data on a given 'XMLAttribute'
+ * @brief Writes the given 'XMLDocument' into a single allocation sized by a counting pass
+ *        The output is NUL terminated, 'XMLDocument_write' produces the same bytes
  *
- * @param self - A reference to the 'XMLAttribute' to free
+ * @param  doc     - The document to write out
+ * @param  out     - Set to the 'malloc' output, which the caller must 'free', or 'NULL' on failure
+ * @param  len     - Set to the number of bytes written, excluding the NUL terminator
+ * @param  indent  - The number of white spaces to place
+ * @return success - A flag indicating the status of the subroutine
  */
-static void XMLAttribute_free(struct XMLAttribute *self) {
-    if (NULL != self) {
-        free(self->key);
-        free(self->value);
-        self->key = self->value = NULL;
+int XMLDocument_writeToBuffer(struct XMLDocument *doc, char **out, size_t *len, int indent) {
+    struct XMLWriter writer = { 0 };
+    int success = FALSE;
+
+    if (NULL != out)
+        *out = NULL;
+    if (NULL != len)
+        *len = 0;
+
+    if (NULL != doc && NULL != out && NULL != len) {
+        lxmlWriteDeclaration(&writer, doc);
+        if (NULL != doc->root)
+            lxmlWriteNode(&writer, doc->root, indent);
+
+        /* A counting pass which could not walk the whole tree has no size to allocate */
+        writer.capacity = writer.size + 1;
+        writer.buf = (FALSE == writer.error) ? malloc(writer.capacity) : NULL;
+
+        if (NULL != writer.buf) {
+            writer.size = 0;
+            lxmlWriteDeclaration(&writer, doc);
+            if (NULL != doc->root)
+                lxmlWriteNode(&writer, doc->root, indent);
+            success = (FALSE == writer.error) ? TRUE : FALSE;
+        } else if (FALSE == writer.error)
+            fprintf(stderr, "Out of memory\n");
+
+        if (TRUE == success) {
+            writer.buf[writer.size] = '\0';
+            *out = writer.buf;
+            *len = writer.size;
+        } else
+            free(writer.buf);
     }
-} /* End of XMLAttribute_free */
+
+    return success;
+} /* End of XMLDocument_writeToBuffer */
 
 /**
- * @brief Adds a given 'XMLAttribute' to 'self'
+ * @brief Writes the given 'XMLDocument' to 'fp' like 'XMLDocument_write', serializing
+ *        sibling subtrees on 'threads' worker threads and writing them out in order
+ *        The first node below the root with several children is split into blocks of
+ *        siblings, the output is byte-identical to 'XMLDocument_write'
+ *        **Note:** Writes serially without 'LXML_HAVE_THREADS' or when 'threads' is below 2
  *
- * @param self - A pointer to the 'XMLAttributeList' to add the 'XMLAttribute to
- * @param attr - The 'XMLAttribute' to add to the list
- * @return success - A Flag indicating the status of the subroutine
+ * @param  doc     - The document to write out
+ * @param  fp      - The file pointer to write to
+ * @param  indent  - The number of white spaces to place
+ * @param  threads - The number of worker threads to start
+ * @return success - A flag indicating the status of the subroutine
  */
-static int XMLAttributeList_add(struct XMLAttributeList *self, struct XMLAttribute attr) {
-    int success = FALSE;
+int XMLDocument_writeParallel(struct XMLDocument *doc, FILE *fp, int indent, int threads) {
+    int success = FALSE, started = 0;
+#ifdef LXML_HAVE_THREADS
+    struct XMLNode *parent = NULL, **chain = NULL;
+    pthread_t *workers = NULL;
+    size_t depth = 0, i = 0;
+
+    if (NULL != doc) {
+        parent = doc->root;
+
+        /* Workers must not build nodes from the shared arena, so lazy documents are built up front */
+        if (NULL != doc->arena && NULL != doc->arena->lazy)
+            XMLNode_walk(doc->root, NULL, NULL, NULL);
+    }
 
-    if (NULL != self) {
-        if (0 == self->size && NULL == self->attribute) {
-            self->attribute = calloc(1, sizeof(struct XMLAttribute*));
+    /* Wrapping elements are written around the split, as with '<catalog>' around its items */
+    while (NULL != parent && 1 == parent->children.size && 0 != parent->children.data[0]->children.size) {
+        parent = parent->children.data[0];
+        ++depth;
+    }
 
-            if (NULL != self->attribute)
-                self->heapSize = 1;
+    if (NULL != fp && threads > 1 && NULL != parent && parent->children.size > 1
+        && NULL != (workers = malloc(sizeof(pthread_t) * (size_t) threads))
+        && NULL != (chain = malloc(sizeof(struct XMLNode*) * (depth + 1)))) {
+        struct XMLParallelWriter pw;
+        struct XMLWriter writer = { 0 };
+
+        memset(&pw, '\0', sizeof(struct XMLParallelWriter));
+        pw.parent = parent;
+        pw.indent = indent;
+        pw.blockNodes = parent->children.size / ((size_t) threads * 4);
+        pw.blockNodes = (0 == pw.blockNodes) ? 1 : (pw.blockNodes > LXML_PARALLEL_BLOCK_NODES) ? LXML_PARALLEL_BLOCK_NODES : pw.blockNodes;
+        pw.blocks = (parent->children.size + pw.blockNodes - 1) / pw.blockNodes;
+        pw.window = (size_t) threads * LXML_PARALLEL_WINDOW;
+        pw.slots = calloc(pw.window, sizeof(struct XMLWriter));
+        pw.ready = calloc(pw.window, sizeof(int));
+
+        writer.fp = fp;
+        writer.capacity = LXML_WRITE_BUFFER_SIZE;
+        writer.buf = malloc(writer.capacity);
+        writer.indent = indent;
+
+        /* The children of 'parent' are written one level below each tagged element around them */
+        for (chain[0] = doc->root, i = 1; i <= depth; ++i)
+            chain[i] = chain[i - 1]->children.data[0];
+        for (i = 0; i <= depth; ++i)
+            pw.times += (NULL != chain[i]->tag) ? 1 : 0;
+
+        for (i = 0; NULL != pw.slots && i < pw.window && FALSE == pw.error; ++i) {
+            pw.slots[i].capacity = LXML_WRITE_BUFFER_SIZE;
+            pw.slots[i].buf = malloc(LXML_WRITE_BUFFER_SIZE);
+            pw.error = (NULL == pw.slots[i].buf) ? TRUE : FALSE;
         }
 
-        while (self->size >= self->heapSize) {
-            self->heapSize *= 2; /* FIXME: Handle 'realloc' Out of Memory Errors */
-            self->attribute = realloc(self->attribute, sizeof(struct XMLAttribute*) * self->heapSize);
-            memset(self->attribute + self->size, '\0', (sizeof(struct XMLAttribute*) * (self->heapSize - self->size)));
-        }
+        if (NULL != pw.slots && NULL != pw.ready && NULL != writer.buf && FALSE == pw.error
+            && 0 == pthread_mutex_init(&pw.lock, NULL)) {
+            if (0 == pthread_cond_init(&pw.cond, NULL)) {
+                for (; started < threads; ++started)
+                    if (0 != pthread_create(&workers[started], NULL, lxmlParallelWriterRun, &pw))
+                        break;
 
-        if (NULL != self->attribute) {
-            self->attribute[self->size] = XMLAttribute_init(attr.key, attr.value);
+                if (0 != started) {
+                    lxmlWriteDeclaration(&writer, doc);
+                    for (i = 0; i <= depth; ++i)
+                        lxmlWriteNodeEnter(&writer, chain[i], i);
 
-            if (NULL != self->attribute[self->size]) {
-                ++self->size;
-                success = TRUE;
+                    lxmlParallelWriterOutput(&pw, &writer);
+
+                    for (i = 0; (int) i < started; ++i)
+                        pthread_join(workers[i], NULL);
+
+                    /* Closed from the inside out */
+                    for (i = depth + 1; i > 0; --i)
+                        lxmlWriteNodeLeave(&writer, chain[i - 1], i - 1);
+
+                    success = (FALSE == pw.error && TRUE == lxmlWriterFlush(&writer)) ? TRUE : FALSE;
+                }
+
+                pthread_cond_destroy(&pw.cond);
             }
+
+            pthread_mutex_destroy(&pw.lock);
         }
+
+        for (i = 0; NULL != pw.slots && i < pw.window; ++i)
+            free(pw.slots[i].buf);
+
+        free(pw.slots);
+        free(pw.ready);
+        free(writer.buf);
     }
 
+    free(workers);
+    free(chain);
+#else
+    (void) threads;
+#endif
+
+    /* Nothing to split or no threads */
+    if (0 == started)
+        success = XMLDocument_write(doc, fp, indent);
+
     return success;
-} /* End of XMLAttributeList_add */
+} /* End of XMLDocument_writeParallel */
 
 /**
- * @brief Frees the given 'XMLAttributeList'
+ * @brief Saves 'doc' to 'path' as a binary snapshot, which 'XMLDocument_openBinary'
+ *        maps and reads without parsing, see 'struct XMLSnapshot' for the format
  *
- * @param self - The 'XMLAttributeList' to free
+ * @param  doc     - The document to save
+ * @param  path    - The path to write out to
+ * @return success - A flag indicating the status of the subroutine
  */
-static void XMLAttributeList_free(struct XMLAttributeList *self) {
-    if (NULL != self) {
-        size_t i = 0;
-        for (;i < self->size; ++i)
-            self->attribute[i]->free(self->attribute[i]);
+int XMLDocument_saveBinary(struct XMLDocument *doc, const char *path) {
+    int success = FALSE;
+    char *out = NULL;
+    size_t len = 0;
 
-        for (i = 0; i < self->heapSize; ++i) {
-            free(self->attribute[i]);
-            self->attribute[i] = NULL;
-        }
+    if (NULL != path && TRUE == XMLDocument_saveBinaryToBuffer(doc, &out, &len)) {
+        FILE *fp = fopen(path, "wb");
 
-        free(self->attribute);
-        self->attribute = NULL;
+        if (NULL != fp) {
+            success = (len == fwrite(out, 1, len, fp)) ? TRUE : FALSE;
 
-        memset(self, '\0', sizeof(struct XMLAttributeList));
+            if (0 != fclose(fp))
+                success = FALSE;
+
+            if (FALSE == success)
+                fprintf(stderr, "Could not write file '%s'\n", path);
+        } else
+            fprintf(stderr, "Could not open file '%s'\n", path);
     }
-} /* End of XMLAttributeList_free */
+
+    free(out);
+    out = NULL;
+
+    return success;
+} /* End of XMLDocument_saveBinary */
 
 /**
- * @brief Obtains the associated 'XMLAttribute' given the 'key'
+ * @brief Saves 'doc' as a binary snapshot into a single allocation
+ *        The snapshot can be opened in place with 'XMLSnapshot_openBuffer'
  *
- * @param self - A reference to the 'XMLAttributeList' to search through
- * @param key - The value to search for
- * @return retAttr - The 'XMLAttribute' containing the associated 'key'
+ * @param  doc     - The document to save
+ * @param  out     - Set to the 'malloc' snapshot, which the caller must 'free', or 'NULL' on failure
+ * @param  len     - Set to the number of bytes in 'out'
+ * @return success - A flag indicating the status of the subroutine
  */
-static struct XMLAttribute* XMLAttributeList_getAttribute(struct XMLAttributeList *self, char *key) {
-    struct XMLAttribute *retAttr = NULL;
+int XMLDocument_saveBinaryToBuffer(struct XMLDocument *doc, char **out, size_t *len) {
+    struct XMLSnapshotWriter writer;
+    size_t version = 0, encoding = 0;
+
+    memset(&writer, '\0', sizeof(struct XMLSnapshotWriter));
+    *out = NULL;
+    *len = 0;
+
+    lxmlSnapshotReserve(&writer, LXML_SNAPSHOT_HEADER_SIZE);
+    if (NULL != doc->version)
+        version = lxmlSnapshotPutString(&writer, doc->version, strlen(doc->version), FALSE);
+    if (NULL != doc->encoding)
+        encoding = lxmlSnapshotPutString(&writer, doc->encoding, strlen(doc->encoding), FALSE);
+    if (FALSE == writer.error && NULL != doc->root)
+        XMLNode_walk(doc->root, lxmlSnapshotWriteEnter, NULL, &writer);
+
+    if (FALSE == writer.error) {
+        memcpy(writer.buf, LXML_SNAPSHOT_MAGIC, 8);
+        lxmlSnapshotPut32(writer.buf + 8, LXML_SNAPSHOT_VERSION);
+        lxmlSnapshotPut32(writer.buf + 12, writer.size);
+        lxmlSnapshotPut32(writer.buf + 16, (NULL != doc->root) ? writer.frames[0].node : 0);
+        lxmlSnapshotPut32(writer.buf + 20, version);
+        lxmlSnapshotPut32(writer.buf + 24, encoding);
+        lxmlSnapshotPut32(writer.buf + 28, writer.nodes);
+
+        *out = (char*) writer.buf;
+        *len = writer.size;
+        writer.buf = NULL;
+    }
 
-    if (NULL != self && NULL != key) {
-        size_t i = 0;
-        for (; i < self->size; ++i) {
-            struct XMLAttribute *attr = self->attribute[i];
+    free(writer.buf);
+    free(writer.names);
+    free(writer.frames);
 
-            if (NULL != attr) {
-                if (0 == strcmp(attr->key, key)) {
-                    retAttr = attr;
-                    break;
-                }
+    return (NULL != *out) ? TRUE : FALSE;
+} /* End of XMLDocument_saveBinaryToBuffer */
+
+/**
+ * @brief Opens a snapshot saved by 'XMLDocument_saveBinary' without parsing it
+ *        On POSIX systems the file is mapped read-only, so only the pages which
+ *        are read are loaded, otherwise it is read into memory
+ *
+ * @param  path     - The path of the snapshot
+ * @return snapshot - The 'XMLSnapshot', released by 'XMLSnapshot_free', or 'NULL' when it
+ *                    cannot be read or is not a snapshot of this version
+ */
+struct XMLSnapshot* XMLDocument_openBinary(const char *path) {
+    struct XMLSnapshot *snapshot = NULL;
+
+    if (NULL != path) {
+#ifdef LXML_HAVE_POSIX
+        int fd = open(path, O_RDONLY);
+
+        if (-1 != fd) {
+            struct stat st;
+            void *map = MAP_FAILED;
+            size_t len = 0;
+
+            if (0 == fstat(fd, &st) && S_ISREG(st.st_mode) && LXML_SNAPSHOT_HEADER_SIZE <= st.st_size && LXML_SNAPSHOT_MAX_SIZE >= (size_t) st.st_size) {
+                len = (size_t) st.st_size;
+                map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
             }
-        }
+
+            if (MAP_FAILED != map) {
+                snapshot = XMLSnapshot_openBuffer(map, len);
+
+                if (NULL != snapshot)
+                    snapshot->mapped = TRUE;
+                else
+                    munmap(map, len);
+            } else
+                fprintf(stderr, "Could not map file '%s'\n", path);
+
+            close(fd);
+        } else
+            fprintf(stderr, "Could not open file '%s'\n", path);
+#else
+        FILE *fp = fopen(path, "rb");
+
+        if (NULL != fp) {
+            lxmlFileOffset end = (0 == lxmlFseek(fp, 0, SEEK_END)) ? lxmlFtell(fp) : -1;
+            char *buf = NULL;
+
+            if (LXML_SNAPSHOT_HEADER_SIZE <= end && LXML_SNAPSHOT_MAX_SIZE >= (size_t) end && 0 == lxmlFseek(fp, 0, SEEK_SET)
+                && NULL != (buf = malloc((size_t) end)) && (size_t) end == fread(buf, 1, (size_t) end, fp))
+                snapshot = XMLSnapshot_openBuffer(buf, (size_t) end);
+            else
+                fprintf(stderr, "Could not read file '%s'\n", path);
+
+            if (NULL != snapshot)
+                snapshot->owned = TRUE;
+            else
+                free(buf);
+
+            fclose(fp);
+            fp = NULL;
+        } else
+            fprintf(stderr, "Could not open file '%s'\n", path);
+#endif
     }
 
-    return retAttr;
-} /* End of XMLAttributeList_getAttribute */
+    return snapshot;
+} /* End of XMLDocument_openBinary */
 
 /**
- * @brief Obtains the associated 'value' given the 'key' from the 'XMLAttributeList'
+ * @brief Opens the snapshot held in the first 'len' bytes of 'buf' in place
+ *        Only the header is checked here, the nodes are checked as they are read
+ *        **Note:** 'buf' is not copied and must outlive the snapshot
  *
- * @param self - A reference to the 'XMLAttributeList' to search from
- * @param key - A string containing the value to search for
- * @return attrVal - The associated attribute value from the 'XMLAttributeList'
+ * @param  buf      - The snapshot, e.g. from 'XMLDocument_saveBinaryToBuffer'
+ * @param  len      - The number of bytes in 'buf'
+ * @return snapshot - The 'XMLSnapshot', released by 'XMLSnapshot_free', or 'NULL' when
+ *                    'buf' is not a snapshot of this version
  */
-static char* XMLAttributeList_getAttributeValue(struct XMLAttributeList *self, char *key) {
-    char *attrVal = NULL;
+struct XMLSnapshot* XMLSnapshot_openBuffer(const void *buf, size_t len) {
+    const unsigned char *data = buf;
+    struct XMLSnapshot *snapshot = NULL;
+
+    if (NULL != data && LXML_SNAPSHOT_HEADER_SIZE <= len && 0 == memcmp(data, LXML_SNAPSHOT_MAGIC, 8)
+        && LXML_SNAPSHOT_VERSION == lxmlSnapshotGet32(data + 8) && len == lxmlSnapshotGet32(data + 12)) {
+        snapshot = calloc(1, sizeof(struct XMLSnapshot));
+
+        if (NULL != snapshot) {
+            size_t attrs = 0, children = 0, versionLen = 0, encodingLen = 0;
+
+            snapshot->data = data;
+            snapshot->size = len;
+            snapshot->root = lxmlSnapshotGet32(data + 16);
+            snapshot->nodes = lxmlSnapshotGet32(data + 28);
+            snapshot->version = lxmlSnapshotString(snapshot, lxmlSnapshotGet32(data + 20), &versionLen);
+            snapshot->encoding = lxmlSnapshotString(snapshot, lxmlSnapshotGet32(data + 24), &encodingLen);
+
+            if ((0 != snapshot->root && NULL == lxmlSnapshotNode(snapshot, snapshot->root, &attrs, &children))
+                || (NULL == snapshot->version && 0 != lxmlSnapshotGet32(data + 20))
+                || (NULL == snapshot->encoding && 0 != lxmlSnapshotGet32(data + 24))) {
+                fprintf(stderr, "Invalid snapshot\n");
+                free(snapshot);
+                snapshot = NULL;
+            }
+        } else
+            fprintf(stderr, "Out of memory\n");
+    } else
+        fprintf(stderr, "Not a snapshot of version %d\n", LXML_SNAPSHOT_VERSION);
 
-    if (NULL != self && NULL != key) {
-        size_t i = 0;
-        for (; i < self->size; ++i) {
-            struct XMLAttribute *attr = self->attribute[i];
+    return snapshot;
+} /* End of XMLSnapshot_openBuffer */
 
-            if (NULL != attr && NULL != attr->key) {
-                if (0 == strcmp(attr->key, key)) {
-                    attrVal = lxmlStrdup(attr->value);
-                    break;
+/**
+ * @brief Rebuilds a normal 'XMLDocument' from 'snapshot'
+ *        The nodes are handed to the same callbacks the parser uses, so the flags mean the same
+ *        as for 'XMLDocument_loadBufferWithFlags' but no text has to be tokenized
+ *        **Note:** With 'LXML_LOAD_IN_SITU' the strings point into the snapshot, which must outlive the document
+ *
+ * @param  snapshot - The snapshot to rebuild
+ * @param  flags    - 'LXML_LOAD_*' flags, 'LXML_LOAD_PARALLEL' is ignored
+ * @return doc      - The 'XMLDocument', check 'doc.success' for the status
+ */
+struct XMLDocument XMLSnapshot_toDocument(const struct XMLSnapshot *snapshot, int flags) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+    struct XMLParser *parser = (NULL != snapshot) ? XMLParser_createWithFlags(flags) : NULL;
+
+    if (NULL != parser) {
+        struct XMLSnapshotFrame *frames = NULL;
+        size_t depth = 0, heapSize = LXML_WALK_STACK_SIZE, visited = 1;
+        int success = TRUE;
+
+        /* The strings were decoded when the document was saved */
+        parser->inSitu = (LXML_LOAD_IN_SITU == (flags & LXML_LOAD_IN_SITU)) ? TRUE : FALSE;
+        parser->raw = TRUE;
+
+        if (NULL != snapshot->version || NULL != snapshot->encoding)
+            success = lxmlDomDeclaration(parser, snapshot->version, lxmlViewLen(snapshot->version, 0), snapshot->encoding, lxmlViewLen(snapshot->encoding, 0));
+
+        if (TRUE == success && 0 != snapshot->root) {
+            frames = malloc(sizeof(struct XMLSnapshotFrame) * heapSize);
+
+            if (NULL != frames) {
+                frames[0].node = snapshot->root;
+                success = lxmlSnapshotReplay(snapshot, parser, &frames[0], TRUE);
+                depth = 1;
+            } else {
+                fprintf(stderr, "Out of memory\n");
+                success = FALSE;
+            }
+        }
+
+        /* The children of a node always follow it and at most 'nodes' are visited, so a
+         * corrupt snapshot can neither loop nor expand a subtree shared by several parents */
+        while (TRUE == success && 0 != depth) {
+            struct XMLSnapshotFrame *frame = &frames[depth - 1];
+
+            if (frame->next < XMLSnapshot_childCount(snapshot, frame->node)) {
+                size_t child = XMLSnapshot_getChild(snapshot, frame->node, frame->next++);
+
+                if (0 == child || ++visited > snapshot->nodes) {
+                    fprintf(stderr, "Invalid snapshot\n");
+                    success = FALSE;
+                } else if (depth == heapSize) {
+                    struct XMLSnapshotFrame *tmp = realloc(frames, sizeof(struct XMLSnapshotFrame) * heapSize * 2);
+
+                    if (NULL != tmp) {
+                        frames = tmp;
+                        heapSize *= 2;
+                    } else {
+                        fprintf(stderr, "Out of memory\n");
+                        success = FALSE;
+                    }
+                }
+
+                if (TRUE == success) {
+                    frames[depth].node = child;
+                    success = lxmlSnapshotReplay(snapshot, parser, &frames[depth], FALSE);
+                    ++depth;
                 }
+            } else {
+                if (TRUE == frame->started)
+                    success = lxmlDomEndElement(parser, NULL, 0);
+                --depth;
             }
         }
+
+        if (FALSE == success)
+            parser->tokenizer.error = TRUE;
+
+        doc = XMLParser_finish(parser);
+        parser = NULL;
+
+        free(frames);
+        frames = NULL;
+    }
+
+    return doc;
+} /* End of XMLSnapshot_toDocument */
+
+/**
+ * @brief Obtains the tag of a node of 'snapshot'
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node, e.g. 'snapshot->root' or a child of it
+ * @param  len      - Optionally set to the length of the tag
+ * @return tag      - The NUL terminated tag within the snapshot, 'NULL' without one
+ */
+const char* XMLSnapshot_getTag(const struct XMLSnapshot *snapshot, size_t node, size_t *len) {
+    size_t attrs = 0, children = 0, tagLen = 0;
+    const unsigned char *record = lxmlSnapshotNode(snapshot, node, &attrs, &children);
+    const char *tag = (NULL != record) ? lxmlSnapshotString(snapshot, lxmlSnapshotGet32(record), &tagLen) : NULL;
+
+    if (NULL != len)
+        *len = tagLen;
+
+    return tag;
+} /* End of XMLSnapshot_getTag */
+
+/**
+ * @brief Obtains the inner text of a node of 'snapshot'
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @param  len      - Optionally set to the length of the text
+ * @return text     - The NUL terminated text within the snapshot, 'NULL' without any
+ */
+const char* XMLSnapshot_getInnerText(const struct XMLSnapshot *snapshot, size_t node, size_t *len) {
+    size_t attrs = 0, children = 0, textLen = 0;
+    const unsigned char *record = lxmlSnapshotNode(snapshot, node, &attrs, &children);
+    const char *text = (NULL != record) ? lxmlSnapshotString(snapshot, lxmlSnapshotGet32(record + 4), &textLen) : NULL;
+
+    if (NULL != len)
+        *len = textLen;
+
+    return text;
+} /* End of XMLSnapshot_getInnerText */
+
+/**
+ * @brief Obtains the parent of a node of 'snapshot'
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @return parent   - The parent node, 0 for 'snapshot->root' or an invalid 'node'
+ */
+size_t XMLSnapshot_getParent(const struct XMLSnapshot *snapshot, size_t node) {
+    size_t attrs = 0, children = 0;
+    const unsigned char *record = lxmlSnapshotNode(snapshot, node, &attrs, &children);
+
+    return (NULL != record) ? lxmlSnapshotGet32(record + 8) : 0;
+} /* End of XMLSnapshot_getParent */
+
+/**
+ * @brief Obtains the number of children of a node of 'snapshot'
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @return size     - The number of children, 0 for an invalid 'node'
+ */
+size_t XMLSnapshot_childCount(const struct XMLSnapshot *snapshot, size_t node) {
+    size_t attrs = 0, children = 0;
+
+    return (NULL != lxmlSnapshotNode(snapshot, node, &attrs, &children)) ? children : 0;
+} /* End of XMLSnapshot_childCount */
+
+/**
+ * @brief Obtains the 'i'th child of a node of 'snapshot'
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @param  i        - The position of the child
+ * @return child    - The child node, 0 when out of range or invalid
+ */
+size_t XMLSnapshot_getChild(const struct XMLSnapshot *snapshot, size_t node, size_t i) {
+    size_t attrs = 0, children = 0, child = 0;
+    const unsigned char *record = lxmlSnapshotNode(snapshot, node, &attrs, &children);
+
+    if (NULL != record && i < children)
+        child = lxmlSnapshotGet32(record + LXML_SNAPSHOT_NODE_SIZE + 8 * attrs + 4 * i);
+
+    /* Children follow their parent, anything else is corrupt */
+    return (child > node) ? child : 0;
+} /* End of XMLSnapshot_getChild */
+
+/**
+ * @brief Obtains the first child of a node of 'snapshot' with the given tag
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @param  tagName  - The tag to look for
+ * @return child    - The first matching child, 0 when there is none
+ */
+size_t XMLSnapshot_getImmediateElementByTagName(const struct XMLSnapshot *snapshot, size_t node, const char *tagName) {
+    size_t size = XMLSnapshot_childCount(snapshot, node), len = (NULL != tagName) ? strlen(tagName) : 0, found = 0, i = 0;
+
+    for (; NULL != tagName && 0 == found && i < size; ++i) {
+        size_t child = XMLSnapshot_getChild(snapshot, node, i), tagLen = 0;
+        const char *tag = XMLSnapshot_getTag(snapshot, child, &tagLen);
+
+        if (NULL != tag && len == tagLen && 0 == memcmp(tag, tagName, len))
+            found = child;
+    }
+
+    return found;
+} /* End of XMLSnapshot_getImmediateElementByTagName */
+
+/**
+ * @brief Obtains the number of attributes of a node of 'snapshot'
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @return size     - The number of attributes, 0 for an invalid 'node'
+ */
+size_t XMLSnapshot_attributeCount(const struct XMLSnapshot *snapshot, size_t node) {
+    size_t attrs = 0, children = 0;
+
+    return (NULL != lxmlSnapshotNode(snapshot, node, &attrs, &children)) ? attrs : 0;
+} /* End of XMLSnapshot_attributeCount */
+
+/**
+ * @brief Obtains the 'i'th attribute of a node of 'snapshot'
+ *        The key and value are NUL terminated strings within the snapshot
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @param  i        - The position of the attribute
+ * @param  key      - Set to the key, 'NULL' if the attribute has none
+ * @param  keyLen   - Set to the length of 'key'
+ * @param  value    - Set to the value, 'NULL' if the attribute has none
+ * @param  valueLen - Set to the length of 'value'
+ * @return success  - 'FALSE' when 'i' is out of range or the attribute is invalid
+ */
+int XMLSnapshot_getAttribute(const struct XMLSnapshot *snapshot, size_t node, size_t i, const char **key, size_t *keyLen, const char **value, size_t *valueLen) {
+    size_t attrs = 0, children = 0;
+    const unsigned char *record = lxmlSnapshotNode(snapshot, node, &attrs, &children);
+    int success = FALSE;
+
+    *key = *value = NULL;
+    *keyLen = *valueLen = 0;
+
+    if (NULL != record && i < attrs) {
+        size_t keyOffset = lxmlSnapshotGet32(record + LXML_SNAPSHOT_NODE_SIZE + 8 * i);
+        size_t valueOffset = lxmlSnapshotGet32(record + LXML_SNAPSHOT_NODE_SIZE + 8 * i + 4);
+
+        *key = lxmlSnapshotString(snapshot, keyOffset, keyLen);
+        *value = lxmlSnapshotString(snapshot, valueOffset, valueLen);
+
+        success = ((0 == keyOffset || NULL != *key) && (0 == valueOffset || NULL != *value)) ? TRUE : FALSE;
+    }
+
+    return success;
+} /* End of XMLSnapshot_getAttribute */
+
+/**
+ * @brief Obtains the value of the first attribute of a node of 'snapshot' with the given key
+ *
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The node
+ * @param  key      - The key to look for
+ * @param  len      - Optionally set to the length of the value
+ * @return value    - The NUL terminated value within the snapshot, 'NULL' when there is none
+ */
+const char* XMLSnapshot_getAttributeValue(const struct XMLSnapshot *snapshot, size_t node, const char *key, size_t *len) {
+    size_t size = XMLSnapshot_attributeCount(snapshot, node), keyLen = (NULL != key) ? strlen(key) : 0, valueLen = 0, i = 0;
+    const char *value = NULL;
+    int found = FALSE;
+
+    for (; NULL != key && FALSE == found && i < size; ++i) {
+        const char *attrKey = NULL, *attrValue = NULL;
+        size_t attrKeyLen = 0, attrValueLen = 0;
+
+        if (TRUE == XMLSnapshot_getAttribute(snapshot, node, i, &attrKey, &attrKeyLen, &attrValue, &attrValueLen)
+            && NULL != attrKey && keyLen == attrKeyLen && 0 == memcmp(attrKey, key, keyLen)) {
+            value = attrValue;
+            valueLen = attrValueLen;
+            found = TRUE;
+        }
+    }
+
+    if (NULL != len)
+        *len = valueLen;
+
+    return value;
+} /* End of XMLSnapshot_getAttributeValue */
+
+/**
+ * @brief Releases 'snapshot' along with the mapping or buffer 'XMLDocument_openBinary' read it into
+ *        **Note:** Documents rebuilt with 'LXML_LOAD_IN_SITU' must be freed first
+ *
+ * @param snapshot - The 'XMLSnapshot' to free
+ */
+void XMLSnapshot_free(struct XMLSnapshot *snapshot) {
+    if (NULL != snapshot) {
+#ifdef LXML_HAVE_POSIX
+        if (TRUE == snapshot->mapped)
+            munmap((void*) snapshot->data, snapshot->size);
+#endif
+        if (TRUE == snapshot->owned)
+            free((void*) snapshot->data);
+
+        free(snapshot);
+        snapshot = NULL;
+    }
+} /* End of XMLSnapshot_free */
+
+/**
+ * @brief Creates a reader which pulls the document from 'fp' a window at a time
+ *        Memory does not grow with the document, only with its depth and longest tag
+ *        **Note:** 'fp' is not closed by 'XMLReader_free'
+ *
+ * @param  fp     - The file pointer to read from
+ * @return reader - A 'malloc' 'XMLReader' or 'NULL' when out of memory
+ */
+struct XMLReader* XMLReader_open(FILE *fp) {
+    struct XMLReader *reader = (NULL != fp) ? lxmlReaderCreate(NULL, 0) : NULL;
+
+    if (NULL != reader) {
+        reader->fp = fp;
+        reader->eof = FALSE;
+        reader->window = malloc(LXML_READER_BUFFER_SIZE);
+        reader->buf = reader->window;
+        reader->capacity = LXML_READER_BUFFER_SIZE;
+
+        if (NULL == reader->window) {
+            fprintf(stderr, "Out of memory\n");
+            free(reader);
+            reader = NULL;
+        }
+    }
+
+    return reader;
+} /* End of XMLReader_open */
+
+/**
+ * @brief Creates a reader which pulls the document from the first 'len' bytes of 'buf'
+ *        **Note:** 'buf' must outlive the reader, nothing is copied
+ *
+ * @param  buf    - The XML contents to read, this does not need to be NUL terminated
+ * @param  len    - The number of bytes in 'buf'
+ * @return reader - A 'malloc' 'XMLReader' or 'NULL' when out of memory
+ */
+struct XMLReader* XMLReader_openBuffer(const char *buf, size_t len) {
+    return (NULL != buf || 0 == len) ? lxmlReaderCreate(buf, len) : NULL;
+} /* End of XMLReader_openBuffer */
+
+/**
+ * @brief Advances 'reader' to the next part of the document
+ *        Names, attributes and text are views into the input which stay valid until the next call
+ *        A self-closing element is returned as a start followed by an end, CDATA sections as text
+ *        and the declaration's version and encoding are read with 'XMLReader_nextAttribute'
+ *        **Note:** From a stream, text and comments longer than the window come in several pieces
+ *
+ * @param  reader - The 'XMLReader' to advance
+ * @return event  - What was found, 'LXML_READER_DONE' at the end of a well formed document and
+ *                  'LXML_READER_ERROR' once it is known to be malformed, both of which are then repeated
+ */
+enum XMLReaderEvent XMLReader_next(struct XMLReader *reader) {
+    enum XMLReaderEvent event = LXML_READER_ERROR;
+
+    if (NULL != reader) {
+        if (TRUE == reader->pendingEnd) {
+            /* The name of the element is still in the window */
+            reader->pendingEnd = FALSE;
+            event = LXML_READER_END;
+        } else
+            event = lxmlReaderRead(reader);
+
+        if (LXML_READER_START == event && TRUE == reader->token.selfClosing)
+            reader->pendingEnd = TRUE;
+
+        /* Open elements are counted by the tokenizer, which has already pushed a start tag */
+        reader->depth = reader->tokenizer.depth;
+        if (LXML_READER_START == event && FALSE == reader->token.selfClosing)
+            --reader->depth;
+
+        reader->event = event;
+        reader->attr = 0;
+
+        if (NULL != reader->decoded)
+            lxmlArenaReset(reader->decoded);
+    }
+
+    return event;
+} /* End of XMLReader_next */
+
+/**
+ * @brief Moves 'reader' past the end of the element whose start it just returned,
+ *        as if that end had been returned. The content is only scanned for markup and
+ *        the tags within it counted, it is not tokenized or checked beyond being balanced
+ *
+ * @param  reader  - The 'XMLReader' positioned on a 'LXML_READER_START'
+ * @return success - 'FALSE' when 'reader' is not on a start or the document ends first
+ */
+int XMLReader_skipSubtree(struct XMLReader *reader) {
+    int success = FALSE;
+
+    if (NULL != reader && LXML_READER_START == reader->event) {
+        if (TRUE == reader->pendingEnd) {
+            reader->pendingEnd = FALSE;
+            success = TRUE;
+        } else if (TRUE == (success = lxmlReaderSkip(reader))) {
+            /* The popped name stays in the tokenizer until the next start tag */
+            reader->token.data = lxmlTokenizerTopName(&reader->tokenizer, &reader->token.dataLen);
+            lxmlTokenizerPopName(&reader->tokenizer, reader->token.data, reader->token.dataLen);
+            reader->depth = reader->tokenizer.depth;
+        }
+
+        reader->event = (TRUE == success) ? LXML_READER_END : LXML_READER_ERROR;
+        reader->attr = 0;
+    }
+
+    return success;
+} /* End of XMLReader_skipSubtree */
+
+/**
+ * @brief Obtains the name of the element 'reader' is on
+ *
+ * @param  reader - The 'XMLReader' to read from
+ * @param  len    - Set to the number of bytes in the name when not 'NULL'
+ * @return name   - A view of the name, 'NULL' unless on a 'LXML_READER_START' or 'LXML_READER_END'
+ */
+const char* XMLReader_getName(const struct XMLReader *reader, size_t *len) {
+    const char *name = NULL;
+
+    if (NULL != reader && (LXML_READER_START == reader->event || LXML_READER_END == reader->event))
+        name = reader->token.data;
+
+    if (NULL != len)
+        *len = (NULL != name) ? reader->token.dataLen : 0;
+
+    return name;
+} /* End of XMLReader_getName */
+
+/**
+ * @brief Obtains the text or comment 'reader' is on
+ *        References in text outside CDATA sections are decoded as 'XMLDocument_load' does
+ *
+ * @param  reader - The 'XMLReader' to read from
+ * @param  len    - Set to the number of bytes in the text when not 'NULL'
+ * @return text   - A view of the text, valid until the next 'XMLReader_next', or 'NULL'
+ *                  unless on a 'LXML_READER_TEXT' or 'LXML_READER_COMMENT'
+ */
+const char* XMLReader_getText(struct XMLReader *reader, size_t *len) {
+    const char *text = NULL;
+    size_t textLen = 0;
+
+    if (NULL != reader && (LXML_READER_TEXT == reader->event || LXML_READER_COMMENT == reader->event)) {
+        text = reader->token.data;
+        textLen = reader->token.dataLen;
+
+        if (LXML_READER_TEXT == reader->event && FALSE == reader->token.cdata)
+            text = lxmlReaderDecode(reader, text, &textLen);
+    }
+
+    if (NULL != len)
+        *len = (NULL != text) ? textLen : 0;
+
+    return text;
+} /* End of XMLReader_getText */
+
+/**
+ * @brief Obtains the next attribute of the start tag or declaration 'reader' is on
+ *
+ * @param  reader   - The 'XMLReader' to read from
+ * @param  key      - Set to a view of the key
+ * @param  keyLen   - Set to the number of bytes in the key
+ * @param  value    - Set to a view of the value without its quotes and with its references decoded,
+ *                    valid until the next 'XMLReader_next'
+ * @param  valueLen - Set to the number of bytes in the value
+ * @return found    - 1 when an attribute was found, otherwise 0
+ */
+int XMLReader_nextAttribute(struct XMLReader *reader, const char **key, size_t *keyLen, const char **value, size_t *valueLen) {
+    int found = 0;
+
+    /* The attributes were checked when the tag was read, so this cannot fail */
+    if (NULL != reader && NULL != key && NULL != keyLen && NULL != value && NULL != valueLen
+        && (LXML_READER_START == reader->event || LXML_READER_DECLARATION == reader->event))
+        found = lxmlNextAttribute(reader->token.attrs, reader->token.attrsLen, &reader->attr, key, keyLen, value, valueLen);
+
+    if (1 == found && NULL == (*value = lxmlReaderDecode(reader, *value, valueLen)))
+        found = 0;
+
+    return (1 == found) ? 1 : 0;
+} /* End of XMLReader_nextAttribute */
+
+/**
+ * @brief Obtains the value of the attribute 'key' of the start tag or declaration 'reader' is on
+ *
+ * @param  reader - The 'XMLReader' to read from
+ * @param  key    - The key to search for
+ * @param  len    - Set to the number of bytes in the value when not 'NULL'
+ * @return value  - A view of the value with its references decoded, valid until the next
+ *                  'XMLReader_next', or 'NULL' if not present
+ */
+const char* XMLReader_getAttributeValue(struct XMLReader *reader, const char *key, size_t *len) {
+    const char *value = NULL, *attrKey = NULL, *attrValue = NULL;
+    size_t keyLen = 0, valueLen = 0, i = 0;
+
+    if (NULL != reader && NULL != key && (LXML_READER_START == reader->event || LXML_READER_DECLARATION == reader->event)) {
+        while (NULL == value && 1 == lxmlNextAttribute(reader->token.attrs, reader->token.attrsLen, &i, &attrKey, &keyLen, &attrValue, &valueLen))
+            if (TRUE == lxmlViewEquals(attrKey, keyLen, key))
+                value = lxmlReaderDecode(reader, attrValue, &valueLen);
+    }
+
+    if (NULL != len)
+        *len = (NULL != value) ? valueLen : 0;
+
+    return value;
+} /* End of XMLReader_getAttributeValue */
+
+/**
+ * @brief Obtains the number of elements around the part of the document 'reader' is on
+ *        The root element is at depth 0 and its text and children at depth 1
+ *
+ * @param  reader - The 'XMLReader' to read from
+ * @return depth  - The number of enclosing elements
+ */
+size_t XMLReader_depth(const struct XMLReader *reader) {
+    return (NULL != reader) ? reader->depth : 0;
+} /* End of XMLReader_depth */
+
+/**
+ * @brief Releases 'reader', but not the buffer or stream it reads from
+ *
+ * @param reader - The 'XMLReader' to free
+ */
+void XMLReader_free(struct XMLReader *reader) {
+    if (NULL != reader) {
+        free(reader->tokenizer.names);
+        free(reader->window);
+        lxmlArenaFree(reader->decoded);
+        free(reader);
+        reader = NULL;
+    }
+} /* End of XMLReader_free */
+
+/**
+ * @brief Reads 'fp' through an 'XMLReader', building each element named 'tagName' as an
+ *        'XMLNode' subtree which is passed to 'callback' and released once it returns
+ *        Everything outside those elements is checked but not built, and an element named
+ *        'tagName' inside another is part of the outer subtree
+ *        **Note:** Only one element is held at a time, its nodes are allocated from one
+ *        arena which is recycled for the next, so nothing of it may be kept after 'callback'
+ *
+ * @param  fp       - The stream to read, which is not closed
+ * @param  tagName  - The NUL terminated tag of the elements to build
+ * @param  callback - Receives each element, returning 'FALSE' stops the stream
+ * @param  ctx      - Passed as the first argument of 'callback'
+ * @return success  - 'FALSE' if the document is malformed or 'callback' stopped the stream
+ *                    the elements before the error have still been passed to 'callback'
+ */
+int XMLDocument_streamElements(FILE *fp, const char *tagName, int (*callback)(void *ctx, struct XMLNode *node), void *ctx) {
+    struct XMLReader *reader = (NULL != tagName && NULL != callback) ? XMLReader_open(fp) : NULL;
+    size_t tagLen = (NULL != tagName) ? strlen(tagName) : 0, depth = 0, len = 0;
+    const char *name = NULL, *key = NULL, *value = NULL;
+    size_t keyLen = 0, valueLen = 0;
+    enum XMLReaderEvent event = LXML_READER_ERROR;
+    int success = FALSE, building = FALSE;
+    struct XMLParser parser;
+
+    if (NULL != reader) {
+        lxmlParserInit(&parser, &lxmlDomHandler, &parser);
+        parser.doc.arena = lxmlArenaCreate();
+        parser.doc.root = parser.curr_node = lxmlArenaNode(parser.doc.arena);
+
+        /* The reader has already decoded every text and attribute value */
+        parser.raw = TRUE;
+
+        success = (NULL != parser.doc.arena && NULL != parser.doc.root) ? TRUE : FALSE;
+    }
+
+    while (TRUE == success && LXML_READER_DONE != (event = XMLReader_next(reader))) {
+        if (LXML_READER_START == event) {
+            name = XMLReader_getName(reader, &len);
+
+            if (FALSE == building && len == tagLen && 0 == memcmp(name, tagName, len)) {
+                building = TRUE;
+                depth = XMLReader_depth(reader);
+            }
+
+            if (TRUE == building)
+                success = lxmlDomStartElement(&parser, name, len);
+
+            while (TRUE == building && TRUE == success && 1 == XMLReader_nextAttribute(reader, &key, &keyLen, &value, &valueLen))
+                success = lxmlDomAttribute(&parser, key, keyLen, value, valueLen);
+        } else if (LXML_READER_END == event && TRUE == building) {
+            lxmlDomEndElement(&parser, NULL, 0);
+
+            /* The element is complete, hand it over and start the next one afresh */
+            if (depth == XMLReader_depth(reader)) {
+                success = callback(ctx, parser.doc.root->children.data[0]);
+                building = FALSE;
+
+                lxmlArenaReset(parser.doc.arena);
+                parser.doc.root = parser.curr_node = lxmlArenaNode(parser.doc.arena);
+                parser.text_node = NULL;
+
+                if (NULL == parser.doc.root)
+                    success = FALSE;
+            }
+        } else if (LXML_READER_TEXT == event && TRUE == building) {
+            name = XMLReader_getText(reader, &len);
+            success = lxmlDomText(&parser, name, len);
+        } else if (LXML_READER_COMMENT == event && TRUE == building)
+            lxmlDomComment(&parser, NULL, 0);
+        else if (LXML_READER_ERROR == event)
+            success = FALSE;
+    }
+
+    if (NULL != reader) {
+        parser.doc.free(&parser.doc);
+        XMLReader_free(reader);
+        reader = NULL;
+    }
+
+    return success;
+} /* End of XMLDocument_streamElements */
+
+/**
+ * @brief Compiles an XPath-like 'expr' into a plan which can be evaluated any number of times
+ *        Supported are the child ('/') and descendant ('//') axes, name tests and '*', a final
+ *        attribute step ('@name' or '@*') and the predicates '[n]', '[@key]' and '[@key='value']'
+ *        e.g. '/struct/field[@type='int']/@name' or '//description'
+ *
+ * @param  expr  - The NUL terminated expression to compile
+ * @return query - A new 'XMLQuery' or 'NULL' when 'expr' is malformed or out of memory
+ */
+struct XMLQuery* XMLQuery_compile(const char *expr) {
+    struct XMLArena *arena = (NULL != expr) ? lxmlArenaCreate() : NULL;
+    struct XMLQuery *query = (NULL != arena) ? lxmlArenaAlloc(arena, sizeof(struct XMLQuery)) : NULL;
+
+    if (NULL != query) {
+        size_t i = 0;
+        int success = TRUE;
+
+        memset(query, '\0', sizeof(struct XMLQuery));
+        query->arena = arena;
+        query->absolute = ('/' == expr[0]) ? TRUE : FALSE;
+
+        while (TRUE == success && '\0' != expr[i]) {
+            int descendant = FALSE;
+
+            if ('/' == expr[i] && '/' == expr[i + 1]) {
+                descendant = TRUE;
+                i += 2;
+            } else if ('/' == expr[i])
+                ++i;
+            else if (0 != query->stepCount)
+                success = FALSE;
+
+            /* Nothing may follow an attribute step */
+            if (TRUE == success && (0 == query->stepCount || FALSE == query->steps[query->stepCount - 1].attribute))
+                success = lxmlQueryParseStep(query, expr, &i, descendant);
+            else
+                success = FALSE;
+        }
+
+        if (FALSE == success || 0 == query->stepCount) {
+            fprintf(stderr, "Malformed query '%s' at %lu\n", expr, (unsigned long) i);
+            query = NULL;
+        }
+    }
+
+    if (NULL == query)
+        lxmlArenaFree(arena);
+
+    return query;
+} /* End of XMLQuery_compile */
+
+/**
+ * @brief Reports every match of 'query' below 'node' to 'callback' in document order
+ *        The query is only read, so a compiled query can be evaluated from many places at once.
+ *        Nothing is allocated unless a '//' step walks more than 'LXML_WALK_STACK_SIZE' levels deep
+ *        **Note:** A node reached through several '//' steps is reported once for each
+ *
+ * @param  query    - The 'XMLQuery' to evaluate
+ * @param  node     - The context 'XMLNode', absolute queries start from its topmost ancestor
+ * @param  callback - Invoked with each matching node and, for attribute steps, the attribute
+ *                    Returning 'FALSE' stops the evaluation, 'NULL' only counts the matches
+ * @param  ctx      - Passed as the first argument of 'callback'
+ * @return matches  - The number of matches reported, or 'LXML_QUERY_ERROR' when out of memory
+ *                    or a lazy node could not be built, after some matches may have been reported
+ */
+size_t XMLQuery_eval(const struct XMLQuery *query, struct XMLNode *node, int (*callback)(void *ctx, struct XMLNode *node, struct XMLAttribute *attr), void *ctx) {
+    struct XMLQueryEval eval;
+
+    eval.callback = callback;
+    eval.ctx = ctx;
+    eval.matches = 0;
+    eval.stopped = eval.failed = FALSE;
+
+    if (NULL != query && NULL != node) {
+        if (TRUE == query->absolute)
+            while (NULL != node->parent)
+                node = node->parent;
+
+        lxmlQueryStep(query, 0, node, &eval);
+    }
+
+    return (FALSE == eval.failed) ? eval.matches : LXML_QUERY_ERROR;
+} /* End of XMLQuery_eval */
+
+/**
+ * @brief Frees a plan returned by 'XMLQuery_compile'
+ *
+ * @param query - The 'XMLQuery' to free
+ */
+void XMLQuery_free(struct XMLQuery *query) {
+    if (NULL != query)
+        lxmlArenaFree(query->arena);
+} /* End of XMLQuery_free */
+
+/********************Public End********************/
+
+/******************Private Start*******************/
+
+/**
+ * @brief Frees the data on a given 'XMLAttribute'
+ *
+ * @param self - A reference to the 'XMLAttribute' to free
+ */
+void XMLAttribute_free(struct XMLAttribute *self) {
+    if (NULL != self) {
+        free(self->key);
+        free(self->value);
+        self->key = self->value = NULL;
+        self->keyLen = self->valueLen = 0;
+    }
+} /* End of XMLAttribute_free */
+
+/**
+ * @brief Releases an 'XMLAttribute' allocated from an arena
+ *        **Note:** The memory is only returned when the owning document is freed
+ *
+ * @param self - A reference to the 'XMLAttribute' to free
+ */
+void XMLAttribute_freeArena(struct XMLAttribute *self) {
+    if (NULL != self) {
+        self->key = self->value = NULL;
+        self->keyLen = self->valueLen = 0;
+    }
+} /* End of XMLAttribute_freeArena */
+
+/**
+ * @brief Adds a given 'XMLAttribute' to 'self'
+ *
+ * @param self - A pointer to the 'XMLAttributeList' to add the 'XMLAttribute to
+ * @param attr - The 'XMLAttribute' to add to the list
+ * @return success - A Flag indicating the status of the subroutine
+ */
+int XMLAttributeList_add(struct XMLAttributeList *self, struct XMLAttribute attr) {
+    int success = FALSE;
+
+    if (NULL != self)
+        success = XMLAttributeList_append(self, attr.key, lxmlViewLen(attr.key, attr.keyLen), attr.value, lxmlViewLen(attr.value, attr.valueLen), TRUE);
+
+    return success;
+} /* End of XMLAttributeList_add */
+
+/**
+ * @brief Adds a given 'XMLAttribute' to 'self' taking ownership of its strings
+ *        instead of copying them, they must have been allocated with 'malloc'
+ *        **Note:** Arena lists copy into the arena and free the originals
+ *
+ * @param self - A pointer to the 'XMLAttributeList' to add the 'XMLAttribute to
+ * @param attr - The 'XMLAttribute' to move into the list
+ * @return success - A Flag indicating the status of the subroutine, 'attr' is left untouched on failure
+ */
+int XMLAttributeList_take(struct XMLAttributeList *self, struct XMLAttribute attr) {
+    int success = FALSE;
+
+    if (NULL != self && NULL != self->arena)
+        success = XMLAttributeList_append(self, attr.key, lxmlViewLen(attr.key, attr.keyLen), attr.value, lxmlViewLen(attr.value, attr.valueLen), TRUE);
+    else if (NULL != self) {
+        struct XMLAttribute *slot = XMLAttributeList_reserve(self);
+
+        if (NULL != slot) {
+            *slot = attr;
+#ifndef LXML_COMPACT_NODES
+            slot->free = XMLAttribute_free;
+#endif
+            ++self->size;
+            success = TRUE;
+        }
+    }
+
+    if (TRUE == success && NULL != self->arena)
+        XMLAttribute_free(&attr);
+
+    return success;
+} /* End of XMLAttributeList_take */
+
+/**
+ * @brief Makes room for one more 'XMLAttribute' at the end of 'self'
+ *
+ * @param  self - A pointer to the 'XMLAttributeList' to grow
+ * @return slot - The uninitialised 'XMLAttribute' at 'self->size' or 'NULL' when out of memory
+ */
+static struct XMLAttribute* XMLAttributeList_reserve(struct XMLAttributeList *self) {
+    while (self->size >= self->heapSize) {
+        size_t heapSize = (0 != self->heapSize) ? self->heapSize * 2 : 1;
+        struct XMLAttribute *tmp = lxmlArenaRealloc(self->arena, self->attribute, sizeof(struct XMLAttribute) * self->heapSize, sizeof(struct XMLAttribute) * heapSize);
+
+        if (NULL == tmp)
+            break;
+
+        self->attribute = tmp;
+        self->heapSize = heapSize;
+    }
+
+    return (self->size < self->heapSize) ? &self->attribute[self->size] : NULL;
+} /* End of XMLAttributeList_reserve */
+
+/**
+ * @brief Adds the given attribute slices to 'self'
+ *        The copies come from 'self->arena' when it is set
+ *
+ * @param  self     - A pointer to the 'XMLAttributeList' to add the attribute to
+ * @param  key      - The attribute key, this does not need to be NUL terminated
+ * @param  keyLen   - The number of bytes in 'key'
+ * @param  value    - The attribute value, this does not need to be NUL terminated
+ * @param  valueLen - The number of bytes in 'value'
+ * @param  copy     - 'FALSE' to keep 'key' and 'value' as views, which requires 'self->arena'
+ * @return success  - A Flag indicating the status of the subroutine
+ */
+static int XMLAttributeList_append(struct XMLAttributeList *self, const char *key, size_t keyLen, const char *value, size_t valueLen, int copy) {
+    struct XMLAttribute *slot = XMLAttributeList_reserve(self);
+    int success = FALSE;
+
+    if (NULL != slot && TRUE == lxmlArenaAttribute(self->arena, slot, key, keyLen, value, valueLen, copy)) {
+        ++self->size;
+        success = TRUE;
+    }
+
+    return success;
+} /* End of XMLAttributeList_append */
+
+/**
+ * @brief Frees the given 'XMLAttributeList'
+ *
+ * @param self - The 'XMLAttributeList' to free
+ */
+void XMLAttributeList_free(struct XMLAttributeList *self) {
+    /* Arena lists are released with the document */
+    if (NULL != self && NULL == self->arena) {
+        size_t i = 0;
+        for (;i < self->size; ++i)
+            XMLAttribute_free(&self->attribute[i]);
+
+        lxmlIndexFree(NULL, self->index);
+        free(self->attribute);
+        self->attribute = NULL;
+    }
+
+    if (NULL != self)
+        memset(self, '\0', sizeof(struct XMLAttributeList));
+} /* End of XMLAttributeList_free */
+
+/**
+ * @brief Obtains the associated 'XMLAttribute' given the 'key'
+ *
+ * @param self - A reference to the 'XMLAttributeList' to search through
+ * @param key - The value to search for
+ * @return retAttr - The 'XMLAttribute' containing the associated 'key'
+ */
+struct XMLAttribute* XMLAttributeList_getAttribute(struct XMLAttributeList *self, char *key) {
+    struct XMLAttribute *retAttr = NULL;
+
+    if (NULL != self && NULL != key && NULL != lxmlAttributeListIndex(self, FALSE)) {
+        size_t i = lxmlIndexFind(self->index, key, strlen(key), 0, FALSE);
+
+        if (LXML_INDEX_END != i)
+            retAttr = &self->attribute[i];
+    } else if (NULL != self && NULL != key) {
+        size_t i = 0;
+        for (; i < self->size; ++i) {
+            struct XMLAttribute *attr = &self->attribute[i];
+
+            if (TRUE == lxmlViewEquals(attr->key, attr->keyLen, key)) {
+                retAttr = attr;
+                break;
+            }
+        }
+    }
+
+    return retAttr;
+} /* End of XMLAttributeList_getAttribute */
+
+/**
+ * @brief Obtains the associated 'value' given the 'key' from the 'XMLAttributeList'
+ *
+ * @param self - A reference to the 'XMLAttributeList' to search from
+ * @param key - A string containing the value to search for
+ * @return attrVal - The associated attribute value from the 'XMLAttributeList'
+ */
+char* XMLAttributeList_getAttributeValue(struct XMLAttributeList *self, char *key) {
+    char *attrVal = NULL;
+    struct XMLAttribute *attr = XMLAttributeList_getAttribute(self, key);
+
+    if (NULL != attr)
+        attrVal = lxmlStrndup(attr->value, lxmlViewLen(attr->value, attr->valueLen));
+
+    return attrVal;
+}/* End of XMLAttributeList_getAttributeValue */
+
+/**
+ * @brief Obtains the 'XMLAttribute' whose key is the interned 'name'
+ *        Keys are compared by pointer, so only documents loaded with 'LXML_LOAD_INTERN' match
+ *
+ * @param  self    - A reference to the 'XMLAttributeList' to search through
+ * @param  name    - A name returned by 'XMLNameTable_intern' or 'XMLNameTable_get'
+ * @return retAttr - The 'XMLAttribute' with the key 'name' or 'NULL' if not present
+ */
+struct XMLAttribute* XMLAttributeList_getAttributeByName(struct XMLAttributeList *self, const char *name) {
+    struct XMLAttribute *retAttr = NULL;
+
+    if (NULL != self && NULL != name && NULL != lxmlAttributeListIndex(self, FALSE)) {
+        size_t i = lxmlIndexFind(self->index, name, strlen(name), 0, FALSE);
+
+        while (LXML_INDEX_END != i && name != self->attribute[i].key)
+            i = self->index->next[i];
+
+        if (LXML_INDEX_END != i)
+            retAttr = &self->attribute[i];
+    } else if (NULL != self && NULL != name) {
+        size_t i = 0;
+
+        for (;i < self->size; ++i) {
+            if (name == self->attribute[i].key) {
+                retAttr = &self->attribute[i];
+                break;
+            }
+        }
+    }
+
+    return retAttr;
+} /* End of XMLAttributeList_getAttributeByName */
+
+/**
+ * @brief Convenience function to add an 'XMLNode' to the 'children'
+ *        **Note:** See 'XMLNodeList_add' for implementation
+ *
+ * @param self - A reference to the struct you wish to add the node to
+ * @param node - The 'XMLNode' to add to 'self'
+ * @return success - A flag indicating the status of the subroutine
+ */
+int XMLNode_add(struct XMLNode *self, struct XMLNode *node) {
+    return (NULL != self && NULL != node) ? XMLNodeList_add(&self->children, self, node) : FALSE;
+} /* End of XMLNode_add */
+
+/**
+ * @brief Convenience function to add and append 'XMLNode' to the 'children'
+ *        **Note:** See 'XMLNode_add' for implementation
+ *
+ * @param  self - A reference to the struct you wish to add the node to
+ * @return node - The new node that's been appended to the XMLNodeList
+ */
+struct XMLNode* XMLNode_createAndAppend(struct XMLNode *self) {
+    struct XMLNode *node = NULL;
+
+    if (NULL != self) {
+        node = lxmlArenaNode(self->children.arena);
+
+        if (NULL != node) {
+            int success = XMLNode_add(self, node);
+
+            if (FALSE == success) {
+                XMLNode_free(node);
+                if (NULL == self->children.arena)
+                    free(node);
+                node = NULL;
+            }
+        }
+    }
+
+    return node;
+} /* End of XMLNode_createAndAppend */
+
+/**
+ * @brief Obtains the associated 'XMLAttribute' given the 'key'
+ *        **Note:** See 'XMLAttributeList_getAttribute' for implementation
+ *
+ * @param self - A reference to the 'XMLNode' to search through
+ * @param key - The value to search for
+ * @return retAttr - The 'XMLAttribute' containing the associated 'key'
+ */
+struct XMLAttribute* XMLNode_getAttribute(struct XMLNode *self, char *key) {
+    return (NULL != self && NULL != key) ? XMLAttributeList_getAttribute(&self->attributes, key) : NULL;
+} /* End of XMLNode_getAttribute */
+
+/**
+ * @brief Obtains the associated 'value' given the 'key' from the 'XMLNode'
+ *        **Note:** See 'XMLAttributeList_getAttributeValue' for implementation
+ *
+ * @param self - A reference to the 'XMLNode' to search from
+ * @param key - A string containing the value to search for
+ * @return attrVal - The associated attribute value from the 'XMLNode'
+ */
+char* XMLNode_getAttributeValue(struct XMLNode *self, char *key) {
+    return (NULL != self && NULL != key) ? XMLAttributeList_getAttributeValue(&self->attributes, key) : NULL;
+} /* End of XMLNode_getAttributeValue */
+
+/**
+ * @brief Searches the immediate 'XMLNode' for the first child that matches the 'tagName'
+ *        *NOTE:* This returns a pointer value to the 'XMLNode' and mustn't be free'd directly
+ *
+ * @param self - A reference to the 'XMLNode' to search from
+ * @param tagName - The name of the tag to search for
+ * @return node - The found 'XMLNode' or 'NULL' if not present
+ */
+struct XMLNode* XMLNode_getImmediateElementByTagName(struct XMLNode *self, char *tagName) {
+    size_t childIndex = 0;
+
+    return XMLNode_getNextImmediateElementByTagName(self, tagName, &childIndex);
+} /* End of XMLNode_getImmediateElementByTagName */
+
+/**
+ * @brief Searches the immediate children of 'self' from position '*i' for the next that matches the 'tagName'
+ *        Start with '*i' at 0 and pass it back unchanged to visit every match in order
+ *        *NOTE:* This returns a pointer value to the 'XMLNode' and mustn't be free'd directly
+ *
+ * @param  self    - A reference to the 'XMLNode' to search from
+ * @param  tagName - The name of the tag to search for
+ * @param  i       - The position to search from, set to just after the match
+ * @return node    - The found 'XMLNode' or 'NULL' once there are no more matches
+ */
+struct XMLNode* XMLNode_getNextImmediateElementByTagName(struct XMLNode *self, char *tagName, size_t *i) {
+    struct XMLNode *node = NULL;
+
+    if (NULL != self && NULL != tagName && NULL != i && TRUE == XMLNode_expand(self) && *i < self->children.size) {
+        if (NULL != lxmlNodeListIndex(&self->children, FALSE)) {
+            struct XMLNode *prev = (0 != *i) ? self->children.data[*i - 1] : NULL;
+            int chained = (NULL != prev && TRUE == lxmlViewEquals(prev->tag, prev->tagLen, tagName)) ? TRUE : FALSE;
+            size_t childIndex = lxmlIndexFind(self->children.index, tagName, strlen(tagName), *i, chained);
+
+            if (LXML_INDEX_END != childIndex) {
+                node = self->children.data[childIndex];
+                *i = childIndex + 1;
+            }
+        } else {
+            while (*i < self->children.size && NULL == node) {
+                struct XMLNode *child = self->children.data[(*i)++];
+
+                if (TRUE == lxmlViewEquals(child->tag, child->tagLen, tagName))
+                    node = child;
+            }
+        }
+
+        if (NULL == node)
+            *i = self->children.size;
+    }
+
+    return node;
+} /* End of XMLNode_getNextImmediateElementByTagName */
+
+/**
+ * @brief Obtains the 'XMLAttribute' of 'self' whose key is the interned 'name'
+ *        **Note:** See 'XMLAttributeList_getAttributeByName' for implementation
+ *
+ * @param  self    - A reference to the 'XMLNode' to search through
+ * @param  name    - A name returned by 'XMLNameTable_intern' or 'XMLNameTable_get'
+ * @return retAttr - The 'XMLAttribute' with the key 'name' or 'NULL' if not present
+ */
+struct XMLAttribute* XMLNode_getAttributeByName(struct XMLNode *self, const char *name) {
+    return (NULL != self && NULL != name) ? XMLAttributeList_getAttributeByName(&self->attributes, name) : NULL;
+} /* End of XMLNode_getAttributeByName */
+
+/**
+ * @brief Searches the immediate children of 'self' for the first whose tag is the interned 'name'
+ *        Tags are compared by pointer, so only documents loaded with 'LXML_LOAD_INTERN' match
+ *        *NOTE:* This returns a pointer value to the 'XMLNode' and mustn't be free'd directly
+ *
+ * @param  self - A reference to the 'XMLNode' to search from
+ * @param  name - A name returned by 'XMLNameTable_intern' or 'XMLNameTable_get'
+ * @return node - The found 'XMLNode' or 'NULL' if not present
+ */
+struct XMLNode* XMLNode_getImmediateElementByName(struct XMLNode *self, const char *name) {
+    struct XMLNode *node = NULL;
+
+    if (NULL != self && NULL != name && TRUE == XMLNode_expand(self) && NULL != lxmlNodeListIndex(&self->children, FALSE)) {
+        size_t childIndex = lxmlIndexFind(self->children.index, name, strlen(name), 0, FALSE);
+
+        while (LXML_INDEX_END != childIndex && name != self->children.data[childIndex]->tag)
+            childIndex = self->children.index->next[childIndex];
+
+        if (LXML_INDEX_END != childIndex)
+            node = self->children.data[childIndex];
+    } else if (NULL != self && NULL != name) {
+        size_t childIndex = 0;
+
+        for (;childIndex < self->children.size; ++childIndex) {
+            if (name == self->children.data[childIndex]->tag) {
+                node = self->children.data[childIndex];
+                break;
+            }
+        }
+    }
+
+    return node;
+} /* End of XMLNode_getImmediateElementByName */
+
+/**
+ * @brief Hashes the children and attributes of 'self' now rather than on the first lookup
+ *        Lookups on nodes with fewer than 'LXML_INDEX_MIN_SIZE' children or attributes
+ *        otherwise scan them linearly
+ *
+ * @param  self    - A reference to the 'XMLNode' to index
+ * @return success - A flag indicating the status of the subroutine
+ */
+int XMLNode_buildIndex(struct XMLNode *self) {
+    int success = FALSE;
+
+    if (NULL != self && TRUE == XMLNode_expand(self))
+        success = (NULL != lxmlNodeListIndex(&self->children, TRUE) && NULL != lxmlAttributeListIndex(&self->attributes, TRUE)) ? TRUE : FALSE;
+
+    return success;
+} /* End of XMLNode_buildIndex */
+
+/**
+ * @brief Drops the indexes of 'self' so they are rebuilt by the next lookup
+ *        **Note:** Required after changing the 'tag' of a child or the 'key' of an attribute in place
+ *
+ * @param self - A reference to the 'XMLNode' whose indexes to drop
+ */
+void XMLNode_clearIndex(struct XMLNode *self) {
+    if (NULL != self) {
+        lxmlIndexFree(self->children.arena, self->children.index);
+        lxmlIndexFree(self->attributes.arena, self->attributes.index);
+        self->children.index = NULL;
+        self->attributes.index = NULL;
+    }
+} /* End of XMLNode_clearIndex */
+
+/**
+ * @brief Counts the bytes 'node' and its subtree take when written at the top level
+ *        A node without a tag, such as 'doc->root', counts only its children
+ *        **Note:** The document declaration is not included
+ *
+ * @param  node   - The 'XMLNode' to measure
+ * @param  indent - The number of white spaces to place
+ * @return len    - The exact number of bytes 'XMLDocument_write' would produce for 'node',
+ *                  or 'LXML_WRITE_ERROR' when the tree could not be walked to the end
+ */
+size_t XMLNode_serializedLength(struct XMLNode *node, int indent) {
+    struct XMLWriter writer = { 0 };
+
+    if (NULL != node && FALSE == lxmlWriteNode(&writer, node, indent))
+        writer.size = LXML_WRITE_ERROR;
+
+    return writer.size;
+} /* End of XMLNode_serializedLength */
+
+/**
+ * @brief Visits 'node' and every descendant in document order without recursing
+ *        'enter' is called before a node's children and 'leave' after them,
+ *        either may be 'NULL'. Returning 'LXML_WALK_SKIP' from 'enter' skips the
+ *        children of that node, 'LXML_WALK_STOP' from either ends the walk
+ *        **Note:** The open nodes are kept on a heap stack, so the depth of the tree
+ *        is only limited by memory. Children may be freed from 'leave'
+ *
+ * @param  node    - The 'XMLNode' to start from, visited at depth 0
+ * @param  enter   - Called with each node and its depth below 'node' on the way down
+ * @param  leave   - Called with each node and its depth below 'node' on the way up
+ * @param  ctx     - Passed as the first argument of every callback
+ * @return success - 'FALSE' if a callback stopped the walk or the stack could not grow
+ */
+int XMLNode_walk(struct XMLNode *node, enum XMLWalkAction (*enter)(void *ctx, struct XMLNode *node, size_t depth), enum XMLWalkAction (*leave)(void *ctx, struct XMLNode *node, size_t depth), void *ctx) {
+    struct XMLWalkFrame stackFrames[LXML_WALK_STACK_SIZE], *frames = stackFrames;
+    enum XMLWalkAction action = LXML_WALK_CONTINUE;
+    size_t depth = 0, heapSize = LXML_WALK_STACK_SIZE;
+
+    /* Nodes of lazy documents are expanded before they are visited */
+    if (NULL != node) {
+        action = (FALSE == XMLNode_expand(node)) ? LXML_WALK_STOP : (NULL != enter) ? enter(ctx, node, 0) : LXML_WALK_CONTINUE;
+        frames[0].node = node;
+        frames[0].next = (LXML_WALK_SKIP == action) ? node->children.size : 0;
+    }
+
+    while (NULL != node && LXML_WALK_STOP != action) {
+        struct XMLWalkFrame *frame = &frames[depth];
+
+        if (frame->next < frame->node->children.size) {
+            struct XMLNode *child = frame->node->children.data[frame->next++];
+
+            action = (FALSE == XMLNode_expand(child)) ? LXML_WALK_STOP : (NULL != enter) ? enter(ctx, child, depth + 1) : LXML_WALK_CONTINUE;
+
+            if (LXML_WALK_STOP != action && depth + 1 >= heapSize) {
+                struct XMLWalkFrame *tmp = (frames == stackFrames) ? malloc(sizeof(struct XMLWalkFrame) * heapSize * 2)
+                                                                   : realloc(frames, sizeof(struct XMLWalkFrame) * heapSize * 2);
+
+                if (NULL != tmp) {
+                    if (frames == stackFrames)
+                        memcpy(tmp, stackFrames, sizeof(stackFrames));
+
+                    frames = tmp;
+                    heapSize *= 2;
+                } else {
+                    fprintf(stderr, "Out of memory\n");
+                    action = LXML_WALK_STOP;
+                }
+            }
+
+            if (LXML_WALK_STOP != action) {
+                ++depth;
+                frames[depth].node = child;
+                frames[depth].next = (LXML_WALK_SKIP == action) ? child->children.size : 0;
+            }
+        } else {
+            action = (NULL != leave) ? leave(ctx, frame->node, depth) : LXML_WALK_CONTINUE;
+
+            if (0 == depth)
+                break;
+
+            --depth;
+        }
+    }
+
+    if (frames != stackFrames)
+        free(frames);
+
+    return (LXML_WALK_STOP != action) ? TRUE : FALSE;
+} /* End of XMLNode_walk */
+
+/**
+ * @brief Builds the children and text of 'self' if it belongs to a 'LXML_LOAD_LAZY' document
+ *        and has not been built yet. The children get their tags and attributes, but their own
+ *        children and text wait until they are expanded in turn
+ *        **Note:** The lookup functions and 'XMLNode_walk' expand the nodes they visit, this is only
+ *        needed before reading 'self->children' or 'self->inner_text' directly. As reading a lazy
+ *        document builds it, one must not be read from several threads at once
+ *
+ * @param  self    - A reference to the 'XMLNode' to expand
+ * @return success - 'FALSE' when out of memory
+ */
+int XMLNode_expand(struct XMLNode *self) {
+    int success = TRUE;
+
+    if (NULL != self && 0 != self->lazy) {
+        const struct XMLLazyIndex *lazy = self->children.arena->lazy;
+        const struct XMLLazyElement *element = &lazy->elements[self->lazy - 1];
+        size_t next = self->lazy, i = element->content, j = 0;
+        struct XMLParser parser;
+        struct XMLToken token;
+        enum XMLTokenType type = LXML_TOKEN_NONE;
+
+        lxmlParserInit(&parser, &lxmlDomHandler, &parser);
+        parser.doc.arena = self->children.arena;
+        parser.curr_node = self;
+        parser.inSitu = lazy->inSitu;
+
+        /* 'doc.root' covers the whole input, any other element ends with its own end tag */
+        if (1 != self->lazy)
+            lxmlTokenizerPushName(&parser.tokenizer, self->tag, self->tagLen);
+        self->lazy = 0;
+
+        while (FALSE == parser.tokenizer.error && LXML_TOKEN_END != type
+               && LXML_TOKEN_NONE != (type = lxmlTokenizerNext(&parser.tokenizer, lazy->buf, element->end, &i, TRUE, &token))) {
+            if (LXML_TOKEN_START == type) {
+                const struct XMLLazyElement *child = &lazy->elements[next];
+
+                if (FALSE == lxmlParserDispatch(&parser, &token))
+                    parser.tokenizer.error = TRUE;
+                else if (FALSE == token.selfClosing) {
+                    /* The content of the child is skipped until it is expanded itself */
+                    parser.curr_node->lazy = next + 1;
+                    i = child->end;
+
+                    lxmlTokenizerPopName(&parser.tokenizer, token.data, token.dataLen);
+                    lxmlDomEndElement(&parser, token.data, token.dataLen);
+                }
+
+                next += 1 + child->descendants;
+            } else if (LXML_TOKEN_TEXT == type || LXML_TOKEN_COMMENT == type) {
+                if (FALSE == lxmlParserDispatch(&parser, &token))
+                    parser.tokenizer.error = TRUE;
+            }
+        }
+
+        success = lxmlParserEnd(&parser);
+
+        /* Every node has its attributes indexed when its parent is expanded */
+        if (TRUE == success && TRUE == lazy->indexNodes) {
+            lxmlNodeListIndex(&self->children, FALSE);
+
+            for (; j < self->children.size; ++j)
+                lxmlAttributeListIndex(&self->children.data[j]->attributes, FALSE);
+        }
+    }
+
+    return success;
+} /* End of XMLNode_expand */
+
+/**
+ * @brief Obtains the text of 'self', expanding it first when it has not been built yet
+ *
+ * @param  self - A reference to the 'XMLNode' to read
+ * @param  len  - Set to the number of bytes in the text when not 'NULL'
+ * @return text - The first run of text of 'self' or 'NULL' if it has none
+ *                **Note:** This is not NUL terminated in documents loaded with 'LXML_LOAD_IN_SITU'
+ */
+const char* XMLNode_getInnerText(struct XMLNode *self, size_t *len) {
+    const char *text = NULL;
+
+    if (NULL != self && TRUE == XMLNode_expand(self))
+        text = self->inner_text;
+
+    if (NULL != len)
+        *len = (NULL != text) ? lxmlViewLen(text, self->innerTextLen) : 0;
+
+    return text;
+} /* End of XMLNode_getInnerText */
+
+/**
+ * @brief Counts the children of 'self', expanding it first when it has not been built yet
+ *
+ * @param  self  - A reference to the 'XMLNode' to count the children of
+ * @return count - The number of children of 'self'
+ */
+size_t XMLNode_childCount(struct XMLNode *self) {
+    return (NULL != self && TRUE == XMLNode_expand(self)) ? self->children.size : 0;
+} /* End of XMLNode_childCount */
+
+/**
+ * @brief Obtains the child of 'self' at position 'i', expanding 'self' first when it has not been built yet
+ *        *NOTE:* This returns a pointer value to the 'XMLNode' and mustn't be free'd directly
+ *
+ * @param  self - A reference to the 'XMLNode' to read
+ * @param  i    - The position of the child, from 0
+ * @return node - The child or 'NULL' when 'i' is out of range
+ */
+struct XMLNode* XMLNode_getChild(struct XMLNode *self, size_t i) {
+    return (i < XMLNode_childCount(self)) ? self->children.data[i] : NULL;
+} /* End of XMLNode_getChild */
+
+/**
+ * @brief Creates a stack allocated 'XMLNode', initialises it then returns it.
+ *
+ * @return node - A stack allocated and initialised XMLNode
+ */
+static struct XMLNode XMLNodeInitStack() {
+    struct XMLNode node;
+
+    memset(&node, '\0', sizeof(struct XMLNode));
+    node.attributes = XMLAttributeList_init();
+    node.children = XMLNodeList_init();
+
+#ifndef LXML_COMPACT_NODES
+    node.add = XMLNode_add;
+    node.createAndAppend = XMLNode_createAndAppend;
+    node.free = XMLNode_free;
+    node.getAttributeValue = XMLNode_getAttributeValue;
+    node.getAttribute = XMLNode_getAttribute;
+    node.getImmediateElementByTagName = XMLNode_getImmediateElementByTagName;
+#endif
+
+    return node;
+} /* End of XMLNodeInitStack */
+
+/**
+ * @brief Stops 'XMLNode_free' from descending into arena lists, which are released with the document
+ *        **Note:** See 'XMLNode_walk' for the parameters
+ */
+static enum XMLWalkAction lxmlNodeFreeEnter(void *ctx, struct XMLNode *node, size_t depth) {
+    (void) ctx;
+    (void) depth;
+
+    return (NULL == node->children.arena) ? LXML_WALK_CONTINUE : LXML_WALK_SKIP;
+} /* End of lxmlNodeFreeEnter */
+
+/**
+ * @brief Frees what 'node' holds once its children have been emptied, then the children themselves
+ *        **Note:** See 'XMLNode_walk' for the parameters
+ */
+static enum XMLWalkAction lxmlNodeFreeLeave(void *ctx, struct XMLNode *node, size_t depth) {
+    (void) ctx;
+    (void) depth;
+
+    /* Strings of arena nodes are released with the document */
+    if (NULL == node->children.arena) {
+        free(node->tag);
+        free(node->inner_text);
+    }
+
+    node->tag = node->inner_text = NULL;
+    node->tagLen = node->innerTextLen = 0;
+
+    XMLAttributeList_free(&node->attributes);
+    lxmlNodeListRelease(&node->children);
+
+    return LXML_WALK_CONTINUE;
+} /* End of lxmlNodeFreeLeave */
+
+/**
+ * @brief Adds a 'XMLNode' to the 'XMLNodeList'
+ *
+ * @param self - A reference to the struct you wish to add the node to
+ * @param parent - A reference to the parent
+ * @param node - The 'XMLNode' to add to 'self'
+ * @return success - A flag indicating the status of the subroutine
+ */
+int XMLNodeList_add(struct XMLNodeList *self, struct XMLNode *parent, struct XMLNode *node) {
+    /* A lazy parent is built first so 'node' follows the children it already has */
+    int success = (TRUE == XMLNode_expand(parent) && TRUE == lxmlNodeListJoin(self, node)) ? XMLNodeList_append(self, parent, node) : FALSE;
+
+    if (TRUE == success) {
+        if (NULL != self->arena && NULL != self->arena->owner)
+            ++self->arena->owner->generation;
+        else if (NULL != self->arena)
+            ++self->arena->generation;
+        else
+            ++self->generation->value;
+    }
+
+    return success;
+} /* End of XMLNodeList_add */
+
+/**
+ * @brief Makes 'self' and the children of 'node' share the generation of the heap tree of 'self'
+ *        A tree brought along by 'node' forwards to it, so this does not depend on the size of either
+ *        **Note:** Arena lists keep their generation on the arena and are left alone
+ *
+ * @param  self    - The 'XMLNodeList' 'node' is about to be added to
+ * @param  node    - The 'XMLNode' being added
+ * @return success - 'FALSE' when the generation could not be allocated
+ */
+static int lxmlNodeListJoin(struct XMLNodeList *self, struct XMLNode *node) {
+    struct XMLGeneration *tree = NULL, *added = NULL;
+    int success = TRUE;
+
+    if (NULL != self && NULL == self->arena && NULL != node) {
+        tree = lxmlGenerationResolve(&self->generation);
+        added = (NULL == node->children.arena) ? lxmlGenerationResolve(&node->children.generation) : NULL;
+
+        if (NULL == tree && NULL == added)
+            tree = calloc(1, sizeof(struct XMLGeneration));
+        else if (NULL == tree)
+            tree = added;
+        else if (NULL != added && added != tree) {
+            /* An index built on either tree must not see its old generation again */
+            tree->value = (added->value > tree->value) ? added->value : tree->value;
+            lxmlGenerationSet(&added->owner, tree);
+        }
+
+        if (NULL != tree) {
+            lxmlGenerationSet(&self->generation, tree);
+            if (NULL == node->children.arena && NULL == node->children.generation)
+                lxmlGenerationSet(&node->children.generation, tree);
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            success = FALSE;
+        }
+    }
+
+    return success;
+} /* End of lxmlNodeListJoin */
+
+/**
+ * @brief Follows the generations forwarded to others up to the one which is counted
+ *        and points 'generation' straight at it, so the next lookup is a single step
+ *
+ * @param  generation - A reference to the generation of a list, may hold 'NULL'
+ * @return tree       - The generation of the whole tree or 'NULL' when there is none
+ */
+static struct XMLGeneration* lxmlGenerationResolve(struct XMLGeneration **generation) {
+    struct XMLGeneration *tree = *generation;
+
+    while (NULL != tree && NULL != tree->owner)
+        tree = tree->owner;
+
+    if (tree != *generation)
+        lxmlGenerationSet(generation, tree);
+
+    return tree;
+} /* End of lxmlGenerationResolve */
+
+/**
+ * @brief Points 'generation' at 'value', releasing the generation it pointed at before
+ *
+ * @param generation - A reference to the pointer to set
+ * @param value      - The generation to share, or 'NULL'
+ */
+static void lxmlGenerationSet(struct XMLGeneration **generation, struct XMLGeneration *value) {
+    if (NULL != value)
+        ++value->refs;
+
+    lxmlGenerationRelease(*generation);
+    *generation = value;
+} /* End of lxmlGenerationSet */
+
+/**
+ * @brief Drops a reference to 'generation', freeing it and those it forwards to once unused
+ *
+ * @param generation - The generation to release, or 'NULL'
+ */
+static void lxmlGenerationRelease(struct XMLGeneration *generation) {
+    while (NULL != generation && 0 == --generation->refs) {
+        struct XMLGeneration *owner = generation->owner;
+
+        free(generation);
+        generation = owner;
+    }
+} /* End of lxmlGenerationRelease */
+
+/**
+ * @brief Adds 'node' to 'self' without changing the generation of the tree
+ *        **Note:** Only for trees which are still being built and have no index
+ *
+ * @param  self    - A reference to the struct you wish to add the node to
+ * @param  parent  - A reference to the parent
+ * @param  node    - The 'XMLNode' to add to 'self'
+ * @return success - A flag indicating the status of the subroutine
+ */
+static int XMLNodeList_append(struct XMLNodeList *self, struct XMLNode *parent, struct XMLNode *node) {
+    int success = FALSE;
+
+    if (NULL != self) {
+        while (self->size >= self->heapSize) {
+            size_t heapSize = (0 != self->heapSize) ? self->heapSize * 2 : 1;
+            struct XMLNode **tmp = lxmlArenaRealloc(self->arena, self->data, sizeof(struct XMLNode*) * self->heapSize, sizeof(struct XMLNode*) * heapSize);
+
+            if (NULL == tmp)
+                break;
+
+            memset(tmp + self->heapSize, '\0', (sizeof(struct XMLNode*) * (heapSize - self->heapSize)));
+            self->data = tmp;
+            self->heapSize = heapSize;
+        }
+
+        if (self->size < self->heapSize) {
+            node->parent = parent;
+            self->data[self->size++] = node;
+            success = TRUE;
+        }
+    }
+
+    return success;
+} /* End of XMLNodeList_append */
+
+/**
+ * @brief Adds a 'XMLNode' to the 'XMLNodeList'
+ *
+ * @param  self - A reference to the struct you wish to add the node to
+ * @return node - The new node that's been appended to the XMLNodeList
+ */
+struct XMLNode* XMLNodeList_createAndAppend(struct XMLNodeList *self) {
+    struct XMLNode *node = NULL;
+
+    if (NULL != self) {
+        node = lxmlArenaNode(self->arena);
+
+        if (NULL != node) {
+            int success = XMLNodeList_add(self, NULL, node);
+
+            if (FALSE == success) {
+                XMLNode_free(node);
+                if (NULL == self->arena)
+                    free(node);
+                node = NULL;
+            }
+        }
+    }
+
+    return node;
+} /* End of XMLNodeList_createAndAppend */
+
+/**
+ * @brief Frees the given 'XMLNodeList'
+ *
+ * @param self - A reference to the struct you wish to free
+ */
+void XMLNodeList_free(struct XMLNodeList *self) {
+    /* Arena lists are released with the document */
+    if (NULL != self && NULL == self->arena) {
+        size_t i = 0;
+        for (; i < self->size; ++i)
+            XMLNode_free(self->data[i]);
+    }
+
+    lxmlNodeListRelease(self);
+} /* End of XMLNodeList_free */
+
+/**
+ * @brief Frees the storage of 'self' and the nodes in it, which must already be empty
+ *
+ * @param self - The 'XMLNodeList' to release and reset
+ */
+static void lxmlNodeListRelease(struct XMLNodeList *self) {
+    if (NULL != self && NULL == self->arena) {
+        size_t i = 0;
+
+        for (; i < self->heapSize; ++i) {
+            free(self->data[i]);
+            self->data[i] = NULL;
+        }
+
+        lxmlIndexFree(NULL, self->index);
+        free(self->data);
+        self->data = NULL;
+    }
+
+    if (NULL != self) {
+        lxmlGenerationRelease(self->generation);
+        *self = XMLNodeList_init();
+    }
+} /* End of lxmlNodeListRelease */
+
+/**
+ * @brief Frees the given 'XMLDocument'
+ *
+ * @param self - A reference to the struct you wish to free
+ */
+void XMLDocument_free(struct XMLDocument *self) {
+    if (NULL != self) {
+        XMLDocument_clearIndex(self);
+
+        if (NULL != self->arena) {
+            lxmlArenaFree(self->arena);
+            self->arena = NULL;
+        } else {
+            XMLNode_free(self->root);
+            free(self->root);
+
+            free(self->version);
+            free(self->encoding);
+        }
+
+        self->root = NULL;
+        self->version = self->encoding = NULL;
+        self->success = FALSE;
+    }
+} /* End of XMLDocument_free */
+
+/**
+ * @brief Obtains the table the tags and attribute keys of 'doc' were interned into
+ *
+ * @param  doc   - A reference to the 'XMLDocument'
+ * @return names - The 'XMLNameTable' or 'NULL' when 'doc' was not loaded with 'LXML_LOAD_INTERN'
+ */
+struct XMLNameTable* XMLDocument_getNameTable(struct XMLDocument *doc) {
+    return (NULL != doc && NULL != doc->arena) ? doc->arena->names : NULL;
+} /* End of XMLDocument_getNameTable */
+
+/**
+ * @brief Obtains every element of 'doc' whose tag is 'tagName', in document order
+ *        The first call indexes the whole tree by tag, later calls reuse the index
+ *        until a node is added to the tree
+ *        **Note:** The array belongs to 'doc' and is only valid until the tree changes,
+ *        call 'XMLDocument_clearIndex' after changing a 'tag' in place
+ *
+ * @param  doc     - A reference to the 'XMLDocument' to search
+ * @param  tagName - The name of the tag to search for
+ * @param  count   - Set to the number of matches
+ * @return nodes   - The matching 'XMLNode's or 'NULL' when there are none
+ */
+struct XMLNode** XMLDocument_getElementsByTagName(struct XMLDocument *doc, char *tagName, size_t *count) {
+    struct XMLNode **nodes = NULL;
+
+    if (NULL != count)
+        *count = 0;
+
+    if (NULL != doc && NULL != doc->root && NULL != tagName && NULL != count) {
+        size_t generation = lxmlTreeGeneration(doc);
+
+        if (NULL != doc->tagIndex && generation != doc->tagIndex->generation)
+            XMLDocument_clearIndex(doc);
+
+        if (NULL == doc->tagIndex)
+            doc->tagIndex = lxmlTagIndexCreate(doc->root, generation);
+
+        if (NULL != doc->tagIndex && 0 != doc->tagIndex->names.size && '\0' != tagName[0]) {
+            struct XMLIndexSlot *slot = lxmlIndexSlot(doc->tagIndex->names.slots, doc->tagIndex->names.capacity, tagName, strlen(tagName));
+
+            if (NULL != slot->name) {
+                nodes = doc->tagIndex->nodes + slot->first;
+                *count = slot->last - slot->first;
+            }
+        }
+    }
+
+    return nodes;
+} /* End of XMLDocument_getElementsByTagName */
+
+/**
+ * @brief Drops the tag index of 'doc' so it is rebuilt by the next 'XMLDocument_getElementsByTagName'
+ *
+ * @param doc - A reference to the 'XMLDocument' whose index to drop
+ */
+void XMLDocument_clearIndex(struct XMLDocument *doc) {
+    if (NULL != doc) {
+        lxmlTagIndexFree(doc->tagIndex);
+        doc->tagIndex = NULL;
+    }
+} /* End of XMLDocument_clearIndex */
+
+/**
+ * @brief Creates an empty name table which can be passed to 'XMLDocument_loadBufferWithNames'
+ *
+ * @return names - A 'malloc' 'XMLNameTable' or 'NULL' when out of memory
+ */
+struct XMLNameTable* XMLNameTable_create() {
+    struct XMLNameTable *names = malloc(sizeof(struct XMLNameTable));
+
+    if (NULL != names) {
+        names->size = 0;
+        names->capacity = LXML_NAME_TABLE_SIZE;
+        names->slots = calloc(names->capacity, sizeof(const char*));
+        names->strings = lxmlArenaCreate();
+#ifdef LXML_HAVE_THREADS
+        names->shared = NULL;
+        names->lock = NULL;
+#endif
+
+        if (NULL == names->slots || NULL == names->strings) {
+            XMLNameTable_free(names);
+            names = NULL;
+        }
+    }
+
+    return names;
+} /* End of XMLNameTable_create */
+
+/**
+ * @brief Obtains the canonical copy of the first 'len' bytes of 'name', adding it when it is new
+ *
+ * @param  names    - The 'XMLNameTable' to intern into
+ * @param  name     - The name to intern, this does not need to be NUL terminated
+ * @param  len      - The number of bytes in 'name'
+ * @return interned - A NUL terminated string owned by 'names' or 'NULL' when out of memory
+ */
+const char* XMLNameTable_intern(struct XMLNameTable *names, const char *name, size_t len) {
+    const char *interned = NULL;
+
+    if (NULL != names && NULL != name && 0 != len) {
+        const char **slot = NULL;
+
+        /* Kept at most half full so probe sequences stay short */
+        if (names->size + 1 > names->capacity / 2) {
+            size_t capacity = names->capacity * 2, i = 0;
+            const char **slots = calloc(capacity, sizeof(const char*));
+
+            if (NULL != slots) {
+                for (; i < names->capacity; ++i)
+                    if (NULL != names->slots[i])
+                        *lxmlNameTableSlot(slots, capacity, names->slots[i], strlen(names->slots[i])) = names->slots[i];
+
+                free(names->slots);
+                names->slots = slots;
+                names->capacity = capacity;
+            }
+        }
+
+        slot = lxmlNameTableSlot(names->slots, names->capacity, name, len);
+
+        if (NULL == *slot && names->size + 1 <= names->capacity / 2) {
+#ifdef LXML_HAVE_THREADS
+            if (NULL != names->shared) {
+                pthread_mutex_lock(names->lock);
+                *slot = XMLNameTable_intern(names->shared, name, len);
+                pthread_mutex_unlock(names->lock);
+            } else
+#endif
+                *slot = lxmlArenaStrndup(names->strings, name, len);
+
+            if (NULL != *slot)
+                ++names->size;
+        }
+
+        interned = *slot;
+    }
+
+    return interned;
+} /* End of XMLNameTable_intern */
+
+/**
+ * @brief Looks up the canonical copy of 'name' without adding it
+ *        Useful for resolving a name once before many pointer compared lookups
+ *
+ * @param  names    - The 'XMLNameTable' to search
+ * @param  name     - The NUL terminated name to look up
+ * @return interned - The string owned by 'names' or 'NULL' when 'name' has not been interned
+ */
+const char* XMLNameTable_get(struct XMLNameTable *names, const char *name) {
+    return (NULL != names && NULL != name) ? *lxmlNameTableSlot(names->slots, names->capacity, name, strlen(name)) : NULL;
+} /* End of XMLNameTable_get */
+
+/**
+ * @brief Frees 'names' and every string interned into it
+ *        **Note:** Documents using 'names' must be freed first
+ *
+ * @param names - The 'XMLNameTable' to free
+ */
+void XMLNameTable_free(struct XMLNameTable *names) {
+    if (NULL != names) {
+        free(names->slots);
+        lxmlArenaFree(names->strings);
+        free(names);
+    }
+} /* End of XMLNameTable_free */
+
+/**
+ * @brief Initialises 'parser' to report to 'handler'
+ *
+ * @param parser  - The 'XMLParser' to initialise
+ * @param handler - The callbacks to invoke
+ * @param ctx     - Passed as the first argument of every callback
+ */
+static void lxmlParserInit(struct XMLParser *parser, const struct XMLEventHandler *handler, void *ctx) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+
+    memset(parser, '\0', sizeof(struct XMLParser));
+
+    parser->handler = handler;
+    parser->ctx = ctx;
+    parser->doc = doc;
+    parser->tokenizer.state = LXML_PARSER_CONTENT;
+} /* End of lxmlParserInit */
+
+/**
+ * @brief Checks that the input seen by 'parser' formed a complete document
+ *        and releases the memory held by 'parser', but not 'parser->doc'
+ *
+ * @param  parser  - The 'XMLParser' to end
+ * @return success - A flag indicating whether the document was well formed
+ */
+static int lxmlParserEnd(struct XMLParser *parser) {
+    struct XMLTokenizer *tokenizer = &parser->tokenizer;
+
+    if (FALSE == tokenizer->error && LXML_PARSER_CONTENT != tokenizer->state) {
+        fprintf(stderr, "Unexpected end of document, expected '%s'\n", (LXML_PARSER_COMMENT == tokenizer->state) ? "-->" : "]]>");
+        tokenizer->error = TRUE;
+    }
+
+    if (FALSE == tokenizer->error && 0 != tokenizer->depth) {
+        size_t nameLen = 0;
+        const char *name = lxmlTokenizerTopName(tokenizer, &nameLen);
+
+        fprintf(stderr, "Unexpected end of document, '%.*s' is not closed\n", (int) nameLen, name);
+        tokenizer->error = TRUE;
+    }
+
+    if (NULL != parser->scratch) {
+        parser->scratch->names = tokenizer->names;
+        parser->scratch->namesHeapSize = tokenizer->namesHeapSize;
+    } else
+        free(tokenizer->names);
+
+    tokenizer->names = NULL;
+    tokenizer->namesSize = tokenizer->namesHeapSize = tokenizer->depth = 0;
+
+    free(parser->pending);
+    parser->pending = NULL;
+    parser->pendingSize = parser->pendingHeapSize = 0;
+
+    free(parser->decoded);
+    parser->decoded = NULL;
+    parser->decodedHeapSize = 0;
+
+    return (FALSE == tokenizer->error) ? TRUE : FALSE;
+} /* End of lxmlParserEnd */
+
+/**
+ * @brief Reports as many complete tokens from 'buf' to 'parser->handler' as possible
+ *        A partial token is left unconsumed unless 'final' is set, in which case it is an error
+ *
+ * @param  parser - The 'XMLParser' holding the state between calls
+ * @param  buf    - The buffer to parse, this does not need to be NUL terminated
+ * @param  len    - The number of bytes in 'buf'
+ * @param  final  - A flag indicating that no more input will follow 'buf'
+ * @return i      - The number of bytes consumed from 'buf'
+ */
+static size_t lxmlParserRun(struct XMLParser *parser, const char *buf, size_t len, int final) {
+    struct XMLToken token;
+    size_t i = 0;
+
+    while (LXML_TOKEN_NONE != lxmlTokenizerNext(&parser->tokenizer, buf, len, &i, final, &token)) {
+        if (FALSE == lxmlParserDispatch(parser, &token)) {
+            parser->tokenizer.error = TRUE;
+            break;
+        }
+    }
+
+    return i;
+} /* End of lxmlParserRun */
+
+/**
+ * @brief Invokes the callbacks of 'parser->handler' for 'token'
+ *
+ * @param  parser  - The 'XMLParser' holding the handler
+ * @param  token   - The token to report
+ * @return success - 'FALSE' if the token is malformed or a callback stopped the parse
+ */
+static int lxmlParserDispatch(struct XMLParser *parser, const struct XMLToken *token) {
+    const struct XMLEventHandler *handler = parser->handler;
+    const char *key = NULL, *value = NULL;
+    size_t keyLen = 0, valueLen = 0, i = 0;
+    int success = TRUE, found = 0;
+
+    parser->raw = token->cdata;
+
+    switch (token->type) {
+        case LXML_TOKEN_DECLARATION: {
+            const char *version = NULL, *encoding = NULL;
+            size_t versionLen = 0, encodingLen = 0;
+
+            while (1 == (found = lxmlNextAttribute(token->attrs, token->attrsLen, &i, &key, &keyLen, &value, &valueLen))) {
+                if (7 == keyLen && 0 == memcmp(key, "version", 7)) {
+                    version = value;
+                    versionLen = valueLen;
+                } else if (8 == keyLen && 0 == memcmp(key, "encoding", 8)) {
+                    encoding = value;
+                    encodingLen = valueLen;
+                }
+            }
+
+            success = (-1 != found) ? TRUE : FALSE;
+
+            if (TRUE == success && NULL != handler->declaration)
+                success = handler->declaration(parser->ctx, version, versionLen, encoding, encodingLen);
+            break;
+        }
+
+        case LXML_TOKEN_START:
+            if (NULL != handler->startElement)
+                success = handler->startElement(parser->ctx, token->data, token->dataLen);
+
+            while (TRUE == success && 1 == (found = lxmlNextAttribute(token->attrs, token->attrsLen, &i, &key, &keyLen, &value, &valueLen)))
+                if (NULL != handler->attribute && TRUE == (success = lxmlParserDecode(parser, &value, &valueLen)))
+                    success = handler->attribute(parser->ctx, key, keyLen, value, valueLen);
+
+            if (-1 == found)
+                success = FALSE;
+
+            if (TRUE == success && TRUE == token->selfClosing && NULL != handler->endElement)
+                success = handler->endElement(parser->ctx, token->data, token->dataLen);
+            break;
+
+        case LXML_TOKEN_END:
+            if (NULL != handler->endElement)
+                success = handler->endElement(parser->ctx, token->data, token->dataLen);
+            break;
+
+        case LXML_TOKEN_TEXT:
+            value = token->data;
+            valueLen = token->dataLen;
+
+            if (NULL != handler->text && TRUE == (success = lxmlParserDecode(parser, &value, &valueLen)))
+                success = handler->text(parser->ctx, value, valueLen);
+            break;
+
+        case LXML_TOKEN_COMMENT:
+            if (NULL != handler->comment)
+                success = handler->comment(parser->ctx, token->data, token->dataLen);
+            break;
+
+        default:
+            break;
+    }
+
+    return success;
+} /* End of lxmlParserDispatch */
+
+/**
+ * @brief Appends 'len' bytes of 'buf' to the partial lexeme of 'parser'
+ *
+ * @param  parser  - The 'XMLParser' to append to
+ * @param  buf     - The bytes to append
+ * @param  len     - The number of bytes in 'buf'
+ * @return success - A flag indicating the status of the subroutine
+ */
+static int lxmlParserAppendPending(struct XMLParser *parser, const char *buf, size_t len) {
+    if (parser->pendingSize + len > parser->pendingHeapSize) {
+        size_t heapSize = (0 != parser->pendingHeapSize) ? parser->pendingHeapSize : 64;
+        char *tmp = NULL;
+
+        while (heapSize < parser->pendingSize + len)
+            heapSize *= 2;
+
+        tmp = realloc(parser->pending, heapSize);
+
+        if (NULL != tmp) {
+            parser->pending = tmp;
+            parser->pendingHeapSize = heapSize;
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            parser->tokenizer.error = TRUE;
+        }
+    }
+
+    if (FALSE == parser->tokenizer.error) {
+        memcpy(parser->pending + parser->pendingSize, buf, len);
+        parser->pendingSize += len;
+    }
+
+    return (FALSE == parser->tokenizer.error) ? TRUE : FALSE;
+} /* End of lxmlParserAppendPending */
+
+/**
+ * @brief Points '*str' at a copy of itself with its references decoded, so handlers get the same
+ *        text as the DOM. CDATA text, strings without references and the DOM handler, which
+ *        decodes into the document itself, are left as they are
+ *        **Note:** The copy is only valid until the next string is decoded
+ *
+ * @param  parser  - The 'XMLParser' reporting '*str'
+ * @param  str     - The text or attribute value to report, replaced by its decoded copy
+ * @param  len     - The number of bytes in '*str', replaced by that of the copy
+ * @return success - 'FALSE' when out of memory
+ */
+static int lxmlParserDecode(struct XMLParser *parser, const char **str, size_t *len) {
+    int success = TRUE;
+
+    if (&lxmlDomHandler != parser->handler && FALSE == parser->raw && NULL != *str && NULL != memchr(*str, '&', *len)) {
+        /* Decoding never makes a string longer */
+        if (*len + 1 > parser->decodedHeapSize) {
+            char *tmp = realloc(parser->decoded, *len + 1);
+
+            if (NULL != tmp) {
+                parser->decoded = tmp;
+                parser->decodedHeapSize = *len + 1;
+            } else
+                success = FALSE;
+        }
+
+        if (TRUE == success) {
+            *len = lxmlDecodeReferences(parser->decoded, *str, *len);
+            parser->decoded[*len] = '\0';
+            *str = parser->decoded;
+        } else
+            fprintf(stderr, "Out of memory\n");
+    }
+
+    return success;
+} /* End of lxmlParserDecode */
+
+/**
+ * @brief Loads an 'XMLDocument' from the first 'len' bytes of 'buf'
+ *        With several 'threads' the children of the root element are parsed by 'lxmlLoadParallel',
+ *        with 'LXML_LOAD_LAZY' only the children of 'doc.root' are built by 'lxmlLoadLazy'
+ *
+ * @param  buf     - The XML contents to parse
+ * @param  len     - The number of bytes in 'buf'
+ * @param  flags   - 'LXML_LOAD_*' flags, 'LXML_LOAD_INTERN' is implied when 'names' is given
+ * @param  names   - The 'XMLNameTable' to intern into or 'NULL'
+ * @param  threads - The number of threads to parse with, including the calling thread
+ * @param  scratch - Memory reused from a previous load or 'NULL'
+ * @return doc     - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+static struct XMLDocument lxmlLoadBuffer(const char *buf, size_t len, int flags, struct XMLNameTable *names, int threads, struct XMLLoadScratch *scratch) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+
+    if (NULL != buf || 0 == len) {
+        struct XMLParser *parser = XMLParser_createWithNames(flags, names);
+
+        if (NULL != parser) {
+            size_t i = 0;
+
+            parser->inSitu = (LXML_LOAD_IN_SITU == (flags & LXML_LOAD_IN_SITU)) ? TRUE : FALSE;
+
+            if (NULL != scratch) {
+                parser->scratch = scratch;
+                parser->tokenizer.names = scratch->names;
+                parser->tokenizer.namesHeapSize = scratch->namesHeapSize;
+                scratch->names = NULL;
+                scratch->namesHeapSize = 0;
+            }
+
+            /* Lazy documents only build what is visited, so there is nothing to share out */
+            if (LXML_LOAD_LAZY == (flags & LXML_LOAD_LAZY))
+                lxmlLoadLazy(parser, buf, len);
+            else {
+#ifdef LXML_HAVE_THREADS
+                if (threads > 1)
+                    i = lxmlLoadParallel(parser, buf, len, threads);
+#else
+                (void) threads;
+#endif
+
+                /* The whole document is available so every token is a slice of 'buf' */
+                lxmlParserRun(parser, (0 != i) ? buf + i : buf, len - i, TRUE);
+            }
+
+            doc = XMLParser_finish(parser);
+            parser = NULL;
+        }
+    }
+
+    return doc;
+} /* End of lxmlLoadBuffer */
+
+/**
+ * @brief Obtains the number of threads 'LXML_LOAD_PARALLEL' loads with
+ *
+ * @return threads - The number of online processors or 1 when unknown or without threads
+ */
+static int lxmlThreadCount() {
+    int threads = 1;
+
+#if defined LXML_HAVE_THREADS && defined _SC_NPROCESSORS_ONLN
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (processors > 1)
+        threads = (processors < 256) ? (int) processors : 256;
+#endif
+
+    return threads;
+} /* End of lxmlThreadCount */
+
+/**
+ * @brief Decides whether a document loaded with 'flags' points into its input
+ *
+ * @param  flags  - 'LXML_LOAD_*' flags
+ * @return retain - 'TRUE' for 'LXML_LOAD_IN_SITU' and 'LXML_LOAD_LAZY', whose input must outlive the document
+ */
+static int lxmlRetainsInput(int flags) {
+    return (LXML_LOAD_IN_SITU == (flags & LXML_LOAD_IN_SITU) || LXML_LOAD_LAZY == (flags & LXML_LOAD_LAZY)) ? TRUE : FALSE;
+} /* End of lxmlRetainsInput */
+
+/**
+ * @brief Finds where every element of 'buf' lies without building any of them, then builds
+ *        the children of 'parser->doc.root'. The rest of the tree is built by 'XMLNode_expand'
+ *        The whole input is checked, so malformed documents fail to load as they otherwise would
+ *        **Note:** Sets 'parser->tokenizer.error' when the document is malformed
+ *
+ * @param parser - The 'XMLParser' building a 'LXML_LOAD_LAZY' document
+ * @param buf    - The XML contents to parse, which the document points into
+ * @param len    - The number of bytes in 'buf'
+ */
+static void lxmlLoadLazy(struct XMLParser *parser, const char *buf, size_t len) {
+    struct XMLTokenizer *tokenizer = &parser->tokenizer;
+    struct XMLLazyIndex *lazy = calloc(1, sizeof(struct XMLLazyIndex));
+    struct XMLToken token;
+    enum XMLTokenType type = LXML_TOKEN_NONE;
+    size_t open = 0, i = 0;
+
+    if (NULL != lazy) {
+        lazy->buf = buf;
+        lazy->inSitu = parser->inSitu;
+        lazy->indexNodes = parser->indexNodes;
+        parser->doc.arena->lazy = lazy;
+
+        /* Nodes are indexed as they are expanded rather than all at once */
+        parser->indexNodes = FALSE;
+    }
+
+    if (NULL == lazy || FALSE == lxmlLazyAppend(lazy, 0))
+        tokenizer->error = TRUE;
+
+    /* Until an element is closed its 'end' holds the element it is nested in */
+    while (FALSE == tokenizer->error && LXML_TOKEN_NONE != (type = lxmlTokenizerNext(tokenizer, buf, len, &i, TRUE, &token))) {
+        if (LXML_TOKEN_DECLARATION == type) {
+            if (FALSE == lxmlParserDispatch(parser, &token))
+                tokenizer->error = TRUE;
+        } else if (LXML_TOKEN_START == type) {
+            const char *key = NULL, *value = NULL;
+            size_t keyLen = 0, valueLen = 0, j = 0;
+            int found = 0;
+
+            /* Attributes are checked now so they cannot fail once the element is built */
+            while (1 == (found = lxmlNextAttribute(token.attrs, token.attrsLen, &j, &key, &keyLen, &value, &valueLen)))
+                ;
+
+            if (-1 == found || FALSE == lxmlLazyAppend(lazy, i))
+                tokenizer->error = TRUE;
+            else if (FALSE == token.selfClosing) {
+                lazy->elements[lazy->size - 1].end = open;
+                open = lazy->size - 1;
+            }
+        } else if (LXML_TOKEN_END == type && FALSE == tokenizer->error) {
+            struct XMLLazyElement *element = &lazy->elements[open];
+
+            open = element->end;
+            element->end = i;
+            element->descendants = lazy->size - (size_t) (element - lazy->elements) - 1;
+        }
+    }
+
+    /* Incomplete documents are reported by 'lxmlParserEnd' */
+    if (FALSE == tokenizer->error && LXML_PARSER_CONTENT == tokenizer->state && 0 == tokenizer->depth) {
+        lazy->elements[0].end = len;
+        lazy->elements[0].descendants = lazy->size - 1;
+        parser->doc.root->lazy = 1;
+
+        if (FALSE == XMLNode_expand(parser->doc.root))
+            tokenizer->error = TRUE;
+    }
+} /* End of lxmlLoadLazy */
+
+/**
+ * @brief Appends an element whose content starts at 'content' to 'lazy'
+ *
+ * @param  lazy    - The 'XMLLazyIndex' to append to
+ * @param  content - The offset just past the start tag of the element
+ * @return success - A flag indicating the status of the subroutine
+ */
+static int lxmlLazyAppend(struct XMLLazyIndex *lazy, size_t content) {
+    int success = TRUE;
+
+    if (lazy->size == lazy->heapSize) {
+        size_t heapSize = (0 != lazy->heapSize) ? lazy->heapSize * 2 : 64;
+        struct XMLLazyElement *tmp = realloc(lazy->elements, sizeof(struct XMLLazyElement) * heapSize);
+
+        if (NULL != tmp) {
+            lazy->elements = tmp;
+            lazy->heapSize = heapSize;
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            success = FALSE;
+        }
+    }
+
+    if (TRUE == success) {
+        lazy->elements[lazy->size].content = lazy->elements[lazy->size].end = content;
+        lazy->elements[lazy->size].descendants = 0;
+        ++lazy->size;
+    }
+
+    return success;
+} /* End of lxmlLazyAppend */
+
+/**
+ * @brief Loads the file at 'path' for 'XMLDocument_loadMany'
+ *        Small regular files are read into 'scratch->buf', or a buffer the document takes over
+ *        when it is loaded in situ, anything else goes through 'XMLDocument_loadFdWithFlags'
+ *
+ * @param  path    - The path of the file to load
+ * @param  flags   - 'LXML_LOAD_*' flags
+ * @param  scratch - Memory reused from the previous file
+ * @return doc     - The parsed 'XMLDocument', check 'doc.success' for the status
+ */
+static struct XMLDocument lxmlLoadFile(const char *path, int flags, struct XMLLoadScratch *scratch) {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+
+#ifdef LXML_HAVE_POSIX
+    int fd = (NULL != path) ? open(path, O_RDONLY) : -1;
+
+    if (-1 != fd) {
+        struct stat st;
+
+        if (0 == fstat(fd, &st) && S_ISREG(st.st_mode) && 0 < st.st_size && LXML_SCRATCH_FILE_SIZE >= st.st_size) {
+            size_t len = (size_t) st.st_size, got = 0;
+            int inSitu = lxmlRetainsInput(flags);
+            char *buf = (TRUE == inSitu) ? malloc(len) : scratch->buf;
+            ssize_t bytesRead = 0;
+
+            if (FALSE == inSitu && len > scratch->bufSize && NULL != (buf = realloc(scratch->buf, len))) {
+                scratch->buf = buf;
+                scratch->bufSize = len;
+            }
+
+            while (NULL != buf && got < len && 0 < (bytesRead = read(fd, buf + got, len - got)))
+                got += (size_t) bytesRead;
+
+            if (NULL != buf && got == len) {
+                doc = lxmlLoadBuffer(buf, len, flags, NULL, 1, scratch);
+
+                /* In situ and lazy documents point into 'buf' so they take ownership of it */
+                if (TRUE == inSitu && NULL != doc.arena) {
+                    doc.arena->input = buf;
+                    buf = NULL;
+                }
+            } else
+                fprintf(stderr, "Could not read file '%s'\n", path);
+
+            if (TRUE == inSitu)
+                free(buf);
+        } else
+            doc = XMLDocument_loadFdWithFlags(fd, flags);
+
+        close(fd);
+    } else if (NULL != path)
+        fprintf(stderr, "Could not open file '%s'\n", path);
+#else
+    (void) scratch;
+
+    doc = XMLDocument_loadPathWithFlags(path, flags);
+#endif
+
+    return doc;
+} /* End of lxmlLoadFile */
+
+#ifdef LXML_HAVE_THREADS
+/**
+ * @brief Parses the prolog of 'buf' and the start tag of its root element into 'parser', then
+ *        the children of the root element on 'threads' threads
+ *        The content of the root element is first tokenized without being built, to cut it
+ *        before children into runs of similar size. Each run is parsed into a tree of its own
+ *        and the trees are moved under the root element in document order
+ *        **Note:** When the content cannot be split, or a run fails to parse, nothing of it is
+ *        kept and 'parser' continues from the start of the content, so malformed documents
+ *        are reported by the serial parser
+ *
+ * @param  parser  - The 'XMLParser' building the document
+ * @param  buf     - The XML contents to parse
+ * @param  len     - The number of bytes in 'buf'
+ * @param  threads - The number of threads to parse with, including the calling thread
+ * @return i       - The offset within 'buf' from which 'parser' continues
+ */
+static size_t lxmlLoadParallel(struct XMLParser *parser, const char *buf, size_t len, int threads) {
+    struct XMLParallelLoader loader;
+    struct XMLTokenizer scan;
+    struct XMLToken token;
+    size_t i = 0, capacity = (size_t) threads * LXML_PARALLEL_LOAD_CHUNKS;
+
+    memset(&loader, '\0', sizeof(struct XMLParallelLoader));
+    memset(&scan, '\0', sizeof(struct XMLTokenizer));
+    scan.state = LXML_PARSER_CONTENT;
+
+    /* The prolog and the start tag of the root element */
+    while (NULL == loader.root && LXML_TOKEN_NONE != lxmlTokenizerNext(&parser->tokenizer, buf, len, &i, TRUE, &token)) {
+        if (FALSE == lxmlParserDispatch(parser, &token))
+            parser->tokenizer.error = TRUE;
+        else if (LXML_TOKEN_START == token.type && 1 == parser->tokenizer.depth)
+            loader.root = parser->curr_node;
+    }
+
+    if (NULL != loader.root && TRUE == lxmlTokenizerPushName(&scan, token.data, token.dataLen)
+        && NULL != (loader.chunks = calloc(capacity, sizeof(struct XMLParallelChunk)))) {
+        size_t start = i, j = i, target = (len - i) / capacity + 1;
+        int split = FALSE;
+
+        /* Children are cut at their start tags, so no run of text is shared by two chunks */
+        while (FALSE == split) {
+            size_t depth = scan.depth, tokenStart = j;
+            enum XMLTokenType type = lxmlTokenizerNext(&scan, buf, len, &j, TRUE, &token);
+
+            /* A declaration within the root would replace the one of the document */
+            if (LXML_TOKEN_NONE == type || LXML_TOKEN_DECLARATION == type)
+                break;
+
+            if ((LXML_TOKEN_START == type && 1 == depth && tokenStart - start >= target && loader.count + 1 < capacity)
+                || (LXML_TOKEN_END == type && 0 == scan.depth)) {
+                loader.chunks[loader.count].start = start;
+                loader.chunks[loader.count++].end = tokenStart;
+                start = tokenStart;
+                split = (LXML_TOKEN_END == type) ? TRUE : FALSE;
+            }
+        }
+
+        if (TRUE == split && loader.count > 1 && 0 == pthread_mutex_init(&loader.lock, NULL)) {
+            pthread_t *workers = malloc(sizeof(pthread_t) * (size_t) (threads - 1));
+            int started = 0, success = TRUE;
+            size_t k = 0;
+
+            loader.buf = buf;
+            loader.arena = parser->doc.arena;
+            loader.inSitu = parser->inSitu;
+            loader.indexNodes = parser->indexNodes;
+
+            for (; NULL != workers && started < threads - 1 && (size_t) started + 1 < loader.count; ++started)
+                if (0 != pthread_create(&workers[started], NULL, lxmlParallelLoaderRun, &loader))
+                    break;
+
+            /* The calling thread takes chunks as well */
+            lxmlParallelLoaderRun(&loader);
+
+            for (k = 0; (int) k < started; ++k)
+                pthread_join(workers[k], NULL);
+
+            for (k = 0; k < loader.count; ++k)
+                success &= loader.chunks[k].success;
+
+            success = lxmlParallelLoaderMerge(&loader, success);
+
+            if (TRUE == success) {
+                parser->indexed = loader.root;
+                i = start;
+            }
+
+            pthread_mutex_destroy(&loader.lock);
+            free(workers);
+        }
+    }
+
+    free(scan.names);
+    free(loader.chunks);
+
+    return i;
+} /* End of lxmlLoadParallel */
+
+/**
+ * @brief Thread of 'lxmlLoadParallel', parses unclaimed chunks until there are none left
+ *        Names are interned through a table private to the thread, so the shared table
+ *        is only locked the first time the thread meets each name
+ *
+ * @param  arg  - The shared 'XMLParallelLoader'
+ * @return NULL - Always
+ */
+static void* lxmlParallelLoaderRun(void *arg) {
+    struct XMLParallelLoader *loader = arg;
+    struct XMLNameTable *names = NULL;
+
+    if (NULL != loader->arena && NULL != loader->arena->names && NULL != (names = XMLNameTable_create())) {
+        names->shared = loader->arena->names;
+        names->lock = &loader->lock;
+    }
+
+    while (1) {
+        struct XMLParallelChunk *chunk = NULL;
+
+        pthread_mutex_lock(&loader->lock);
+        if (loader->next < loader->count)
+            chunk = &loader->chunks[loader->next++];
+        pthread_mutex_unlock(&loader->lock);
+
+        if (NULL == chunk)
+            break;
+
+        lxmlParallelLoaderParse(loader, chunk, names);
+    }
+
+    XMLNameTable_free(names);
+
+    return NULL;
+} /* End of lxmlParallelLoaderRun */
+
+/**
+ * @brief Parses one chunk of the root element's content into the children of a placeholder node,
+ *        which are then given the root element as their parent
+ *
+ * @param loader - The shared 'XMLParallelLoader'
+ * @param chunk  - The 'XMLParallelChunk' to parse, 'chunk->success' is set
+ * @param names  - The thread's 'XMLNameTable', required when the document interns its names
+ */
+static void lxmlParallelLoaderParse(struct XMLParallelLoader *loader, struct XMLParallelChunk *chunk, struct XMLNameTable *names) {
+    struct XMLParser parser;
+    size_t i = 0;
+
+    lxmlParserInit(&parser, &lxmlDomHandler, &parser);
+    parser.inSitu = loader->inSitu;
+
+    if (NULL != loader->arena && NULL != (chunk->arena = lxmlArenaCreate()))
+        chunk->arena->names = names;
+
+    if (NULL == loader->arena || NULL != chunk->arena)
+        chunk->node = lxmlArenaNode(chunk->arena);
+
+    parser.doc.arena = chunk->arena;
+    parser.doc.root = parser.curr_node = chunk->node;
+
+    if (NULL != chunk->node && (NULL == loader->arena || NULL == loader->arena->names || NULL != names))
+        lxmlParserRun(&parser, loader->buf + chunk->start, chunk->end - chunk->start, TRUE);
+    else
+        parser.tokenizer.error = TRUE;
+
+    chunk->success = lxmlParserEnd(&parser);
+
+    /* Names added to these nodes later go straight to the document's table */
+    if (NULL != chunk->arena)
+        chunk->arena->names = loader->arena->names;
+
+    for (; TRUE == chunk->success && i < chunk->node->children.size; ++i) {
+        chunk->node->children.data[i]->parent = loader->root;
+
+        if (TRUE == loader->indexNodes)
+            lxmlIndexTree(chunk->node->children.data[i], NULL);
+    }
+} /* End of lxmlParallelLoaderParse */
+
+/**
+ * @brief Moves the children of every chunk under the root element in document order
+ *        The first run of text directly within the root element becomes its inner text
+ *
+ * @param  loader  - The shared 'XMLParallelLoader', whose threads have finished
+ * @param  success - 'FALSE' to release the chunks instead
+ * @return success - 'FALSE' when the chunks were released
+ */
+static int lxmlParallelLoaderMerge(struct XMLParallelLoader *loader, int success) {
+    struct XMLNodeList *children = &loader->root->children;
+    size_t total = 0, k = 0;
+
+    for (k = 0; TRUE == success && k < loader->count; ++k)
+        total += loader->chunks[k].node->children.size;
+
+    /* The root element has no children yet, its content is all in the chunks */
+    if (TRUE == success && 0 != total) {
+        struct XMLNode **data = lxmlArenaRealloc(children->arena, children->data, sizeof(struct XMLNode*) * children->heapSize, sizeof(struct XMLNode*) * total);
+
+        if (NULL != data) {
+            children->data = data;
+            children->heapSize = total;
+        } else
+            success = FALSE;
+    }
+
+    for (k = 0; k < loader->count; ++k) {
+        struct XMLParallelChunk *chunk = &loader->chunks[k];
+        struct XMLNode *node = chunk->node;
+
+        /* Nodes later added below a heap chunk's children count towards the document's generation */
+        if (TRUE == success && NULL == chunk->arena && 0 != node->children.size)
+            success = lxmlNodeListJoin(children, node);
+
+        if (TRUE == success) {
+            /* A chunk of only text has no array to copy from */
+            if (0 != node->children.size)
+                memcpy(children->data + children->size, node->children.data, sizeof(struct XMLNode*) * node->children.size);
+            children->size += node->children.size;
+
+            /* The placeholder of a heap document would free every node its array held */
+            if (NULL == chunk->arena)
+                free(node->children.data);
+            node->children.data = NULL;
+            node->children.size = node->children.heapSize = 0;
+
+            if (NULL == loader->root->inner_text && NULL != node->inner_text) {
+                loader->root->inner_text = node->inner_text;
+                loader->root->innerTextLen = node->innerTextLen;
+                node->inner_text = NULL;
+            }
+        }
+
+        if (NULL != chunk->arena && TRUE == success) {
+            chunk->arena->owner = loader->arena;
+            chunk->arena->nextMerged = loader->arena->merged;
+            loader->arena->merged = chunk->arena;
+        } else if (NULL != chunk->arena)
+            lxmlArenaFree(chunk->arena);
+        else if (NULL != node) {
+            XMLNode_free(node);
+            free(node);
+        }
+
+        chunk->arena = NULL;
+        chunk->node = NULL;
+    }
+
+    return success;
+} /* End of lxmlParallelLoaderMerge */
+
+/**
+ * @brief Thread of 'XMLDocument_loadMany', loads the files of its own queue from the front
+ *        and steals from the other queues once it is empty
+ *
+ * @param  arg  - The 'XMLLoadQueue' of the thread
+ * @return NULL - Always
+ */
+static void* lxmlBatchLoadRun(void *arg) {
+    struct XMLLoadQueue *queue = arg;
+    struct XMLBatchLoad *batch = queue->batch;
+    struct XMLLoadScratch scratch = { 0 };
+
+    while (1) {
+        size_t i = 0;
+        int found = FALSE;
+
+        pthread_mutex_lock(&queue->lock);
+        if (queue->begin < queue->end) {
+            i = queue->begin++;
+            found = TRUE;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (TRUE == found)
+            batch->docs[i] = lxmlLoadFile(batch->paths[i], batch->flags, &scratch);
+        else if (FALSE == lxmlBatchLoadSteal(queue))
+            break;
+    }
+
+    free(scratch.buf);
+    free(scratch.names);
+
+    return NULL;
+} /* End of lxmlBatchLoadRun */
+
+/**
+ * @brief Moves the back half of the files left in another queue to the empty 'queue'
+ *        The queues are visited starting after 'queue' so thieves spread over their victims
+ *
+ * @param  queue - The 'XMLLoadQueue' of the calling thread
+ * @return found - 'FALSE' when every other queue is empty
+ */
+static int lxmlBatchLoadSteal(struct XMLLoadQueue *queue) {
+    struct XMLBatchLoad *batch = queue->batch;
+    size_t self = (size_t) (queue - batch->queues), k = 1;
+    int found = FALSE;
+
+    for (; FALSE == found && k < (size_t) batch->threads; ++k) {
+        struct XMLLoadQueue *victim = &batch->queues[(self + k) % (size_t) batch->threads];
+        size_t begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->begin < victim->end) {
+            end = victim->end;
+            begin = victim->end -= (victim->end - victim->begin + 1) / 2;
+            found = TRUE;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        /* Only one lock is held at a time, the stolen files belong to no queue in between */
+        if (TRUE == found) {
+            pthread_mutex_lock(&queue->lock);
+            queue->begin = begin;
+            queue->end = end;
+            pthread_mutex_unlock(&queue->lock);
+        }
+    }
+
+    return found;
+} /* End of lxmlBatchLoadSteal */
+#endif
+
+/**
+ * @brief Finds the next complete token in 'buf' starting at '*i'
+ *        Text is returned as it is found, comments and CDATA sections are returned in pieces
+ *        while their end is missing and a partial markup token is left unconsumed
+ *        unless 'final' is set, in which case it is an error
+ *
+ * @param  tokenizer - The 'XMLTokenizer' holding the state between calls
+ * @param  buf       - The buffer to parse, this does not need to be NUL terminated
+ * @param  len       - The number of bytes in 'buf'
+ * @param  i         - The offset to begin parsing from, advanced past the token
+ * @param  final     - A flag indicating that no more input will follow 'buf'
+ * @param  token     - Set to the token found, all strings are slices of 'buf'
+ * @return type      - The type of 'token' or 'LXML_TOKEN_NONE' when more input is needed
+ */
+static enum XMLTokenType lxmlTokenizerNext(struct XMLTokenizer *tokenizer, const char *buf, size_t len, size_t *i, int final, struct XMLToken *token) {
+    enum XMLTokenType type = LXML_TOKEN_NONE;
+
+    while (LXML_TOKEN_NONE == type && *i < len && FALSE == tokenizer->error) {
+        size_t start = *i, scan = tokenizer->scanned;
+        int incomplete = FALSE;
+
+        token->data = buf + start;
+        token->attrs = NULL;
+        token->dataLen = token->attrsLen = 0;
+        token->selfClosing = token->cdata = FALSE;
+
+        /* Comments and CDATA may be larger than a chunk so they are returned in pieces,
+         * CDATA is reported as text */
+        if (LXML_PARSER_CONTENT != tokenizer->state) {
+            enum XMLTokenType pieceType = (LXML_PARSER_COMMENT == tokenizer->state) ? LXML_TOKEN_COMMENT : LXML_TOKEN_TEXT;
+            size_t end = lxmlFind(buf, len, start, (LXML_TOKEN_COMMENT == pieceType) ? "-->" : "]]>", 3);
+
+            token->cdata = (LXML_TOKEN_TEXT == pieceType) ? TRUE : FALSE;
+
+            if (end < len) {
+                tokenizer->state = LXML_PARSER_CONTENT;
+                token->dataLen = end - start;
+                type = pieceType;
+                *i = end + 3;
+
+                /* An empty section has nothing to report */
+                if (LXML_TOKEN_TEXT == type && 0 == token->dataLen)
+                    type = LXML_TOKEN_NONE;
+            } else if (FALSE == final) {
+                /* Hold back enough to match a '-->' or ']]>' split across chunks */
+                if (len - start > 2) {
+                    token->dataLen = len - 2 - start;
+                    type = pieceType;
+                    *i = len - 2;
+                }
+                break;
+            } else
+                incomplete = TRUE;
+        }
+
+        /* Inner text */
+        else if ('<' != buf[start]) {
+            const char *next = memchr(buf + start, '<', len - start);
+            size_t end = (NULL != next) ? (size_t) (next - buf) : len;
+
+            /* A reference which may continue in the next chunk is left for it */
+            if (NULL == next && FALSE == final) {
+                while (end > start && len - end < LXML_MAX_REFERENCE_SIZE && '&' != buf[end - 1] && ';' != buf[end - 1])
+                    --end;
+
+                end = (end > start && '&' == buf[end - 1]) ? end - 1 : len;
+            }
+
+            if (end == start)
+                break;
+
+            *i = end;
+            token->dataLen = end - start;
+            type = LXML_TOKEN_TEXT;
+        }
+
+        else if (start + 1 >= len)
+            incomplete = TRUE;
+
+        /* End of node */
+        else if ('/' == buf[start + 1]) {
+            const char *close = memchr(buf + start + scan, '>', len - start - scan);
+
+            if (NULL != close) {
+                size_t j = start + 2;
+
+                lxmlParseEndOfNode(buf, len, &j, &token->data, &token->dataLen);
+
+                if (TRUE == lxmlTokenizerPopName(tokenizer, token->data, token->dataLen))
+                    type = LXML_TOKEN_END;
+
+                *i = (size_t) (close - buf) + 1;
+            } else {
+                scan = len - start;
+                incomplete = TRUE;
+            }
+        }
+
+        /* Special nodes */
+        else if ('!' == buf[start + 1]) {
+            if (len - start < 4 && FALSE == final)
+                incomplete = TRUE;
+
+            /* Comments */
+            else if (len - start >= 4 && 0 == memcmp(buf + start, "<!--", 4)) {
+                tokenizer->state = LXML_PARSER_COMMENT;
+                *i = start + 4;
+            }
+
+            else if (len - start < 9 && FALSE == final && '[' == buf[start + 2])
+                incomplete = TRUE;
+
+            /* CDATA sections */
+            else if (len - start >= 9 && 0 == memcmp(buf + start, "<![CDATA[", 9)) {
+                tokenizer->state = LXML_PARSER_CDATA;
+                *i = start + 9;
+            }
+
+            /* DOCTYPE and other declarations are skipped */
+            else if (TRUE == lxmlFindDeclarationEnd(buf + start, len - start, &scan, &tokenizer->quote))
+                *i = start + scan + 1;
+            else
+                incomplete = TRUE;
+        }
+
+        /* Declaration tags */
+        else if ('?' == buf[start + 1]) {
+            if (len - start < 6 && FALSE == final)
+                incomplete = TRUE;
+
+            /* This is the XML declaration */
+            else if (len - start >= 6 && 0 == memcmp(buf + start, "<?xml", 5) && TRUE == lxmlIsSpace(buf[start + 5])) {
+                if (TRUE == lxmlFindTagEnd(buf + start, len - start, &scan, &tokenizer->quote)) {
+                    token->attrs = buf + start + 5;
+                    token->attrsLen = scan - 5;
+
+                    if ('?' == buf[start + scan - 1])
+                        --token->attrsLen;
+
+                    type = LXML_TOKEN_DECLARATION;
+                    *i = start + scan + 1;
+                } else
+                    incomplete = TRUE;
+            } else {
+                size_t end = lxmlFind(buf + start, len - start, (scan > 2) ? scan - 1 : 2, "?>", 2);
+
+                if (end < len - start)
+                    *i = start + end + 2;
+                else {
+                    scan = len - start;
+                    incomplete = TRUE;
+                }
+            }
+        }
+
+        /* Start tag */
+        else if (TRUE == lxmlFindTagEnd(buf + start, len - start, &scan, &tokenizer->quote)) {
+            size_t end = start + scan, nameEnd = start + 1;
+
+            /* Inline node */
+            if ('/' == buf[end - 1] && end - 1 > start) {
+                token->selfClosing = TRUE;
+                --end;
+            }
+
+            while (nameEnd < end && FALSE == lxmlIsSpace(buf[nameEnd]))
+                ++nameEnd;
+
+            token->data = buf + start + 1;
+            token->dataLen = nameEnd - start - 1;
+            token->attrs = buf + nameEnd;
+            token->attrsLen = end - nameEnd;
+
+            if (0 == token->dataLen) {
+                fprintf(stderr, "Malformed tag\n");
+                tokenizer->error = TRUE;
+            } else if (TRUE == token->selfClosing || TRUE == lxmlTokenizerPushName(tokenizer, token->data, token->dataLen))
+                type = LXML_TOKEN_START;
+
+            *i = start + scan + 1;
+        } else
+            incomplete = TRUE;
+
+        if (TRUE == incomplete) {
+            if (TRUE == final) {
+                fprintf(stderr, "Unexpected end of document\n");
+                tokenizer->error = TRUE;
+            } else {
+                tokenizer->scanned = scan;
+                break;
+            }
+        }
+
+        tokenizer->scanned = 0;
+        tokenizer->quote = '\0';
+    }
+
+    token->type = type;
+
+    return type;
+} /* End of lxmlTokenizerNext */
+
+/**
+ * @brief Records 'name' as the innermost open element
+ *
+ * @param  tokenizer - The 'XMLTokenizer' to record the name in
+ * @param  name      - The tag name, this does not need to be NUL terminated
+ * @param  nameLen   - The number of bytes in 'name'
+ * @return success   - A flag indicating the status of the subroutine
+ */
+static int lxmlTokenizerPushName(struct XMLTokenizer *tokenizer, const char *name, size_t nameLen) {
+    if (tokenizer->namesSize + nameLen + 1 > tokenizer->namesHeapSize) {
+        size_t heapSize = (0 != tokenizer->namesHeapSize) ? tokenizer->namesHeapSize : 256;
+        char *tmp = NULL;
+
+        while (heapSize < tokenizer->namesSize + nameLen + 1)
+            heapSize *= 2;
+
+        tmp = realloc(tokenizer->names, heapSize);
+
+        if (NULL != tmp) {
+            tokenizer->names = tmp;
+            tokenizer->namesHeapSize = heapSize;
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            tokenizer->error = TRUE;
+        }
+    }
+
+    if (FALSE == tokenizer->error) {
+        memcpy(tokenizer->names + tokenizer->namesSize, name, nameLen);
+        tokenizer->namesSize += nameLen;
+        tokenizer->names[tokenizer->namesSize++] = '\0';
+        ++tokenizer->depth;
+    }
+
+    return (FALSE == tokenizer->error) ? TRUE : FALSE;
+} /* End of lxmlTokenizerPushName */
+
+/**
+ * @brief Obtains the name of the innermost open element
+ *
+ * @param  tokenizer - The 'XMLTokenizer' holding the open elements
+ * @param  nameLen   - Set to the length of the name
+ * @return name      - The name of the innermost element or 'NULL' at the root
+ */
+static const char* lxmlTokenizerTopName(const struct XMLTokenizer *tokenizer, size_t *nameLen) {
+    const char *name = NULL;
+
+    *nameLen = 0;
+
+    if (0 != tokenizer->depth) {
+        size_t start = tokenizer->namesSize - 1;
+
+        while (0 != start && '\0' != tokenizer->names[start - 1])
+            --start;
+
+        name = tokenizer->names + start;
+        *nameLen = tokenizer->namesSize - 1 - start;
+    }
+
+    return name;
+} /* End of lxmlTokenizerTopName */
+
+/**
+ * @brief Closes the innermost open element, which must be called 'name'
+ *
+ * @param  tokenizer - The 'XMLTokenizer' holding the open elements
+ * @param  name      - The tag name of the end tag, this does not need to be NUL terminated
+ * @param  nameLen   - The number of bytes in 'name'
+ * @return success   - A flag indicating whether the end tag matched
+ */
+static int lxmlTokenizerPopName(struct XMLTokenizer *tokenizer, const char *name, size_t nameLen) {
+    size_t topLen = 0;
+    const char *top = lxmlTokenizerTopName(tokenizer, &topLen);
+
+    if (NULL == top) {
+        fprintf(stderr, "Already at the root\n");
+        tokenizer->error = TRUE;
+    } else if (topLen != nameLen || 0 != memcmp(top, name, nameLen)) {
+        fprintf(stderr, "Mismatched tags (%.*s != %.*s)\n", (int) topLen, top, (int) nameLen, name);
+        tokenizer->error = TRUE;
+    } else {
+        tokenizer->namesSize = (size_t) (top - tokenizer->names);
+        --tokenizer->depth;
+    }
+
+    return (FALSE == tokenizer->error) ? TRUE : FALSE;
+} /* End of lxmlTokenizerPopName */
+
+/**
+ * @brief Finds the next 'key="value"' pair in the attributes of a tag
+ *
+ * @param  attrs    - The attributes of the tag, this does not need to be NUL terminated
+ * @param  len      - The number of bytes in 'attrs'
+ * @param  i        - The offset to begin parsing from, advanced past the attribute
+ * @param  key      - Set to the start of the key within 'attrs'
+ * @param  keyLen   - Set to the length of the key
+ * @param  value    - Set to the start of the value within 'attrs'
+ * @param  valueLen - Set to the length of the value
+ * @return found    - 1 when an attribute was found, 0 at the end of 'attrs' or -1 when malformed
+ */
+static int lxmlNextAttribute(const char *attrs, size_t len, size_t *i, const char **key, size_t *keyLen, const char **value, size_t *valueLen) {
+    enum XMLAttrState state = LXML_ATTR_SPACE, last = LXML_ATTR_SPACE;
+    int found = 0;
+
+    while (*i < len && LXML_ATTR_DONE != state && LXML_ATTR_ERROR != state) {
+        last = state;
+        state = (enum XMLAttrState) lxmlAttrTransitions[state][lxmlCharClass[(unsigned char) attrs[*i]]];
+
+        if (LXML_ATTR_KEY == state && LXML_ATTR_KEY != last)
+            *key = attrs + *i;
+        else if (LXML_ATTR_KEY == last && LXML_ATTR_KEY != state)
+            *keyLen = (size_t) ((attrs + *i) - *key);
+
+        /* The whole value is skipped at once, up to its closing quote, which either finishes the
+         * attribute or runs to the end of 'attrs', so a value state is never looked up in the table */
+        if (LXML_ATTR_EQUALS == last && (LXML_ATTR_DQUOTE_VALUE == state || LXML_ATTR_SQUOTE_VALUE == state)) {
+            const char *valueEnd = memchr(attrs + *i + 1, attrs[*i], len - *i - 1);
+
+            *value = attrs + *i + 1;
+
+            if (NULL != valueEnd) {
+                *valueLen = (size_t) (valueEnd - *value);
+                *i = (size_t) (valueEnd - attrs);
+                state = LXML_ATTR_DONE;
+            } else
+                *i = len - 1;
+        }
+
+        if (LXML_ATTR_ERROR != state)
+            (*i)++;
+    }
+
+    if (LXML_ATTR_DONE == state)
+        found = 1;
+    else if (LXML_ATTR_SPACE != state) {
+        if (LXML_ATTR_ERROR == state)
+            state = last;
+
+        if (LXML_ATTR_DQUOTE_VALUE == state || LXML_ATTR_SQUOTE_VALUE == state)
+            fprintf(stderr, "Unterminated attribute value\n");
+        else if (LXML_ATTR_EQUALS == state)
+            fprintf(stderr, "Value has no key\n");
+        else
+            fprintf(stderr, "Attribute has no value\n");
+
+        found = -1;
+    }
+
+    return found;
+} /* End of lxmlNextAttribute */
+
+/**
+ * @brief Records the XML declaration in the document being built
+ *        **Note:** See 'struct XMLEventHandler' for the parameters
+ */
+static int lxmlDomDeclaration(void *ctx, const char *version, size_t versionLen, const char *encoding, size_t encodingLen) {
+    struct XMLParser *parser = ctx;
+
+    /* A later declaration replaces an earlier one */
+    if (NULL == parser->doc.arena) {
+        free(parser->doc.version);
+        free(parser->doc.encoding);
+    }
+
+    /* Copying the terminator of "" keeps an empty value apart from a missing one */
+    parser->doc.version = (NULL != version && 0 == versionLen) ? lxmlArenaStrndup(parser->doc.arena, "", 1)
+                                                               : lxmlArenaStrndup(parser->doc.arena, version, versionLen);
+    parser->doc.encoding = (NULL != encoding && 0 == encodingLen) ? lxmlArenaStrndup(parser->doc.arena, "", 1)
+                                                                  : lxmlArenaStrndup(parser->doc.arena, encoding, encodingLen);
+
+    return TRUE;
+} /* End of lxmlDomDeclaration */
+
+/**
+ * @brief Appends a new 'XMLNode' to the current node and makes it current
+ *        **Note:** See 'struct XMLEventHandler' for the parameters
+ */
+static int lxmlDomStartElement(void *ctx, const char *tag, size_t tagLen) {
+    struct XMLParser *parser = ctx;
+    struct XMLNodeList *children = &parser->curr_node->children;
+    struct XMLNode *tmp = lxmlArenaNode(children->arena);
+
+    /* Nothing can be indexing a document which is still being parsed, so its generation
+     * is only shared with the new node rather than bumped */
+    if (NULL != tmp && (FALSE == lxmlNodeListJoin(children, tmp) || FALSE == XMLNodeList_append(children, parser->curr_node, tmp))) {
+        XMLNode_free(tmp);
+        if (NULL == children->arena)
+            free(tmp);
+        tmp = NULL;
+    }
+
+    if (NULL != tmp) {
+        if (NULL != parser->doc.arena && NULL != parser->doc.arena->names)
+            tmp->tag = (char*) XMLNameTable_intern(parser->doc.arena->names, tag, tagLen);
+        else
+            tmp->tag = (TRUE == parser->inSitu) ? (char*) tag : lxmlArenaStrndup(parser->doc.arena, tag, tagLen);
+        tmp->tagLen = tagLen;
+    }
+
+    if (NULL != tmp && NULL != tmp->tag) {
+        parser->curr_node = tmp;
+        parser->text_node = NULL;
+    } else
+        fprintf(stderr, "Out of memory\n");
+
+    return (parser->curr_node == tmp) ? TRUE : FALSE;
+} /* End of lxmlDomStartElement */
+
+/**
+ * @brief Adds an attribute to the current node
+ *        **Note:** See 'struct XMLEventHandler' for the parameters
+ */
+static int lxmlDomAttribute(void *ctx, const char *key, size_t keyLen, const char *value, size_t valueLen) {
+    struct XMLParser *parser = ctx;
+    char *decoded = NULL;
+    int success = TRUE;
+
+    /* A value with references is decoded into the arena when in situ, otherwise into a copy for the list to copy */
+    if (FALSE == parser->raw && NULL != value && NULL != memchr(value, '&', valueLen)) {
+        decoded = lxmlArenaStrndupDecoded((TRUE == parser->inSitu) ? parser->doc.arena : NULL, value, valueLen, &valueLen);
+        value = decoded;
+
+        success = (NULL != decoded) ? TRUE : FALSE;
+    }
+
+    if (TRUE == success)
+        success = XMLAttributeList_append(&parser->curr_node->attributes, key, keyLen, value, valueLen, !parser->inSitu);
+
+    if (FALSE == parser->inSitu)
+        free(decoded);
+
+    return success;
+} /* End of lxmlDomAttribute */
+
+/**
+ * @brief Places text into the current node, decoding its references unless it is from a CDATA section
+ *        Only the first run of text is kept, which may arrive split across chunks
+ *        **Note:** See 'struct XMLEventHandler' for the parameters
+ */
+static int lxmlDomText(void *ctx, const char *text, size_t len) {
+    struct XMLParser *parser = ctx;
+    struct XMLNode *curr_node = parser->curr_node;
+    int success = TRUE;
+
+    if (NULL == curr_node->inner_text) {
+        /* Text without references is kept as it is, a view when in situ */
+        if (FALSE == parser->raw && NULL != memchr(text, '&', len))
+            curr_node->inner_text = lxmlArenaStrndupDecoded(parser->doc.arena, text, len, &len);
+        else
+            curr_node->inner_text = (TRUE == parser->inSitu) ? (char*) text : lxmlArenaStrndup(parser->doc.arena, text, len);
+        curr_node->innerTextLen = len;
+        parser->text_node = curr_node;
+
+        success = (NULL != curr_node->inner_text) ? TRUE : FALSE;
+    } else if (parser->text_node == curr_node) {
+        /* Only 'innerTextLen' bytes are copied so views are never read past their end */
+        char *tmp = lxmlArenaRealloc(parser->doc.arena, curr_node->inner_text, curr_node->innerTextLen, curr_node->innerTextLen + len + 1);
+
+        if (NULL != tmp) {
+            if (FALSE == parser->raw && NULL != memchr(text, '&', len))
+                curr_node->innerTextLen += lxmlDecodeReferences(tmp + curr_node->innerTextLen, text, len);
+            else {
+                memcpy(tmp + curr_node->innerTextLen, text, len);
+                curr_node->innerTextLen += len;
+            }
+            tmp[curr_node->innerTextLen] = '\0';
+            curr_node->inner_text = tmp;
+        } else
+            success = FALSE;
+    }
+
+    if (FALSE == success)
+        fprintf(stderr, "Out of memory\n");
+
+    return success;
+} /* End of lxmlDomText */
+
+/**
+ * @brief Makes the parent of the current node current
+ *        **Note:** See 'struct XMLEventHandler' for the parameters
+ */
+static int lxmlDomEndElement(void *ctx, const char *tag, size_t tagLen) {
+    struct XMLParser *parser = ctx;
+
+    (void) tag;
+    (void) tagLen;
+
+    parser->curr_node = parser->curr_node->parent;
+    parser->text_node = NULL;
+
+    return TRUE;
+} /* End of lxmlDomEndElement */
+
+/**
+ * @brief Comments are not kept in the document, but they end the current run of text
+ *        **Note:** See 'struct XMLEventHandler' for the parameters
+ */
+static int lxmlDomComment(void *ctx, const char *comment, size_t len) {
+    struct XMLParser *parser = ctx;
+
+    (void) comment;
+    (void) len;
+
+    parser->text_node = NULL;
+
+    return TRUE;
+} /* End of lxmlDomComment */
+
+/**
+ * @brief Creates an empty arena, the first block is allocated on first use
+ *
+ * @return arena - A 'malloc' 'XMLArena' or 'NULL' when out of memory
+ */
+static struct XMLArena* lxmlArenaCreate() {
+    struct XMLArena *arena = malloc(sizeof(struct XMLArena));
+
+    if (NULL != arena) {
+        arena->head = NULL;
+        arena->blockSize = LXML_ARENA_BLOCK_SIZE;
+        arena->last = NULL;
+
+        arena->input = NULL;
+        arena->inputLen = 0;
+        arena->inputMapped = FALSE;
+
+        arena->names = NULL;
+        arena->ownsNames = FALSE;
+
+        arena->generation = 0;
+        arena->lazy = NULL;
+        arena->owner = arena->merged = arena->nextMerged = NULL;
+    }
+
+    return arena;
+} /* End of lxmlArenaCreate */
+
+/**
+ * @brief Releases 'arena', every allocation made from it, the retained input
+ *        and the name table unless it is shared
+ *
+ * @param arena - The 'XMLArena' to free
+ */
+static void lxmlArenaFree(struct XMLArena *arena) {
+    if (NULL != arena) {
+#ifdef LXML_HAVE_POSIX
+        if (TRUE == arena->inputMapped)
+            munmap(arena->input, arena->inputLen);
+        else
+#endif
+            free(arena->input);
+
+        if (TRUE == arena->ownsNames)
+            XMLNameTable_free(arena->names);
+
+        if (NULL != arena->lazy)
+            free(arena->lazy->elements);
+        free(arena->lazy);
+
+        while (NULL != arena->merged) {
+            struct XMLArena *next = arena->merged->nextMerged;
+
+            lxmlArenaFree(arena->merged);
+            arena->merged = next;
+        }
+
+        while (NULL != arena->head) {
+            struct XMLArenaBlock *next = arena->head->next;
+
+            free(arena->head);
+            arena->head = next;
+        }
+
+        free(arena);
+    }
+} /* End of lxmlArenaFree */
+
+/**
+ * @brief Releases every allocation made from 'arena' at once, keeping its current block for reuse
+ *        **Note:** Only for arenas which do not retain input or names, see 'XMLDocument_streamElements'
+ *
+ * @param arena - The 'XMLArena' to empty
+ */
+static void lxmlArenaReset(struct XMLArena *arena) {
+    if (NULL != arena && NULL != arena->head) {
+        while (NULL != arena->head->next) {
+            struct XMLArenaBlock *next = arena->head->next->next;
+
+            free(arena->head->next);
+            arena->head->next = next;
+        }
+
+        arena->head->used = 0;
+        arena->last = NULL;
+    }
+} /* End of lxmlArenaReset */
+
+/**
+ * @brief Bump allocates 'size' bytes from 'arena'
+ *        Requests larger than a quarter of a block get a block of their own so
+ *        the space left in the current block is not wasted
+ *        **Note:** The memory is not zeroed
+ *
+ * @param  arena - The 'XMLArena' to allocate from
+ * @param  size  - The number of bytes required
+ * @return ptr   - 'LXML_ARENA_ALIGN' aligned memory or 'NULL' when out of memory
+ */
+static void* lxmlArenaAlloc(struct XMLArena *arena, size_t size) {
+    const size_t header = LXML_ARENA_ROUND(sizeof(struct XMLArenaBlock));
+    struct XMLArenaBlock *block = arena->head;
+    char *ptr = NULL;
+
+    size = (0 != size) ? LXML_ARENA_ROUND(size) : LXML_ARENA_ALIGN;
+
+    if (NULL != block && block->size - block->used >= size) {
+        ptr = (char*) block + header + block->used;
+        block->used += size;
+        arena->last = ptr;
+    } else if (size > arena->blockSize / 4) {
+        block = malloc(header + size);
+
+        if (NULL != block) {
+            block->size = block->used = size;
+
+            /* Kept behind 'head' so it never becomes the bump block */
+            if (NULL != arena->head) {
+                block->next = arena->head->next;
+                arena->head->next = block;
+            } else {
+                block->next = NULL;
+                arena->head = block;
+                arena->last = NULL;
+            }
+
+            ptr = (char*) block + header;
+        }
+    } else {
+        block = malloc(header + arena->blockSize);
+
+        if (NULL != block) {
+            block->next = arena->head;
+            block->size = arena->blockSize;
+            block->used = size;
+            arena->head = block;
+
+            if (arena->blockSize < LXML_ARENA_MAX_BLOCK_SIZE)
+                arena->blockSize *= 2;
+
+            ptr = (char*) block + header;
+            arena->last = ptr;
+        }
+    }
+
+    if (NULL == ptr)
+        fprintf(stderr, "Out of memory\n");
+
+    return ptr;
+} /* End of lxmlArenaAlloc */
+
+/**
+ * @brief Resizes an allocation, the most recent allocation grows in place when it fits
+ *        **Note:** Falls back to 'realloc' when 'arena' is 'NULL'
+ *
+ * @param  arena   - The 'XMLArena' 'ptr' was allocated from
+ * @param  ptr     - The allocation to resize or 'NULL'
+ * @param  oldSize - The number of bytes requested when 'ptr' was allocated
+ * @param  size    - The number of bytes required
+ * @return tmp     - The resized allocation or 'NULL' when out of memory, 'ptr' is left untouched
+ */
+static void* lxmlArenaRealloc(struct XMLArena *arena, void *ptr, size_t oldSize, size_t size) {
+    void *tmp = NULL;
+
+    if (NULL == arena)
+        tmp = realloc(ptr, size);
+    else {
+        if (NULL != ptr && (char*) ptr == arena->last) {
+            struct XMLArenaBlock *block = arena->head;
+            size_t offset = (size_t) ((char*) ptr - ((char*) block + LXML_ARENA_ROUND(sizeof(struct XMLArenaBlock))));
+
+            if (block->size - offset >= LXML_ARENA_ROUND(size)) {
+                block->used = offset + LXML_ARENA_ROUND(size);
+                tmp = ptr;
+            }
+        }
+
+        if (NULL == tmp) {
+            tmp = lxmlArenaAlloc(arena, size);
+
+            if (NULL != tmp && NULL != ptr)
+                memcpy(tmp, ptr, (oldSize < size) ? oldSize : size);
+        }
+    }
+
+    return tmp;
+} /* End of lxmlArenaRealloc */
+
+/**
+ * @brief Clones the first 'len' bytes located at 'str' into a NUL terminated string
+ *        allocated from 'arena'
+ *        **Note:** Falls back to 'lxmlStrndup' when 'arena' is 'NULL'
+ *
+ * @param  arena   - The 'XMLArena' to allocate from
+ * @param  str     - The bytes to duplicate, these do not need to be NUL terminated
+ * @param  len     - The number of bytes to duplicate
+ * @return strndup - The cloned string or 'NULL' when 'len' is zero
+ */
+static char* lxmlArenaStrndup(struct XMLArena *arena, const char *str, size_t len) {
+    char *strndup = NULL;
+
+    if (NULL == arena)
+        strndup = lxmlStrndup(str, len);
+    else if (NULL != str && 0 != len) {
+        strndup = lxmlArenaAlloc(arena, len + 1);
+
+        if (NULL != strndup) {
+            memcpy(strndup, str, len);
+            strndup[len] = '\0';
+        }
+    }
+
+    return strndup;
+} /* End of lxmlArenaStrndup */
+
+/**
+ * @brief As 'lxmlArenaStrndup' replacing references with the characters they stand for
+ *        **Note:** Falls back to the heap when 'arena' is 'NULL'
+ *
+ * @param  arena      - The 'XMLArena' to allocate from
+ * @param  str        - The bytes to decode, these do not need to be NUL terminated
+ * @param  len        - The number of bytes in 'str'
+ * @param  decodedLen - Set to the number of bytes in the result
+ * @return strndup    - The decoded string or 'NULL' when out of memory
+ */
+static char* lxmlArenaStrndupDecoded(struct XMLArena *arena, const char *str, size_t len, size_t *decodedLen) {
+    char *strndup = (NULL != arena) ? lxmlArenaAlloc(arena, len + 1) : malloc(len + 1);
+
+    if (NULL != strndup) {
+        *decodedLen = lxmlDecodeReferences(strndup, str, len);
+        strndup[*decodedLen] = '\0';
+    }
+
+    return strndup;
+} /* End of lxmlArenaStrndupDecoded */
+
+/**
+ * @brief Initialises an 'XMLNode' allocated from 'arena'
+ *        Its lists allocate from 'arena' as well
+ *        **Note:** Falls back to 'XMLNode_init' when 'arena' is 'NULL'
+ *
+ * @param  arena - The 'XMLArena' to allocate from
+ * @return node  - The new 'XMLNode' or 'NULL' when out of memory
+ */
+static struct XMLNode* lxmlArenaNode(struct XMLArena *arena) {
+    struct XMLNode *node = NULL;
+
+    if (NULL == arena)
+        node = XMLNode_init();
+    else {
+        node = lxmlArenaAlloc(arena, sizeof(struct XMLNode));
+
+        if (NULL != node) {
+            *node = XMLNodeInitStack();
+            node->attributes.arena = node->children.arena = arena;
+        }
+    }
+
+    return node;
+} /* End of lxmlArenaNode */
+
+/**
+ * @brief Initialises 'attr' with strings allocated from 'arena'
+ *        'key' and 'value' are only set when both are non-empty
+ *        **Note:** Falls back to the heap when 'arena' is 'NULL'
+ *
+ * @param  arena    - The 'XMLArena' to allocate from
+ * @param  attr     - The 'XMLAttribute' to initialise
+ * @param  key      - The attribute key, this does not need to be NUL terminated
+ * @param  keyLen   - The number of bytes in 'key'
+ * @param  value    - The attribute value, this does not need to be NUL terminated
+ * @param  valueLen - The number of bytes in 'value'
+ * @param  copy     - 'FALSE' to keep 'key' and 'value' as views, which requires 'arena'
+ *                    Keys are interned instead when 'arena' has a name table
+ * @return success  - A flag indicating the status of the subroutine
+ */
+static int lxmlArenaAttribute(struct XMLArena *arena, struct XMLAttribute *attr, const char *key, size_t keyLen, const char *value, size_t valueLen, int copy) {
+    int success = TRUE;
+
+    attr->key = attr->value = NULL;
+    attr->keyLen = attr->valueLen = 0;
+#ifndef LXML_COMPACT_NODES
+    attr->free = (NULL != arena) ? XMLAttribute_freeArena : XMLAttribute_free;
+#endif
+
+    if (NULL != key && NULL != value && 0 != keyLen && 0 != valueLen) {
+        if (NULL != arena && NULL != arena->names)
+            attr->key = (char*) XMLNameTable_intern(arena->names, key, keyLen);
+        else
+            attr->key = (FALSE == copy && NULL != arena) ? (char*) key : lxmlArenaStrndup(arena, key, keyLen);
+        attr->value = (FALSE == copy && NULL != arena) ? (char*) value : lxmlArenaStrndup(arena, value, valueLen);
+        attr->keyLen = keyLen;
+        attr->valueLen = valueLen;
+
+        if (NULL == attr->key || NULL == attr->value) {
+            if (NULL == arena)
+                XMLAttribute_free(attr);
+
+            success = FALSE;
+        }
+    }
+
+    return success;
+} /* End of lxmlArenaAttribute */
+
+/**
+ * @brief Finds the slot holding 'name' or the free slot where it belongs
+ *
+ * @param  slots    - The slots of an 'XMLNameTable', at least one of which is free
+ * @param  capacity - The number of slots, a power of two
+ * @param  name     - The name to look for, this does not need to be NUL terminated
+ * @param  len      - The number of bytes in 'name'
+ * @return slot     - The matching or free slot
+ */
+static const char** lxmlNameTableSlot(const char **slots, size_t capacity, const char *name, size_t len) {
+    size_t i = (size_t) lxmlHashName(name, len) & (capacity - 1);
+
+    while (NULL != slots[i] && (0 != strncmp(slots[i], name, len) || '\0' != slots[i][len]))
+        i = (i + 1) & (capacity - 1);
+
+    return &slots[i];
+} /* End of lxmlNameTableSlot */
+
+/**
+ * @brief Hashes the first 'len' bytes of 'name' with FNV-1a
+ *
+ * @param  name - The bytes to hash
+ * @param  len  - The number of bytes in 'name'
+ * @return hash - The hash of 'name'
+ */
+static unsigned long lxmlHashName(const char *name, size_t len) {
+    unsigned long hash = 2166136261UL;
+    size_t i = 0;
+
+    for (; i < len; ++i) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619UL;
+    }
+
+    return hash;
+} /* End of lxmlHashName */
+
+/**
+ * @brief Creates an empty 'XMLIndex'
+ *
+ * @param  arena - The 'XMLArena' to allocate from or 'NULL' for the heap
+ * @return index - The new 'XMLIndex' or 'NULL' when out of memory
+ */
+static struct XMLIndex* lxmlIndexCreate(struct XMLArena *arena) {
+    struct XMLIndex *index = lxmlArenaRealloc(arena, NULL, 0, sizeof(struct XMLIndex));
+
+    if (NULL != index)
+        memset(index, '\0', sizeof(struct XMLIndex));
+
+    return index;
+} /* End of lxmlIndexCreate */
+
+/**
+ * @brief Releases 'index'
+ *        **Note:** Arena indexes are released with the document
+ *
+ * @param arena - The 'XMLArena' 'index' was allocated from
+ * @param index - The 'XMLIndex' to free
+ */
+static void lxmlIndexFree(struct XMLArena *arena, struct XMLIndex *index) {
+    if (NULL == arena && NULL != index) {
+        free(index->slots);
+        free(index->next);
+        free(index);
+    }
+} /* End of lxmlIndexFree */
+
+/**
+ * @brief Appends the entry at position 'index->count' named by the first 'len' bytes of 'name'
+ *        Unnamed entries take a position but can't be found
+ *
+ * @param  arena   - The 'XMLArena' 'index' was allocated from
+ * @param  index   - The 'XMLIndex' to append to
+ * @param  name    - The tag or key of the entry, this does not need to be NUL terminated
+ * @param  len     - The number of bytes in 'name'
+ * @return success - A flag indicating the status of the subroutine
+ */
+static int lxmlIndexAdd(struct XMLArena *arena, struct XMLIndex *index, const char *name, size_t len) {
+    int success = TRUE;
+
+    if (index->count >= index->heapSize) {
+        size_t heapSize = (0 != index->heapSize) ? index->heapSize * 2 : LXML_INDEX_MIN_SIZE;
+        size_t *tmp = lxmlArenaRealloc(arena, index->next, sizeof(size_t) * index->heapSize, sizeof(size_t) * heapSize);
+
+        if (NULL != tmp) {
+            index->next = tmp;
+            index->heapSize = heapSize;
+        } else
+            success = FALSE;
+    }
+
+    /* Kept at most half full so probe sequences stay short */
+    if (TRUE == success && NULL != name && 0 != len && index->size + 1 > index->capacity / 2) {
+        size_t capacity = (0 != index->capacity) ? index->capacity * 2 : LXML_INDEX_MIN_SIZE, i = 0;
+        struct XMLIndexSlot *slots = lxmlArenaRealloc(arena, NULL, 0, sizeof(struct XMLIndexSlot) * capacity);
+
+        if (NULL != slots) {
+            memset(slots, '\0', sizeof(struct XMLIndexSlot) * capacity);
+
+            for (; i < index->capacity; ++i)
+                if (NULL != index->slots[i].name)
+                    *lxmlIndexSlot(slots, capacity, index->slots[i].name, index->slots[i].nameLen) = index->slots[i];
+
+            if (NULL == arena)
+                free(index->slots);
+            index->slots = slots;
+            index->capacity = capacity;
+        } else
+            success = FALSE;
+    }
+
+    if (TRUE == success) {
+        index->next[index->count] = LXML_INDEX_END;
+
+        if (NULL != name && 0 != len) {
+            struct XMLIndexSlot *slot = lxmlIndexSlot(index->slots, index->capacity, name, len);
+
+            if (NULL == slot->name) {
+                slot->name = name;
+                slot->nameLen = len;
+                slot->first = index->count;
+                ++index->size;
+            } else
+                index->next[slot->last] = index->count;
+
+            slot->last = index->count;
+        }
+
+        ++index->count;
+    }
+
+    return success;
+} /* End of lxmlIndexAdd */
+
+/**
+ * @brief Finds the position of the first entry at or after 'from' named by the first 'len' bytes of 'name'
+ *
+ * @param  index   - The 'XMLIndex' to search
+ * @param  name    - The name to look for, this does not need to be NUL terminated
+ * @param  len     - The number of bytes in 'name'
+ * @param  from    - The position to search from
+ * @param  chained - A flag indicating that the entry at 'from - 1' is named 'name' too,
+ *                   so the match is found without probing
+ * @return i       - The position of the entry or 'LXML_INDEX_END' when there is none
+ */
+static size_t lxmlIndexFind(const struct XMLIndex *index, const char *name, size_t len, size_t from, int chained) {
+    size_t i = LXML_INDEX_END;
+
+    if (TRUE == chained && 0 != from)
+        i = index->next[from - 1];
+    else if (0 != index->size && 0 != len) {
+        const struct XMLIndexSlot *slot = lxmlIndexSlot(index->slots, index->capacity, name, len);
+
+        if (NULL != slot->name)
+            for (i = slot->first; LXML_INDEX_END != i && i < from;)
+                i = index->next[i];
+    }
+
+    return i;
+} /* End of lxmlIndexFind */
+
+/**
+ * @brief Finds the slot holding 'name' or the free slot where it belongs
+ *
+ * @param  slots    - The slots of an 'XMLIndex', at least one of which is free
+ * @param  capacity - The number of slots, a power of two
+ * @param  name     - The name to look for, this does not need to be NUL terminated
+ * @param  len      - The number of bytes in 'name'
+ * @return slot     - The matching or free slot
+ */
+static struct XMLIndexSlot* lxmlIndexSlot(struct XMLIndexSlot *slots, size_t capacity, const char *name, size_t len) {
+    size_t i = (size_t) lxmlHashName(name, len) & (capacity - 1);
+
+    while (NULL != slots[i].name && (slots[i].nameLen != len || 0 != memcmp(slots[i].name, name, len)))
+        i = (i + 1) & (capacity - 1);
+
+    return &slots[i];
+} /* End of lxmlIndexSlot */
+
+/**
+ * @brief Brings the index of the children in 'self' up to date, creating it
+ *        once 'self' holds 'LXML_INDEX_MIN_SIZE' children
+ *
+ * @param  self  - The 'XMLNodeList' to index
+ * @param  force - A flag to create the index whatever the size of 'self'
+ * @return index - The up to date 'XMLIndex' or 'NULL' when 'self' should be scanned instead
+ */
+static struct XMLIndex* lxmlNodeListIndex(struct XMLNodeList *self, int force) {
+    /* Lists only grow, a smaller list has been rebuilt by hand */
+    if (NULL != self->index && self->index->count > self->size) {
+        lxmlIndexFree(self->arena, self->index);
+        self->index = NULL;
+    }
+
+    if (NULL == self->index && (TRUE == force || self->size >= LXML_INDEX_MIN_SIZE))
+        self->index = lxmlIndexCreate(self->arena);
+
+    while (NULL != self->index && self->index->count < self->size) {
+        struct XMLNode *child = self->data[self->index->count];
+
+        if (FALSE == lxmlIndexAdd(self->arena, self->index, child->tag, lxmlViewLen(child->tag, child->tagLen))) {
+            lxmlIndexFree(self->arena, self->index);
+            self->index = NULL;
+        }
+    }
+
+    return self->index;
+} /* End of lxmlNodeListIndex */
+
+/**
+ * @brief Brings the index of the attributes in 'self' up to date, creating it
+ *        once 'self' holds 'LXML_INDEX_MIN_SIZE' attributes
+ *
+ * @param  self  - The 'XMLAttributeList' to index
+ * @param  force - A flag to create the index whatever the size of 'self'
+ * @return index - The up to date 'XMLIndex' or 'NULL' when 'self' should be scanned instead
+ */
+static struct XMLIndex* lxmlAttributeListIndex(struct XMLAttributeList *self, int force) {
+    if (NULL != self->index && self->index->count > self->size) {
+        lxmlIndexFree(self->arena, self->index);
+        self->index = NULL;
+    }
+
+    if (NULL == self->index && (TRUE == force || self->size >= LXML_INDEX_MIN_SIZE))
+        self->index = lxmlIndexCreate(self->arena);
+
+    while (NULL != self->index && self->index->count < self->size) {
+        struct XMLAttribute *attr = &self->attribute[self->index->count];
+
+        if (FALSE == lxmlIndexAdd(self->arena, self->index, attr->key, lxmlViewLen(attr->key, attr->keyLen))) {
+            lxmlIndexFree(self->arena, self->index);
+            self->index = NULL;
+        }
+    }
+
+    return self->index;
+} /* End of lxmlAttributeListIndex */
+
+/**
+ * @brief Indexes every node below 'node' with enough children or attributes
+ *        **Note:** Nodes that cannot be indexed are scanned linearly instead
+ *
+ * @param node    - The 'XMLNode' to start from
+ * @param indexed - A node whose descendants are already indexed or 'NULL'
+ */
+static void lxmlIndexTree(struct XMLNode *node, struct XMLNode *indexed) {
+    XMLNode_walk(node, lxmlIndexTreeEnter, NULL, indexed);
+} /* End of lxmlIndexTree */
+
+/**
+ * @brief Indexes the children and attributes of 'node' for 'lxmlIndexTree'
+ *        The descendants of 'ctx', the 'indexed' node, are skipped
+ *        **Note:** See 'XMLNode_walk' for the parameters
+ */
+static enum XMLWalkAction lxmlIndexTreeEnter(void *ctx, struct XMLNode *node, size_t depth) {
+    (void) depth;
+
+    lxmlNodeListIndex(&node->children, FALSE);
+    lxmlAttributeListIndex(&node->attributes, FALSE);
+
+    return (node == ctx) ? LXML_WALK_SKIP : LXML_WALK_CONTINUE;
+} /* End of lxmlIndexTreeEnter */
+
+/**
+ * @brief Indexes every element below 'root' by tag in a single traversal
+ *        **Note:** The index is allocated from the heap even for arena documents
+ *
+ * @param  root       - The 'XMLNode' whose descendants to index
+ * @param  generation - The generation of the tree 'root' belongs to
+ * @return tagIndex   - A 'malloc' 'XMLTagIndex' or 'NULL' when out of memory
+ */
+static struct XMLTagIndex* lxmlTagIndexCreate(struct XMLNode *root, size_t generation) {
+    struct XMLTagIndex *tagIndex = calloc(1, sizeof(struct XMLTagIndex));
+    struct XMLTagIndexCollect collect = { 0 };
+
+    collect.names = (NULL != tagIndex) ? &tagIndex->names : NULL;
+
+    if (NULL != tagIndex && TRUE == XMLNode_walk(root, lxmlTagIndexCollect, NULL, &collect)
+        && NULL != (tagIndex->nodes = malloc(sizeof(struct XMLNode*) * (tagIndex->names.count + 1)))) {
+        size_t i = 0, n = 0;
+
+        /* Each chain is already in document order, so copying them one after
+         * the other groups the elements by tag */
+        for (; i < tagIndex->names.capacity; ++i) {
+            struct XMLIndexSlot *slot = &tagIndex->names.slots[i];
+
+            if (NULL != slot->name) {
+                size_t j = slot->first;
+
+                slot->first = n;
+                for (; LXML_INDEX_END != j; j = tagIndex->names.next[j])
+                    tagIndex->nodes[n++] = collect.order[j];
+                slot->last = n;
+            }
+        }
+
+        free(tagIndex->names.next);
+        tagIndex->names.next = NULL;
+        tagIndex->names.heapSize = 0;
+        tagIndex->generation = generation;
+    } else {
+        lxmlTagIndexFree(tagIndex);
+        tagIndex = NULL;
+    }
+
+    free(collect.order);
+
+    return tagIndex;
+} /* End of lxmlTagIndexCreate */
+
+/**
+ * @brief Releases 'tagIndex'
+ *
+ * @param tagIndex - The 'XMLTagIndex' to free
+ */
+static void lxmlTagIndexFree(struct XMLTagIndex *tagIndex) {
+    if (NULL != tagIndex) {
+        free(tagIndex->names.slots);
+        free(tagIndex->names.next);
+        free(tagIndex->nodes);
+        free(tagIndex);
+    }
+} /* End of lxmlTagIndexFree */
+
+/**
+ * @brief Adds each descendant of the walk's root to 'collect->names' in document order
+ *        **Note:** See 'XMLNode_walk' for the parameters, 'ctx' is a 'struct XMLTagIndexCollect'
+ */
+static enum XMLWalkAction lxmlTagIndexCollect(void *ctx, struct XMLNode *node, size_t depth) {
+    struct XMLTagIndexCollect *collect = ctx;
+    struct XMLIndex *names = collect->names;
+    enum XMLWalkAction action = LXML_WALK_CONTINUE;
+
+    if (0 != depth) {
+        if (names->count >= collect->heapSize) {
+            size_t size = (0 != collect->heapSize) ? collect->heapSize * 2 : LXML_INDEX_MIN_SIZE;
+            struct XMLNode **tmp = realloc(collect->order, sizeof(struct XMLNode*) * size);
+
+            if (NULL != tmp) {
+                collect->order = tmp;
+                collect->heapSize = size;
+            } else
+                action = LXML_WALK_STOP;
+        }
+
+        if (LXML_WALK_CONTINUE == action) {
+            collect->order[names->count] = node;
+
+            if (FALSE == lxmlIndexAdd(NULL, names, node->tag, lxmlViewLen(node->tag, node->tagLen)))
+                action = LXML_WALK_STOP;
+        }
+    }
+
+    return action;
+} /* End of lxmlTagIndexCollect */
+
+/**
+ * @brief Obtains the generation of the tree of 'doc', which changes whenever a node is added
+ *        Trees on the heap share theirs between their lists, arena trees keep it on the arena
+ *
+ * @param  doc        - A reference to the 'XMLDocument'
+ * @return generation - The current generation
+ */
+static size_t lxmlTreeGeneration(const struct XMLDocument *doc) {
+    const struct XMLGeneration *tree = (NULL == doc->arena) ? doc->root->children.generation : NULL;
+
+    while (NULL != tree && NULL != tree->owner)
+        tree = tree->owner;
+
+    return (NULL != doc->arena) ? doc->arena->generation : (NULL != tree) ? tree->value : 0;
+} /* End of lxmlTreeGeneration */
+
+/**
+ * @brief Parses the name test and predicates of the step at 'expr[*i]' into a new step of 'query'
+ *
+ * @param  query      - The 'XMLQuery' to append the step to
+ * @param  expr       - The expression being compiled
+ * @param  i          - The offset of the step, advanced past it
+ * @param  descendant - A flag indicating that the step follows '//'
+ * @return success    - 'FALSE' when the step is malformed or out of memory
+ */
+static int lxmlQueryParseStep(struct XMLQuery *query, const char *expr, size_t *i, int descendant) {
+    struct XMLQueryStep *steps = lxmlArenaRealloc(query->arena, query->steps, sizeof(struct XMLQueryStep) * query->stepCount, sizeof(struct XMLQueryStep) * (query->stepCount + 1));
+    int success = FALSE;
+
+    if (NULL != steps) {
+        struct XMLQueryStep *step = &steps[query->stepCount];
+        size_t nameLen = 0;
+
+        memset(step, '\0', sizeof(struct XMLQueryStep));
+        step->descendant = descendant;
+        query->steps = steps;
+
+        if ('@' == expr[*i]) {
+            step->attribute = TRUE;
+            ++*i;
+        }
+
+        if ('*' == expr[*i]) {
+            ++*i;
+            success = TRUE;
+        } else if (0 != (nameLen = lxmlQueryNameLen(expr, *i))) {
+            step->name = lxmlArenaStrndup(query->arena, expr + *i, nameLen);
+            step->nameLen = nameLen;
+            *i += nameLen;
+            success = (NULL != step->name) ? TRUE : FALSE;
+        }
+
+        while (TRUE == success && FALSE == step->attribute && '[' == expr[*i])
+            success = lxmlQueryParsePredicate(query->arena, step, expr, i);
+
+        if (TRUE == success && '\0' != expr[*i] && '/' != expr[*i])
+            success = FALSE;
+
+        if (TRUE == success)
+            ++query->stepCount;
+    }
+
+    return success;
+} /* End of lxmlQueryParseStep */
+
+/**
+ * @brief Parses the predicate at 'expr[*i]', which starts with '[', into 'step'
+ *
+ * @param  arena   - The 'XMLArena' of the query
+ * @param  step    - The 'XMLQueryStep' to add the predicate to
+ * @param  expr    - The expression being compiled
+ * @param  i       - The offset of the predicate, advanced past it
+ * @return success - 'FALSE' when the predicate is malformed or out of memory
+ */
+static int lxmlQueryParsePredicate(struct XMLArena *arena, struct XMLQueryStep *step, const char *expr, size_t *i) {
+    struct XMLQueryPredicate *predicates = NULL, *predicate = NULL;
+    int success = FALSE;
+
+    if (step->predicateCount < LXML_QUERY_MAX_PREDICATES)
+        predicates = lxmlArenaRealloc(arena, step->predicates, sizeof(struct XMLQueryPredicate) * step->predicateCount, sizeof(struct XMLQueryPredicate) * (step->predicateCount + 1));
+
+    if (NULL != predicates) {
+        predicate = &predicates[step->predicateCount];
+        memset(predicate, '\0', sizeof(struct XMLQueryPredicate));
+        step->predicates = predicates;
+
+        ++*i;
+        lxmlQuerySkipSpace(expr, i);
+
+        /* Position */
+        if ('0' <= expr[*i] && '9' >= expr[*i]) {
+            while ('0' <= expr[*i] && '9' >= expr[*i])
+                predicate->position = predicate->position * 10 + (size_t) (expr[(*i)++] - '0');
+
+            success = (0 != predicate->position) ? TRUE : FALSE;
+            step->positional = TRUE;
+        }
+
+        /* Attribute presence or equality */
+        else if ('@' == expr[*i]) {
+            size_t keyLen = lxmlQueryNameLen(expr, ++*i);
+
+            predicate->key = lxmlArenaStrndup(arena, expr + *i, keyLen);
+            *i += keyLen;
+            lxmlQuerySkipSpace(expr, i);
+
+            success = (NULL != predicate->key) ? TRUE : FALSE;
+
+            if (TRUE == success && '=' == expr[*i]) {
+                const char *close = NULL;
+                char quote = '\0';
+
+                ++*i;
+                lxmlQuerySkipSpace(expr, i);
+                quote = expr[*i];
+
+                if (('\'' == quote || '"' == quote) && NULL != (close = strchr(expr + *i + 1, quote))) {
+                    predicate->valueLen = (size_t) (close - (expr + *i + 1));
+
+                    /* An empty value is still a value to compare against */
+                    predicate->value = lxmlArenaAlloc(arena, predicate->valueLen + 1);
+
+                    if (NULL != predicate->value) {
+                        memcpy(predicate->value, expr + *i + 1, predicate->valueLen);
+                        predicate->value[predicate->valueLen] = '\0';
+                    } else
+                        success = FALSE;
+
+                    *i = (size_t) (close - expr) + 1;
+                } else
+                    success = FALSE;
+            }
+        }
+
+        lxmlQuerySkipSpace(expr, i);
+
+        if (TRUE == success && ']' == expr[*i]) {
+            ++*i;
+            ++step->predicateCount;
+        } else
+            success = FALSE;
+    }
+
+    return success;
+} /* End of lxmlQueryParsePredicate */
+
+/**
+ * @brief Obtains the length of the name starting at 'expr[i]'
+ *
+ * @param  expr - The expression being compiled
+ * @param  i    - The offset of the name
+ * @return len  - The number of bytes in the name, 0 when there is none
+ */
+static size_t lxmlQueryNameLen(const char *expr, size_t i) {
+    size_t len = 0;
+
+    while ('\0' != expr[i + len] && NULL == strchr("/[]@=*'\"", expr[i + len]) && FALSE == lxmlIsSpace(expr[i + len]))
+        ++len;
+
+    return len;
+} /* End of lxmlQueryNameLen */
+
+/**
+ * @brief Advances '*i' past any white space in 'expr'
+ *
+ * @param expr - The expression being compiled
+ * @param i    - The offset to advance
+ */
+static void lxmlQuerySkipSpace(const char *expr, size_t *i) {
+    while (TRUE == lxmlIsSpace(expr[*i]))
+        ++*i;
+} /* End of lxmlQuerySkipSpace */
+
+/**
+ * @brief Applies step 'k' of 'query' to 'context', continuing with the next step from every match
+ *        Descendant steps walk the subtree in document order, so matches stay in document order
+ *
+ * @param query   - The 'XMLQuery' being evaluated
+ * @param k       - The step to apply
+ * @param context - The 'XMLNode' the step is applied to
+ * @param eval    - The state of the evaluation
+ */
+static void lxmlQueryStep(const struct XMLQuery *query, size_t k, struct XMLNode *context, struct XMLQueryEval *eval) {
+    const struct XMLQueryStep *step = &query->steps[k];
+    size_t counts[LXML_QUERY_MAX_PREDICATES], i = 0;
+
+    memset(counts, '\0', sizeof(counts));
+
+    if (FALSE == XMLNode_expand(context))
+        eval->stopped = eval->failed = TRUE;
+
+    else if (TRUE == step->descendant) {
+        struct XMLQueryWalk walk;
+
+        /* Rows of 'stackCounts' are cleared as the walk reaches them */
+        walk.query = query;
+        walk.k = k;
+        walk.eval = eval;
+        walk.counts = walk.stackCounts;
+        walk.rows = LXML_WALK_STACK_SIZE;
+
+        /* The walk only stops by itself when its stack cannot grow or a node cannot be built */
+        if (FALSE == XMLNode_walk(context, lxmlQueryDescendant, NULL, &walk) && FALSE == eval->stopped)
+            eval->stopped = eval->failed = TRUE;
+
+        if (walk.counts != walk.stackCounts)
+            free(walk.counts);
+    }
+
+    else if (TRUE == step->attribute)
+        lxmlQueryAttributes(step, context, eval);
+
+    /* Children already indexed by tag are found without testing every one */
+    else if (NULL != step->name && NULL != context->children.index) {
+        struct XMLNode *child = NULL;
+
+        while (FALSE == eval->stopped && NULL != (child = XMLNode_getNextImmediateElementByTagName(context, step->name, &i)))
+            if (TRUE == lxmlQueryPredicates(step, child, counts))
+                lxmlQueryMatch(query, k, child, eval);
+    } else {
+        for (; i < context->children.size && FALSE == eval->stopped; ++i) {
+            struct XMLNode *child = context->children.data[i];
+
+            if ((NULL == step->name || TRUE == lxmlQueryNameEquals(child->tag, child->tagLen, step->name, step->nameLen))
+                && TRUE == lxmlQueryPredicates(step, child, counts))
+                lxmlQueryMatch(query, k, child, eval);
+        }
+    }
+} /* End of lxmlQueryStep */
+
+/**
+ * @brief Continues the evaluation from 'node', which matched step 'k'
+ *
+ * @param query - The 'XMLQuery' being evaluated
+ * @param k     - The step 'node' matched
+ * @param node  - The matching 'XMLNode'
+ * @param eval  - The state of the evaluation
+ */
+static void lxmlQueryMatch(const struct XMLQuery *query, size_t k, struct XMLNode *node, struct XMLQueryEval *eval) {
+    if (k + 1 < query->stepCount)
+        lxmlQueryStep(query, k + 1, node, eval);
+    else {
+        ++eval->matches;
+
+        if (NULL != eval->callback && FALSE == eval->callback(eval->ctx, node, NULL))
+            eval->stopped = TRUE;
+    }
+} /* End of lxmlQueryMatch */
+
+/**
+ * @brief Applies the descendant step 'walk->k' to 'node', the walk's root only has its attributes tested
+ *        **Note:** See 'XMLNode_walk' for the parameters, 'ctx' is a 'struct XMLQueryWalk'
+ */
+static enum XMLWalkAction lxmlQueryDescendant(void *ctx, struct XMLNode *node, size_t depth) {
+    struct XMLQueryWalk *walk = ctx;
+    const struct XMLQueryStep *step = &walk->query->steps[walk->k];
+
+    if (TRUE == step->attribute)
+        lxmlQueryAttributes(step, node, walk->eval);
+    else if (0 != depth && (NULL == step->name || TRUE == lxmlQueryNameEquals(node->tag, node->tagLen, step->name, step->nameLen))
+             && TRUE == lxmlQueryPredicates(step, node, (TRUE == step->positional) ? walk->counts + depth * LXML_QUERY_MAX_PREDICATES : NULL))
+        lxmlQueryMatch(walk->query, walk->k, node, walk->eval);
+
+    /* Positions among the children of 'node' start again from zero */
+    if (FALSE == walk->eval->stopped && FALSE == step->attribute && TRUE == step->positional) {
+        if (depth + 2 > walk->rows) {
+            size_t rows = walk->rows * 2;
+            size_t *tmp = (walk->counts == walk->stackCounts) ? malloc(sizeof(size_t) * LXML_QUERY_MAX_PREDICATES * rows)
+                                                              : realloc(walk->counts, sizeof(size_t) * LXML_QUERY_MAX_PREDICATES * rows);
+
+            if (NULL != tmp) {
+                if (walk->counts == walk->stackCounts)
+                    memcpy(tmp, walk->stackCounts, sizeof(walk->stackCounts));
+
+                walk->counts = tmp;
+                walk->rows = rows;
+            } else {
+                fprintf(stderr, "Out of memory\n");
+                walk->eval->stopped = walk->eval->failed = TRUE;
+            }
+        }
+
+        if (FALSE == walk->eval->stopped)
+            memset(walk->counts + (depth + 1) * LXML_QUERY_MAX_PREDICATES, '\0', sizeof(size_t) * LXML_QUERY_MAX_PREDICATES);
+    }
+
+    return (FALSE == walk->eval->stopped) ? LXML_WALK_CONTINUE : LXML_WALK_STOP;
+} /* End of lxmlQueryDescendant */
+
+/**
+ * @brief Reports the attributes of 'node' selected by the attribute 'step'
+ *
+ * @param step - The attribute 'XMLQueryStep'
+ * @param node - The 'XMLNode' whose attributes to test
+ * @param eval - The state of the evaluation
+ */
+static void lxmlQueryAttributes(const struct XMLQueryStep *step, struct XMLNode *node, struct XMLQueryEval *eval) {
+    size_t i = 0;
+
+    for (; i < node->attributes.size && FALSE == eval->stopped; ++i) {
+        struct XMLAttribute *attr = &node->attributes.attribute[i];
+
+        if (NULL != attr->key && (NULL == step->name || TRUE == lxmlQueryNameEquals(attr->key, attr->keyLen, step->name, step->nameLen))) {
+            ++eval->matches;
+
+            if (NULL != eval->callback && FALSE == eval->callback(eval->ctx, node, attr))
+                eval->stopped = TRUE;
+        }
+    }
+} /* End of lxmlQueryAttributes */
+
+/**
+ * @brief Tests 'node' against the predicates of 'step' in order
+ *
+ * @param  step    - The 'XMLQueryStep' holding the predicates
+ * @param  node    - The candidate 'XMLNode', whose name already matched
+ * @param  counts  - The number of candidates that reached each predicate so far, only read by position predicates
+ * @return success - A flag indicating whether 'node' passed every predicate
+ */
+static int lxmlQueryPredicates(const struct XMLQueryStep *step, struct XMLNode *node, size_t *counts) {
+    int success = TRUE;
+    size_t i = 0;
+
+    for (; i < step->predicateCount && TRUE == success; ++i) {
+        const struct XMLQueryPredicate *predicate = &step->predicates[i];
+
+        if (0 != predicate->position)
+            success = (++counts[i] == predicate->position) ? TRUE : FALSE;
+        else {
+            struct XMLAttribute *attr = XMLAttributeList_getAttribute(&node->attributes, predicate->key);
+
+            success = (NULL != attr) ? TRUE : FALSE;
+
+            if (TRUE == success && NULL != predicate->value)
+                success = lxmlQueryNameEquals(attr->value, attr->valueLen, predicate->value, predicate->valueLen);
+        }
+    }
+
+    return success;
+} /* End of lxmlQueryPredicates */
+
+/**
+ * @brief Compares a string stored with an optional length against 'nameLen' bytes of 'name'
+ *
+ * @param  view    - The string, this is only NUL terminated when 'len' is zero
+ * @param  len     - The stored length of 'view'
+ * @param  name    - The name to compare against
+ * @param  nameLen - The number of bytes in 'name'
+ * @return success - A flag indicating whether both are equal
+ */
+static int lxmlQueryNameEquals(const char *view, size_t len, const char *name, size_t nameLen) {
+    return (lxmlViewLen(view, len) == nameLen && (0 == nameLen || 0 == memcmp(view, name, nameLen))) ? TRUE : FALSE;
+} /* End of lxmlQueryNameEquals */
+
+/**
+ * @brief Reads the rest of the file, from where 'fp' stands, into memory
+ *        and returns it as a 'calloc' piece of memory 'buf'
+ *        **Note:** On failure 'fp' is seeked back to where it stood, so it can still be read as a stream
+ *
+ * @param fp - The file pointer to read
+ * @return buf - The buffer containing all of the files contents
+ */
+static char* lxmlReadXmlContentsIntoMemory(FILE *fp) {
+    char *buf = NULL;
+
+    if (NULL != fp) {
+        lxmlFileOffset start = lxmlFtell(fp), fileSize = -1;
+
+        if (start >= 0 && 0 == lxmlFseek(fp, 0, SEEK_END)) {
+            fileSize = lxmlFtell(fp);
+            fileSize = (fileSize >= start && 0 == lxmlFseek(fp, start, SEEK_SET)) ? fileSize - start : -1;
+        }
+
+        /* Reject sizes that cannot be represented once the terminator is added */
+        if (fileSize >= 0 && (size_t) fileSize < (size_t) -1 && (lxmlFileOffset) (size_t) fileSize == fileSize)
+            buf = calloc((size_t) fileSize + 1, sizeof(char));
+
+        if (NULL != buf) {
+            size_t bytesRead = fread(buf, sizeof(char), (size_t) fileSize, fp);
+
+            if (fileSize > 0 && bytesRead != (size_t) fileSize) {
+                free(buf);
+                buf = NULL;
+            }
+        }
+
+        if (NULL == buf && start >= 0)
+            lxmlFseek(fp, start, SEEK_SET);
+    }
+
+    return buf;
+} /* End of lxmlReadXmlContentsIntoMemory */
+
+/**
+ * @brief Writes 'node' and its subtree, a node without a tag, such as 'doc->root', writes only its children
+ *
+ * @param  writer  - The 'XMLWriter' to write to
+ * @param  node    - The 'XMLNode' to write
+ * @param  indent  - The number of white spaces to place per level
+ * @return success - 'FALSE' once 'writer->error' is set, which includes a walk that stopped part-way
+ */
+static int lxmlWriteNode(struct XMLWriter *writer, struct XMLNode *node, int indent) {
+    writer->indent = indent;
+    writer->times = 0;
+
+    /* The walk stops by itself when its stack cannot grow or a lazy node cannot be built */
+    if (FALSE == XMLNode_walk(node, lxmlWriteNodeEnter, lxmlWriteNodeLeave, writer))
+        writer->error = TRUE;
+
+    return (FALSE == writer->error) ? TRUE : FALSE;
+} /* End of lxmlWriteNode */
+
+/**
+ * @brief Writes the start tag of 'node', or the whole element when it has no children
+ *        **Note:** See 'XMLNode_walk' for the parameters
+ */
+static enum XMLWalkAction lxmlWriteNodeEnter(void *ctx, struct XMLNode *node, size_t depth) {
+    struct XMLWriter *writer = ctx;
+    size_t i = 0;
+
+    (void) depth;
+
+    if (NULL != node->tag) {
+        lxmlWriterIndent(writer, writer->indent, writer->times);
+        lxmlWriterPut(writer, "<", 1);
+        lxmlWriterPutView(writer, node->tag, node->tagLen);
+
+        for (; i < node->attributes.size; ++i) {
+            struct XMLAttribute *attr = &node->attributes.attribute[i];
+            size_t valueLen = lxmlViewLen(attr->value, attr->valueLen);
+
+            if (0 != valueLen) {
+                /* Values read from single quotes may hold double quotes */
+                const char *quote = (NULL == memchr(attr->value, '"', valueLen)) ? "\"" : "'";
+
+                lxmlWriterPut(writer, " ", 1);
+                lxmlWriterPutView(writer, attr->key, attr->keyLen);
+                lxmlWriterPut(writer, "=", 1);
+                lxmlWriterPut(writer, quote, 1);
+                lxmlWriterPutEscaped(writer, attr->value, valueLen, quote[0]);
+                lxmlWriterPut(writer, quote, 1);
+            }
+        }
+
+        if (0 != node->children.size) {
+            lxmlWriterPut(writer, ">\n", 2);
+            ++writer->times;
+        } else if (NULL == node->inner_text)
+            lxmlWriterPut(writer, " />\n", 4);
+        else {
+            lxmlWriterPut(writer, ">", 1);
+            lxmlWriterPutEscaped(writer, node->inner_text, lxmlViewLen(node->inner_text, node->innerTextLen), '\0');
+            lxmlWriterPut(writer, "</", 2);
+            lxmlWriterPutView(writer, node->tag, node->tagLen);
+            lxmlWriterPut(writer, ">\n", 2);
+        }
+    }
+
+    return LXML_WALK_CONTINUE;
+} /* End of lxmlWriteNodeEnter */
+
+/**
+ * @brief Writes the end tag of 'node' when it has children
+ *        **Note:** See 'XMLNode_walk' for the parameters
+ */
+static enum XMLWalkAction lxmlWriteNodeLeave(void *ctx, struct XMLNode *node, size_t depth) {
+    struct XMLWriter *writer = ctx;
+
+    (void) depth;
+
+    if (NULL != node->tag && 0 != node->children.size) {
+        --writer->times;
+        lxmlWriterIndent(writer, writer->indent, writer->times);
+        lxmlWriterPut(writer, "</", 2);
+        lxmlWriterPutView(writer, node->tag, node->tagLen);
+        lxmlWriterPut(writer, ">\n", 2);
+    }
+
+    return LXML_WALK_CONTINUE;
+} /* End of lxmlWriteNodeLeave */
+
+#ifdef LXML_HAVE_THREADS
+/**
+ * @brief Worker of 'XMLDocument_writeParallel', serializes the next unclaimed block of
+ *        siblings into its slot while the slot is free
+ *
+ * @param  arg  - The shared 'XMLParallelWriter'
+ * @return NULL - Always
+ */
+static void* lxmlParallelWriterRun(void *arg) {
+    struct XMLParallelWriter *pw = arg;
+
+    pthread_mutex_lock(&pw->lock);
+
+    while (1) {
+        struct XMLWriter *slot = NULL;
+        size_t block = 0, i = 0, end = 0;
+
+        while (FALSE == pw->error && pw->next < pw->blocks && pw->next >= pw->written + pw->window)
+            pthread_cond_wait(&pw->cond, &pw->lock);
+
+        if (TRUE == pw->error || pw->next >= pw->blocks)
+            break;
+
+        block = pw->next++;
+        slot = &pw->slots[block % pw->window];
+        pthread_mutex_unlock(&pw->lock);
+
+        slot->size = 0;
+        slot->indent = pw->indent;
+        i = block * pw->blockNodes;
+        end = (i + pw->blockNodes < pw->parent->children.size) ? i + pw->blockNodes : pw->parent->children.size;
+
+        for (; i < end && FALSE == slot->error; ++i) {
+            slot->times = pw->times;
+            if (FALSE == XMLNode_walk(pw->parent->children.data[i], lxmlWriteNodeEnter, lxmlWriteNodeLeave, slot))
+                slot->error = TRUE;
+        }
+
+        pthread_mutex_lock(&pw->lock);
+
+        if (TRUE == slot->error)
+            pw->error = TRUE;
+
+        pw->ready[block % pw->window] = TRUE;
+        pthread_cond_broadcast(&pw->cond);
+    }
+
+    pthread_mutex_unlock(&pw->lock);
+
+    return NULL;
+} /* End of lxmlParallelWriterRun */
+
+/**
+ * @brief Writes each block to 'writer' in order as the workers finish them, freeing their slots
+ *
+ * @param pw     - The shared 'XMLParallelWriter'
+ * @param writer - The 'XMLWriter' of the output
+ */
+static void lxmlParallelWriterOutput(struct XMLParallelWriter *pw, struct XMLWriter *writer) {
+    size_t block = 0;
+
+    for (; block < pw->blocks; ++block) {
+        struct XMLWriter *slot = &pw->slots[block % pw->window];
+        int error = FALSE;
+
+        pthread_mutex_lock(&pw->lock);
+        while (FALSE == pw->error && FALSE == pw->ready[block % pw->window])
+            pthread_cond_wait(&pw->cond, &pw->lock);
+        error = pw->error;
+        pthread_mutex_unlock(&pw->lock);
+
+        if (TRUE == error)
+            break;
+
+        /* The slot is not touched by the workers until it is released below */
+        lxmlWriterPut(writer, slot->buf, slot->size);
+
+        pthread_mutex_lock(&pw->lock);
+        pw->ready[block % pw->window] = FALSE;
+        ++pw->written;
+
+        if (TRUE == writer->error)
+            pw->error = TRUE;
+
+        pthread_cond_broadcast(&pw->cond);
+        pthread_mutex_unlock(&pw->lock);
+    }
+} /* End of lxmlParallelWriterOutput */
+#endif
+
+/**
+ * @brief Writes the '<?xml ... ?>' declaration of 'doc'
+ *
+ * @param writer - The 'XMLWriter' to write to
+ * @param doc    - The document being written
+ */
+static void lxmlWriteDeclaration(struct XMLWriter *writer, struct XMLDocument *doc) {
+    const char *version = (NULL != doc->version) ? doc->version : "1.0",
+               *encoding = (NULL != doc->encoding) ? doc->encoding : "UTF-8";
+
+    lxmlWriterPut(writer, "<?xml version=\"", 15);
+    lxmlWriterPut(writer, version, strlen(version));
+    lxmlWriterPut(writer, "\" encoding=\"", 12);
+    lxmlWriterPut(writer, encoding, strlen(encoding));
+    lxmlWriterPut(writer, "\" ?>\n", 5);
+} /* End of lxmlWriteDeclaration */
+
+/**
+ * @brief Appends 'len' bytes of 'str' to 'writer', flushing to 'writer->fp' when the buffer is full
+ *        or growing the buffer when there is no 'fp'. Without a buffer the bytes are only counted
+ *
+ * @param writer - The 'XMLWriter' to append to
+ * @param str    - The bytes to append
+ * @param len    - The number of bytes in 'str'
+ */
+static void lxmlWriterPut(struct XMLWriter *writer, const char *str, size_t len) {
+    if (NULL == writer->buf)
+        writer->size += len;
+    else {
+        if (writer->size + len > writer->capacity && NULL != writer->fp)
+            lxmlWriterFlush(writer);
+
+        if (writer->size + len <= writer->capacity) {
+            memcpy(writer->buf + writer->size, str, len);
+            writer->size += len;
+        } else if (NULL != writer->fp) {
+            /* Larger than the whole buffer */
+            if (fwrite(str, sizeof(char), len, writer->fp) != len)
+                writer->error = TRUE;
+        } else {
+            /* Memory output grows to fit */
+            size_t capacity = writer->capacity * 2;
+            char *tmp = NULL;
+
+            while (capacity < writer->size + len)
+                capacity *= 2;
+
+            tmp = realloc(writer->buf, capacity);
+
+            if (NULL != tmp) {
+                writer->buf = tmp;
+                writer->capacity = capacity;
+                memcpy(writer->buf + writer->size, str, len);
+                writer->size += len;
+            } else
+                writer->error = TRUE;
+        }
+    }
+} /* End of lxmlWriterPut */
+
+/**
+ * @brief Appends a view to 'writer', see 'lxmlWriterPut'
+ *
+ * @param writer - The 'XMLWriter' to append to
+ * @param view   - The string, this is only NUL terminated when 'len' is zero
+ * @param len    - The stored length of 'view'
+ */
+static void lxmlWriterPutView(struct XMLWriter *writer, const char *view, size_t len) {
+    if (NULL != view)
+        lxmlWriterPut(writer, view, lxmlViewLen(view, len));
+} /* End of lxmlWriterPutView */
+
+/**
+ * @brief Appends text or an attribute value to 'writer', replacing '&', '<' and either '>' in text
+ *        or the quote of a value with references. Runs between them are found with 'lxmlScan3'
+ *        so strings without any are appended at once
+ *
+ * @param writer - The 'XMLWriter' to append to
+ * @param str    - The bytes to append
+ * @param len    - The number of bytes in 'str'
+ * @param quote  - The quote around an attribute value or '\0' for text
+ */
+static void lxmlWriterPutEscaped(struct XMLWriter *writer, const char *str, size_t len, char quote) {
+    size_t from = 0;
+
+    while (from < len) {
+        size_t i = lxmlScan3(str, len, from, '&', '<', ('\0' != quote) ? quote : '>');
+
+        lxmlWriterPut(writer, str + from, i - from);
+
+        if (i < len) {
+            if ('&' == str[i])
+                lxmlWriterPut(writer, "&amp;", 5);
+            else if ('<' == str[i])
+                lxmlWriterPut(writer, "&lt;", 4);
+            else if ('>' == str[i])
+                lxmlWriterPut(writer, "&gt;", 4);
+            else if ('"' == str[i])
+                lxmlWriterPut(writer, "&quot;", 6);
+            else
+                lxmlWriterPut(writer, "&apos;", 6);
+        }
+
+        from = i + 1;
+    }
+} /* End of lxmlWriterPutEscaped */
+
+/**
+ * @brief Appends the indentation for depth 'times', nothing at the top level
+ *        Matches the historic '%*s' output, which writes at least one space
+ *
+ * @param writer - The 'XMLWriter' to append to
+ * @param indent - The number of white spaces to place per level
+ * @param times  - The depth being indented
+ */
+static void lxmlWriterIndent(struct XMLWriter *writer, int indent, int times) {
+    static const char spaces[] = "                                                                ";
+
+    if (times > 0) {
+        size_t width = (indent * times > 1) ? (size_t) (indent * times) : 1;
+
+        while (width > 0) {
+            size_t n = (width < sizeof(spaces) - 1) ? width : sizeof(spaces) - 1;
+
+            lxmlWriterPut(writer, spaces, n);
+            width -= n;
+        }
+    }
+} /* End of lxmlWriterIndent */
+
+/**
+ * @brief Writes the buffered bytes of 'writer' to 'writer->fp'
+ *
+ * @param  writer  - The 'XMLWriter' to flush
+ * @return success - 'FALSE' if any write so far has failed
+ */
+static int lxmlWriterFlush(struct XMLWriter *writer) {
+    if (NULL != writer->fp && 0 != writer->size) {
+        if (fwrite(writer->buf, sizeof(char), writer->size, writer->fp) != writer->size)
+            writer->error = TRUE;
+
+        writer->size = 0;
+    }
+
+    return (FALSE == writer->error) ? TRUE : FALSE;
+} /* End of lxmlWriterFlush */
+
+/**
+ * @brief Appends 'size' zeroed bytes to the snapshot being built, aligned to 4 bytes
+ *
+ * @param  writer - The 'XMLSnapshotWriter' to append to
+ * @param  size   - The number of bytes needed
+ * @return offset - The offset of the bytes, 0 once 'writer->error' is set
+ */
+static size_t lxmlSnapshotReserve(struct XMLSnapshotWriter *writer, size_t size) {
+    size_t offset = writer->size, end = 0;
+
+    /* 'offset' never exceeds 'LXML_SNAPSHOT_MAX_SIZE' so this cannot wrap */
+    if (FALSE == writer->error && size > LXML_SNAPSHOT_MAX_SIZE - offset) {
+        fprintf(stderr, "Document too large for a snapshot\n");
+        writer->error = TRUE;
+    }
+
+    end = (offset + size + 3) & ~(size_t) 3;
+
+    if (FALSE == writer->error && end > writer->capacity) {
+        size_t capacity = (0 != writer->capacity) ? writer->capacity : LXML_WRITE_BUFFER_SIZE;
+        unsigned char *tmp = NULL;
+
+        while (capacity < end)
+            capacity *= 2;
+
+        tmp = realloc(writer->buf, capacity);
+
+        if (NULL != tmp) {
+            writer->buf = tmp;
+            writer->capacity = capacity;
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            writer->error = TRUE;
+        }
+    }
+
+    if (FALSE == writer->error) {
+        memset(writer->buf + offset, '\0', end - offset);
+        writer->size = end;
+    }
+
+    return (FALSE == writer->error) ? offset : 0;
+} /* End of lxmlSnapshotReserve */
+
+/**
+ * @brief Appends a string to the snapshot being built
+ *        With 'intern' a string written before with the same bytes is reused
+ *
+ * @param  writer - The 'XMLSnapshotWriter' to append to
+ * @param  str    - The string, this does not need to be NUL terminated
+ * @param  len    - The number of bytes in 'str'
+ * @param  intern - A flag indicating that 'str' is a name which is likely to repeat
+ * @return offset - The offset of the string, 0 once 'writer->error' is set
+ */
+static size_t lxmlSnapshotPutString(struct XMLSnapshotWriter *writer, const char *str, size_t len, int intern) {
+    size_t *slot = NULL, offset = 0;
+
+    if (TRUE == intern && writer->namesSize * 2 >= writer->namesCapacity) {
+        size_t capacity = (0 != writer->namesCapacity) ? writer->namesCapacity * 2 : LXML_NAME_TABLE_SIZE, i = 0;
+        size_t *names = calloc(capacity, sizeof(size_t));
+
+        if (NULL != names) {
+            for (; i < writer->namesCapacity; ++i) {
+                if (0 != writer->names[i]) {
+                    const unsigned char *name = writer->buf + writer->names[i];
+
+                    *lxmlSnapshotNameSlot(names, capacity, writer->buf, (const char*) name + 4, lxmlSnapshotGet32(name)) = writer->names[i];
+                }
+            }
+
+            free(writer->names);
+            writer->names = names;
+            writer->namesCapacity = capacity;
+        }
+    }
+
+    /* Without room in the table the name is simply written again */
+    if (TRUE == intern && writer->namesSize * 2 < writer->namesCapacity) {
+        slot = lxmlSnapshotNameSlot(writer->names, writer->namesCapacity, writer->buf, str, len);
+        offset = *slot;
+    }
+
+    if (0 == offset && 0 != (offset = lxmlSnapshotReserve(writer, len + 5))) {
+        lxmlSnapshotPut32(writer->buf + offset, len);
+        memcpy(writer->buf + offset + 4, str, len);
+
+        if (NULL != slot) {
+            *slot = offset;
+            ++writer->namesSize;
+        }
+    }
+
+    return offset;
+} /* End of lxmlSnapshotPutString */
+
+/**
+ * @brief Finds the slot of a name in the table of an 'XMLSnapshotWriter'
+ *
+ * @param  names    - The slots of the table
+ * @param  capacity - The number of slots, a power of two
+ * @param  buf      - The snapshot the slots point into
+ * @param  name     - The name to find, this does not need to be NUL terminated
+ * @param  len      - The number of bytes in 'name'
+ * @return slot     - The slot holding 'name' or the free slot it belongs in
+ */
+static size_t* lxmlSnapshotNameSlot(size_t *names, size_t capacity, const unsigned char *buf, const char *name, size_t len) {
+    size_t i = (size_t) lxmlHashName(name, len) & (capacity - 1);
+
+    while (0 != names[i] && (len != lxmlSnapshotGet32(buf + names[i]) || 0 != memcmp(buf + names[i] + 4, name, len)))
+        i = (i + 1) & (capacity - 1);
+
+    return &names[i];
+} /* End of lxmlSnapshotNameSlot */
+
+/**
+ * @brief Writes the record and strings of a node to the snapshot being built
+ *        and its offset into the child slot it fills in its parent
+ *        **Note:** See 'XMLNode_walk' for the parameters
+ */
+static enum XMLWalkAction lxmlSnapshotWriteEnter(void *ctx, struct XMLNode *node, size_t depth) {
+    struct XMLSnapshotWriter *writer = ctx;
+    size_t attrs = node->attributes.size, record = 0, offset = 0, i = 0;
+
+    if (depth >= writer->framesHeapSize) {
+        size_t heapSize = (0 != writer->framesHeapSize) ? writer->framesHeapSize * 2 : LXML_WALK_STACK_SIZE;
+        struct XMLSnapshotFrame *tmp = realloc(writer->frames, sizeof(struct XMLSnapshotFrame) * heapSize);
+
+        if (NULL != tmp) {
+            writer->frames = tmp;
+            writer->framesHeapSize = heapSize;
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            writer->error = TRUE;
+        }
+    }
+
+    record = lxmlSnapshotReserve(writer, LXML_SNAPSHOT_NODE_SIZE + 8 * attrs + 4 * node->children.size);
+
+    if (FALSE == writer->error) {
+        writer->frames[depth].node = record;
+        writer->frames[depth].next = 0;
+        ++writer->nodes;
+
+        if (0 != depth) {
+            struct XMLSnapshotFrame *parent = &writer->frames[depth - 1];
+            size_t slot = parent->node + LXML_SNAPSHOT_NODE_SIZE + 8 * lxmlSnapshotGet32(writer->buf + parent->node + 12) + 4 * parent->next++;
+
+            lxmlSnapshotPut32(writer->buf + slot, record);
+            lxmlSnapshotPut32(writer->buf + record + 8, parent->node);
+        }
+
+        lxmlSnapshotPut32(writer->buf + record + 12, attrs);
+        lxmlSnapshotPut32(writer->buf + record + 16, node->children.size);
+    }
+
+    /* Writing a string may move 'writer->buf', so each offset is stored once it is known */
+    if (FALSE == writer->error && NULL != node->tag) {
+        offset = lxmlSnapshotPutString(writer, node->tag, lxmlViewLen(node->tag, node->tagLen), TRUE);
+        lxmlSnapshotPut32(writer->buf + record, offset);
+    }
+
+    if (FALSE == writer->error && NULL != node->inner_text) {
+        offset = lxmlSnapshotPutString(writer, node->inner_text, lxmlViewLen(node->inner_text, node->innerTextLen), FALSE);
+        lxmlSnapshotPut32(writer->buf + record + 4, offset);
+    }
+
+    for (; FALSE == writer->error && i < attrs; ++i) {
+        struct XMLAttribute *attr = &node->attributes.attribute[i];
+
+        if (NULL != attr->key) {
+            offset = lxmlSnapshotPutString(writer, attr->key, lxmlViewLen(attr->key, attr->keyLen), TRUE);
+            lxmlSnapshotPut32(writer->buf + record + LXML_SNAPSHOT_NODE_SIZE + 8 * i, offset);
+        }
+
+        if (FALSE == writer->error && NULL != attr->value) {
+            offset = lxmlSnapshotPutString(writer, attr->value, lxmlViewLen(attr->value, attr->valueLen), FALSE);
+            lxmlSnapshotPut32(writer->buf + record + LXML_SNAPSHOT_NODE_SIZE + 8 * i + 4, offset);
+        }
     }
 
-    return attrVal;
-}/* End of XMLAttributeList_getAttributeValue */
+    return (FALSE == writer->error) ? LXML_WALK_CONTINUE : LXML_WALK_STOP;
+} /* End of lxmlSnapshotWriteEnter */
 
 /**
- * @brief Convenience function to add an 'XMLNode' to the 'children'
- *        **Note:** See 'XMLNodeList_add' for implementation
+ * @brief Checks that a whole node record lies within 'snapshot'
  *
- * @param self - A reference to the struct you wish to add the node to
- * @param node - The 'XMLNode' to add to 'self'
- * @return success - A flag indicating the status of the subroutine
+ * @param  snapshot - The snapshot holding 'node'
+ * @param  node     - The offset of the record
+ * @param  attrs    - Set to the number of attributes of the node
+ * @param  children - Set to the number of children of the node
+ * @return record   - The record or 'NULL' when 'node' is not a valid record
  */
-static int XMLNode_add(struct XMLNode *self, struct XMLNode *node) {
-    return (NULL != self && NULL != self->children.add && NULL != node) ? self->children.add(&self->children, self, node) : FALSE;
-} /* End of XMLNode_add */
+static const unsigned char* lxmlSnapshotNode(const struct XMLSnapshot *snapshot, size_t node, size_t *attrs, size_t *children) {
+    const unsigned char *record = NULL;
+
+    *attrs = *children = 0;
+
+    if (NULL != snapshot && LXML_SNAPSHOT_HEADER_SIZE <= node && 0 == node % 4 && node < snapshot->size
+        && LXML_SNAPSHOT_NODE_SIZE <= snapshot->size - node) {
+        size_t room = snapshot->size - node - LXML_SNAPSHOT_NODE_SIZE;
+
+        *attrs = lxmlSnapshotGet32(snapshot->data + node + 12);
+        *children = lxmlSnapshotGet32(snapshot->data + node + 16);
+
+        if (*attrs <= room / 8 && *children <= (room - 8 * *attrs) / 4)
+            record = snapshot->data + node;
+        else
+            *attrs = *children = 0;
+    }
+
+    return record;
+} /* End of lxmlSnapshotNode */
 
 /**
- * @brief Convenience function to add and append 'XMLNode' to the 'children'
- *        **Note:** See 'XMLNode_add' for implementation
+ * @brief Checks that a whole string lies within 'snapshot'
  *
- * @param  self - A reference to the struct you wish to add the node to
- * @return node - The new node that's been appended to the XMLNodeList
+ * @param  snapshot - The snapshot holding the string
+ * @param  offset   - The offset of the string, 0 for none
+ * @param  len      - Set to the length of the string
+ * @return str      - The NUL terminated string or 'NULL' when there is none or it is invalid
  */
-static struct XMLNode* XMLNode_createAndAppend(struct XMLNode *self) {
-    struct XMLNode *node = NULL;
+static const char* lxmlSnapshotString(const struct XMLSnapshot *snapshot, size_t offset, size_t *len) {
+    const char *str = NULL;
 
-    if (NULL != self) {
-        node = XMLNode_init();
+    *len = 0;
 
-        if (NULL != node) {
-            int success = self->add(self, node);
+    if (0 != offset && 0 == offset % 4 && offset < snapshot->size && 4 < snapshot->size - offset) {
+        size_t strLen = lxmlSnapshotGet32(snapshot->data + offset);
 
-            if (FALSE == success) {
-                node->free(node);
-                free(node);
-                node = NULL;
-            }
+        if (strLen < snapshot->size - offset - 4 && '\0' == snapshot->data[offset + 4 + strLen]) {
+            str = (const char*) snapshot->data + offset + 4;
+            *len = strLen;
         }
     }
 
-    return node;
-} /* End of XMLNode_createAndAppend */
+    return str;
+} /* End of lxmlSnapshotString */
 
 /**
- * @brief Obtains the associated 'XMLAttribute' given the 'key'
- *        **Note:** See 'XMLAttributeList_getAttribute' for implementation
+ * @brief Reports a node of 'snapshot' to the DOM callbacks of 'parser' as if it had just been parsed
+ *        A node without a tag is not written out as XML either, so only its children are kept
  *
- * @param self - A reference to the 'XMLNode' to search through
- * @param key - The value to search for
- * @return retAttr - The 'XMLAttribute' containing the associated 'key'
+ * @param  snapshot - The snapshot holding the node
+ * @param  parser   - The 'XMLParser' building the document
+ * @param  frame    - The frame of the node, 'started' is set when its start was reported
+ * @param  root     - A flag indicating the node is the root, which the parser has already created
+ * @return success  - 'FALSE' if the node is invalid or a callback failed
  */
-static struct XMLAttribute* XMLNode_getAttribute(struct XMLNode *self, char *key) {
-    return (NULL != self && NULL != self->attributes.getAttribute && NULL != key) ? self->attributes.getAttribute(&self->attributes, key) : NULL;
-} /* End of XMLNode_getAttribute */
+static int lxmlSnapshotReplay(const struct XMLSnapshot *snapshot, struct XMLParser *parser, struct XMLSnapshotFrame *frame, int root) {
+    size_t attrs = 0, children = 0, len = 0, i = 0;
+    const unsigned char *record = lxmlSnapshotNode(snapshot, frame->node, &attrs, &children);
+    const char *tag = (NULL != record) ? lxmlSnapshotString(snapshot, lxmlSnapshotGet32(record), &len) : NULL;
+    int success = (NULL != record) ? TRUE : FALSE;
+
+    frame->next = 0;
+    frame->started = FALSE;
+
+    if (TRUE == success && FALSE == root && NULL != tag && 0 != len) {
+        success = lxmlDomStartElement(parser, tag, len);
+        frame->started = success;
+    }
+
+    for (; TRUE == success && (TRUE == root || TRUE == frame->started) && i < attrs; ++i) {
+        const char *key = NULL, *value = NULL;
+        size_t keyLen = 0, valueLen = 0;
+
+        success = XMLSnapshot_getAttribute(snapshot, frame->node, i, &key, &keyLen, &value, &valueLen);
+
+        if (TRUE == success && NULL != key && 0 != keyLen)
+            success = lxmlDomAttribute(parser, key, keyLen, (NULL != value) ? value : "", valueLen);
+    }
+
+    if (TRUE == success && (TRUE == root || TRUE == frame->started)) {
+        const char *text = lxmlSnapshotString(snapshot, lxmlSnapshotGet32(record + 4), &len);
+
+        if (NULL != text && 0 != len)
+            success = lxmlDomText(parser, text, len);
+    }
+
+    if (NULL == record)
+        fprintf(stderr, "Invalid snapshot\n");
+
+    return success;
+} /* End of lxmlSnapshotReplay */
 
 /**
- * @brief Obtains the associated 'value' given the 'key' from the 'XMLNode'
- *        **Note:** See 'XMLAttributeList_getAttributeValue' for implementation
+ * @brief Reads a 32 bit little endian integer of a snapshot
  *
- * @param self - A reference to the 'XMLNode' to search from
- * @param key - A string containing the value to search for
- * @return attrVal - The associated attribute value from the 'XMLNode'
+ * @param  p     - The first of its 4 bytes
+ * @return value - The integer
  */
-static char* XMLNode_getAttributeValue(struct XMLNode *self, char *key) {
-    return (NULL != self && NULL != self->attributes.getAttributeValue && NULL != key) ? self->attributes.getAttributeValue(&self->attributes, key) : NULL;
-} /* End of XMLNode_getAttributeValue */
+static size_t lxmlSnapshotGet32(const unsigned char *p) {
+    return (size_t) p[0] | ((size_t) p[1] << 8) | ((size_t) p[2] << 16) | ((size_t) p[3] << 24);
+} /* End of lxmlSnapshotGet32 */
 
 /**
- * @brief Searches the immediate 'XMLNode' for the first child that matches the 'tagName'
- *        *NOTE:* This returns a pointer value to the 'XMLNode' and mustn't be free'd directly
+ * @brief Writes a 32 bit little endian integer of a snapshot
  *
- * @param self - A reference to the 'XMLNode' to search from
- * @param tagName - The name of the tag to search for
- * @return node - The found 'XMLNode' or 'NULL' if not present
+ * @param p     - The first of its 4 bytes
+ * @param value - The integer, at most 32 bits
  */
-static struct XMLNode* XMLNode_getImmediateElementByTagName(struct XMLNode *self, char *tagName) {
-    struct XMLNode *node = NULL;
+static void lxmlSnapshotPut32(unsigned char *p, size_t value) {
+    p[0] = (unsigned char) (value & 0xFF);
+    p[1] = (unsigned char) ((value >> 8) & 0xFF);
+    p[2] = (unsigned char) ((value >> 16) & 0xFF);
+    p[3] = (unsigned char) ((value >> 24) & 0xFF);
+} /* End of lxmlSnapshotPut32 */
 
-    if (NULL != self && NULL != tagName && 0 != self->children.size) {
-        size_t childIndex = 0;
+/**
+ * @brief Creates a reader over the first 'len' bytes of 'buf', which is the whole input
+ *
+ * @param  buf    - The XML contents to read
+ * @param  len    - The number of bytes in 'buf'
+ * @return reader - A 'calloc' 'XMLReader' or 'NULL' when out of memory
+ */
+static struct XMLReader* lxmlReaderCreate(const char *buf, size_t len) {
+    struct XMLReader *reader = calloc(1, sizeof(struct XMLReader));
 
-        for (;childIndex < self->children.size; ++childIndex) {
-            if (0 == strcmp(tagName, self->children.data[childIndex]->tag)) {
-                node = self->children.data[childIndex];
-                break;
-            }
-        }
-    }
+    if (NULL != reader) {
+        reader->tokenizer.state = LXML_PARSER_CONTENT;
+        reader->buf = buf;
+        reader->len = reader->capacity = len;
+        reader->eof = TRUE;
+    } else
+        fprintf(stderr, "Out of memory\n");
 
-    return node;
-} /* End of XMLNode_getImmediateElementByTagName */
+    return reader;
+} /* End of lxmlReaderCreate */
 
 /**
- * @brief Creates a stack allocated 'XMLNode', initialises it then returns it.
+ * @brief Reads the next token for 'XMLReader_next', refilling the window as needed
+ *        Text and comments which run to the end of the window, or to a reference it cuts, are read again once more
+ *        of the input is in, unless they already fill it
  *
- * @return node - A stack allocated and initialised XMLNode
+ * @param  reader - The 'XMLReader' to read from
+ * @return event  - What was found
  */
-static struct XMLNode XMLNodeInitStack() {
-    struct XMLNode node = { NULL, NULL, NULL, { 0 }, { 0 }, XMLNode_add, XMLNode_createAndAppend, XMLNode_free, XMLNode_getAttributeValue, XMLNode_getAttribute, XMLNode_getImmediateElementByTagName };
+static enum XMLReaderEvent lxmlReaderRead(struct XMLReader *reader) {
+    struct XMLTokenizer *tokenizer = &reader->tokenizer;
+    struct XMLToken *token = &reader->token;
+    enum XMLReaderEvent event = LXML_READER_ERROR;
+    int done = FALSE;
+
+    while (FALSE == done) {
+        struct XMLTokenizer saved = *tokenizer;
+        size_t start = reader->pos;
+        enum XMLTokenType type = lxmlTokenizerNext(tokenizer, reader->buf, reader->len, &reader->pos, reader->eof, token);
+
+        /* Text and comments never change the names, so rewinding only restores the state */
+        if ((LXML_TOKEN_TEXT == type || LXML_TOKEN_COMMENT == type) && FALSE == reader->eof
+            && (LXML_PARSER_CONTENT != tokenizer->state || reader->pos == reader->len || '<' != reader->buf[reader->pos])
+            && (0 != start || reader->len < reader->capacity)) {
+            *tokenizer = saved;
+            reader->pos = start;
+            type = LXML_TOKEN_NONE;
+        }
 
-    node.attributes = XMLAttributeList_init();
-    node.children = XMLNodeList_init();
+        if (LXML_TOKEN_NONE == type) {
+            if (TRUE == tokenizer->error)
+                done = TRUE;
+            else if (TRUE == reader->eof) {
+                size_t nameLen = 0;
+                const char *name = lxmlTokenizerTopName(tokenizer, &nameLen);
+
+                if (LXML_PARSER_CONTENT != tokenizer->state)
+                    fprintf(stderr, "Unexpected end of document, expected '%s'\n", (LXML_PARSER_COMMENT == tokenizer->state) ? "-->" : "]]>");
+                else if (NULL != name)
+                    fprintf(stderr, "Unexpected end of document, '%.*s' is not closed\n", (int) nameLen, name);
+                else
+                    event = LXML_READER_DONE;
+
+                /* Either end is returned again by later calls */
+                tokenizer->error = (LXML_READER_DONE != event) ? TRUE : FALSE;
+
+                done = TRUE;
+            } else
+                done = (FALSE == lxmlReaderFill(reader)) ? TRUE : FALSE;
+        } else {
+            const char *key = NULL, *value = NULL;
+            size_t keyLen = 0, valueLen = 0, i = 0;
+            int found = 0;
+
+            /* Attributes are checked now so malformed documents fail as they do when loaded */
+            if (LXML_TOKEN_START == type || LXML_TOKEN_DECLARATION == type)
+                while (1 == (found = lxmlNextAttribute(token->attrs, token->attrsLen, &i, &key, &keyLen, &value, &valueLen)))
+                    ;
+
+            if (-1 == found)
+                tokenizer->error = TRUE;
+            else if (LXML_TOKEN_DECLARATION == type)
+                event = LXML_READER_DECLARATION;
+            else if (LXML_TOKEN_START == type)
+                event = LXML_READER_START;
+            else if (LXML_TOKEN_END == type)
+                event = LXML_READER_END;
+            else
+                event = (LXML_TOKEN_TEXT == type) ? LXML_READER_TEXT : LXML_READER_COMMENT;
+
+            done = TRUE;
+        }
+    }
 
-    return node;
-} /* End of XMLNodeInitStack */
+    return event;
+} /* End of lxmlReaderRead */
 
 /**
- * @brief Adds a 'XMLNode' to the 'XMLNodeList'
+ * @brief Moves the unread part of the window to its start and reads more of the stream after it
+ *        The window only grows when a single token fills it
  *
- * @param self - A reference to the struct you wish to add the node to
- * @param parent - A reference to the parent
- * @param node - The 'XMLNode' to add to 'self'
- * @return success - A flag indicating the status of the subroutine
+ * @param  reader  - The 'XMLReader' to refill
+ * @return success - 'FALSE' when the stream could not be read or out of memory
  */
-static int XMLNodeList_add(struct XMLNodeList *self, struct XMLNode *parent, struct XMLNode *node) {
-    int success = FALSE;
+static int lxmlReaderFill(struct XMLReader *reader) {
+    int success = TRUE;
+
+    if (0 != reader->pos) {
+        memmove(reader->window, reader->window + reader->pos, reader->len - reader->pos);
+        reader->len -= reader->pos;
+        reader->pos = 0;
+    } else if (reader->len == reader->capacity) {
+        char *tmp = realloc(reader->window, reader->capacity * 2);
+
+        if (NULL != tmp) {
+            reader->buf = reader->window = tmp;
+            reader->capacity *= 2;
+        } else {
+            fprintf(stderr, "Out of memory\n");
+            success = FALSE;
+        }
+    }
 
-    if (NULL != self) {
-        if (0 == self->size && NULL == self->data) {
-            self->data = calloc(1, sizeof(struct XMLNode*));
+    if (TRUE == success) {
+        size_t bytesRead = fread(reader->window + reader->len, sizeof(char), reader->capacity - reader->len, reader->fp);
 
-            if (NULL != self->data)
-                self->heapSize = 1;
-        }
+        reader->len += bytesRead;
 
-        while (self->size >= self->heapSize) {
-            self->heapSize *= 2;
-            self->data = realloc(self->data, sizeof(struct XMLNode*) * self->heapSize);
-            memset(self->data + self->size, '\0', (sizeof(struct XMLNode*) * (self->heapSize - self->size)));
-        }
+        if (0 == bytesRead) {
+            reader->eof = TRUE;
 
-        if (NULL != self->data) {
-            node->parent = parent;
-            self->data[self->size++] = node;
-            success = TRUE;
+            if (0 != ferror(reader->fp)) {
+                fprintf(stderr, "Could not read the document\n");
+                success = FALSE;
+            }
         }
     }
 
+    if (FALSE == success)
+        reader->tokenizer.error = TRUE;
+
     return success;
-} /* End of XMLNodeList_add */
+} /* End of lxmlReaderFill */
 
 /**
- * @brief Adds a 'XMLNode' to the 'XMLNodeList'
+ * @brief Scans past the end tag matching the start tag 'reader' returned for 'XMLReader_skipSubtree'
+ *        Markup is told apart by its first bytes and tags are only counted, so nothing
+ *        inside is tokenized. Text and the insides of comments, CDATA sections and processing
+ *        instructions are dropped from the window as they are passed
  *
- * @param  self - A reference to the struct you wish to add the node to
- * @return node - The new node that's been appended to the XMLNodeList
+ * @param  reader  - The 'XMLReader' to advance
+ * @return success - 'FALSE' when the document ends before the element
  */
-static struct XMLNode* XMLNodeList_createAndAppend(struct XMLNodeList *self) {
-    struct XMLNode *node = NULL;
-
-    if (NULL != self) {
-        node = XMLNode_init();
-
-        if (NULL != node) {
-            int success = self->add(self, NULL, node);
-
-            if (FALSE == success) {
-                node->free(node);
-                free(node);
-                node = NULL;
+static int lxmlReaderSkip(struct XMLReader *reader) {
+    struct XMLTokenizer *tokenizer = &reader->tokenizer;
+    const char *terminator = NULL;
+    size_t open = 1, scan = 0;
+    char quote = '\0';
+
+    while (0 != open && FALSE == tokenizer->error) {
+        const char *buf = reader->buf, *next = NULL;
+        size_t len = reader->len, start = reader->pos;
+        int incomplete = FALSE;
+
+        /* Inside a comment, CDATA section or processing instruction */
+        if (NULL != terminator) {
+            size_t end = lxmlFind(buf, len, start, terminator, strlen(terminator));
+
+            if (end < len) {
+                reader->pos = end + strlen(terminator);
+                terminator = NULL;
+            } else {
+                /* Hold back enough to match a terminator split across windows */
+                reader->pos = (len - start > 2) ? len - 2 : start;
+                incomplete = TRUE;
             }
+        } else if (NULL == (next = memchr(buf + start, '<', len - start))) {
+            reader->pos = len;
+            incomplete = TRUE;
+        } else {
+            start = reader->pos = (size_t) (next - buf);
+
+            /* Enough to tell '<![CDATA[' apart */
+            if (len - start < 9 && FALSE == reader->eof)
+                incomplete = TRUE;
+            else if (len - start >= 4 && 0 == memcmp(buf + start, "<!--", 4)) {
+                terminator = "-->";
+                reader->pos = start + 4;
+            } else if (len - start >= 9 && 0 == memcmp(buf + start, "<![CDATA[", 9)) {
+                terminator = "]]>";
+                reader->pos = start + 9;
+            } else if (len - start >= 2 && '?' == buf[start + 1]) {
+                terminator = "?>";
+                reader->pos = start + 2;
+            } else if (len - start >= 2 && '!' == buf[start + 1]) {
+                if (TRUE == lxmlFindDeclarationEnd(buf + start, len - start, &scan, &quote))
+                    reader->pos = start + scan + 1;
+                else
+                    incomplete = TRUE;
+            } else if (TRUE == lxmlFindTagEnd(buf + start, len - start, &scan, &quote)) {
+                if ('/' == buf[start + 1])
+                    --open;
+                else if ('/' != buf[start + scan - 1])
+                    ++open;
+
+                reader->pos = start + scan + 1;
+            } else
+                incomplete = TRUE;
         }
+
+        if (FALSE == incomplete) {
+            scan = 0;
+            quote = '\0';
+        } else if (TRUE == reader->eof) {
+            fprintf(stderr, "Unexpected end of document\n");
+            tokenizer->error = TRUE;
+        } else
+            lxmlReaderFill(reader);
     }
 
-    return node;
-} /* End of XMLNodeList_createAndAppend */
+    return (FALSE == tokenizer->error) ? TRUE : FALSE;
+} /* End of lxmlReaderSkip */
 
 /**
- * @brief Frees the given 'XMLNodeList'
+ * @brief Decodes the references of 'str' into the scratch arena of 'reader'
  *
- * @param self - A reference to the struct you wish to free
+ * @param  reader  - The 'XMLReader' 'str' was read by
+ * @param  str     - The text or attribute value to decode
+ * @param  len     - The number of bytes in 'str', set to the number decoded
+ * @return decoded - 'str' itself when it has no references, its decoded copy or 'NULL' when out of memory
  */
-static void XMLNodeList_free(struct XMLNodeList *self) {
-    if (NULL != self)     {
-        size_t i = 0;
-        for (; i < self->size; ++i)
-            self->data[i]->free(self->data[i]);
+static const char* lxmlReaderDecode(struct XMLReader *reader, const char *str, size_t *len) {
+    const char *decoded = str;
 
-        for (i = 0; i < self->heapSize; ++i) {
-            free(self->data[i]);
-            self->data[i] = NULL;
-        }
+    if (NULL != str && NULL != memchr(str, '&', *len)) {
+        if (NULL == reader->decoded)
+            reader->decoded = lxmlArenaCreate();
 
-        free(self->data);
-        self->data = NULL;
+        decoded = (NULL != reader->decoded) ? lxmlArenaStrndupDecoded(reader->decoded, str, *len, len) : NULL;
 
-        *self = XMLNodeList_init();
+        if (NULL == decoded)
+            fprintf(stderr, "Out of memory\n");
     }
-} /* End of XMLNodeList_free */
+
+    return decoded;
+} /* End of lxmlReaderDecode */
 
 /**
- * @brief Frees the given 'XMLDocument'
+ * @brief Clones the first 'len' bytes located at 'str' into a NUL terminated string
  *
- * @param self - A reference to the struct you wish to free
+ * @param str - The bytes to duplicate, these do not need to be NUL terminated
+ * @param len - The number of bytes to duplicate
+ * @return strndup - The cloned string or 'NULL' when 'len' is zero
  */
-static void XMLDocument_free(struct XMLDocument *self) {
-    if (NULL != self) {
-        XMLNode_free(self->root);
-        free(self->root);
-        self->root = NULL;
+static char* lxmlStrndup(const char *str, size_t len) {
+    char *strndup = NULL;
 
-        free(self->version);
-        free(self->encoding);
+    if (NULL != str && 0 != len) {
+        strndup = malloc(len + 1);
 
-        self->version = self->encoding = NULL;
-        self->success = FALSE;
+        if (NULL != strndup) {
+            memcpy(strndup, str, len);
+            strndup[len] = '\0';
+        }
     }
-} /* End of XMLDocument_free */
+
+    return strndup;
+} /* End of lxmlStrndup */
 
 /**
- * @brief Searches the 'haystack' to see if it ends with the 'needle'
+ * @brief Checks whether 'c' is XML white space
  *
- * @param haystack - The string to search through
- * @param needle - The item to search for
+ * @param  c       - The character to check
  * @return success - A flag indicating the status of the subroutine
  */
-static int lxmlEndsWith(const char *haystack, const char *needle) {
-    int success = FALSE;
+static int lxmlIsSpace(char c) {
+    return (LXML_CLASS_SPACE == lxmlCharClass[(unsigned char) c]) ? TRUE : FALSE;
+} /* End of lxmlIsSpace */
 
-    if (NULL != haystack && NULL != needle) {
-        size_t h_len = strlen(haystack),
-               n_len = strlen(needle);
+/**
+ * @brief Obtains the length of a string stored with an optional length
+ *
+ * @param  view - The string, this is only NUL terminated when 'len' is zero
+ * @param  len  - The stored length of 'view'
+ * @return len  - The number of bytes in 'view'
+ */
+static size_t lxmlViewLen(const char *view, size_t len) {
+    return (NULL == view || 0 != len) ? len : strlen(view);
+} /* End of lxmlViewLen */
 
-        if (h_len >= n_len) {
-            size_t i = 0;
-            for (; i < n_len; ++i)
-                if (haystack[h_len - n_len + i] != needle[i])
-                    break;
+/**
+ * @brief Compares a string stored with an optional length against the NUL terminated 'str'
+ *
+ * @param  view    - The string, this is only NUL terminated when 'len' is zero
+ * @param  len     - The stored length of 'view'
+ * @param  str     - The NUL terminated string to compare against
+ * @return success - A flag indicating whether both are equal
+ */
+static int lxmlViewEquals(const char *view, size_t len, const char *str) {
+    int success = FALSE;
 
-            if (i == n_len)
-                success = TRUE;
-        }
+    if (NULL != view && NULL != str) {
+        len = lxmlViewLen(view, len);
+        success = (0 == strncmp(view, str, len) && '\0' == str[len]) ? TRUE : FALSE;
     }
 
     return success;
-} /* End of lxmlEndsWith */
+} /* End of lxmlViewEquals */
 
-static enum TagType lxmlParseAttrs(char *buf, size_t *i, char *lex, size_t *lexi, struct XMLNode *curr_node) {
-    enum TagType type = TAG_START;
-    struct XMLAttribute curr_attr = { 0, 0, XMLAttribute_free };
-    char *ignoreWhiteSpaceMap = IGNORE_WHITESPACE_MAP;
-    size_t j = 0;
+/**
+ * @brief Searches 'buf' for the first occurrence of 'needle' at or after 'from'
+ *
+ * @param  buf       - The buffer to search through
+ * @param  len       - The number of bytes in 'buf'
+ * @param  from      - The offset to begin searching from
+ * @param  needle    - The bytes to search for
+ * @param  needleLen - The number of bytes in 'needle'
+ * @return i         - The offset of 'needle' or 'len' when not found
+ */
+static size_t lxmlFind(const char *buf, size_t len, size_t from, const char *needle, size_t needleLen) {
+    size_t i = len;
 
-    while ('>' != buf[*i]) {
-        lex[(*lexi)++] = buf[(*i)++];
+#ifdef LXML_HAVE_SSE2
+    /* Candidates must match both the first and last byte of 'needle', which rules out
+     * the runs of '-' or ']' and the '>' of commented out markup that defeat a search on one byte */
+    if (needleLen > 1) {
+        const __m128i first = _mm_set1_epi8(needle[0]), last = _mm_set1_epi8(needle[needleLen - 1]);
 
-        /* Tag name */
-        if ((' ' == buf[*i] || '>' == buf[*i+1]) && NULL == curr_node->tag) {
-            if ('>' == buf[*i+1])
-                lex[(*lexi)++] = buf[*i];
+        while (len == i && from + needleLen - 1 + 16 <= len) {
+            const __m128i a = _mm_loadu_si128((const __m128i*) (buf + from)),
+                          b = _mm_loadu_si128((const __m128i*) (buf + from + needleLen - 1));
+            unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
 
-            lex[*lexi] = '\0';
-            /* FIXME: Can be NULL */
-            curr_node->tag = lxmlStrdup(lex);
-            *lexi = 0;
-            (*i)++;
-            continue;
-        }
+            while (0 != mask && len == i) {
+                size_t candidate = from + (size_t) __builtin_ctz(mask);
 
-        /* Usually ignore spaces */
-        for (j = 0; j < IGNORE_WHITESPACE_MAP_SIZE; ++j) {
-            if (ignoreWhiteSpaceMap[j] == lex[*lexi-1]) {
-                (*lexi)--;
-                break;
+                if (0 == memcmp(buf + candidate + 1, needle + 1, needleLen - 2))
+                    i = candidate;
+
+                mask &= mask - 1;
             }
-        }
 
-        /* Attribute key */
-        if ('=' == buf[*i]) {
-            lex[*lexi] = '\0';
-            curr_attr.key = lxmlStrdup(lex);
-            *lexi = 0;
-            continue;
+            from += 16;
         }
+    }
+#endif
 
-        /* Attribute value */
-        if ('"' == buf[*i]) {
-            if (NULL == curr_attr.key) {
-                fprintf(stderr, "Value has no key\n");
-                type = TAG_START;
-                break;
-            }
-
-            *lexi = 0;
-            (*i)++;
+    while (len == i && from + needleLen <= len) {
+        const char *next = memchr(buf + from, needle[0], len - from - needleLen + 1);
 
-            while ('"' != buf[*i])
-                lex[(*lexi)++] = buf[(*i)++];
-            lex[*lexi] = '\0';
-            curr_attr.value = lxmlStrdup(lex);
+        if (NULL == next)
+            break;
 
-            curr_node->attributes.add(&curr_node->attributes, curr_attr);
+        from = (size_t) (next - buf);
 
-            curr_attr.free(&curr_attr);
-            *lexi = 0;
-            (*i)++;
-            continue;
-        }
+        if (0 == memcmp(next, needle, needleLen))
+            i = from;
 
-        /* Inline node */
-        if ('/' == buf[*i - 1] && '>' == buf[*i]) {
-            lex[*lexi] = '\0';
-            if (NULL == curr_node->tag) /* FIXME: Can be NULL */
-                curr_node->tag = lxmlStrdup(lex);
-            (*i)++;
-            type = TAG_INLINE;
-            break;
-        }
+        ++from;
     }
 
-    curr_attr.free(&curr_attr);
-
-    return type;
-} /* End of lxmlParseAttrs */
+    return i;
+} /* End of lxmlFind */
 
 /**
- * @brief Reads the entire file, pointed to by 'fp' into memory
- *        and returns it as a 'calloc' piece of memory 'buf'
+ * @brief Searches for the '>' closing the tag at 'buf[0]', skipping over quoted values
+ *        The search can be resumed when more of the tag is available
  *
- * @param fp - The file pointer to read
- * @return buf - The buffer containing all of the files contents
+ * @param  buf     - The tag to search through
+ * @param  len     - The number of bytes in 'buf'
+ * @param  scan    - The offset to resume from, set to the offset of '>' when found
+ * @param  quote   - The quote character of the value being scanned, or '\0'
+ * @return success - A flag indicating whether the end of the tag was found
  */
-static char* lxmlReadXmlContentsIntoMemory(FILE *fp) {
-    char *buf = NULL;
-
-    if (NULL != fp) {
-        long fileSize = 0;
-        size_t bytesRead = 0;
-
-        fseek(fp, 0, SEEK_END);
-        fileSize = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-
-        buf = calloc(fileSize+1, sizeof(char));
+static int lxmlFindTagEnd(const char *buf, size_t len, size_t *scan, char *quote) {
+    int success = FALSE;
 
-        if (NULL != buf) {
-            bytesRead = fread(buf, sizeof(char), fileSize, fp);
+    while (*scan < len) {
+        if ('\0' != *quote) {
+            const char *close = memchr(buf + *scan, *quote, len - *scan);
 
-            if (fileSize > 0 && bytesRead != (size_t) fileSize) {
-                free(buf);
-                buf = NULL;
+            if (NULL == close) {
+                *scan = len;
+                break;
             }
+
+            *scan = (size_t) (close - buf) + 1;
+            *quote = '\0';
+            continue;
         }
-    }
 
-    return buf;
-} /* End of lxmlReadXmlContentsIntoMemory */
+        /* Jump straight to the next structural character */
+        *scan = lxmlScan3(buf, len, *scan, '>', '"', '\'');
 
-static void node_out(FILE *file, struct XMLNode *node, const char * const indentation, int indent, int times) {
-    size_t i = 0, j = 0;
-    const char * const indentationStr = (NULL != indentation) ? indentation : " ";
+        if (*scan >= len)
+            break;
+        else if ('>' == buf[*scan]) {
+            success = TRUE;
+            break;
+        }
 
-    for (; i < node->children.size; ++i) {
-        struct XMLNode *child = node->children.data[i];
+        *quote = buf[(*scan)++];
+    }
 
-        if (times > 0)
-            fprintf(file, "%*s", indent * times, indentationStr);
+    return success;
+} /* End of lxmlFindTagEnd */
 
-        fprintf(file, "<%s", child->tag);
-        for (j = 0; j < child->attributes.size; ++j) {
-            struct XMLAttribute *attr = child->attributes.attribute[j];
+/**
+ * @brief Searches for the '>' closing the declaration at 'buf[0]', such as '<!DOCTYPE ...>'
+ *        Quoted literals and an internal subset in '[...]' are skipped over
+ *        The search can be resumed when more of the declaration is available
+ *
+ * @param  buf     - The declaration to search through
+ * @param  len     - The number of bytes in 'buf'
+ * @param  scan    - The offset to resume from, set to the offset of '>' when found
+ * @param  quote   - The quote character of the literal being scanned, '[' within the subset, or '\0'
+ * @return success - A flag indicating whether the end of the declaration was found
+ */
+static int lxmlFindDeclarationEnd(const char *buf, size_t len, size_t *scan, char *quote) {
+    int success = FALSE;
 
-            if (NULL != attr && NULL != attr->value && 0 != strcmp(attr->value, ""))
-                fprintf(file, " %s=\"%s\"", attr->key, attr->value);
-        }
+    while (FALSE == success && *scan < len) {
+        if ('\0' != *quote) {
+            const char *close = memchr(buf + *scan, ('[' == *quote) ? ']' : *quote, len - *scan);
 
-        if (0 == child->children.size && NULL == child->inner_text)
-            fprintf(file, " />\n");
-        else {
-            fprintf(file, ">");
-            if (0 == child->children.size)
-                fprintf(file, "%s</%s>\n", child->inner_text, child->tag);
+            if (NULL == close)
+                *scan = len;
             else {
-                fprintf(file, "\n");
-                node_out(file, child, indentationStr, indent, times + 1);
-                if (times > 0)
-                    fprintf(file, "%*s", indent * times, " ");
-                fprintf(file, "</%s>\n", child->tag);
+                *scan = (size_t) (close - buf) + 1;
+                *quote = '\0';
             }
+        } else if ('>' == buf[*scan])
+            success = TRUE;
+        else {
+            if ('"' == buf[*scan] || '\'' == buf[*scan] || '[' == buf[*scan])
+                *quote = buf[*scan];
+
+            ++(*scan);
         }
     }
-} /* End of node_out */
+
+    return success;
+} /* End of lxmlFindDeclarationEnd */
 
 /**
- * @brief Clones the string located at 'str'
+ * @brief Searches 'buf' for the first of the bytes 'a', 'b' or 'c' at or after 'from'
+ *        16 bytes are compared at a time with SSE2 and 32 with AVX2, see 'LXML_NO_SIMD'
  *
- * @param str - The string to duplicate
- * @return strdup - The cloned string
+ * @param  buf  - The buffer to search through
+ * @param  len  - The number of bytes in 'buf'
+ * @param  from - The offset to begin searching from
+ * @param  a    - The first byte to search for
+ * @param  b    - The second byte to search for
+ * @param  c    - The third byte to search for
+ * @return i    - The offset of the first match or 'len' when not found
  */
-static char* lxmlStrdup(const char *str) {
-    char *strdup = NULL;
+static size_t lxmlScan3(const char *buf, size_t len, size_t from, char a, char b, char c) {
+    int found = FALSE;
+
+#ifdef LXML_HAVE_AVX2
+    /* Only worth checking for runs which span several vectors */
+    if (from + 64 <= len && __builtin_cpu_supports("avx2")) {
+        from = lxmlScan3Avx2(buf, len, from, a, b, c);
+        found = (from + 32 <= len) ? TRUE : FALSE;
+    }
+#endif
 
-    if (NULL != str) {
-        size_t strlength = strlen(str);
+#ifdef LXML_HAVE_SSE2
+    if (FALSE == found) {
+        const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c);
 
-        if (0 != strlength) {
-            strdup = calloc(strlength+1, sizeof(char));
+        while (FALSE == found && from + 16 <= len) {
+            const __m128i v = _mm_loadu_si128((const __m128i*) (buf + from));
+            unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)), _mm_cmpeq_epi8(v, vc)));
 
-            if (NULL != strdup)
-                strcpy(strdup, str);
+            if (0 != mask) {
+                from += (size_t) __builtin_ctz(mask);
+                found = TRUE;
+            } else
+                from += 16;
         }
     }
+#endif
+
+    /* Scalar tail, or the whole search without SIMD */
+    while (FALSE == found && from < len && a != buf[from] && b != buf[from] && c != buf[from])
+        ++from;
+
+    return from;
+} /* End of lxmlScan3 */
+
+#ifdef LXML_HAVE_AVX2
+/**
+ * @brief The AVX2 part of 'lxmlScan3', which stops at a match or fewer than 32 bytes from 'len'
+ *        **Note:** Only call when '__builtin_cpu_supports("avx2")', see 'lxmlScan3' for the parameters
+ *
+ * @return i - The offset of the first match or, within 32 bytes of 'len', where the search should continue
+ */
+__attribute__((target("avx2"))) static size_t lxmlScan3Avx2(const char *buf, size_t len, size_t from, char a, char b, char c) {
+    const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), vc = _mm256_set1_epi8(c);
+    unsigned int mask = 0;
+
+    while (0 == mask && from + 32 <= len) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*) (buf + from));
+
+        mask = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)), _mm256_cmpeq_epi8(v, vc)));
+        from += (0 != mask) ? (size_t) __builtin_ctz(mask) : 32;
+    }
 
-    return strdup;
-} /* End of lxmlStrdup */
+    return from;
+} /* End of lxmlScan3Avx2 */
+#endif /* LXML_HAVE_AVX2 */
 
 /**
  * @brief Parses the input buffer for the end of node
+ *        On return '*i' is positioned at the closing '>'
  *
- * @param buf - The buffer to parse
- * @param bufOffset - The offet to begin parsing from
- * @param lex - The buffer to place the lexime into
- * @param lexi - The offset for the lexime buffer
+ * @param buf     - The buffer to parse
+ * @param len     - The number of bytes in 'buf'
+ * @param i       - The offset to begin parsing from, just after '</'
+ * @param name    - Set to the start of the tag name within 'buf'
+ * @param nameLen - Set to the length of the tag name
  *
  * @return success - A Flag indicating the status of the subroutine
  */
-static int lxmlParseEndOfNode(const char *buf, size_t *bufOffset, char *lex, size_t lexBufSize, size_t *lexi) {
+static int lxmlParseEndOfNode(const char *buf, size_t len, size_t *i, const char **name, size_t *nameLen) {
     int success = FALSE;
 
-    if (NULL != buf && NULL != bufOffset && NULL != lex && NULL != lexi) {
-        success = TRUE;
+    if (NULL != buf && NULL != i && NULL != name && NULL != nameLen) {
+        const char *end = (*i < len) ? memchr(buf + *i, '>', len - *i) : NULL;
 
-        while (buf[*bufOffset] != '>') {
-            if ('\0' != buf[*bufOffset] || *lexi >= lexBufSize)
-                lex[(*lexi)++] = buf[(*bufOffset)++];
-            else {
-                success = FALSE;
-                break;
-            }
-        }
+        if (NULL != end) {
+            *name = buf + *i;
+            *nameLen = (size_t) (end - *name);
+
+            while (0 != *nameLen && TRUE == lxmlIsSpace((*name)[*nameLen - 1]))
+                --(*nameLen);
 
-        lex[*lexi] = '\0';
+            *i = (size_t) (end - buf);
+            success = TRUE;
+        } else
+            fprintf(stderr, "Unexpected end of document in end tag\n");
     }
 
     return success;
 } /* End of lxmlParseEndOfNode*/
 
+/**
+ * @brief Copies 'len' bytes of 'src' to 'dst' replacing the predefined entities and character
+ *        references with the characters they stand for, anything else after a '&' is copied as it is
+ *        The runs between references are found with 'memchr'
+ *        **Note:** The result is never longer than 'src', so 'dst' may be 'src' itself
+ *
+ * @param  dst - Where to write at least 'len' bytes
+ * @param  src - The bytes to decode, these do not need to be NUL terminated
+ * @param  len - The number of bytes in 'src'
+ * @return n   - The number of bytes written to 'dst'
+ */
+static size_t lxmlDecodeReferences(char *dst, const char *src, size_t len) {
+    size_t i = 0, n = 0;
+
+    while (i < len) {
+        const char *amp = memchr(src + i, '&', len - i);
+        size_t run = (NULL != amp) ? (size_t) (amp - src) - i : len - i, refLen = 0;
+
+        memmove(dst + n, src + i, run);
+        n += run;
+        i += run;
+
+        if (i < len) {
+            unsigned long c = lxmlParseReference(src + i, len - i, &refLen);
+
+            if (0 != c) {
+                n += lxmlEncodeUtf8(c, dst + n);
+                i += refLen;
+            } else
+                dst[n++] = src[i++];
+        }
+    }
+
+    return n;
+} /* End of lxmlDecodeReferences */
+
+/**
+ * @brief Reads the entity or character reference at the start of 'ref'
+ *
+ * @param  ref    - The bytes from a '&', these do not need to be NUL terminated
+ * @param  len    - The number of bytes in 'ref'
+ * @param  refLen - Set to the length of the reference including its ';'
+ * @return c      - The code point it stands for or 0 when it is not one the parser knows
+ */
+static unsigned long lxmlParseReference(const char *ref, size_t len, size_t *refLen) {
+    const char *semi = memchr(ref, ';', (len < LXML_MAX_REFERENCE_SIZE) ? len : LXML_MAX_REFERENCE_SIZE);
+    size_t n = (NULL != semi) ? (size_t) (semi - ref) + 1 : 0, i = 0;
+    unsigned long c = 0;
+
+    if (n > 3 && '#' == ref[1]) {
+        int hex = ('x' == ref[2]) ? TRUE : FALSE, valid = TRUE;
+
+        for (i = (TRUE == hex) ? 3 : 2; TRUE == valid && i < n - 1; ++i) {
+            int digit = ('0' <= ref[i] && ref[i] <= '9') ? ref[i] - '0' : -1;
+
+            if (TRUE == hex && 'a' <= (ref[i] | 0x20) && (ref[i] | 0x20) <= 'f')
+                digit = (ref[i] | 0x20) - 'a' + 10;
+
+            c = c * ((TRUE == hex) ? 16 : 10) + (unsigned long) digit;
+            valid = (-1 != digit && c <= 0x10FFFF) ? TRUE : FALSE;
+        }
+
+        /* Only characters XML allows */
+        if (FALSE == valid || (TRUE == hex && 4 == n) || (c < 0x20 && 0x9 != c && 0xA != c && 0xD != c)
+            || (0xD800 <= c && c <= 0xDFFF) || 0xFFFE == c || 0xFFFF == c)
+            c = 0;
+    } else if (4 == n && 't' == ref[2])
+        c = ('l' == ref[1]) ? '<' : ('g' == ref[1]) ? '>' : 0;
+    else if (5 == n && 0 == memcmp(ref, "&amp;", 5))
+        c = '&';
+    else if (6 == n && 0 == memcmp(ref, "&quot;", 6))
+        c = '"';
+    else if (6 == n && 0 == memcmp(ref, "&apos;", 6))
+        c = '\'';
+
+    *refLen = (0 != c) ? n : 0;
+
+    return c;
+} /* End of lxmlParseReference */
+
+/**
+ * @brief Writes the UTF-8 encoding of 'c' to 'dst'
+ *
+ * @param  c   - A code point up to 0x10FFFF
+ * @param  dst - Where to write up to 4 bytes
+ * @return n   - The number of bytes written
+ */
+static size_t lxmlEncodeUtf8(unsigned long c, char *dst) {
+    size_t n = 0;
+
+    if (c < 0x80)
+        dst[n++] = (char) c;
+    else if (c < 0x800) {
+        dst[n++] = (char) (0xC0 | (c >> 6));
+        dst[n++] = (char) (0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        dst[n++] = (char) (0xE0 | (c >> 12));
+        dst[n++] = (char) (0x80 | ((c >> 6) & 0x3F));
+        dst[n++] = (char) (0x80 | (c & 0x3F));
+    } else {
+        dst[n++] = (char) (0xF0 | (c >> 18));
+        dst[n++] = (char) (0x80 | ((c >> 12) & 0x3F));
+        dst[n++] = (char) (0x80 | ((c >> 6) & 0x3F));
+        dst[n++] = (char) (0x80 | (c & 0x3F));
+    }
+
+    return n;
+} /* End of lxmlEncodeUtf8 */
+
 /*******************Private End********************/
 #endif /* LITTLE_XML_H */
@@ -9,10 +9,42 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+/* Allocations made by 'lxml.h' go through these, the standard headers are included first so only
+ * its own calls use the macros. While 'tlxmlCounting' is set they are counted and the one numbered
+ * 'tlxmlFailAt' fails, it is only set while no other thread runs */
+static int tlxmlCounting = 0;
+static unsigned long tlxmlAllocs = 0, tlxmlFailAt = 0;
+
+static int tlxmlAllocate() {
+    return (0 == tlxmlCounting || ++tlxmlAllocs != tlxmlFailAt) ? 1 : 0;
+} /* End of tlxmlAllocate */
+
+static void* tlxmlMalloc(size_t size) {
+    return (1 == tlxmlAllocate()) ? malloc(size) : NULL;
+} /* End of tlxmlMalloc */
+
+static void* tlxmlCalloc(size_t n, size_t size) {
+    return (1 == tlxmlAllocate()) ? calloc(n, size) : NULL;
+} /* End of tlxmlCalloc */
+
+static void* tlxmlRealloc(void *ptr, size_t size) {
+    return (1 == tlxmlAllocate()) ? realloc(ptr, size) : NULL;
+} /* End of tlxmlRealloc */
+
+#define malloc(size) tlxmlMalloc(size)
+#define calloc(n, size) tlxmlCalloc(n, size)
+#define realloc(ptr, size) tlxmlRealloc(ptr, size)
+
 #include "lxml.h"
 
+#undef malloc
+#undef calloc
+#undef realloc
+
 /* 'fmemopen' not available in all standards */
 #if defined __USE_XOPEN || defined __USE_XOPEN2K8
 #define LXML_HAVE_FMEMOPEN
@@ -45,10 +77,37 @@
 
 #define TEST_XML_VALID_1_SIZE (sizeof(TEST_XML_VALID_1)-1)
 
+#define TEST_XML_CHUNKED TEST_XML_HEADER "\n\
+<!-- a comment -- with > inside -->\
+<!DOCTYPE root [ <!ENTITY e \"a>b\"> <!-- it's > --> ]>\
+<root a=\"x>y\" b=\"2\">\
+<item>Some text which gets split</item><item><![CDATA[<x> & ]]]]></item><!---->\
+<empty></empty><?pi data?></root>\n"
+
+#define TEST_XML_REFERENCES TEST_XML_HEADER \
+    "<a k='&lt;&#x41;&#66;\"&amp;amp;' u=\"caf&#233; &#x1F600;\" bad=\"&nbsp; &#0; &#xD800; &#; AT&T &\">" \
+    "x &lt; y &amp;&amp; &gt;<![CDATA[&lt;]]>&apos;&#x2e;<plain>plain</plain>after &amp;</a>"
+
+#define TEST_XML_QUERY TEST_XML_HEADER \
+"<struct name=\"Person\">\
+<field name=\"name\" type=\"string\" />\
+<field name=\"age\" type=\"int\" />\
+<field name=\"height\" type=\"int\" />\
+<description>This defines a person</description>\
+<nested><description>Inner</description></nested>\
+</struct>"
+
 #define TXML_TEST_XML_NODE_TREE_CHILDREN_SIZE 12
 #define TEST_EXAMPLE_XML_NODE_TREE_STRING "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n<top>\n  <foo />\n  <bar />\n  <baz />\n</top>\n<middle>\n  <child />\n  <child />\n  <child />\n</middle>\n<bottom>\n  <nest>\n    <nest>\n      <nest />\n    </nest>\n  </nest>\n</bottom>\n"
 
 static struct XMLNode* tlxmlCreateTestXMLNodeTree();
+static char* tlxmlStrdup(const char *str);
+static int tlxmlCompareXmlNodes(struct XMLNode *a, struct XMLNode *b);
+static int tlxmlCompareViews(const char *a, size_t aLen, const char *b, size_t bLen);
+static char* tlxmlCreateFeed(size_t records, size_t at, const char *bad);
+#ifdef LXML_HAVE_THREADS
+static void* tlxmlEditTree(void *arg);
+#endif
 
 static int lxmlTestPopulateAttributeListWith(struct XMLAttributeList *list, struct XMLAttribute **attrs, size_t attrsSize);
 static int lxmlTestPopulateXmlAttributeListWithDefaultAttributes(struct XMLAttributeList *list);
@@ -60,6 +119,7 @@ static void lxmlTestFreeAttrs(struct XMLAttribute **attrs, size_t attrsSize);
 static int lxmlTestAttributeInit();
 static int lxmlTestAttributeListInit();
 static int lxmlTestAttributeListAdd();
+static int lxmlTestAttributeListTake();
 static int lxmlTestAttributeListGetAttributeValue();
 
 static int lxmlTestAttributeListGetAttributeValueMissing();
@@ -68,26 +128,84 @@ static int lxmlTestAttributeListGetAttributeMissing();
 
 static int lxmlTestParseAttributes();
 static int lxmlTestParseAttributesPass();
+static int lxmlTestScan();
+static int lxmlTestFind();
+static int lxmlTestNextAttribute();
+static int lxmlTestSingleQuotedAttributes();
+static int lxmlTestFindTagEndLong();
+
+static int lxmlTestXMLDocumentLoadBuffer();
+static int lxmlTestXMLDocumentLoadBufferUnterminated();
+static int lxmlTestXMLDocumentLoadBufferMalformed();
+static int lxmlTestXMLDocumentLoadBufferParallel();
+static int lxmlTestXMLDocumentLoadBufferParallelMalformed();
+static int lxmlTestXMLDocumentSnapshot();
+static int lxmlTestXMLDocumentLoadMany();
+static int lxmlTestXMLDocumentLoadBufferCData();
+static int lxmlTestXMLDocumentLoadBufferReferences();
+static int lxmlTestXMLDocumentLoadPath();
+static int lxmlTestXMLDocumentLoadBufferArena();
+static int lxmlTestXMLDocumentLoadBufferInSitu();
+static int lxmlTestXMLDocumentLoadBufferLazy();
+static int lxmlTestXMLDocumentLoadBufferIntern();
+static int lxmlTestXMLDocumentGetElementsByTagName();
+
+static int lxmlTestXMLParser();
+static int lxmlTestXMLParserChunked();
+static int lxmlTestXMLParserMalformed();
+
+static int lxmlTestXMLDocumentParseEvents();
+static int lxmlTestXMLDocumentParseEventsLog();
+static int lxmlTestXMLDocumentParseEventsChunked();
+static int lxmlTestXMLDocumentParseEventsStop();
+
+static int lxmlTestXMLReader();
+static int lxmlTestXMLReaderBuffer();
+static int lxmlTestXMLReaderStream();
+static int lxmlTestXMLReaderSkipSubtree();
+static int lxmlTestXMLReaderMalformed();
+static int lxmlTestXMLReaderReferences();
+static int lxmlTestXMLDocumentStreamElements();
+
+static int lxmlTestXMLQuery();
+static int lxmlTestXMLQueryCompileMalformed();
+static int lxmlTestXMLQueryEval();
+static int lxmlTestXMLQueryEvalStop();
+static int lxmlTestXMLQueryEvalAllocations();
+
+static int lxmlTestXMLDocumentWrite();
+static int lxmlTestXMLDocumentWriteToBuffer();
+static int lxmlTestXMLDocumentWriteLarge();
+static int lxmlTestXMLDocumentWriteParallel();
+static int lxmlTestXMLDocumentWriteEscaped();
+static int lxmlTestXMLDocumentWriteTruncated();
 
 static int lxmlTestNode();
 static int lxmlTestNodeInit();
 static int lxmlTestNodeAdd();
 static int lxmlTestNodeGetImmediateElementByTagName();
 static int lxmlTestNodeGetImmediateElementByTagNameNodeNotFound();
+static int lxmlTestNodeFreeFunctions();
+static int lxmlTestNodeIndex();
+static int lxmlTestNodeIndexLoad();
+static int lxmlTestNodeWalk();
+static int lxmlTestNodeWalkDeep();
 
 static int lxmlTestNodeListInit();
 static int lxmlTestNodeListAdd();
 static int lxmlTestNodeListCreateAndAppend();
 static int lxmlTestNodeList();
 
-static int lxmlTestEndsWith();
-static int lxmlTestEndsWithPass();
-static int lxmlTestEndsWithFail();
-static int lxmlTestEndsWithFail2();
+static const char* tlxmlTokenize(const char *xml, char *types);
+
+static int lxmlTestEndTag();
+static int lxmlTestEndTagPass();
+static int lxmlTestEndTagFail();
+static int lxmlTestEndTagFail2();
 
-static int lxmlTestEndsWithFailHaystackLargerThanNeedle();
-static int lxmlTestEndsWithFailNullHaystack();
-static int lxmlTestEndsWithFailNullNeedle();
+static int lxmlTestEndTagFailWithoutStart();
+static int lxmlTestEndTagEmpty();
+static int lxmlTestEndTagMissing();
 
 #ifdef LXML_HAVE_FMEMOPEN
 static int tlxmlCompareXmlNodeListAgainstString(struct XMLNode *tree, char *str);
@@ -98,6 +216,7 @@ static int lxmlTestReadXmlContentsIntoMemoryNullFp();
 
 static int lxmlTestXMLDocument_load();
 static int lxmlTestXmlDocumentLoadPass();
+static int lxmlTestXmlDocumentLoadFromOffset();
 
 /**
  * @brief Compares an 'XMLNode' to a given string
@@ -118,7 +237,7 @@ static int tlxmlCompareXmlNodeListAgainstString(struct XMLNode *tree, char *str)
             FILE *fp = fmemopen(buf, strLen + 2, "w");
 
             if (NULL != fp) {
-                struct XMLDocument doc = { tree, "1.0", "UTF-8", TRUE, XMLDocument_free };
+                struct XMLDocument doc = { tree, "1.0", "UTF-8", TRUE, XMLDocument_free, NULL, NULL };
 
                 success = XMLDocument_write(&doc, fp, 2);
                 fclose(fp);
@@ -189,12 +308,41 @@ static int lxmlTestXmlDocumentLoadPass() {
     fclose(fp);
     fp = NULL;
 
-    printf("lxmlTestXMLDocument_load: %s\n", (TRUE == success) ? "Pass" : "Fail");
     return success;
 } /* End of lxmlTestXmlDocumentLoadPass */
 
+static int lxmlTestXmlDocumentLoadFromOffset() {
+    struct XMLDocument doc = { 0 };
+    FILE *fp = tmpfile();
+    char *buf = NULL;
+
+    assert(NULL != fp);
+    fprintf(fp, "</skipped><a>Text</a>");
+
+    /* Both the whole file read and the stream it falls back to start where 'fp' stands */
+    assert(0 == fseek(fp, 10, SEEK_SET));
+    buf = lxmlReadXmlContentsIntoMemory(fp);
+    assert(NULL != buf && 0 == strcmp("<a>Text</a>", buf));
+
+    assert(0 == fseek(fp, 10, SEEK_SET));
+    doc = XMLDocument_load(fp);
+    assert(TRUE == doc.success && 1 == doc.root->children.size);
+    assert(0 == strcmp("Text", XMLNode_getChild(doc.root, 0)->inner_text));
+
+    doc.free(&doc);
+    fclose(fp);
+    free(buf);
+
+    return TRUE;
+} /* End of lxmlTestXmlDocumentLoadFromOffset */
+
 static int lxmlTestXMLDocument_load() {
     int success = lxmlTestXmlDocumentLoadPass();
+
+    success &= lxmlTestXmlDocumentLoadFromOffset();
+
+    printf("lxmlTestXMLDocument_load: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
     return success;
 } /* End of lxmlTestXMLDocument_load */
 
@@ -232,44 +380,44 @@ static struct XMLNode* tlxmlCreateTestXMLNodeTree() {
     size_t i = 0;
 
     assert(NULL != tree && NULL != tmp && NULL != tmp2);
-    tree->add(tree, tmp);
-    tmp->tag  = lxmlStrdup("top");
-    tmp2->tag = lxmlStrdup("foo");
+    XMLNode_add(tree, tmp);
+    tmp->tag  = tlxmlStrdup("top");
+    tmp2->tag = tlxmlStrdup("foo");
 
-    tmp->add(tmp, tmp2);
+    XMLNode_add(tmp, tmp2);
 
     tmp2 = XMLNode_init();
-    tmp2->tag = lxmlStrdup("bar");
-    tmp->add(tmp, tmp2);
+    tmp2->tag = tlxmlStrdup("bar");
+    XMLNode_add(tmp, tmp2);
 
     tmp2 = XMLNode_init();
-    tmp2->tag = lxmlStrdup("baz");
-    tmp->add(tmp, tmp2);
+    tmp2->tag = tlxmlStrdup("baz");
+    XMLNode_add(tmp, tmp2);
 
     tmp = XMLNode_init();
-    tree->add(tree, tmp);
-    tmp->tag = lxmlStrdup("middle");
+    XMLNode_add(tree, tmp);
+    tmp->tag = tlxmlStrdup("middle");
 
     tmp2 = XMLNode_init();
-    tmp2->tag = lxmlStrdup("child");
-    tmp->add(tmp, tmp2);
+    tmp2->tag = tlxmlStrdup("child");
+    XMLNode_add(tmp, tmp2);
 
     tmp2 = XMLNode_init();
-    tmp2->tag = lxmlStrdup("child");
-    tmp->add(tmp, tmp2);
+    tmp2->tag = tlxmlStrdup("child");
+    XMLNode_add(tmp, tmp2);
 
     tmp2 = XMLNode_init();
-    tmp2->tag = lxmlStrdup("child");
-    tmp->add(tmp, tmp2);
+    tmp2->tag = tlxmlStrdup("child");
+    XMLNode_add(tmp, tmp2);
 
     tmp = XMLNode_init();
-    tree->add(tree, tmp);
-    tmp->tag = lxmlStrdup("bottom");
+    XMLNode_add(tree, tmp);
+    tmp->tag = tlxmlStrdup("bottom");
 
     for (i=0;i<3;++i) {
         tmp2 = XMLNode_init();
-        tmp2->tag = lxmlStrdup("nest");
-        tmp->add(tmp, tmp2);
+        tmp2->tag = tlxmlStrdup("nest");
+        XMLNode_add(tmp, tmp2);
         tmp = tmp2;
     }
 
@@ -297,7 +445,7 @@ static int lxmlTestPopulateAttributeListWith(struct XMLAttributeList *list, stru
        
         for (i=0;i<attrsSize;++i) {
             assert(NULL != attrs[i]);
-            success = list->add(list, *attrs[i]);
+            success = XMLAttributeList_add(list, *attrs[i]);
 
             assert(TRUE == success);
         }
@@ -330,17 +478,17 @@ static int lxmlTestPopulateXmlAttributeListWithDefaultAttributes(struct XMLAttri
  * @return success - A flag indicating the status of the subroutine
  */
 static int lxmlTestGetDefaultAttributeValuesFromAttributeList(struct XMLAttributeList list) {
-    char *tmp = list.getAttributeValue(&list, "Fizz");
+    char *tmp = XMLAttributeList_getAttributeValue(&list, "Fizz");
     assert(NULL != tmp);
     assert(0 == strcmp("Buzz", tmp));
     free(tmp); tmp = NULL;
 
-    tmp = list.getAttributeValue(&list, "Hello");
+    tmp = XMLAttributeList_getAttributeValue(&list, "Hello");
     assert(NULL != tmp);
     assert(0 == strcmp("World", tmp));
     free(tmp); tmp = NULL;
 
-    tmp = list.getAttributeValue(&list, "Foo");
+    tmp = XMLAttributeList_getAttributeValue(&list, "Foo");
     assert(NULL != tmp);
     assert(0 == strcmp("Bar", tmp));
     free(tmp); tmp = NULL;
@@ -355,17 +503,17 @@ static int lxmlTestGetDefaultAttributeValuesFromAttributeList(struct XMLAttribut
  * @return success - A flag indicating the status of the subroutine
  */
 static int lxmlTestGetDefaultAttributesFromAttributeList(struct XMLAttributeList list) {
-    struct XMLAttribute *tmp = list.getAttribute(&list, "Fizz");
+    struct XMLAttribute *tmp = XMLAttributeList_getAttribute(&list, "Fizz");
     assert(NULL != tmp);
     assert(0 == strcmp("Fizz", tmp->key));
     assert(0 == strcmp("Buzz", tmp->value));
 
-    tmp = list.getAttribute(&list, "Hello");
+    tmp = XMLAttributeList_getAttribute(&list, "Hello");
     assert(NULL != tmp);
     assert(0 == strcmp("Hello", tmp->key));
     assert(0 == strcmp("World", tmp->value));
 
-    tmp = list.getAttribute(&list, "Foo");
+    tmp = XMLAttributeList_getAttribute(&list, "Foo");
     assert(NULL != tmp);
     assert(0 == strcmp("Foo", tmp->key));
     assert(0 == strcmp("Bar", tmp->value));
@@ -384,7 +532,7 @@ static void lxmlTestFreeAttrs(struct XMLAttribute **attrs, size_t attrsSize) {
         size_t i = 0;
         for (;i<attrsSize;++i) {
             if (NULL != attrs[i]) {
-                attrs[i]->free(attrs[i]);
+                XMLAttribute_free(attrs[i]);
                 free(attrs[i]);
                 attrs[i] = NULL;
             }
@@ -394,363 +542,2862 @@ static void lxmlTestFreeAttrs(struct XMLAttribute **attrs, size_t attrsSize) {
 
 static int lxmlTestParseAttributesPass() {
     char *testXml = TEST_XML_HEADER;
-    char testLex[TEST_BUF+1] = { 0 };
-    size_t i = 0, lexi = 0;
-    enum TagType tagType = TAG_UNSUPPORTED;
-
-    struct XMLNode *node = XMLNode_init();
-
-    strcpy(testLex, testXml);
-    assert(NULL != node);
-
-    tagType = lxmlParseAttrs(testXml, &i, testLex, &lexi, node);
+    const char *key = NULL, *value = NULL;
+    size_t i = 0, j = 0, keyLen = 0, valueLen = 0;
+    struct XMLTokenizer tokenizer;
+    struct XMLToken token;
 
-    assert(TAG_START == tagType);
+    memset(&tokenizer, '\0', sizeof(struct XMLTokenizer));
+    tokenizer.state = LXML_PARSER_CONTENT;
 
-    assert(0 == strcmp(node->tag, TEST_XML_TAG));
-    assert(NULL == node->inner_text);
+    assert(LXML_TOKEN_DECLARATION == lxmlTokenizerNext(&tokenizer, testXml, strlen(testXml), &i, TRUE, &token));
+    assert(strlen(testXml) == i);
+    assert(testXml + strlen(TEST_XML_TAG) == token.attrs);
 
-    assert(2 == node->attributes.size);
-    assert(0 == strcmp(node->attributes.attribute[0]->key, "version"));
-    assert(0 == strcmp(node->attributes.attribute[0]->value, "1.0"));
-    assert(0 == strcmp(node->attributes.attribute[1]->key, "encoding"));
-    assert(0 == strcmp(node->attributes.attribute[1]->value, "UTF-8"));
+    assert(1 == lxmlNextAttribute(token.attrs, token.attrsLen, &j, &key, &keyLen, &value, &valueLen));
+    assert(TRUE == tlxmlCompareViews(key, keyLen, "version", 7) && TRUE == tlxmlCompareViews(value, valueLen, "1.0", 3));
+    assert(1 == lxmlNextAttribute(token.attrs, token.attrsLen, &j, &key, &keyLen, &value, &valueLen));
+    assert(TRUE == tlxmlCompareViews(key, keyLen, "encoding", 8) && TRUE == tlxmlCompareViews(value, valueLen, "UTF-8", 5));
+    assert(0 == lxmlNextAttribute(token.attrs, token.attrsLen, &j, &key, &keyLen, &value, &valueLen));
 
-    XMLNode_free(node);
-    free(node);
-    node = NULL;
+    assert(FALSE == tokenizer.error && LXML_TOKEN_NONE == lxmlTokenizerNext(&tokenizer, testXml, strlen(testXml), &i, TRUE, &token));
+    free(tokenizer.names);
 
     return TRUE;
 } /* End of lxmlTestParseAttributesPass */
 
-static int lxmlTestParseAttributes() {
-    int success = FALSE;
-
-    success = lxmlTestParseAttributesPass();
+static int lxmlTestNextAttribute() {
+    const char *attrs = " a=\"1\"\tb = '2 \"x\"'c='' \n", *key = NULL, *value = NULL;
+    const char *malformed[] = { "=\"1\"", "a", "a b=\"1\"", "a=", "a=1", "a=\"1", "a='1\"", "a\"b=\"1\"" };
+    size_t i = 0, keyLen = 0, valueLen = 0, len = strlen(attrs);
+
+    assert(1 == lxmlNextAttribute(attrs, len, &i, &key, &keyLen, &value, &valueLen));
+    assert(1 == keyLen && 'a' == key[0] && 1 == valueLen && '1' == value[0]);
+    assert(1 == lxmlNextAttribute(attrs, len, &i, &key, &keyLen, &value, &valueLen));
+    assert(1 == keyLen && 'b' == key[0] && 5 == valueLen && 0 == memcmp(value, "2 \"x\"", 5));
+    assert(1 == lxmlNextAttribute(attrs, len, &i, &key, &keyLen, &value, &valueLen));
+    assert(1 == keyLen && 'c' == key[0] && 0 == valueLen);
+    assert(0 == lxmlNextAttribute(attrs, len, &i, &key, &keyLen, &value, &valueLen));
+    assert(len == i);
+
+    for (len = 0; len < sizeof(malformed) / sizeof(malformed[0]); ++len) {
+        i = 0;
+        assert(-1 == lxmlNextAttribute(malformed[len], strlen(malformed[len]), &i, &key, &keyLen, &value, &valueLen));
+    }
 
-    printf("lxmlTestParseAttributes: %s\n", (TRUE == success) ? "Pass" : "Fail");
+    return TRUE;
+} /* End of lxmlTestNextAttribute */
+
+static int lxmlTestSingleQuotedAttributes() {
+    const char *xml = "<field name='it\"s' type = 'int' />";
+    struct XMLDocument doc = XMLDocument_loadBuffer(xml, strlen(xml));
+    struct XMLNode *field = NULL;
+    char buf[TEST_BUF];
+    FILE *fp = tmpfile();
+    size_t len = 0;
+
+    assert(TRUE == doc.success && NULL != fp);
+    field = doc.root->children.data[0];
+    assert(0 == strcmp("it\"s", XMLNode_getAttribute(field, "name")->value));
+    assert(0 == strcmp("int", XMLNode_getAttribute(field, "type")->value));
+
+    /* Written back with whichever quote the value allows */
+    assert(TRUE == XMLDocument_write(&doc, fp, 2));
+    rewind(fp);
+    len = fread(buf, sizeof(char), sizeof(buf) - 1, fp);
+    buf[len] = '\0';
+    assert(NULL != strstr(buf, "<field name='it\"s' type=\"int\" />"));
 
-    return success;
-} /* End of lxmlTestParseAttributes */
+    fclose(fp);
+    doc.free(&doc);
 
-static int lxmlTestEndsWithPass() {
-    assert(TRUE == lxmlEndsWith(TEST_HAYSTACK_1, TEST_NEEDLE_1));
     return TRUE;
-} /* End of lxmlTestEndsWithPass */
+} /* End of lxmlTestSingleQuotedAttributes */
 
-static int lxmlTestEndsWithFail() {
-    assert(FALSE == lxmlEndsWith(TEST_HAYSTACK_1, TEST_NEEDLE_INVALID));
-    return TRUE;
-} /* End of lxmlTestEndsWithFail */
+static int lxmlTestScan() {
+    char buf[TEST_BUF];
+    size_t at = 0;
 
-static int lxmlTestEndsWithFail2() {
-    assert(FALSE == lxmlEndsWith(TEST_HAYSTACK_1, TEST_NEEDLE_INVALID2));
-    return TRUE;
-} /* End of lxmlTestEndsWithFail2 */
+    memset(buf, 'x', sizeof(buf));
+    assert(sizeof(buf) == lxmlScan3(buf, sizeof(buf), 0, '>', '"', '\''));
+    assert(0 == lxmlScan3(buf, 0, 0, '>', '"', '\''));
 
-static int lxmlTestEndsWithFailHaystackLargerThanNeedle() {
-    assert(FALSE == lxmlEndsWith(TEST_NEEDLE_1, TEST_HAYSTACK_1));
-    return TRUE;
-} /* End of lxmlTestEndsWithFailHaystackLargerThanNeedle */
+    /* Every offset against every vector boundary and the scalar tail */
+    for (; at < 200; ++at) {
+        size_t from = 0;
 
-static int lxmlTestEndsWithFailNullHaystack() {
-    assert(FALSE == lxmlEndsWith(NULL, TEST_NEEDLE_1));
-    return TRUE;
-} /* End of lxmlTestEndsWithFailNullHaystack */
+        buf[at] = "'>\""[at % 3];
 
-static int lxmlTestEndsWithFailNullNeedle() {
-    assert(FALSE == lxmlEndsWith(TEST_HAYSTACK_1, NULL));
-    return TRUE;
-} /* End of lxmlTestEndsWithFailNullNeedle */
+        for (; from <= at; ++from) {
+            assert(at == lxmlScan3(buf, sizeof(buf), from, '>', '"', '\''));
+            assert(at == lxmlScan3(buf, at + 1, from, '>', '"', '\''));
+            assert(at == lxmlScan3(buf, at, from, '>', '"', '\''));
+        }
 
-static int lxmlTestEndsWith() {
-    int success = lxmlTestEndsWithPass();
+        buf[at] = 'x';
+    }
 
-    success &= lxmlTestEndsWithFail();
-    success &= lxmlTestEndsWithFail2();
-    success &= lxmlTestEndsWithFailHaystackLargerThanNeedle();
-    success &= lxmlTestEndsWithFailNullHaystack();
+    return TRUE;
+} /* End of lxmlTestScan */
 
-    success &= lxmlTestEndsWithFailNullNeedle();
+static int lxmlTestFind() {
+    char buf[TEST_BUF];
+    size_t at = 0, i = 0;
 
-    printf("lxmlTestEndsWith: %s\n", (TRUE == success) ? "Pass" : "Fail");
+    /* Full of '-' and '>' but never '-->' */
+    for (; i < sizeof(buf); ++i)
+        buf[i] = "->"[i % 2];
 
-    return success;
-} /* End of lxmlTestEndsWith */
+    assert(sizeof(buf) == lxmlFind(buf, sizeof(buf), 0, "-->", 3));
+    assert(2 == lxmlFind(buf, 2, 0, "-->", 3));
 
-static int lxmlTestAttributeInit() {
-    struct XMLAttribute *attr = XMLAttribute_init("Hello", "World");
+    for (; at < 200; ++at) {
+        size_t from = 0;
 
-    assert(NULL != attr);
-    assert(NULL != attr->free);
+        memcpy(buf + at, "-->", 3);
 
-    assert(0 == strcmp(attr->key, "Hello"));
-    assert(0 == strcmp(attr->value, "World"));
+        for (; from <= at; ++from) {
+            assert(at == lxmlFind(buf, sizeof(buf), from, "-->", 3));
+            assert(at == lxmlFind(buf, at + 3, from, "-->", 3));
+            assert(at + 2 == lxmlFind(buf, at + 2, from, "-->", 3));
+        }
 
-    attr->free(attr);
-    free(attr);
-    attr = NULL;
+        for (i = at; i < at + 3; ++i)
+            buf[i] = "->"[i % 2];
+    }
 
     return TRUE;
-} /* End of lxmlTestAttributeInit */
+} /* End of lxmlTestFind */
 
-static int lxmlTestAttributeListInit() {
-    struct XMLAttributeList list = XMLAttributeList_init();
+static int lxmlTestFindTagEndLong() {
+    char buf[TEST_BUF];
+    size_t scan = 0, len = 0;
+    char quote = '\0';
 
-    assert(0 == list.size);
-    assert(0 == list.heapSize);
+    len = (size_t) sprintf(buf, "<item description=\"%s > still quoted\" other='%s \"' id=\"1\">", "padding padding padding padding", "more padding padding padding padding");
+    assert(TRUE == lxmlFindTagEnd(buf, len, &scan, &quote));
+    assert(len - 1 == scan && '\0' == quote);
 
-    assert(NULL != list.add);
-    assert(NULL != list.free);
+    /* Resumed part way through a quoted value */
+    scan = 0;
+    assert(FALSE == lxmlFindTagEnd(buf, 40, &scan, &quote));
+    assert(40 == scan && '"' == quote);
+    assert(TRUE == lxmlFindTagEnd(buf, len, &scan, &quote));
+    assert(len - 1 == scan);
 
     return TRUE;
-} /* End of lxmlTestAttributeListInit */
+} /* End of lxmlTestFindTagEndLong */
 
-static int lxmlTestAttributeListAdd() {
+static int lxmlTestParseAttributes() {
     int success = FALSE;
 
-    struct XMLAttributeList list = XMLAttributeList_init();
-    struct XMLAttribute *attr = XMLAttribute_init("Hello", "World");
+    success = lxmlTestParseAttributesPass();
+    success &= lxmlTestScan();
+    success &= lxmlTestFind();
+    success &= lxmlTestNextAttribute();
+    success &= lxmlTestSingleQuotedAttributes();
+    success &= lxmlTestFindTagEndLong();
 
-    assert(NULL != attr);
+    printf("lxmlTestParseAttributes: %s\n", (TRUE == success) ? "Pass" : "Fail");
 
-    success = list.add(&list, *attr);
+    return success;
+} /* End of lxmlTestParseAttributes */
 
-    assert(TRUE == success);
-    assert(1 == list.size);
-    assert(1 == list.heapSize);
+/**
+ * @brief Helper function that asserts 'doc' holds the 'TEST_XML_VALID_1' tree
+ *
+ * @param doc - The loaded 'XMLDocument'
+ * @return success - A flag indicating the status of the subroutine
+ */
+static int tlxmlCheckTestXmlValid1(struct XMLDocument *doc) {
+    struct XMLNode *root = NULL;
+    char *attrVal = NULL;
 
-    assert(0 == strcmp(list.attribute[0]->key, "Hello"));
-    assert(0 == strcmp(list.attribute[0]->value, "World"));
+    assert(TRUE == doc->success);
+    assert(0 == strcmp("1.0", doc->version));
+    assert(0 == strcmp("UTF-8", doc->encoding));
 
-    list.free(&list);
-    attr->free(attr);
-    free(attr);
-    attr = NULL;
+    assert(1 == doc->root->children.size);
+    root = doc->root->children.data[0];
+    assert(0 == strcmp("struct", root->tag));
+    assert(3 == root->children.size);
 
-    return success;
-} /* End of lxmlTestAttributeListAdd */
+    assert(0 == strcmp("field", root->children.data[0]->tag));
+    assert(0 == strcmp("field", root->children.data[1]->tag));
+    assert(0 == strcmp("description", root->children.data[2]->tag));
+    assert(0 == strcmp("This defines a person", root->children.data[2]->inner_text));
 
-static int lxmlTestAttributeListGetAttributeValue() {
-    int success = FALSE;
+    attrVal = XMLNode_getAttributeValue(root->children.data[1], "type");
+    assert(NULL != attrVal && 0 == strcmp("int", attrVal));
+    free(attrVal);
+    attrVal = NULL;
 
-    struct XMLAttributeList list = XMLAttributeList_init();
+    return TRUE;
+} /* End of tlxmlCheckTestXmlValid1 */
 
-    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
-    assert(TRUE == success);
+static int lxmlTestXMLDocumentLoadBufferUnterminated() {
+    /* Copy without the NUL terminator so any over-read is caught by tools like valgrind */
+    char *buf = malloc(TEST_XML_VALID_1_SIZE);
+    struct XMLDocument doc = { 0 };
 
-    success &= lxmlTestGetDefaultAttributeValuesFromAttributeList(list);
-    assert(TRUE == success);
+    assert(NULL != buf);
+    memcpy(buf, TEST_XML_VALID_1, TEST_XML_VALID_1_SIZE);
 
-    list.free(&list);
+    doc = XMLDocument_loadBuffer(buf, TEST_XML_VALID_1_SIZE);
+    tlxmlCheckTestXmlValid1(&doc);
 
-    return success;
-} /* End of lxmlTestAttributeListGetAttributeValue */
+    doc.free(&doc);
+    free(buf);
+    buf = NULL;
 
-static int lxmlTestAttributeListGetAttributeValueMissing() {
-    int success = FALSE;
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferUnterminated */
+
+static int lxmlTestXMLDocumentLoadBufferMalformed() {
+    static const char * const malformed[] = {
+        "<a><b></a></b>",
+        "<a><b></b>",
+        "<a></a></a>",
+        "<a name=\"value></a>",
+        "<a><!-- never closed </a>",
+        "<a><![CDATA[ never closed </a>",
+        "<!DOCTYPE a [ <!ENTITY b \"c\"> <a></a>",
+        "<a"
+    };
+    size_t i = 0;
 
-    struct XMLAttributeList list = XMLAttributeList_init();
-    char *tmp = NULL;
-    
-    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
-    assert(TRUE == success);
+    for (; i < sizeof(malformed) / sizeof(malformed[0]); ++i) {
+        struct XMLDocument doc = XMLDocument_loadBuffer(malformed[i], strlen(malformed[i]));
 
-    tmp = list.getAttributeValue(&list, "Fish");
-    assert(NULL == tmp);
+        assert(FALSE == doc.success);
+        doc.free(&doc);
+    }
 
-    list.free(&list);
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferMalformed */
 
-    return success;
-} /* End of lxmlTestAttributeListGetAttributeValueMissing */
+static int lxmlTestXMLDocumentLoadBufferCData() {
+    const char *xml = "<!DOCTYPE a SYSTEM \"a>b.dtd\"><a><![CDATA[<b>&amp;]]]]><![CDATA[]]>--></a>";
+    struct XMLDocument doc = XMLDocument_loadBuffer(xml, strlen(xml));
+    struct XMLNode *a = NULL;
 
-static int lxmlTestAttributeListGetAttribute() {
-    int success = FALSE;
+    assert(TRUE == doc.success && 1 == doc.root->children.size);
 
-    struct XMLAttributeList list = XMLAttributeList_init();
-    
-    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
-    assert(TRUE == success);
+    /* Markup inside a CDATA section is text and an empty section adds nothing */
+    a = doc.root->children.data[0];
+    assert(0 == a->children.size);
+    assert(0 == strcmp("<b>&amp;]]-->", a->inner_text));
 
-    success &= lxmlTestGetDefaultAttributesFromAttributeList(list);
-    assert(TRUE == success);
+    doc.free(&doc);
 
-    list.free(&list);
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferCData */
 
-    return success;
-} /* End of lxmlTestAttributeListGetAttribute */
+/**
+ * @brief Helper function that checks the tree of 'TEST_XML_REFERENCES' was decoded
+ */
+static void tlxmlCheckReferences(struct XMLNode *root) {
+    struct XMLNode *a = root->children.data[0];
+    size_t len = 0;
+    const char *text = XMLNode_getInnerText(a, &len);
 
-static int lxmlTestAttributeListGetAttributeMissing() {
-    int success = FALSE;
+    assert(lxmlViewEquals(a->tag, a->tagLen, "a") && 3 == a->attributes.size);
+    assert(lxmlViewEquals(a->attributes.attribute[0].value, a->attributes.attribute[0].valueLen, "<AB\"&amp;"));
+    assert(lxmlViewEquals(a->attributes.attribute[1].value, a->attributes.attribute[1].valueLen, "caf\xC3\xA9 \xF0\x9F\x98\x80"));
 
-    struct XMLAttributeList list = XMLAttributeList_init();
-    struct XMLAttribute *tmp = NULL;
-    
-    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
-    
-    assert(TRUE == success);
+    /* Unknown entities, invalid characters and bare ampersands are kept */
+    assert(lxmlViewEquals(a->attributes.attribute[2].value, a->attributes.attribute[2].valueLen, "&nbsp; &#0; &#xD800; &#; AT&T &"));
 
-    tmp = list.getAttribute(&list, "Fish");
-    assert(NULL == tmp);
+    /* References in a CDATA section are not decoded */
+    assert(NULL != text && 16 == len && 0 == memcmp("x < y && >&lt;'.", text, len));
+    assert(lxmlViewEquals(XMLNode_getChild(a, 0)->tag, XMLNode_getChild(a, 0)->tagLen, "plain"));
+} /* End of tlxmlCheckReferences */
 
-    list.free(&list);
+/**
+ * @brief Helper function that compares the text of 'node' with the NUL terminated 'ctx'
+ */
+static int tlxmlOnLongText(void *ctx, struct XMLNode *node) {
+    const char *expected = ctx;
 
-    return success;
-} /* End of lxmlTestAttributeListGetAttributeMisisng */
+    assert(strlen(expected) == node->innerTextLen && 0 == memcmp(expected, node->inner_text, node->innerTextLen));
 
-static int lxmlTestAttributeList() {
-    int success = lxmlTestAttributeListInit(); 
+    return TRUE;
+} /* End of tlxmlOnLongText */
 
-    success &= lxmlTestAttributeListAdd();
-    success &= lxmlTestAttributeListGetAttributeValue();
-    success &= lxmlTestAttributeListGetAttributeValueMissing();
-    success &= lxmlTestAttributeListGetAttribute();
+static int lxmlTestXMLDocumentLoadBufferReferences() {
+    static const int flags[] = { 0, LXML_LOAD_ARENA, LXML_LOAD_IN_SITU, LXML_LOAD_INTERN, LXML_LOAD_LAZY, LXML_LOAD_INDEX, LXML_LOAD_PARALLEL };
+    size_t len = strlen(TEST_XML_REFERENCES), i = 0, textLen = 3 * LXML_READER_BUFFER_SIZE;
+    struct XMLDocument doc = { 0 };
+    struct XMLNode *plain = NULL;
+    char *buf = malloc(len), *big = NULL, *expected = NULL;
+    FILE *fp = NULL;
 
-    success &= lxmlTestAttributeListGetAttributeMissing();
+    assert(NULL != buf);
+    memcpy(buf, TEST_XML_REFERENCES, len);
 
-    printf("lxmlTestAttributeList: %s\n", (TRUE == success) ? "Pass" : "Fail");
+    for (; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+        doc = XMLDocument_loadBufferWithFlags(buf, len, flags[i]);
+        assert(TRUE == doc.success);
+        tlxmlCheckReferences(doc.root);
 
-    return success;
-} /* End of lxmlTestAttributeList */
+        /* Text without references stays a view */
+        plain = XMLNode_getChild(XMLNode_getChild(doc.root, 0), 0);
+        if (LXML_LOAD_IN_SITU == flags[i])
+            assert(buf < plain->inner_text && plain->inner_text < buf + len);
 
-static int lxmlTestNodeInit() {
-    struct XMLNode *node = XMLNode_init();
+        doc.free(&doc);
+    }
 
-    assert(NULL != node);
+    /* A reference split between chunks */
+    {
+        struct XMLParser *parser = XMLParser_create();
 
-    assert(0    == node->children.heapSize);
-    assert(0    == node->children.size);
-    assert(NULL == node->children.data);
+        for (i = 0; i < len; ++i)
+            assert(TRUE == XMLParser_feed(parser, buf + i, 1));
 
-    assert(NULL != node->children.add);
-    assert(NULL != node->children.free);
+        doc = XMLParser_finish(parser);
+        assert(TRUE == doc.success);
+        tlxmlCheckReferences(doc.root);
+        doc.free(&doc);
+    }
 
-    assert(0    == node->attributes.heapSize);
-    assert(0    == node->attributes.size);
-    assert(NULL == node->attributes.attribute);
+    /* Or between the chunks read from a file and the windows of a reader, in text longer than either */
+    big = malloc(2 * textLen + 2);
+    assert(NULL != big);
+    expected = big + textLen + 1;
 
-    assert(NULL != node->attributes.add);
-    assert(NULL != node->attributes.free);
-    assert(NULL != node->attributes.getAttribute);
-    assert(NULL != node->attributes.getAttributeValue);
+    memset(big, 'a', textLen);
+    memcpy(big + LXML_READ_CHUNK_SIZE - 8, "&amp;", 5);
+    memcpy(big + LXML_READER_BUFFER_SIZE - 2, "&#38;", 5);
+    big[textLen] = '\0';
 
-    assert(NULL != node->add);
-    assert(NULL != node->free);
-    assert(NULL != node->getAttribute);
-    assert(NULL != node->getAttributeValue);
+    memset(expected, 'a', textLen - 8);
+    expected[LXML_READ_CHUNK_SIZE - 8] = expected[LXML_READER_BUFFER_SIZE - 6] = '&';
+    expected[textLen - 8] = '\0';
 
-    node->free(node);
-    free(node);
-    node = NULL;
+    fp = tmpfile();
+    assert(NULL != fp);
+    fprintf(fp, "<r><b>%s</b></r>", big);
+    rewind(fp);
 
-    return TRUE;
-} /* End of lxmlTestNodeInit */
+    doc = XMLDocument_load(fp);
+    assert(TRUE == doc.success);
+    assert(TRUE == tlxmlOnLongText(expected, XMLNode_getChild(doc.root, 0)->children.data[0]));
+    rewind(fp);
 
-static int lxmlTestNodeAdd() {
-    struct XMLNode node   = XMLNodeInitStack(),
-                   *child = XMLNode_init();
+    assert(TRUE == XMLDocument_streamElements(fp, "b", tlxmlOnLongText, expected));
 
-    assert(NULL != child);
+    doc.free(&doc);
+    fclose(fp);
+    free(big);
+    free(buf);
 
-    node.add(&node, child);
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferReferences */
 
-    assert(NULL == node.parent);
-    assert(&node == child->parent);
+static int lxmlTestXMLDocumentLoadPath() {
+    const char *path = "lxml_test_load_path.xml";
+    struct XMLDocument doc = { 0 };
+    FILE *fp = fopen(path, "w");
 
-    node.free(&node);
-    child = NULL;
-    
-    return TRUE;
-} /* End of lxmlTestNodeAdd */
+    assert(NULL != fp);
+    assert(TEST_XML_VALID_1_SIZE == fwrite(TEST_XML_VALID_1, 1, TEST_XML_VALID_1_SIZE, fp));
+    fclose(fp);
+    fp = NULL;
 
-static int lxmlTestNodeCreateAndAppend() {
-    struct XMLNode node  = XMLNodeInitStack();
-    struct XMLNode *child = node.createAndAppend(&node);
+    doc = XMLDocument_loadPath(path);
+    tlxmlCheckTestXmlValid1(&doc);
+    doc.free(&doc);
 
-    assert(NULL != child);
-    assert(1 == node.children.size && 1 == node.children.heapSize);
-    assert(child == node.children.data[0]);
+    remove(path);
 
-    node.free(&node);
+    doc = XMLDocument_loadPath(path);
+    assert(FALSE == doc.success);
+    doc.free(&doc);
 
     return TRUE;
-} /* End of lxmlTestNodeCreateAndAppend */
+} /* End of lxmlTestXMLDocumentLoadPath */
+
+static int lxmlTestXMLDocumentLoadMany() {
+    static const int flags[] = { 0, LXML_LOAD_IN_SITU, LXML_LOAD_INTERN };
+    const size_t n = 40;
+    char paths[40][32];
+    const char *list[40];
+    struct XMLDocument docs[40];
+    size_t i = 0, j = 0;
+
+    /* Mostly small files, one larger than 'LXML_SCRATCH_FILE_SIZE', one malformed and one missing */
+    for (; i < n; ++i) {
+        char *feed = tlxmlCreateFeed((1 == i) ? 12000 : i * 3, (7 == i) ? 0 : (size_t) -1, "<a></b>");
+        FILE *fp = NULL;
+
+        sprintf(paths[i], "lxml_test_load_many_%lu.xml", (unsigned long) i);
+        list[i] = paths[i];
+
+        if (1 == i)
+            assert(LXML_SCRATCH_FILE_SIZE < strlen(feed));
+
+        if (13 != i) {
+            fp = fopen(paths[i], "w");
+            assert(NULL != fp);
+            assert(strlen(feed) == fwrite(feed, 1, strlen(feed), fp));
+            fclose(fp);
+        }
 
-static int lxmlTestNodeGetImmediateElementByTagName() {
-    struct XMLNode *tree = tlxmlCreateTestXMLNodeTree();
+        free(feed);
+    }
 
-    assert(NULL != tree);
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+        int threads = 1;
 
-    {
-        struct XMLNode *topNode    = tree->getImmediateElementByTagName(tree, "top"),
-                       *middleNode = tree->getImmediateElementByTagName(tree, "middle"),
-                       *bottomNode = tree->getImmediateElementByTagName(tree, "bottom");
+        for (; threads <= 8; threads += 3) {
+            assert(n - 2 == XMLDocument_loadManyWithFlags(list, n, docs, threads, flags[i]));
 
-        assert(NULL != topNode && NULL != middleNode && NULL != bottomNode);
+            for (j = 0; j < n; ++j) {
+                struct XMLDocument doc = XMLDocument_loadPathWithFlags(list[j], flags[i]);
 
-        assert(0 == strcmp("top",    topNode->tag));
-        assert(0 == strcmp("middle", middleNode->tag));
-        assert(0 == strcmp("bottom", bottomNode->tag));
+                assert(doc.success == docs[j].success && (7 != j && 13 != j) == doc.success);
+                if (TRUE == doc.success)
+                    tlxmlCompareXmlNodes(doc.root, docs[j].root);
+
+                doc.free(&doc);
+                docs[j].free(&docs[j]);
+            }
+        }
     }
 
-    tree->free(tree);
-    free(tree);
-    tree = NULL;
+    for (i = 0; i < n; ++i)
+        remove(paths[i]);
 
     return TRUE;
-} /* End of lxmlTestNodeGetImmediateElementByTagName */
+} /* End of lxmlTestXMLDocumentLoadMany */
 
-static int lxmlTestNodeGetImmediateElementByTagNameNodeNotFound() {
-    struct XMLNode *tree = tlxmlCreateTestXMLNodeTree();
+#ifdef LXML_HAVE_POSIX
+static int lxmlTestXMLDocumentLoadFdPipe() {
+    struct XMLDocument doc = { 0 };
+    int fds[2] = { -1, -1 };
 
-    assert(NULL != tree);
-    assert(NULL == tree->getImmediateElementByTagName(tree, "upper"));
+    assert(0 == pipe(fds));
+    assert(TEST_XML_VALID_1_SIZE == write(fds[1], TEST_XML_VALID_1, TEST_XML_VALID_1_SIZE));
+    close(fds[1]);
 
-    tree->free(tree);
-    free(tree);
-    tree = NULL;
+    doc = XMLDocument_loadFd(fds[0]);
+    tlxmlCheckTestXmlValid1(&doc);
+    doc.free(&doc);
+
+    close(fds[0]);
 
     return TRUE;
-} /* End of lxmlTestNodeGetImmediateElementByTagNameNodeNotFound */
+} /* End of lxmlTestXMLDocumentLoadFdPipe */
+#endif /* LXML_HAVE_POSIX */
+
+static int lxmlTestXMLDocumentLoadBufferArena() {
+    struct XMLDocument heap = XMLDocument_loadBuffer(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED));
+    struct XMLDocument doc = XMLDocument_loadBufferWithFlags(TEST_XML_VALID_1, TEST_XML_VALID_1_SIZE, LXML_LOAD_ARENA);
+    struct XMLNode *root = NULL;
+    char *large = calloc(LXML_ARENA_BLOCK_SIZE, sizeof(char));
+    size_t i = 0;
 
-static int lxmlTestNodeGetAttributeValues() {
-    int success = FALSE;
+    assert(NULL != doc.arena);
+    tlxmlCheckTestXmlValid1(&doc);
 
-    struct XMLNode *node = XMLNode_init();
-    assert(NULL != node);
+    /* Nodes and attributes added later come from the same arena, including ones larger than a block */
+    assert(NULL != large);
+    memset(large, 'x', LXML_ARENA_BLOCK_SIZE - 1);
 
-    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&node->attributes);
-    assert(TRUE == success);
+    root = doc.root->children.data[0];
+    for (; i < 100; ++i) {
+        struct XMLNode *child = XMLNode_createAndAppend(root);
+        struct XMLAttribute attr = { 0 };
 
-    success &= lxmlTestGetDefaultAttributeValuesFromAttributeList(node->attributes);
-    assert(TRUE == success);
+        assert(NULL != child);
+        attr.key = "key";
+        attr.value = (0 == i % 10) ? large : "value";
+        assert(TRUE == XMLAttributeList_add(&child->attributes, attr));
+        assert(TRUE == XMLAttributeList_add(&child->attributes, attr));
+    }
 
-    node->free(node);
-    free(node);
-    node = NULL;
+    assert(103 == root->children.size);
+    assert(0 == strcmp(large, root->children.data[3]->attributes.attribute[1].value));
+    assert(0 == strcmp("value", root->children.data[102]->attributes.attribute[0].value));
 
-    return success;
-} /* End of lxmlTestNodeGetAttributeValues */
+    doc.free(&doc);
+    assert(NULL == doc.arena && NULL == doc.root);
 
-static int lxmlTestNodeGetAttributes() {
-    int success = FALSE;
+    doc = XMLDocument_loadBufferWithFlags(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED), LXML_LOAD_ARENA);
+    assert(TRUE == doc.success);
+    tlxmlCompareXmlNodes(heap.root, doc.root);
 
-    struct XMLNode *node = XMLNode_init();
-    assert(NULL != node);
+    doc.free(&doc);
+    heap.free(&heap);
+    free(large);
+    large = NULL;
 
-    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&node->attributes);
-    assert(TRUE == success);
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferArena */
+
+/**
+ * @brief Helper function that asserts both documents write out the same bytes
+ */
+static int tlxmlCompareWrittenDocuments(struct XMLDocument *a, struct XMLDocument *b) {
+    FILE *fpA = tmpfile(), *fpB = tmpfile();
+    int c = 0;
+
+    assert(NULL != fpA && NULL != fpB);
+    XMLDocument_write(a, fpA, 4);
+    XMLDocument_write(b, fpB, 4);
+    rewind(fpA);
+    rewind(fpB);
+
+    do {
+        c = fgetc(fpA);
+        assert(c == fgetc(fpB));
+    } while (EOF != c);
+
+    fclose(fpA);
+    fclose(fpB);
+
+    return TRUE;
+} /* End of tlxmlCompareWrittenDocuments */
+
+static int lxmlTestXMLDocumentLoadBufferInSitu() {
+    const char *path = "lxml_test_load_in_situ.xml";
+    size_t len = strlen(TEST_XML_CHUNKED);
+    struct XMLDocument heap = XMLDocument_loadBuffer(TEST_XML_CHUNKED, len);
+    struct XMLDocument doc = { 0 };
+    struct XMLNode *root = NULL;
+    char *buf = malloc(len), *attrVal = NULL;
+    FILE *fp = NULL;
+
+    /* Without the NUL terminator, so nothing may rely on it */
+    assert(NULL != buf);
+    memcpy(buf, TEST_XML_CHUNKED, len);
+
+    doc = XMLDocument_loadBufferWithFlags(buf, len, LXML_LOAD_IN_SITU);
+    assert(TRUE == doc.success && NULL != doc.arena);
+    tlxmlCompareXmlNodes(heap.root, doc.root);
+    tlxmlCompareWrittenDocuments(&heap, &doc);
+
+    root = XMLNode_getImmediateElementByTagName(doc.root, "root");
+    assert(NULL != root);
+    assert(buf < root->tag && root->tag < buf + len && 4 == root->tagLen);
+    assert(buf < root->children.data[0]->inner_text && root->children.data[0]->inner_text < buf + len);
+
+    attrVal = XMLNode_getAttributeValue(root, "a");
+    assert(0 == strcmp("x>y", attrVal));
+    free(attrVal);
+    attrVal = NULL;
+
+    doc.free(&doc);
+    free(buf);
+    buf = NULL;
+
+    /* The document keeps the mapping or buffer read from a file */
+    fp = fopen(path, "w");
+    assert(NULL != fp);
+    assert(len == fwrite(TEST_XML_CHUNKED, 1, len, fp));
+    fclose(fp);
+
+    doc = XMLDocument_loadPathWithFlags(path, LXML_LOAD_IN_SITU);
+    remove(path);
+
+    assert(TRUE == doc.success);
+    tlxmlCompareXmlNodes(heap.root, doc.root);
+    doc.free(&doc);
+
+    heap.free(&heap);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferInSitu */
+
+static int lxmlTestXMLDocumentLoadBufferLazy() {
+    const char *path = "lxml_test_load_lazy.xml";
+    size_t len = strlen(TEST_XML_CHUNKED), textLen = 0, count = 0;
+    struct XMLDocument heap = XMLDocument_loadBuffer(TEST_XML_CHUNKED, len);
+    struct XMLDocument doc = { 0 };
+    struct XMLNode *root = NULL, *item = NULL, *nested = NULL;
+    struct XMLQuery *query = NULL;
+    char *buf = malloc(len), *attrVal = NULL;
+    const char *text = NULL;
+    FILE *fp = NULL;
+
+    assert(NULL != buf);
+    memcpy(buf, TEST_XML_CHUNKED, len);
+
+    /* Only the children of 'doc.root' are built up front, with their attributes */
+    doc = XMLDocument_loadBufferWithFlags(buf, len, LXML_LOAD_LAZY);
+    assert(TRUE == doc.success && NULL != doc.arena);
+    assert(0 == strcmp("1.0", doc.version));
+
+    root = doc.root->children.data[0];
+    assert(0 != root->lazy && 0 == root->children.size && NULL == root->inner_text);
+    attrVal = XMLNode_getAttributeValue(root, "a");
+    assert(0 == strcmp("x>y", attrVal));
+    free(attrVal);
+    attrVal = NULL;
+
+    assert(3 == XMLNode_childCount(root) && 0 == root->lazy);
+    item = XMLNode_getChild(root, 0);
+    assert(NULL != item && 0 != item->lazy && NULL == XMLNode_getChild(root, 3));
+
+    text = XMLNode_getInnerText(item, &textLen);
+    assert(0 == item->lazy && 26 == textLen && 0 == memcmp("Some text which gets split", text, textLen));
+    text = XMLNode_getInnerText(XMLNode_getChild(root, 1), &textLen);
+    assert(8 == textLen && 0 == memcmp("<x> & ]]", text, textLen));
+
+    /* Once walked the tree is the one an eager load builds */
+    assert(TRUE == XMLNode_walk(doc.root, NULL, NULL, NULL));
+    tlxmlCompareXmlNodes(heap.root, doc.root);
+    doc.free(&doc);
+
+    /* Writing builds whatever has not been visited yet */
+    doc = XMLDocument_loadBufferWithFlags(buf, len, LXML_LOAD_LAZY | LXML_LOAD_IN_SITU);
+    assert(TRUE == doc.success);
+    tlxmlCompareWrittenDocuments(&heap, &doc);
+    tlxmlCompareXmlNodes(heap.root, doc.root);
+    assert(buf < doc.root->children.data[0]->children.data[0]->inner_text);
+    doc.free(&doc);
+
+    /* Lookups, queries and indexes expand the nodes they pass through */
+    doc = XMLDocument_loadBufferWithFlags(TEST_XML_QUERY, strlen(TEST_XML_QUERY), LXML_LOAD_LAZY | LXML_LOAD_INTERN | LXML_LOAD_INDEX);
+    assert(TRUE == doc.success);
+
+    query = XMLQuery_compile("/struct/nested/description");
+    assert(NULL != query && 1 == XMLQuery_eval(query, doc.root, NULL, NULL));
+    XMLQuery_free(query);
+
+    root = XMLNode_getImmediateElementByTagName(doc.root, "struct");
+    assert(NULL != root && 0 == root->lazy);
+    assert(NULL != XMLNode_getImmediateElementByName(root, XMLNameTable_get(XMLDocument_getNameTable(&doc), "field")));
+    assert(NULL != XMLDocument_getElementsByTagName(&doc, "field", &count) && 3 == count);
+    doc.free(&doc);
+
+    /* Nodes added to an element which was not built yet follow its children */
+    doc = XMLDocument_loadBufferWithFlags(TEST_XML_QUERY, strlen(TEST_XML_QUERY), LXML_LOAD_LAZY);
+    root = doc.root->children.data[0];
+    assert(0 != root->lazy && NULL != XMLNode_createAndAppend(root));
+    assert(6 == root->children.size && NULL == root->children.data[5]->tag);
+
+    nested = root->children.data[4];
+    assert(0 != nested->lazy && 0 == strcmp("nested", nested->tag));
+    assert(0 == strcmp("Inner", XMLNode_getInnerText(XMLNode_getImmediateElementByTagName(nested, "description"), NULL)));
+    doc.free(&doc);
+
+    /* Malformed documents fail although nothing below the root is built */
+    doc = XMLDocument_loadBufferWithFlags("<a><b><c></b></c></a>", 21, LXML_LOAD_LAZY);
+    assert(FALSE == doc.success);
+    doc.free(&doc);
+    doc = XMLDocument_loadBufferWithFlags("<a><b x=\"1\" y></b></a>", 23, LXML_LOAD_LAZY);
+    assert(FALSE == doc.success);
+    doc.free(&doc);
+    doc = XMLDocument_loadBufferWithFlags("<a><b></b>", 10, LXML_LOAD_LAZY);
+    assert(FALSE == doc.success);
+    doc.free(&doc);
+
+    free(buf);
+    buf = NULL;
+
+    /* The document keeps the mapping or buffer read from a file */
+    fp = fopen(path, "w");
+    assert(NULL != fp);
+    assert(len == fwrite(TEST_XML_CHUNKED, 1, len, fp));
+    fclose(fp);
+
+    doc = XMLDocument_loadPathWithFlags(path, LXML_LOAD_LAZY);
+    remove(path);
+
+    assert(TRUE == doc.success);
+    tlxmlCompareWrittenDocuments(&heap, &doc);
+    doc.free(&doc);
+
+    heap.free(&heap);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferLazy */
+
+static int lxmlTestXMLDocumentLoadBufferIntern() {
+    size_t len = strlen(TEST_XML_CHUNKED);
+    struct XMLDocument heap = XMLDocument_loadBuffer(TEST_XML_CHUNKED, len);
+    struct XMLDocument doc = XMLDocument_loadBufferWithFlags(TEST_XML_CHUNKED, len, LXML_LOAD_INTERN);
+    struct XMLDocument other = { 0 };
+    struct XMLNameTable *names = XMLDocument_getNameTable(&doc), *shared = NULL;
+    struct XMLNode *root = NULL, *child = NULL;
+    const char *item = NULL, *b = NULL;
+
+    assert(TRUE == doc.success && NULL != names);
+    assert(NULL == XMLDocument_getNameTable(&heap));
+    tlxmlCompareXmlNodes(heap.root, doc.root);
+    tlxmlCompareWrittenDocuments(&heap, &doc);
+
+    /* root, item, empty, a and b */
+    assert(5 == names->size);
+    assert(NULL == XMLNameTable_get(names, "missing"));
+
+    item = XMLNameTable_get(names, "item");
+    b = XMLNameTable_get(names, "b");
+    assert(NULL != item && NULL != b);
+    assert(item == XMLNameTable_intern(names, "items", 4));
+
+    root = XMLNode_getImmediateElementByName(doc.root, XMLNameTable_get(names, "root"));
+    assert(NULL != root);
+    assert(item == root->children.data[0]->tag && item == root->children.data[1]->tag);
+    assert(root->children.data[0] == XMLNode_getImmediateElementByName(root, item));
+    assert(NULL == XMLNode_getImmediateElementByName(root, "item"));
+    assert(&root->attributes.attribute[1] == XMLNode_getAttributeByName(root, b));
+
+    /* Attributes added later are interned too */
+    child = XMLNode_createAndAppend(root);
+    assert(NULL != child);
+    assert(TRUE == XMLAttributeList_add(&child->attributes, *XMLNode_getAttribute(root, "a")));
+    assert(root->attributes.attribute[0].key == child->attributes.attribute[0].key);
+
+    doc.free(&doc);
+
+    /* Documents loaded with a shared table use the same strings */
+    shared = XMLNameTable_create();
+    assert(NULL != shared);
+
+    doc = XMLDocument_loadBufferWithNames(TEST_XML_CHUNKED, len, LXML_LOAD_IN_SITU, shared);
+    other = XMLDocument_loadBufferWithNames("<root b=\"3\"><item/></root>", 26, 0, shared);
+    assert(TRUE == doc.success && TRUE == other.success);
+    assert(shared == XMLDocument_getNameTable(&doc) && shared == XMLDocument_getNameTable(&other));
+    assert(5 == shared->size);
+    tlxmlCompareXmlNodes(heap.root, doc.root);
+
+    item = XMLNameTable_get(shared, "item");
+    root = XMLNode_getImmediateElementByName(other.root, XMLNameTable_get(shared, "root"));
+    assert(item == XMLNode_getImmediateElementByName(root, item)->tag);
+    assert(0 == strcmp("3", XMLNode_getAttributeByName(root, XMLNameTable_get(shared, "b"))->value));
+
+    doc.free(&doc);
+    other.free(&other);
+    XMLNameTable_free(shared);
+
+    /* Enough names to grow the table */
+    shared = XMLNameTable_create();
+    assert(NULL != shared);
+
+    for (len = 0; len < 1000; ++len) {
+        char name[16];
+
+        sprintf(name, "n%lu", (unsigned long) len);
+        assert(NULL != XMLNameTable_intern(shared, name, strlen(name)));
+    }
+
+    assert(1000 == shared->size && 0 == strcmp("n999", XMLNameTable_get(shared, "n999")));
+    XMLNameTable_free(shared);
+
+    heap.free(&heap);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferIntern */
+
+static int lxmlTestXMLDocumentGetElementsByTagName() {
+    struct XMLNode *tree = tlxmlCreateTestXMLNodeTree(), **nodes = NULL, *child = NULL;
+    struct XMLDocument doc = { 0 };
+    struct XMLTagIndex *tagIndex = NULL;
+    size_t count = 0;
+
+    assert(NULL != tree);
+    doc.root = tree;
+
+    nodes = XMLDocument_getElementsByTagName(&doc, "nest", &count);
+    assert(3 == count && NULL != nodes);
+    assert(nodes[0]->parent == tree->children.data[2]);
+    assert(nodes[1]->parent == nodes[0] && nodes[2]->parent == nodes[1]);
+
+    /* Repeated queries reuse the index */
+    tagIndex = doc.tagIndex;
+    assert(NULL != XMLDocument_getElementsByTagName(&doc, "child", &count) && 3 == count);
+    assert(NULL == XMLDocument_getElementsByTagName(&doc, "missing", &count) && 0 == count);
+    assert(tagIndex == doc.tagIndex);
+
+    /* Adding a node invalidates it */
+    child = XMLNode_createAndAppend(nodes[2]);
+    assert(NULL != child);
+    child->tag = tlxmlStrdup("child");
+    nodes = XMLDocument_getElementsByTagName(&doc, "child", &count);
+    assert(4 == count && child == nodes[3]);
+
+    /* But adding to another tree does not */
+    tagIndex = doc.tagIndex;
+    child = tlxmlCreateTestXMLNodeTree();
+    assert(NULL != child && NULL != XMLNode_createAndAppend(child->children.data[0]));
+    assert(NULL != XMLDocument_getElementsByTagName(&doc, "child", &count) && 4 == count);
+    assert(tagIndex == doc.tagIndex);
+
+    /* Until that tree is added, after which adding anywhere in it does */
+    assert(TRUE == XMLNode_add(tree, child));
+    assert(NULL != XMLDocument_getElementsByTagName(&doc, "child", &count) && 7 == count);
+    child = XMLNode_createAndAppend(child->children.data[1]->children.data[0]);
+    assert(NULL != child);
+    child->tag = tlxmlStrdup("child");
+    nodes = XMLDocument_getElementsByTagName(&doc, "child", &count);
+    assert(8 == count && child == nodes[5]);
+
+#ifdef LXML_HAVE_THREADS
+    {
+        pthread_t threads[2];
+        int i = 0;
+
+        for (; i < 2; ++i)
+            assert(0 == pthread_create(&threads[i], NULL, tlxmlEditTree, NULL));
+        for (i = 0; i < 2; ++i)
+            assert(0 == pthread_join(threads[i], NULL));
+    }
+#endif
+
+    XMLDocument_clearIndex(&doc);
+    assert(NULL == doc.tagIndex);
+    XMLNode_free(tree);
+    free(tree);
+    tree = NULL;
+
+    doc = XMLDocument_loadBufferWithFlags(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED), LXML_LOAD_IN_SITU);
+    assert(TRUE == doc.success);
+
+    nodes = XMLDocument_getElementsByTagName(&doc, "item", &count);
+    assert(2 == count && nodes[0] == doc.root->children.data[0]->children.data[0]);
+    assert(NULL != XMLDocument_getElementsByTagName(&doc, "root", &count) && 1 == count);
+
+    doc.free(&doc);
+    assert(NULL == doc.tagIndex);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentGetElementsByTagName */
+
+#ifdef LXML_HAVE_THREADS
+/**
+ * @brief Helper function that builds and queries a tree of its own, run on several threads at once
+ */
+static void* tlxmlEditTree(void *arg) {
+    struct XMLDocument doc = { 0 };
+    size_t count = 0, i = 0;
+
+    (void) arg;
+    doc.root = XMLNode_init();
+    assert(NULL != doc.root);
+
+    for (; i < 1000; ++i) {
+        struct XMLNode *child = XMLNode_createAndAppend(doc.root);
+
+        assert(NULL != child);
+        child->tag = tlxmlStrdup("child");
+
+        if (0 == i % 100)
+            assert(NULL != XMLDocument_getElementsByTagName(&doc, "child", &count) && i + 1 == count);
+    }
+
+    XMLDocument_clearIndex(&doc);
+    XMLNode_free(doc.root);
+    free(doc.root);
+
+    return NULL;
+} /* End of tlxmlEditTree */
+#endif
+
+/**
+ * @brief Helper function that creates a feed of 'records' children with comments, CDATA,
+ *        processing instructions and text between them, 'bad' is placed within record 'at'
+ */
+static char* tlxmlCreateFeed(size_t records, size_t at, const char *bad) {
+    char *feed = malloc(records * 160 + 256), *out = feed;
+    size_t i = 0;
+
+    assert(NULL != feed);
+    out += sprintf(out, "%s\n<!-- feed -->\n<feed a=\"1\">lead<!-- c -->ignored", TEST_XML_HEADER);
+
+    for (; i < records; ++i) {
+        out += sprintf(out, "\n<record id=\"%lu\" k='v'><name>n%lu</name><!-- > --><v><![CDATA[<%lu>]]>x</v><?pi ?><e/>%s</record>",
+                       (unsigned long) i, (unsigned long) i, (unsigned long) i, (i == at) ? bad : "");
+
+        if (0 == i % 100)
+            out += sprintf(out, "<!-- %lu --><?pi %lu?>text", (unsigned long) i, (unsigned long) i);
+    }
+
+    sprintf(out, "\ntail</feed>\n<!-- end -->\n");
+
+    return feed;
+} /* End of tlxmlCreateFeed */
+
+static int lxmlTestXMLDocumentLoadBufferParallel() {
+    static const int flags[] = {
+        0, LXML_LOAD_ARENA, LXML_LOAD_IN_SITU, LXML_LOAD_INTERN, LXML_LOAD_INDEX, LXML_LOAD_INTERN | LXML_LOAD_INDEX
+    };
+    char *feed = tlxmlCreateFeed(3000, 0, "");
+    size_t i = 0, j = 0;
+
+    for (; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+        struct XMLDocument serial = XMLDocument_loadBufferWithFlags(feed, strlen(feed), flags[i]);
+        int threads = 2;
+
+        assert(TRUE == serial.success);
+
+        for (; threads <= 8; threads *= 2) {
+            struct XMLDocument doc = XMLDocument_loadBufferParallel(feed, strlen(feed), flags[i], threads);
+            struct XMLNode *feedNode = NULL, *record = NULL;
+
+            assert(TRUE == doc.success);
+            assert(0 == strcmp(serial.version, doc.version) && 0 == strcmp(serial.encoding, doc.encoding));
+            tlxmlCompareXmlNodes(serial.root, doc.root);
+
+            feedNode = doc.root->children.data[0];
+            tlxmlCompareViews("lead", 0, feedNode->inner_text, feedNode->innerTextLen);
+            for (j = 0; j < feedNode->children.size; ++j)
+                assert(feedNode == feedNode->children.data[j]->parent);
+
+            /* Records parsed on other threads use the document's names and arena */
+            record = feedNode->children.data[feedNode->children.size - 1];
+            if (LXML_LOAD_INTERN == (flags[i] & LXML_LOAD_INTERN)) {
+                struct XMLNameTable *names = XMLDocument_getNameTable(&doc);
+
+                assert(XMLNameTable_get(names, "record") == record->tag);
+                assert(XMLNameTable_get(names, "k") == record->attributes.attribute[1].key);
+            }
+
+            if (LXML_LOAD_INDEX == (flags[i] & LXML_LOAD_INDEX)) {
+                assert(NULL != feedNode->children.index);
+                assert(record == XMLNode_getImmediateElementByTagName(feedNode, "record") || 1 != feedNode->children.size);
+            }
+
+            {
+                size_t count = 0;
+                struct XMLNode *name = NULL;
+
+                assert(NULL != XMLDocument_getElementsByTagName(&doc, "name", &count) && 3000 == count);
+
+                name = XMLNode_createAndAppend(record);
+                assert(NULL != name);
+                name->tag = (NULL != doc.arena) ? (char*) "name" : tlxmlStrdup("name");
+                assert(NULL != XMLDocument_getElementsByTagName(&doc, "name", &count) && 3001 == count);
+                assert(name == XMLDocument_getElementsByTagName(&doc, "name", &count)[count - 1]);
+            }
+
+            doc.free(&doc);
+        }
+
+        serial.free(&serial);
+    }
+
+    /* Leading text makes a chunk of its own, which has no children to merge */
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+        const char *leading = "<r>leading text long enough to be a chunk of its own<a/><b/><c/></r>";
+        struct XMLDocument serial = XMLDocument_loadBufferWithFlags(leading, strlen(leading), flags[i]),
+                           doc = XMLDocument_loadBufferParallel(leading, strlen(leading), flags[i], 4);
+
+        assert(TRUE == serial.success && TRUE == doc.success);
+        tlxmlCompareXmlNodes(serial.root, doc.root);
+
+        doc.free(&doc);
+        serial.free(&serial);
+    }
+
+    free(feed);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferParallel */
+
+static int lxmlTestXMLDocumentLoadBufferParallelMalformed() {
+    static const char * const bad[] = {
+        "<a></b>",
+        "<a b=></a>",
+        "<!-- never closed",
+        "</record><record>",
+        "<?xml version=\"2.0\" ?>",
+        "<!DOCTYPE x>"
+    };
+    size_t i = 0;
+
+    for (; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        char *feed = tlxmlCreateFeed(1000, 700, bad[i]);
+        struct XMLDocument serial = XMLDocument_loadBuffer(feed, strlen(feed)),
+                           doc = XMLDocument_loadBufferParallel(feed, strlen(feed), 0, 4);
+
+        /* The last ones are well formed, though a declaration within the root stops the split */
+        assert(serial.success == doc.success && (i >= 3) == doc.success);
+        tlxmlCompareXmlNodes(serial.root, doc.root);
+
+        if (TRUE == doc.success)
+            assert(0 == strcmp(serial.version, doc.version));
+
+        serial.free(&serial);
+        doc.free(&doc);
+        free(feed);
+    }
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentLoadBufferParallelMalformed */
+
+static int lxmlTestXMLDocumentSnapshot() {
+    static const int flags[] = { 0, LXML_LOAD_ARENA, LXML_LOAD_IN_SITU, LXML_LOAD_INTERN | LXML_LOAD_INDEX };
+    const char *path = "lxml_test_snapshot.bin";
+    struct XMLDocument doc = XMLDocument_loadBuffer(TEST_XML_QUERY, strlen(TEST_XML_QUERY)), copy = { 0 };
+    struct XMLSnapshot *snapshot = NULL;
+    const char *key = NULL, *value = NULL;
+    size_t size = 0, len = 0, keyLen = 0, valueLen = 0, root = 0, field = 0, i = 0;
+    char *buf = NULL;
+
+    assert(TRUE == doc.success);
+    assert(TRUE == XMLDocument_saveBinaryToBuffer(&doc, &buf, &size));
+    assert(0 == size % 4 && 0 == memcmp(buf, LXML_SNAPSHOT_MAGIC, 8));
+
+    /* Read in place */
+    snapshot = XMLSnapshot_openBuffer(buf, size);
+    assert(NULL != snapshot && 0 == strcmp("1.0", snapshot->version) && 0 == strcmp("UTF-8", snapshot->encoding));
+    assert(8 == snapshot->nodes && 1 == XMLSnapshot_childCount(snapshot, snapshot->root));
+    assert(NULL == XMLSnapshot_getTag(snapshot, snapshot->root, NULL));
+
+    root = XMLSnapshot_getImmediateElementByTagName(snapshot, snapshot->root, "struct");
+    assert(0 != root && root == XMLSnapshot_getChild(snapshot, snapshot->root, 0));
+    assert(snapshot->root == XMLSnapshot_getParent(snapshot, root));
+    assert(0 == strcmp("Person", XMLSnapshot_getAttributeValue(snapshot, root, "name", &len)) && 6 == len);
+    assert(NULL == XMLSnapshot_getAttributeValue(snapshot, root, "type", NULL));
+    assert(5 == XMLSnapshot_childCount(snapshot, root) && 0 == XMLSnapshot_getChild(snapshot, root, 5));
+
+    field = XMLSnapshot_getChild(snapshot, root, 1);
+    assert(0 == strcmp("field", XMLSnapshot_getTag(snapshot, field, &len)) && 5 == len);
+    assert(2 == XMLSnapshot_attributeCount(snapshot, field));
+    assert(TRUE == XMLSnapshot_getAttribute(snapshot, field, 1, &key, &keyLen, &value, &valueLen));
+    assert(0 == strcmp("type", key) && 4 == keyLen && 0 == strcmp("int", value) && 3 == valueLen);
+    assert(FALSE == XMLSnapshot_getAttribute(snapshot, field, 2, &key, &keyLen, &value, &valueLen));
+
+    /* Names are stored once */
+    assert(XMLSnapshot_getTag(snapshot, field, NULL) == XMLSnapshot_getTag(snapshot, XMLSnapshot_getChild(snapshot, root, 0), NULL));
+
+    field = XMLSnapshot_getChild(snapshot, XMLSnapshot_getChild(snapshot, root, 4), 0);
+    assert(0 == strcmp("Inner", XMLSnapshot_getInnerText(snapshot, field, &len)) && 5 == len);
+    assert(0 == XMLSnapshot_getChild(snapshot, field, 0) && 0 == XMLSnapshot_getParent(snapshot, 3));
+
+    /* And rebuilt */
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+        copy = XMLSnapshot_toDocument(snapshot, flags[i]);
+        assert(TRUE == copy.success && 0 == strcmp("UTF-8", copy.encoding));
+        tlxmlCompareXmlNodes(doc.root, copy.root);
+        tlxmlCompareWrittenDocuments(&doc, &copy);
+
+        if (LXML_LOAD_IN_SITU == flags[i])
+            assert((const char*) snapshot->data < copy.root->children.data[0]->tag);
+
+        copy.free(&copy);
+    }
+
+    XMLSnapshot_free(snapshot);
+
+    /* Truncated, from another version and with a node as its own child */
+    assert(NULL == XMLSnapshot_openBuffer(buf, size - 4));
+    buf[8] = 2;
+    assert(NULL == XMLSnapshot_openBuffer(buf, size));
+    buf[8] = 1;
+
+    snapshot = XMLSnapshot_openBuffer(buf, size);
+    assert(NULL != snapshot);
+    root = XMLSnapshot_getChild(snapshot, snapshot->root, 0);
+    memcpy(buf + root + LXML_SNAPSHOT_NODE_SIZE + 8 * 1 + 4 * 2, buf + snapshot->root + LXML_SNAPSHOT_NODE_SIZE, 4);
+    assert(0 == XMLSnapshot_getChild(snapshot, root, 2));
+
+    copy = XMLSnapshot_toDocument(snapshot, 0);
+    assert(FALSE == copy.success);
+    copy.free(&copy);
+    XMLSnapshot_free(snapshot);
+
+    free(buf);
+    buf = NULL;
+
+    /* Through a file */
+    assert(TRUE == XMLDocument_saveBinary(&doc, path));
+    snapshot = XMLDocument_openBinary(path);
+    assert(NULL != snapshot);
+
+    copy = XMLSnapshot_toDocument(snapshot, LXML_LOAD_IN_SITU);
+    assert(TRUE == copy.success);
+    tlxmlCompareXmlNodes(doc.root, copy.root);
+    copy.free(&copy);
+
+    XMLSnapshot_free(snapshot);
+    remove(path);
+    assert(NULL == XMLDocument_openBinary(path));
+
+    doc.free(&doc);
+
+    /* An empty version stays apart from a missing encoding */
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+        doc = XMLDocument_loadBufferWithFlags("<?xml version=\"\"?><a/>", 22, flags[i]);
+        assert(TRUE == doc.success && 0 == strcmp("", doc.version) && NULL == doc.encoding);
+        assert(TRUE == XMLDocument_saveBinaryToBuffer(&doc, &buf, &size));
+
+        snapshot = XMLSnapshot_openBuffer(buf, size);
+        assert(NULL != snapshot && 0 == strcmp("", snapshot->version) && NULL == snapshot->encoding);
+
+        copy = XMLSnapshot_toDocument(snapshot, flags[i]);
+        assert(TRUE == copy.success && 0 == strcmp("", copy.version) && NULL == copy.encoding);
+        tlxmlCompareWrittenDocuments(&doc, &copy);
+
+        copy.free(&copy);
+        XMLSnapshot_free(snapshot);
+        free(buf);
+        doc.free(&doc);
+    }
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentSnapshot */
+
+static int lxmlTestXMLDocumentLoadBuffer() {
+    int success = lxmlTestXMLDocumentLoadBufferUnterminated();
+
+    success &= lxmlTestXMLDocumentLoadBufferMalformed();
+    success &= lxmlTestXMLDocumentLoadBufferCData();
+    success &= lxmlTestXMLDocumentLoadBufferReferences();
+    success &= lxmlTestXMLDocumentLoadPath();
+    success &= lxmlTestXMLDocumentLoadMany();
+    success &= lxmlTestXMLDocumentLoadBufferArena();
+    success &= lxmlTestXMLDocumentLoadBufferInSitu();
+    success &= lxmlTestXMLDocumentLoadBufferLazy();
+    success &= lxmlTestXMLDocumentLoadBufferIntern();
+    success &= lxmlTestXMLDocumentGetElementsByTagName();
+    success &= lxmlTestXMLDocumentLoadBufferParallel();
+    success &= lxmlTestXMLDocumentLoadBufferParallelMalformed();
+    success &= lxmlTestXMLDocumentSnapshot();
+#ifdef LXML_HAVE_POSIX
+    success &= lxmlTestXMLDocumentLoadFdPipe();
+#endif
+
+    printf("lxmlTestXMLDocumentLoadBuffer: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestXMLDocumentLoadBuffer */
+
+/**
+ * @brief Helper function that asserts two strings stored with optional lengths are equal
+ *        **Note:** See 'lxmlViewLen'
+ */
+static int tlxmlCompareViews(const char *a, size_t aLen, const char *b, size_t bLen) {
+    aLen = lxmlViewLen(a, aLen);
+    bLen = lxmlViewLen(b, bLen);
+
+    assert((NULL == a) == (NULL == b));
+    assert(aLen == bLen);
+    assert(0 == aLen || 0 == memcmp(a, b, aLen));
+
+    return TRUE;
+} /* End of tlxmlCompareViews */
+
+/**
+ * @brief Helper function that clones 'str' onto the heap, 'NULL' when it is empty
+ */
+static char* tlxmlStrdup(const char *str) {
+    return lxmlStrndup(str, strlen(str));
+} /* End of tlxmlStrdup */
+
+/**
+ * @brief Helper function that asserts two 'XMLNode' trees hold the same tags, text and attributes
+ *
+ * @param a - The first tree
+ * @param b - The second tree
+ * @return success - A flag indicating the status of the subroutine
+ */
+static int tlxmlCompareXmlNodes(struct XMLNode *a, struct XMLNode *b) {
+    size_t i = 0;
+
+    assert(NULL != a && NULL != b);
+    tlxmlCompareViews(a->tag, a->tagLen, b->tag, b->tagLen);
+    tlxmlCompareViews(a->inner_text, a->innerTextLen, b->inner_text, b->innerTextLen);
+
+    assert(a->attributes.size == b->attributes.size);
+    for (i = 0; i < a->attributes.size; ++i) {
+        struct XMLAttribute *attrA = &a->attributes.attribute[i], *attrB = &b->attributes.attribute[i];
+
+        tlxmlCompareViews(attrA->key, attrA->keyLen, attrB->key, attrB->keyLen);
+        tlxmlCompareViews(attrA->value, attrA->valueLen, attrB->value, attrB->valueLen);
+    }
+
+    assert(a->children.size == b->children.size);
+    for (i = 0; i < a->children.size; ++i)
+        tlxmlCompareXmlNodes(a->children.data[i], b->children.data[i]);
+
+    return TRUE;
+} /* End of tlxmlCompareXmlNodes */
+
+static int lxmlTestXMLParserChunked() {
+    const char *xml = TEST_XML_CHUNKED;
+    size_t len = strlen(xml), chunkSize = 1;
+    struct XMLDocument expected = XMLDocument_loadBuffer(xml, len);
+    struct XMLNode *root = NULL;
+
+    assert(TRUE == expected.success);
+    assert(0 == strcmp("1.0", expected.version));
+
+    root = XMLNode_getImmediateElementByTagName(expected.root, "root");
+    assert(NULL != root && 3 == root->children.size);
+    assert(0 == strcmp("x>y", root->attributes.attribute[0].value));
+    assert(0 == strcmp("Some text which gets split", root->children.data[0]->inner_text));
+
+    for (; chunkSize <= 2 * len; ++chunkSize) {
+        /* The second pass repeats every chunk size with an arena */
+        struct XMLParser *parser = XMLParser_createWithFlags((chunkSize > len) ? LXML_LOAD_ARENA : 0);
+        size_t step = (chunkSize > len) ? chunkSize - len : chunkSize;
+        struct XMLDocument doc = { 0 };
+        size_t offset = 0;
+
+        assert(NULL != parser);
+
+        for (; offset < len; offset += step)
+            assert(TRUE == XMLParser_feed(parser, xml + offset, (len - offset < step) ? len - offset : step));
+
+        doc = XMLParser_finish(parser);
+        parser = NULL;
+
+        assert(TRUE == doc.success);
+        assert(0 == strcmp(expected.version, doc.version));
+        assert(0 == strcmp(expected.encoding, doc.encoding));
+        tlxmlCompareXmlNodes(expected.root, doc.root);
+
+        doc.free(&doc);
+    }
+
+    expected.free(&expected);
+
+    return TRUE;
+} /* End of lxmlTestXMLParserChunked */
+
+static int lxmlTestXMLParserMalformed() {
+    struct XMLParser *parser = XMLParser_create();
+    struct XMLDocument doc = { 0 };
+
+    assert(NULL != parser);
+    assert(TRUE == XMLParser_feed(parser, "<a><b>", 6));
+    assert(FALSE == XMLParser_feed(parser, "</a>", 4));
+    assert(FALSE == XMLParser_feed(parser, "</b>", 4));
+
+    doc = XMLParser_finish(parser);
+    assert(FALSE == doc.success);
+    doc.free(&doc);
+
+    /* Truncated in the middle of a comment and a tag */
+    parser = XMLParser_create();
+    assert(TRUE == XMLParser_feed(parser, "<a><!-- ", 8));
+    doc = XMLParser_finish(parser);
+    assert(FALSE == doc.success);
+    doc.free(&doc);
+
+    parser = XMLParser_create();
+    assert(TRUE == XMLParser_feed(parser, "<a></a><b c=\"", 13));
+    doc = XMLParser_finish(parser);
+    assert(FALSE == doc.success);
+    doc.free(&doc);
+
+    /* Abandoned part way through */
+    parser = XMLParser_create();
+    assert(TRUE == XMLParser_feed(parser, "<a><b>text", 10));
+    XMLParser_free(parser);
+    parser = NULL;
+
+    return TRUE;
+} /* End of lxmlTestXMLParserMalformed */
+
+#ifdef LXML_HAVE_POSIX
+static int lxmlTestXMLParserPipe() {
+    struct XMLDocument doc = { 0 };
+    int fds[2] = { -1, -1 };
+    FILE *fp = NULL;
+
+    assert(0 == pipe(fds));
+    assert(TEST_XML_VALID_1_SIZE == write(fds[1], TEST_XML_VALID_1, TEST_XML_VALID_1_SIZE));
+    close(fds[1]);
+
+    fp = fdopen(fds[0], "r");
+    assert(NULL != fp);
+
+    doc = XMLDocument_load(fp);
+    tlxmlCheckTestXmlValid1(&doc);
+    doc.free(&doc);
+
+    fclose(fp);
+    fp = NULL;
+
+    return TRUE;
+} /* End of lxmlTestXMLParserPipe */
+#endif /* LXML_HAVE_POSIX */
+
+static int lxmlTestXMLParser() {
+    int success = lxmlTestXMLParserChunked();
+
+    success &= lxmlTestXMLParserMalformed();
+#ifdef LXML_HAVE_POSIX
+    success &= lxmlTestXMLParserPipe();
+#endif
+
+    printf("lxmlTestXMLParser: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestXMLParser */
+
+#define TEST_XML_CHUNKED_EVENTS "D(1.0,UTF-8)T\nC a comment -- with > inside S(root)A(a=x>y)A(b=2)S(item)T" \
+"Some text which gets splitE(item)S(item)T<x> & ]]E(item)CS(empty)E(empty)E(root)T\n"
+
+/**
+ * @brief Records the events of 'XMLDocument_parseEvents' into a string
+ *        Consecutive text or comment events are merged since they may be split across chunks
+ */
+struct tlxmlEventLog {
+    char log[512];
+    size_t size;
+    char last;
+    int starts;
+    const char *stopAt;
+};
+
+static void tlxmlLogAppend(struct tlxmlEventLog *log, char event, const char *str, size_t len, int merge) {
+    if (FALSE == merge || event != log->last) {
+        assert(log->size + 1 < sizeof(log->log));
+        log->log[log->size++] = event;
+    }
+
+    assert(log->size + len < sizeof(log->log));
+    memcpy(log->log + log->size, str, len);
+    log->size += len;
+    log->log[log->size] = '\0';
+    log->last = event;
+}
+
+static int tlxmlOnDeclaration(void *ctx, const char *version, size_t versionLen, const char *encoding, size_t encodingLen) {
+    tlxmlLogAppend(ctx, 'D', "(", 1, FALSE);
+    tlxmlLogAppend(ctx, 'D', version, versionLen, TRUE);
+    tlxmlLogAppend(ctx, 'D', ",", 1, TRUE);
+    tlxmlLogAppend(ctx, 'D', encoding, encodingLen, TRUE);
+    tlxmlLogAppend(ctx, 'D', ")", 1, TRUE);
+    return TRUE;
+}
+
+static int tlxmlOnStartElement(void *ctx, const char *tag, size_t tagLen) {
+    struct tlxmlEventLog *log = ctx;
+
+    tlxmlLogAppend(log, 'S', "(", 1, FALSE);
+    tlxmlLogAppend(log, 'S', tag, tagLen, TRUE);
+    tlxmlLogAppend(log, 'S', ")", 1, TRUE);
+    ++log->starts;
+
+    return (NULL == log->stopAt || 0 != strncmp(log->stopAt, tag, tagLen)) ? TRUE : FALSE;
+}
+
+static int tlxmlOnAttribute(void *ctx, const char *key, size_t keyLen, const char *value, size_t valueLen) {
+    tlxmlLogAppend(ctx, 'A', "(", 1, FALSE);
+    tlxmlLogAppend(ctx, 'A', key, keyLen, TRUE);
+    tlxmlLogAppend(ctx, 'A', "=", 1, TRUE);
+    tlxmlLogAppend(ctx, 'A', value, valueLen, TRUE);
+    tlxmlLogAppend(ctx, 'A', ")", 1, TRUE);
+    return TRUE;
+}
+
+static int tlxmlOnText(void *ctx, const char *text, size_t len) {
+    tlxmlLogAppend(ctx, 'T', text, len, TRUE);
+    return TRUE;
+}
+
+static int tlxmlOnEndElement(void *ctx, const char *tag, size_t tagLen) {
+    tlxmlLogAppend(ctx, 'E', "(", 1, FALSE);
+    tlxmlLogAppend(ctx, 'E', tag, tagLen, TRUE);
+    tlxmlLogAppend(ctx, 'E', ")", 1, TRUE);
+    return TRUE;
+}
+
+static int tlxmlOnComment(void *ctx, const char *comment, size_t len) {
+    tlxmlLogAppend(ctx, 'C', comment, len, TRUE);
+    return TRUE;
+}
+
+static const struct XMLEventHandler tlxmlLogHandler = {
+    tlxmlOnDeclaration, tlxmlOnStartElement, tlxmlOnAttribute, tlxmlOnText, tlxmlOnEndElement, tlxmlOnComment
+};
+
+static int lxmlTestXMLDocumentParseEventsLog() {
+    struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+    const struct XMLEventHandler empty = { 0, 0, 0, 0, 0, 0 };
+
+    assert(TRUE == XMLDocument_parseEvents(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED), &tlxmlLogHandler, &log));
+    assert(0 == strcmp(TEST_XML_CHUNKED_EVENTS, log.log));
+
+    /* Every callback is optional */
+    assert(TRUE == XMLDocument_parseEvents(TEST_XML_VALID_1, TEST_XML_VALID_1_SIZE, &empty, NULL));
+    assert(FALSE == XMLDocument_parseEvents("<a><b></a></b>", 14, &empty, NULL));
+    assert(FALSE == XMLDocument_parseEvents("<a b=\"c\"", 9, &empty, NULL));
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentParseEventsLog */
+
+static int lxmlTestXMLDocumentParseEventsChunked() {
+    const char *xml = TEST_XML_CHUNKED;
+    size_t len = strlen(xml), chunkSize = 1;
+
+    for (; chunkSize <= len; ++chunkSize) {
+        struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+        struct XMLParser *parser = XMLParser_createWithHandler(&tlxmlLogHandler, &log);
+        struct XMLDocument doc = { 0 };
+        size_t offset = 0;
+
+        assert(NULL != parser);
+
+        for (; offset < len; offset += chunkSize)
+            assert(TRUE == XMLParser_feed(parser, xml + offset, (len - offset < chunkSize) ? len - offset : chunkSize));
+
+        doc = XMLParser_finish(parser);
+        parser = NULL;
+
+        assert(TRUE == doc.success);
+        assert(NULL == doc.root);
+        assert(0 == strcmp(TEST_XML_CHUNKED_EVENTS, log.log));
+    }
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentParseEventsChunked */
+
+static int lxmlTestXMLDocumentParseEventsStop() {
+    struct tlxmlEventLog log = { { 0 }, 0, 0, 0, "item" };
+
+    assert(FALSE == XMLDocument_parseEvents(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED), &tlxmlLogHandler, &log));
+    assert(2 == log.starts);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentParseEventsStop */
+
+static int lxmlTestXMLDocumentParseEvents() {
+    int success = lxmlTestXMLDocumentParseEventsLog();
+
+    success &= lxmlTestXMLDocumentParseEventsChunked();
+    success &= lxmlTestXMLDocumentParseEventsStop();
+
+    printf("lxmlTestXMLDocumentParseEvents: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestXMLDocumentParseEvents */
+
+/**
+ * @brief Helper function that records the events of 'reader' like 'tlxmlLogHandler'
+ */
+static enum XMLReaderEvent tlxmlLogReader(struct XMLReader *reader, struct tlxmlEventLog *log) {
+    enum XMLReaderEvent event = LXML_READER_DONE;
+    const char *key = NULL, *value = NULL, *str = NULL;
+    size_t keyLen = 0, valueLen = 0, len = 0;
+
+    while (LXML_READER_DONE != (event = XMLReader_next(reader)) && LXML_READER_ERROR != event) {
+        if (LXML_READER_DECLARATION == event) {
+            str = XMLReader_getAttributeValue(reader, "version", &len);
+            value = XMLReader_getAttributeValue(reader, "encoding", &valueLen);
+            tlxmlOnDeclaration(log, str, len, value, valueLen);
+        } else if (LXML_READER_START == event) {
+            str = XMLReader_getName(reader, &len);
+            tlxmlOnStartElement(log, str, len);
+
+            while (1 == XMLReader_nextAttribute(reader, &key, &keyLen, &value, &valueLen))
+                tlxmlOnAttribute(log, key, keyLen, value, valueLen);
+        } else if (LXML_READER_END == event) {
+            str = XMLReader_getName(reader, &len);
+            tlxmlOnEndElement(log, str, len);
+        } else if (LXML_READER_TEXT == event) {
+            str = XMLReader_getText(reader, &len);
+            tlxmlOnText(log, str, len);
+        } else {
+            str = XMLReader_getText(reader, &len);
+            tlxmlOnComment(log, str, len);
+        }
+    }
+
+    return event;
+} /* End of tlxmlLogReader */
+
+/**
+ * @brief Helper function that writes a feed of 'records' records followed by a large text
+ *        and a large comment to a temporary file
+ */
+static FILE* tlxmlCreateReaderFeed(size_t records) {
+    FILE *fp = tmpfile();
+    size_t i = 0;
+
+    assert(NULL != fp);
+    fprintf(fp, "<?xml version=\"1.0\"?>\n<feed>");
+
+    for (; i < records; ++i)
+        fprintf(fp, "<record id=\"%lu\"><name>n%lu</name><!-- note --><![CDATA[x<y]]><empty /></record>\n", (unsigned long) i, (unsigned long) i);
+
+    fputs("<blob>", fp);
+    for (i = 0; i < 3 * LXML_READER_BUFFER_SIZE; ++i)
+        fputc('a' + (int) (i % 26), fp);
+    fputs("</blob><!--", fp);
+    for (i = 0; i < 2 * LXML_READER_BUFFER_SIZE; ++i)
+        fputc('-', fp);
+    fputs("-></feed>\n", fp);
+    rewind(fp);
+
+    return fp;
+} /* End of tlxmlCreateReaderFeed */
+
+/**
+ * @brief Helper function that tallies what 'reader' returns, skipping the odd records when 'skip' is set
+ */
+static int tlxmlTallyReader(struct XMLReader *reader, size_t *tally, int skip) {
+    enum XMLReaderEvent event = LXML_READER_DONE;
+    const char *str = NULL;
+    size_t len = 0;
+
+    memset(tally, '\0', sizeof(size_t) * 5);
+
+    while (LXML_READER_DONE != (event = XMLReader_next(reader))) {
+        assert(LXML_READER_ERROR != event);
+
+        if (LXML_READER_START == event) {
+            ++tally[0];
+            str = XMLReader_getAttributeValue(reader, "id", &len);
+
+            if (NULL != str && TRUE == skip && 1 == (str[len - 1] - '0') % 2) {
+                assert(1 == XMLReader_depth(reader));
+                assert(TRUE == XMLReader_skipSubtree(reader));
+                assert(0 == memcmp("record", XMLReader_getName(reader, &len), 6) && 6 == len);
+                ++tally[1];
+            }
+        } else if (LXML_READER_END == event)
+            ++tally[1];
+        else if (LXML_READER_TEXT == event) {
+            XMLReader_getText(reader, &len);
+            tally[2] += len;
+        } else if (LXML_READER_COMMENT == event) {
+            XMLReader_getText(reader, &len);
+            tally[3] += len;
+        }
+
+        tally[4] = (tally[4] > XMLReader_depth(reader)) ? tally[4] : XMLReader_depth(reader);
+    }
+
+    return TRUE;
+} /* End of tlxmlTallyReader */
+
+static int lxmlTestXMLReaderBuffer() {
+    struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+    struct XMLReader *reader = XMLReader_openBuffer(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED));
+    size_t len = 0;
+
+    /* The same parts as the callbacks get */
+    assert(NULL != reader);
+    assert(LXML_READER_DONE == tlxmlLogReader(reader, &log));
+    assert(0 == strcmp(TEST_XML_CHUNKED_EVENTS, log.log));
+    assert(LXML_READER_DONE == XMLReader_next(reader));
+    XMLReader_free(reader);
+
+    reader = XMLReader_openBuffer(TEST_XML_VALID_1, TEST_XML_VALID_1_SIZE);
+    assert(NULL != reader);
+    assert(LXML_READER_DECLARATION == XMLReader_next(reader));
+    assert(LXML_READER_START == XMLReader_next(reader) && 0 == XMLReader_depth(reader));
+    assert(NULL == XMLReader_getText(reader, &len) && 0 == len);
+    assert(0 == memcmp("Person", XMLReader_getAttributeValue(reader, "name", &len), 6) && 6 == len);
+    assert(NULL == XMLReader_getAttributeValue(reader, "missing", &len) && 0 == len);
+
+    /* Self-closing elements start and end */
+    assert(LXML_READER_TEXT == XMLReader_next(reader) && 1 == XMLReader_depth(reader));
+    assert(LXML_READER_START == XMLReader_next(reader) && 1 == XMLReader_depth(reader));
+    assert(LXML_READER_END == XMLReader_next(reader) && 1 == XMLReader_depth(reader));
+    assert(0 == memcmp("field", XMLReader_getName(reader, &len), 5) && 5 == len);
+    XMLReader_free(reader);
+
+    return TRUE;
+} /* End of lxmlTestXMLReaderBuffer */
+
+static int lxmlTestXMLReaderStream() {
+    struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+    struct XMLReader *reader = NULL;
+    size_t len = strlen(TEST_XML_CHUNKED), tally[5], expected[5];
+    char *buf = NULL;
+    FILE *fp = tmpfile();
+
+    assert(NULL != fp);
+    assert(len == fwrite(TEST_XML_CHUNKED, 1, len, fp));
+    rewind(fp);
+
+    reader = XMLReader_open(fp);
+    assert(NULL != reader);
+    assert(LXML_READER_DONE == tlxmlLogReader(reader, &log));
+    assert(0 == strcmp(TEST_XML_CHUNKED_EVENTS, log.log));
+    XMLReader_free(reader);
+    fclose(fp);
+
+    /* Many windows long, with text and a comment longer than a window */
+    fp = tlxmlCreateReaderFeed(5000);
+    buf = lxmlReadXmlContentsIntoMemory(fp);
+    assert(NULL != buf);
+    rewind(fp);
+
+    reader = XMLReader_openBuffer(buf, strlen(buf));
+    assert(NULL != reader && TRUE == tlxmlTallyReader(reader, expected, FALSE));
+    XMLReader_free(reader);
+    assert(15002 == expected[0] && 15002 == expected[1] && 3 == expected[4]);
+    assert(3 * LXML_READER_BUFFER_SIZE < expected[2] && 2 * LXML_READER_BUFFER_SIZE < expected[3]);
+
+    /* The window does not grow with the document */
+    reader = XMLReader_open(fp);
+    assert(NULL != reader && TRUE == tlxmlTallyReader(reader, tally, FALSE));
+    assert(0 == memcmp(expected, tally, sizeof(tally)));
+    assert(LXML_READER_BUFFER_SIZE == reader->capacity);
+    XMLReader_free(reader);
+
+    free(buf);
+    fclose(fp);
+
+    return TRUE;
+} /* End of lxmlTestXMLReaderStream */
+
+static int lxmlTestXMLReaderSkipSubtree() {
+    struct XMLReader *reader = XMLReader_openBuffer(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED));
+    size_t len = 0, tally[5];
+    FILE *fp = NULL;
+
+    /* Markup inside comments, CDATA and attributes is not counted */
+    assert(NULL != reader);
+    assert(FALSE == XMLReader_skipSubtree(reader));
+    while (LXML_READER_START != XMLReader_next(reader))
+        ;
+    assert(TRUE == XMLReader_skipSubtree(reader));
+    assert(0 == memcmp("root", XMLReader_getName(reader, &len), 4) && 4 == len && 0 == XMLReader_depth(reader));
+    assert(LXML_READER_TEXT == XMLReader_next(reader));
+    assert(LXML_READER_DONE == XMLReader_next(reader));
+    XMLReader_free(reader);
+
+    reader = XMLReader_openBuffer("<a><b/><c>x</c></a>", 19);
+    assert(LXML_READER_START == XMLReader_next(reader) && LXML_READER_START == XMLReader_next(reader));
+    assert(TRUE == XMLReader_skipSubtree(reader));
+    assert(LXML_READER_START == XMLReader_next(reader) && 0 == memcmp("c", XMLReader_getName(reader, &len), 1));
+    XMLReader_free(reader);
+
+    /* Half of the records are skipped, from a stream */
+    fp = tlxmlCreateReaderFeed(5000);
+    reader = XMLReader_open(fp);
+    assert(NULL != reader && TRUE == tlxmlTallyReader(reader, tally, TRUE));
+    assert(2500 * 3 + 2500 + 2 == tally[0] && tally[0] == tally[1]);
+    assert(LXML_READER_BUFFER_SIZE == reader->capacity);
+    XMLReader_free(reader);
+    fclose(fp);
+
+    return TRUE;
+} /* End of lxmlTestXMLReaderSkipSubtree */
+
+static int lxmlTestXMLReaderMalformed() {
+    const char *docs[] = { "<a><b></a></b>", "<a>", "<a b=\"c></a>", "<a b></a>", "<a><!-- x", "</a>" };
+    size_t i = 0;
+
+    for (; i < sizeof(docs) / sizeof(docs[0]); ++i) {
+        struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+        struct XMLReader *reader = XMLReader_openBuffer(docs[i], strlen(docs[i]));
+
+        assert(NULL != reader);
+        assert(LXML_READER_ERROR == tlxmlLogReader(reader, &log));
+        assert(LXML_READER_ERROR == XMLReader_next(reader));
+        XMLReader_free(reader);
+    }
+
+    /* The document ends inside the skipped element */
+    {
+        struct XMLReader *reader = XMLReader_openBuffer("<a><b><c></c>", 13);
+
+        assert(LXML_READER_START == XMLReader_next(reader) && LXML_READER_START == XMLReader_next(reader));
+        assert(FALSE == XMLReader_skipSubtree(reader));
+        assert(LXML_READER_ERROR == XMLReader_next(reader));
+        XMLReader_free(reader);
+    }
+
+    return TRUE;
+} /* End of lxmlTestXMLReaderMalformed */
+
+/**
+ * @brief Helper function that checks each record of 'tlxmlCreateReaderFeed' is built in full
+ */
+static int tlxmlOnRecord(void *ctx, struct XMLNode *node) {
+    size_t *records = ctx;
+    struct XMLNode *name = XMLNode_getImmediateElementByTagName(node, "name");
+    char expected[32];
+
+    sprintf(expected, "%lu", (unsigned long) *records);
+    assert(0 == strcmp("record", node->tag));
+    assert(0 == strcmp(expected, XMLNode_getAttribute(node, "id")->value));
+    assert(2 == XMLNode_childCount(node) && 0 == strcmp("x<y", node->inner_text));
+    assert(NULL != name && 'n' == name->inner_text[0] && 0 == strcmp(expected, name->inner_text + 1));
+    assert(0 == strcmp("empty", XMLNode_getChild(node, 1)->tag));
+
+    return (10 != ++*records) ? TRUE : FALSE;
+} /* End of tlxmlOnRecord */
+
+/**
+ * @brief Helper function that records the tag and children of each element it is given
+ */
+static int tlxmlOnElement(void *ctx, struct XMLNode *node) {
+    struct tlxmlEventLog *log = ctx;
+    char count = (char) ('0' + XMLNode_childCount(node));
+
+    tlxmlLogAppend(log, 'S', node->tag, node->tagLen, FALSE);
+    tlxmlLogAppend(log, 'N', &count, 1, FALSE);
+
+    if (NULL != node->inner_text)
+        tlxmlLogAppend(log, 'T', node->inner_text, node->innerTextLen, FALSE);
+
+    return TRUE;
+} /* End of tlxmlOnElement */
+
+static int lxmlTestXMLDocumentStreamElements() {
+    struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+    const char *doc = "<r><a>skipped</a><b k=\"v\"><b>nested</b><c/></b><x><b/></x><!-- <b> --><b>text<!-- x -->more</b></r>";
+    size_t records = 0, len = strlen(doc);
+    FILE *fp = tmpfile();
+
+    /* Nested elements of the same name belong to the outer one */
+    assert(NULL != fp && len == fwrite(doc, 1, len, fp));
+    rewind(fp);
+    assert(TRUE == XMLDocument_streamElements(fp, "b", tlxmlOnElement, &log));
+    assert(0 == strcmp("SbN2SbN0SbN0Ttext", log.log));
+    fclose(fp);
+
+    /* Stopped by the callback part way through a feed larger than the reader's window */
+    fp = tlxmlCreateReaderFeed(5000);
+    assert(FALSE == XMLDocument_streamElements(fp, "record", tlxmlOnRecord, &records));
+    assert(10 == records);
+    fclose(fp);
+
+    /* Elements before an error are still passed on */
+    fp = tmpfile();
+    doc = "<r><b>1</b><b>2</b><b>3</c></r>";
+    len = strlen(doc);
+    assert(NULL != fp && len == fwrite(doc, 1, len, fp));
+    rewind(fp);
+    memset(&log, '\0', sizeof(log));
+    assert(FALSE == XMLDocument_streamElements(fp, "b", tlxmlOnElement, &log));
+    assert(0 == strcmp("SbN0T1SbN0T2", log.log));
+    assert(FALSE == XMLDocument_streamElements(NULL, "b", tlxmlOnElement, &log));
+    fclose(fp);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentStreamElements */
+
+static int lxmlTestXMLReaderReferences() {
+    struct XMLDocument doc = XMLDocument_loadBuffer(TEST_XML_REFERENCES, strlen(TEST_XML_REFERENCES));
+    struct tlxmlEventLog expected = { { 0 }, 0, 0, 0, NULL };
+    struct XMLReader *reader = NULL;
+    struct XMLNode *a = NULL;
+    size_t len = strlen(TEST_XML_REFERENCES), i = 0;
+    FILE *fp = tmpfile();
+
+    /* The log the callbacks and the reader give, built from what the document holds */
+    assert(TRUE == doc.success && NULL != fp);
+    tlxmlCheckReferences(doc.root);
+    a = doc.root->children.data[0];
+
+    tlxmlOnDeclaration(&expected, "1.0", 3, "UTF-8", 5);
+    tlxmlOnStartElement(&expected, "a", 1);
+    for (; i < a->attributes.size; ++i)
+        tlxmlOnAttribute(&expected, a->attributes.attribute[i].key, strlen(a->attributes.attribute[i].key),
+                         a->attributes.attribute[i].value, a->attributes.attribute[i].valueLen);
+    tlxmlOnText(&expected, a->inner_text, a->innerTextLen);
+    tlxmlLogAppend(&expected, 'S', "(plain)Tplain", 13, FALSE);
+    tlxmlLogAppend(&expected, 'E', "(plain)Tafter &E(a)", 19, FALSE);
+
+    /* Whole, then one byte at a time so references are split between chunks */
+    {
+        struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+        struct XMLParser *parser = XMLParser_createWithHandler(&tlxmlLogHandler, &log);
+
+        assert(TRUE == XMLDocument_parseEvents(TEST_XML_REFERENCES, len, &tlxmlLogHandler, &log));
+        assert(0 == strcmp(expected.log, log.log));
+
+        memset(&log, '\0', sizeof(struct tlxmlEventLog));
+        assert(NULL != parser);
+        for (i = 0; i < len; ++i)
+            assert(TRUE == XMLParser_feed(parser, TEST_XML_REFERENCES + i, 1));
+        assert(TRUE == XMLParser_finish(parser).success);
+        assert(0 == strcmp(expected.log, log.log));
+    }
+
+    {
+        struct tlxmlEventLog log = { { 0 }, 0, 0, 0, NULL };
+
+        reader = XMLReader_openBuffer(TEST_XML_REFERENCES, len);
+        assert(NULL != reader && LXML_READER_DONE == tlxmlLogReader(reader, &log));
+        assert(0 == strcmp(expected.log, log.log));
+        XMLReader_free(reader);
+
+        memset(&log, '\0', sizeof(struct tlxmlEventLog));
+        assert(len == fwrite(TEST_XML_REFERENCES, 1, len, fp));
+        rewind(fp);
+        reader = XMLReader_open(fp);
+        assert(NULL != reader && LXML_READER_DONE == tlxmlLogReader(reader, &log));
+        assert(0 == strcmp(expected.log, log.log));
+        XMLReader_free(reader);
+    }
+
+    /* Decoded values stay valid until the reader moves on */
+    reader = XMLReader_openBuffer(TEST_XML_REFERENCES, len);
+    assert(NULL != reader && LXML_READER_DECLARATION == XMLReader_next(reader) && LXML_READER_START == XMLReader_next(reader));
+    {
+        const char *k = XMLReader_getAttributeValue(reader, "k", &len), *u = XMLReader_getAttributeValue(reader, "u", &i);
+
+        assert(TRUE == tlxmlCompareViews(k, len, a->attributes.attribute[0].value, a->attributes.attribute[0].valueLen));
+        assert(TRUE == tlxmlCompareViews(u, i, a->attributes.attribute[1].value, a->attributes.attribute[1].valueLen));
+    }
+    XMLReader_free(reader);
+
+    fclose(fp);
+    doc.free(&doc);
+
+    return TRUE;
+} /* End of lxmlTestXMLReaderReferences */
+
+static int lxmlTestXMLReader() {
+    int success = lxmlTestXMLReaderBuffer();
+
+    success &= lxmlTestXMLReaderStream();
+    success &= lxmlTestXMLReaderSkipSubtree();
+    success &= lxmlTestXMLReaderMalformed();
+    success &= lxmlTestXMLReaderReferences();
+    success &= lxmlTestXMLDocumentStreamElements();
+
+    printf("lxmlTestXMLReader: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestXMLReader */
+
+/**
+ * @brief Helper callback for 'XMLQuery_eval' which records the matches
+ */
+struct tlxmlQueryMatches {
+    struct XMLNode *nodes[TEST_BUF];
+    struct XMLAttribute *attrs[TEST_BUF];
+    size_t size, limit;
+};
+
+static int tlxmlQueryCollect(void *ctx, struct XMLNode *node, struct XMLAttribute *attr) {
+    struct tlxmlQueryMatches *matches = ctx;
+
+    matches->nodes[matches->size] = node;
+    matches->attrs[matches->size] = attr;
+
+    return (++matches->size != matches->limit) ? TRUE : FALSE;
+} /* End of tlxmlQueryCollect */
+
+static int lxmlTestXMLQueryCompileMalformed() {
+    const char *exprs[] = { "", "/", "/a/", "a//", "/a[", "/a[0]", "/a[x]", "/a[@b='c]", "/@a/b", "/@a[1]", "/a b" };
+    size_t i = 0;
+
+    for (; i < sizeof(exprs) / sizeof(exprs[0]); ++i)
+        assert(NULL == XMLQuery_compile(exprs[i]));
+    assert(NULL == XMLQuery_compile(NULL));
+
+    return TRUE;
+} /* End of lxmlTestXMLQueryCompileMalformed */
+
+static int lxmlTestXMLQueryEval() {
+    struct XMLDocument doc = XMLDocument_loadBufferWithFlags(TEST_XML_QUERY, strlen(TEST_XML_QUERY), LXML_LOAD_IN_SITU);
+    struct tlxmlQueryMatches matches;
+    struct XMLQuery *query = XMLQuery_compile("/struct/field[@type='int']/@name");
+    struct XMLNode *person = NULL;
+
+    assert(TRUE == doc.success && NULL != query);
+    person = doc.root->children.data[0];
+    memset(&matches, '\0', sizeof(matches));
+
+    /* Compiled once, evaluated many times */
+    assert(2 == XMLQuery_eval(query, doc.root, tlxmlQueryCollect, &matches));
+    assert(2 == XMLQuery_eval(query, person->children.data[3], NULL, NULL));
+    assert(person->children.data[1] == matches.nodes[0] && person->children.data[2] == matches.nodes[1]);
+    assert(TRUE == lxmlViewEquals(matches.attrs[0]->value, matches.attrs[0]->valueLen, "age"));
+    assert(TRUE == lxmlViewEquals(matches.attrs[1]->value, matches.attrs[1]->valueLen, "height"));
+    XMLQuery_free(query);
+
+    /* Descendants in document order */
+    matches.size = 0;
+    query = XMLQuery_compile("//description");
+    assert(2 == XMLQuery_eval(query, doc.root, tlxmlQueryCollect, &matches));
+    assert(person->children.data[3] == matches.nodes[0] && NULL == matches.attrs[0]);
+    assert(person->children.data[4]->children.data[0] == matches.nodes[1]);
+    XMLQuery_free(query);
+
+    /* Relative paths start from the given node */
+    query = XMLQuery_compile("field[2]");
+    assert(0 == XMLQuery_eval(query, doc.root, NULL, NULL));
+    matches.size = 0;
+    assert(1 == XMLQuery_eval(query, person, tlxmlQueryCollect, &matches));
+    assert(person->children.data[1] == matches.nodes[0]);
+
+    /* Indexed children give the same matches */
+    assert(TRUE == XMLNode_buildIndex(person));
+    assert(1 == XMLQuery_eval(query, person, tlxmlQueryCollect, &matches));
+    assert(person->children.data[1] == matches.nodes[1]);
+    XMLQuery_free(query);
+
+    query = XMLQuery_compile("/*/*[@type][ 3 ]");
+    matches.size = 0;
+    assert(1 == XMLQuery_eval(query, doc.root, tlxmlQueryCollect, &matches));
+    assert(person->children.data[2] == matches.nodes[0]);
+    XMLQuery_free(query);
+
+    query = XMLQuery_compile("//@*");
+    assert(7 == XMLQuery_eval(query, doc.root, NULL, NULL));
+    XMLQuery_free(query);
+
+    query = XMLQuery_compile("//field[@type=\"bool\"]");
+    assert(0 == XMLQuery_eval(query, doc.root, NULL, NULL));
+    XMLQuery_free(query);
+
+    doc.free(&doc);
+
+    return TRUE;
+} /* End of lxmlTestXMLQueryEval */
+
+static int lxmlTestXMLQueryEvalStop() {
+    struct XMLDocument doc = XMLDocument_loadBuffer(TEST_XML_QUERY, strlen(TEST_XML_QUERY));
+    struct XMLQuery *query = XMLQuery_compile("//*");
+    struct tlxmlQueryMatches matches;
+
+    assert(TRUE == doc.success && NULL != query);
+    memset(&matches, '\0', sizeof(matches));
+    assert(7 == XMLQuery_eval(query, doc.root, NULL, NULL));
+
+    matches.limit = 2;
+    assert(2 == XMLQuery_eval(query, doc.root, tlxmlQueryCollect, &matches));
+    assert(doc.root->children.data[0] == matches.nodes[0]);
+    assert(doc.root->children.data[0]->children.data[0] == matches.nodes[1]);
+
+    XMLQuery_free(query);
+    doc.free(&doc);
+
+    return TRUE;
+} /* End of lxmlTestXMLQueryEvalStop */
+
+static int lxmlTestXMLQueryEvalAllocations() {
+    const size_t depth = 100;
+    char *xml = malloc(depth * 7);
+    struct XMLDocument doc = XMLDocument_loadBuffer(TEST_XML_QUERY, strlen(TEST_XML_QUERY));
+    struct XMLQuery *position = XMLQuery_compile("//field[1]"), *attribute = XMLQuery_compile("//field[@type='int']");
+    size_t i = 0;
+
+    assert(TRUE == doc.success && NULL != position && NULL != attribute && NULL != xml);
+
+    /* Nothing is allocated within 'LXML_WALK_STACK_SIZE' levels */
+    tlxmlAllocs = 0;
+    tlxmlCounting = TRUE;
+    assert(1 == XMLQuery_eval(position, doc.root, NULL, NULL));
+    assert(2 == XMLQuery_eval(attribute, doc.root, NULL, NULL));
+    tlxmlCounting = FALSE;
+    assert(0 == tlxmlAllocs);
+    doc.free(&doc);
+    XMLQuery_free(position);
+    XMLQuery_free(attribute);
+
+    /* Deeper walks allocate, and failing to is an error rather than fewer matches */
+    for (; i < depth; ++i) {
+        memcpy(xml + i * 3, "<a>", 3);
+        memcpy(xml + depth * 3 + i * 4, "</a>", 4);
+    }
+
+    doc = XMLDocument_loadBuffer(xml, depth * 7);
+    position = XMLQuery_compile("//a[1]");
+    assert(TRUE == doc.success && NULL != position);
+
+    tlxmlAllocs = 0;
+    tlxmlFailAt = 1;
+    tlxmlCounting = TRUE;
+    assert(LXML_QUERY_ERROR == XMLQuery_eval(position, doc.root, NULL, NULL));
+    tlxmlFailAt = 2;
+    tlxmlAllocs = 0;
+    assert(LXML_QUERY_ERROR == XMLQuery_eval(position, doc.root, NULL, NULL));
+    tlxmlFailAt = 0;
+    assert(depth == XMLQuery_eval(position, doc.root, NULL, NULL));
+    tlxmlCounting = FALSE;
+
+    XMLQuery_free(position);
+    doc.free(&doc);
+    free(xml);
+
+    return TRUE;
+} /* End of lxmlTestXMLQueryEvalAllocations */
+
+static int lxmlTestXMLQuery() {
+    int success = lxmlTestXMLQueryCompileMalformed();
+
+    success &= lxmlTestXMLQueryEval();
+    success &= lxmlTestXMLQueryEvalStop();
+    success &= lxmlTestXMLQueryEvalAllocations();
+
+    printf("lxmlTestXMLQuery: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestXMLQuery */
+
+/**
+ * @brief Helper function that asserts 'XMLDocument_write', or 'XMLDocument_writeParallel'
+ *        when 'threads' is set, produces the 'len' bytes of 'expected'
+ */
+static int tlxmlCompareWrittenBuffer(struct XMLDocument *doc, int indent, int threads, const char *expected, size_t len) {
+    FILE *fp = tmpfile();
+    size_t i = 0;
+
+    assert(NULL != fp);
+    assert(TRUE == ((0 != threads) ? XMLDocument_writeParallel(doc, fp, indent, threads) : XMLDocument_write(doc, fp, indent)));
+    rewind(fp);
+
+    for (; i < len; ++i)
+        assert(expected[i] == (char) fgetc(fp));
+    assert(EOF == fgetc(fp));
+
+    fclose(fp);
+
+    return TRUE;
+} /* End of tlxmlCompareWrittenBuffer */
+
+static int lxmlTestXMLDocumentWriteToBuffer() {
+    const size_t declarationLen = strlen(TEST_XML_HEADER "\n");
+    struct XMLDocument doc = XMLDocument_loadBuffer(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED));
+    static const int indents[] = { 0, 1, 4, 70 };
+    size_t i = 0;
+
+    assert(TRUE == doc.success);
+
+    for (; i < sizeof(indents) / sizeof(indents[0]); ++i) {
+        struct XMLNode *root = doc.root->children.data[0];
+        char *out = NULL;
+        size_t len = 0;
+
+        assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, indents[i]));
+        assert(NULL != out && len == strlen(out));
+        assert(0 == memcmp(TEST_XML_HEADER "\n<root a=\"x>y\" b=\"2\">\n", out, declarationLen + 21));
+        tlxmlCompareWrittenBuffer(&doc, indents[i], 0, out, len);
+
+        /* Exact for the whole tree, which here is a single element, and for any subtree */
+        assert(len == declarationLen + XMLNode_serializedLength(doc.root, indents[i]));
+        assert(len == declarationLen + XMLNode_serializedLength(root, indents[i]));
+        assert(strlen("<item>Some text which gets split</item>\n") == XMLNode_serializedLength(root->children.data[0], indents[i]));
+
+        free(out);
+    }
+
+    assert(0 == XMLNode_serializedLength(NULL, 2));
+
+    /* Missing arguments fail like 'XMLDocument_write' rather than crash */
+    {
+        char *out = (char*) "unset";
+        size_t len = 1;
+
+        assert(FALSE == XMLDocument_writeToBuffer(NULL, &out, &len, 0) && NULL == out && 0 == len);
+        assert(FALSE == XMLDocument_writeToBuffer(&doc, NULL, &len, 0) && 0 == len);
+        assert(FALSE == XMLDocument_writeToBuffer(&doc, &out, NULL, 0) && NULL == out);
+
+        /* As does running out of memory */
+        tlxmlAllocs = 0;
+        tlxmlFailAt = 1;
+        tlxmlCounting = TRUE;
+        assert(FALSE == XMLDocument_writeToBuffer(&doc, &out, &len, 0) && NULL == out && 0 == len);
+        tlxmlCounting = FALSE;
+        tlxmlFailAt = 0;
+    }
+
+    doc.free(&doc);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentWriteToBuffer */
+
+static int lxmlTestXMLDocumentWriteLarge() {
+    struct XMLDocument doc = { 0, 0, 0, 0, XMLDocument_free, 0, 0 };
+    struct XMLNode *parent = NULL;
+    char *large = calloc(2 * LXML_WRITE_BUFFER_SIZE, sizeof(char)), *out = NULL;
+    size_t i = 0, len = 0;
+
+    assert(NULL != large);
+    memset(large, 'x', 2 * LXML_WRITE_BUFFER_SIZE - 1);
+
+    doc.root = XMLNode_init();
+    parent = XMLNode_createAndAppend(doc.root);
+    assert(NULL != parent);
+    parent->tag = tlxmlStrdup("list");
+
+    /* Spans several flushes, and one value is written past the buffer */
+    for (; i < 5000; ++i) {
+        struct XMLNode *child = XMLNode_createAndAppend(parent);
+
+        assert(NULL != child);
+        child->tag = tlxmlStrdup("entry");
+        child->inner_text = tlxmlStrdup((2500 == i) ? large : "text");
+    }
+
+    assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, 2));
+    assert(len > 2 * LXML_WRITE_BUFFER_SIZE && len == strlen(out));
+    tlxmlCompareWrittenBuffer(&doc, 2, 0, out, len);
+
+    free(out);
+    free(large);
+    doc.free(&doc);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentWriteLarge */
+
+static int lxmlTestXMLDocumentWriteParallel() {
+    struct XMLDocument doc = XMLDocument_loadBuffer(TEST_XML_CHUNKED, strlen(TEST_XML_CHUNKED));
+    struct XMLNode *parent = NULL;
+    char *large = calloc(2 * LXML_WRITE_BUFFER_SIZE, sizeof(char)), *out = NULL;
+    size_t i = 0, len = 0;
+    int threads = 1;
+
+    assert(TRUE == doc.success && NULL != large);
+    memset(large, 'x', 2 * LXML_WRITE_BUFFER_SIZE - 1);
+    assert(FALSE == XMLDocument_writeParallel(NULL, stdout, 0, 4));
+
+    /* A handful of siblings, fewer than blocks per thread */
+    assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, 4));
+    for (threads = 1; threads <= 8; ++threads)
+        tlxmlCompareWrittenBuffer(&doc, 4, threads, out, len);
+    free(out);
+
+    /* Thousands of siblings inside wrapping elements, with one child larger than a buffer */
+    parent = doc.root->children.data[0]->children.data[2];
+    assert(0 == strcmp("empty", parent->tag));
+    for (; i < 5000; ++i) {
+        struct XMLNode *child = XMLNode_createAndAppend(parent), *grandchild = NULL;
+
+        assert(NULL != child);
+        child->tag = tlxmlStrdup("entry");
+        grandchild = XMLNode_createAndAppend(child);
+        assert(NULL != grandchild);
+        grandchild->tag = tlxmlStrdup("value");
+        grandchild->inner_text = tlxmlStrdup((2500 == i) ? large : "text");
+    }
+
+    /* 'empty' is no longer the only place to split, the whole root is */
+    assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, 2));
+    for (threads = 2; threads <= 8; threads *= 2)
+        tlxmlCompareWrittenBuffer(&doc, 2, threads, out, len);
+    free(out);
+
+    /* Only the wrapped siblings are split */
+    XMLNode_free(doc.root->children.data[0]->children.data[0]);
+    XMLNode_free(doc.root->children.data[0]->children.data[1]);
+    free(doc.root->children.data[0]->children.data[0]);
+    free(doc.root->children.data[0]->children.data[1]);
+    doc.root->children.data[0]->children.data[0] = parent;
+    doc.root->children.data[0]->children.data[1] = doc.root->children.data[0]->children.data[2] = NULL;
+    doc.root->children.data[0]->children.size = 1;
+
+    assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, 3));
+    for (threads = 2; threads <= 8; threads *= 2)
+        tlxmlCompareWrittenBuffer(&doc, 3, threads, out, len);
+    free(out);
+
+    free(large);
+    doc.free(&doc);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentWriteParallel */
+
+static int lxmlTestXMLDocumentWriteEscaped() {
+    struct XMLDocument doc = XMLDocument_loadBuffer(TEST_XML_REFERENCES, strlen(TEST_XML_REFERENCES)), again = { 0 };
+    struct XMLNode *node = NULL;
+    char *out = NULL;
+    size_t len = 0;
+
+    assert(TRUE == doc.success);
+
+    /* The text of an element with children is not written */
+    node = doc.root->children.data[0];
+    free(node->inner_text);
+    node->inner_text = NULL;
+    node->innerTextLen = 0;
+
+    /* Only what has to be is escaped, a value holding '"' is quoted with ''' */
+    node = XMLNode_createAndAppend(node);
+    node->tag = tlxmlStrdup("q");
+    node->tagLen = 1;
+    node->inner_text = tlxmlStrdup("]]> & '\"");
+    node->innerTextLen = strlen(node->inner_text);
+    assert(TRUE == XMLAttributeList_append(&node->attributes, "v", 1, "a\"b'c", 5, TRUE));
+    assert(TRUE == XMLAttributeList_append(&node->attributes, "w", 1, "<x>", 3, TRUE));
+
+    assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, 0));
+    assert(len == strlen(TEST_XML_HEADER "\n") + XMLNode_serializedLength(doc.root, 0));
+    assert(NULL != strstr(out, "<a k='&lt;AB\"&amp;amp;' u=\"caf\xC3\xA9 \xF0\x9F\x98\x80\" bad=\"&amp;nbsp; &amp;#0; &amp;#xD800; &amp;#; AT&amp;T &amp;\">"));
+    assert(NULL != strstr(out, "<plain>plain</plain>"));
+    assert(NULL != strstr(out, "<q v='a\"b&apos;c' w=\"&lt;x>\">]]&gt; &amp; '\"</q>"));
+
+    /* And reads back the same, but for the indentation now in the text of 'a' */
+    again = XMLDocument_loadBuffer(out, len);
+    assert(TRUE == again.success);
+    node = again.root->children.data[0];
+    free(node->inner_text);
+    node->inner_text = NULL;
+    node->innerTextLen = 0;
+    tlxmlCompareXmlNodes(doc.root->children.data[0], node);
+
+    again.free(&again);
+    doc.free(&doc);
+    free(out);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentWriteEscaped */
+
+static int lxmlTestXMLDocumentWriteTruncated() {
+    const size_t depth = 100;
+    char *xml = malloc(depth * 7), *out = NULL;
+    struct XMLDocument doc = { 0 };
+    FILE *fp = tmpfile();
+    size_t i = 0, len = 0, expected = 0;
+
+    assert(NULL != xml && NULL != fp);
+    for (; i < depth; ++i) {
+        memcpy(xml + i * 3, "<a>", 3);
+        memcpy(xml + depth * 3 + i * 4, "</a>", 4);
+    }
+
+    doc = XMLDocument_loadBuffer(xml, depth * 7);
+    assert(TRUE == doc.success);
+    expected = XMLNode_serializedLength(doc.root, 0);
+    assert(LXML_WRITE_ERROR != expected && 0 != expected);
+
+    /* Deeper than the stack of the walk, which fails to grow on the first allocation */
+    tlxmlCounting = TRUE;
+    tlxmlAllocs = 0;
+    tlxmlFailAt = 1;
+    assert(LXML_WRITE_ERROR == XMLNode_serializedLength(doc.root, 0));
+    tlxmlAllocs = 0;
+    assert(FALSE == XMLDocument_writeToBuffer(&doc, &out, &len, 0) && NULL == out && 0 == len);
+
+    /* The buffer of 'XMLDocument_write' is the first allocation, the walk's stack the second */
+    tlxmlAllocs = 0;
+    tlxmlFailAt = 2;
+    assert(FALSE == XMLDocument_write(&doc, fp, 0));
+    tlxmlCounting = FALSE;
+    tlxmlFailAt = 0;
+
+    assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, 0));
+    assert(len == strlen(TEST_XML_HEADER "\n") + expected);
+
+    doc.free(&doc);
+    fclose(fp);
+    free(out);
+    free(xml);
+
+    return TRUE;
+} /* End of lxmlTestXMLDocumentWriteTruncated */
+
+static int lxmlTestXMLDocumentWrite() {
+    int success = lxmlTestXMLDocumentWriteToBuffer();
+
+    success &= lxmlTestXMLDocumentWriteLarge();
+    success &= lxmlTestXMLDocumentWriteParallel();
+    success &= lxmlTestXMLDocumentWriteEscaped();
+    success &= lxmlTestXMLDocumentWriteTruncated();
+
+    printf("lxmlTestXMLDocumentWrite: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestXMLDocumentWrite */
+
+/**
+ * @brief Helper function that tokenizes all of 'xml' into 'types', a letter for each token:
+ *        'D'eclaration, 'S'tart, 'E'nd, 'T'ext or 'C'omment, then '!' if the tokenizer failed
+ */
+static const char* tlxmlTokenize(const char *xml, char *types) {
+    struct XMLTokenizer tokenizer;
+    struct XMLToken token;
+    enum XMLTokenType type = LXML_TOKEN_NONE;
+    size_t i = 0, size = 0;
+
+    memset(&tokenizer, '\0', sizeof(struct XMLTokenizer));
+    tokenizer.state = LXML_PARSER_CONTENT;
+
+    while (LXML_TOKEN_NONE != (type = lxmlTokenizerNext(&tokenizer, xml, strlen(xml), &i, TRUE, &token)))
+        types[size++] = " DSETC"[type];
+
+    if (TRUE == tokenizer.error)
+        types[size++] = '!';
+
+    types[size] = '\0';
+    free(tokenizer.names);
+
+    return types;
+} /* End of tlxmlTokenize */
+
+static int lxmlTestEndTagPass() {
+    char types[16];
+
+    assert(0 == strcmp("STE", tlxmlTokenize(TEST_HAYSTACK_1, types)));
+    return TRUE;
+} /* End of lxmlTestEndTagPass */
+
+static int lxmlTestEndTagFail() {
+    char types[16];
+
+    assert(0 == strcmp("ST!", tlxmlTokenize("<description>This defines a person" TEST_NEEDLE_INVALID, types)));
+    return TRUE;
+} /* End of lxmlTestEndTagFail */
+
+static int lxmlTestEndTagFail2() {
+    char types[16];
+
+    assert(0 == strcmp("ST!", tlxmlTokenize("<description>This defines a person" TEST_NEEDLE_INVALID2, types)));
+    return TRUE;
+} /* End of lxmlTestEndTagFail2 */
+
+static int lxmlTestEndTagFailWithoutStart() {
+    char types[16];
+
+    assert(0 == strcmp("!", tlxmlTokenize(TEST_NEEDLE_1, types)));
+    return TRUE;
+} /* End of lxmlTestEndTagFailWithoutStart */
+
+static int lxmlTestEndTagEmpty() {
+    char types[16];
+
+    assert(0 == strcmp("", tlxmlTokenize("", types)));
+    return TRUE;
+} /* End of lxmlTestEndTagEmpty */
+
+static int lxmlTestEndTagMissing() {
+    char types[16];
+
+    /* The tokenizer leaves reporting unclosed elements to its caller */
+    assert(0 == strcmp("ST", tlxmlTokenize("<description>This defines a person", types)));
+    return TRUE;
+} /* End of lxmlTestEndTagMissing */
+
+static int lxmlTestEndTag() {
+    int success = lxmlTestEndTagPass();
+
+    success &= lxmlTestEndTagFail();
+    success &= lxmlTestEndTagFail2();
+    success &= lxmlTestEndTagFailWithoutStart();
+    success &= lxmlTestEndTagEmpty();
+
+    success &= lxmlTestEndTagMissing();
+
+    printf("lxmlTestEndTag: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestEndTag */
+
+static int lxmlTestAttributeInit() {
+    struct XMLAttribute *attr = XMLAttribute_init("Hello", "World");
+
+    assert(NULL != attr);
+#ifndef LXML_COMPACT_NODES
+    assert(XMLAttribute_free == attr->free);
+#endif
+
+    assert(0 == strcmp(attr->key, "Hello"));
+    assert(0 == strcmp(attr->value, "World"));
+
+    XMLAttribute_free(attr);
+    free(attr);
+    attr = NULL;
+
+    return TRUE;
+} /* End of lxmlTestAttributeInit */
+
+static int lxmlTestAttributeListInit() {
+    struct XMLAttributeList list = XMLAttributeList_init();
+
+    assert(0 == list.size);
+    assert(0 == list.heapSize);
+
+#ifndef LXML_COMPACT_NODES
+    assert(XMLAttributeList_add == list.add);
+    assert(XMLAttributeList_free == list.free);
+#endif
+
+    return TRUE;
+} /* End of lxmlTestAttributeListInit */
+
+static int lxmlTestAttributeListAdd() {
+    int success = FALSE;
+
+    struct XMLAttributeList list = XMLAttributeList_init();
+    struct XMLAttribute *attr = XMLAttribute_init("Hello", "World");
+
+    assert(NULL != attr);
+
+    success = XMLAttributeList_add(&list, *attr);
+
+    assert(TRUE == success);
+    assert(1 == list.size);
+    assert(1 == list.heapSize);
+
+    assert(0 == strcmp(list.attribute[0].key, "Hello"));
+    assert(0 == strcmp(list.attribute[0].value, "World"));
+
+    XMLAttributeList_free(&list);
+    XMLAttribute_free(attr);
+    free(attr);
+    attr = NULL;
+
+    return success;
+} /* End of lxmlTestAttributeListAdd */
+
+static int lxmlTestAttributeListTake() {
+    int success = FALSE;
+
+    struct XMLAttributeList list = XMLAttributeList_init();
+    struct XMLAttribute *attr = XMLAttribute_init("Hello", "World");
+    size_t i = 0;
+
+    assert(NULL != attr);
+
+    success = XMLAttributeList_take(&list, *attr);
+
+    assert(TRUE == success);
+    assert(1 == list.size);
+    assert(attr->key == list.attribute[0].key);
+    assert(attr->value == list.attribute[0].value);
+
+    /* The list owns the strings now, only the struct is left to release */
+    free(attr);
+    attr = NULL;
+
+    for (i = 0; i < 100 && TRUE == success; ++i) {
+        attr = XMLAttribute_init("key", "value");
+        success = XMLAttributeList_take(&list, *attr);
+        free(attr);
+    }
+
+    assert(TRUE == success);
+    assert(101 == list.size);
+    assert(0 == strcmp(list.attribute[0].key, "Hello"));
+    assert(0 == strcmp(list.attribute[100].value, "value"));
+    assert(&list.attribute[0] == XMLAttributeList_getAttribute(&list, "Hello"));
+
+    XMLAttributeList_free(&list);
+
+    return success;
+} /* End of lxmlTestAttributeListTake */
+
+static int lxmlTestAttributeListGetAttributeValue() {
+    int success = FALSE;
+
+    struct XMLAttributeList list = XMLAttributeList_init();
+
+    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
+    assert(TRUE == success);
+
+    success &= lxmlTestGetDefaultAttributeValuesFromAttributeList(list);
+    assert(TRUE == success);
+
+    XMLAttributeList_free(&list);
+
+    return success;
+} /* End of lxmlTestAttributeListGetAttributeValue */
+
+static int lxmlTestAttributeListGetAttributeValueMissing() {
+    int success = FALSE;
+
+    struct XMLAttributeList list = XMLAttributeList_init();
+    char *tmp = NULL;
+    
+    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
+    assert(TRUE == success);
+
+    tmp = XMLAttributeList_getAttributeValue(&list, "Fish");
+    assert(NULL == tmp);
+
+    XMLAttributeList_free(&list);
+
+    return success;
+} /* End of lxmlTestAttributeListGetAttributeValueMissing */
+
+static int lxmlTestAttributeListGetAttribute() {
+    int success = FALSE;
+
+    struct XMLAttributeList list = XMLAttributeList_init();
+    
+    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
+    assert(TRUE == success);
+
+    success &= lxmlTestGetDefaultAttributesFromAttributeList(list);
+    assert(TRUE == success);
+
+    XMLAttributeList_free(&list);
+
+    return success;
+} /* End of lxmlTestAttributeListGetAttribute */
+
+static int lxmlTestAttributeListGetAttributeMissing() {
+    int success = FALSE;
+
+    struct XMLAttributeList list = XMLAttributeList_init();
+    struct XMLAttribute *tmp = NULL;
+    
+    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&list);
+    
+    assert(TRUE == success);
+
+    tmp = XMLAttributeList_getAttribute(&list, "Fish");
+    assert(NULL == tmp);
+
+    XMLAttributeList_free(&list);
+
+    return success;
+} /* End of lxmlTestAttributeListGetAttributeMisisng */
+
+static int lxmlTestAttributeList() {
+    int success = lxmlTestAttributeListInit(); 
+
+    success &= lxmlTestAttributeListAdd();
+    success &= lxmlTestAttributeListTake();
+    success &= lxmlTestAttributeListGetAttributeValue();
+    success &= lxmlTestAttributeListGetAttributeValueMissing();
+    success &= lxmlTestAttributeListGetAttribute();
+
+    success &= lxmlTestAttributeListGetAttributeMissing();
+
+    printf("lxmlTestAttributeList: %s\n", (TRUE == success) ? "Pass" : "Fail");
+
+    return success;
+} /* End of lxmlTestAttributeList */
+
+static int lxmlTestNodeInit() {
+    struct XMLNode *node = XMLNode_init();
+
+    assert(NULL != node);
+
+    assert(0    == node->children.heapSize);
+    assert(0    == node->children.size);
+    assert(NULL == node->children.data);
+
+#ifndef LXML_COMPACT_NODES
+    assert(XMLNodeList_add == node->children.add);
+    assert(XMLNodeList_free == node->children.free);
+#endif
+
+    assert(0    == node->attributes.heapSize);
+    assert(0    == node->attributes.size);
+    assert(NULL == node->attributes.attribute);
+
+#ifndef LXML_COMPACT_NODES
+    assert(XMLAttributeList_add == node->attributes.add);
+    assert(XMLAttributeList_free == node->attributes.free);
+    assert(XMLAttributeList_getAttribute == node->attributes.getAttribute);
+    assert(XMLAttributeList_getAttributeValue == node->attributes.getAttributeValue);
+
+    assert(XMLNode_add == node->add);
+    assert(XMLNode_free == node->free);
+    assert(XMLNode_getAttribute == node->getAttribute);
+    assert(XMLNode_getAttributeValue == node->getAttributeValue);
+#endif
+
+    XMLNode_free(node);
+    free(node);
+    node = NULL;
+
+    return TRUE;
+} /* End of lxmlTestNodeInit */
+
+/* The free functions are the only API when built with 'LXML_COMPACT_NODES' */
+static int lxmlTestNodeFreeFunctions() {
+    struct XMLNode node = XMLNodeInitStack(), *child = NULL;
+    struct XMLAttribute attr = { 0 };
+    char *attrVal = NULL;
+
+    child = XMLNode_createAndAppend(&node);
+    assert(NULL != child && &node == child->parent);
+    child->tag = tlxmlStrdup("child");
+
+    attr.key = "key";
+    attr.value = "value";
+    assert(TRUE == XMLAttributeList_add(&child->attributes, attr));
+    assert(&child->attributes.attribute[0] == XMLNode_getAttribute(child, "key"));
+
+    attrVal = XMLNode_getAttributeValue(child, "key");
+    assert(0 == strcmp("value", attrVal));
+    free(attrVal);
+    attrVal = NULL;
+
+    assert(TRUE == XMLNode_add(&node, XMLNode_init()));
+    assert(2 == node.children.size);
+    assert(child == XMLNode_getImmediateElementByTagName(&node, "child"));
+
+    XMLNode_free(&node);
+    child = NULL;
+
+    return TRUE;
+} /* End of lxmlTestNodeFreeFunctions */
+
+static int lxmlTestNodeAdd() {
+    struct XMLNode node   = XMLNodeInitStack(),
+                   *child = XMLNode_init();
+
+    assert(NULL != child);
+
+    XMLNode_add(&node, child);
+
+    assert(NULL == node.parent);
+    assert(&node == child->parent);
+
+    XMLNode_free(&node);
+    child = NULL;
+    
+    return TRUE;
+} /* End of lxmlTestNodeAdd */
+
+static int lxmlTestNodeCreateAndAppend() {
+    struct XMLNode node  = XMLNodeInitStack();
+    struct XMLNode *child = XMLNode_createAndAppend(&node);
+
+    assert(NULL != child);
+    assert(1 == node.children.size && 1 == node.children.heapSize);
+    assert(child == node.children.data[0]);
+
+    XMLNode_free(&node);
+
+    return TRUE;
+} /* End of lxmlTestNodeCreateAndAppend */
+
+static int lxmlTestNodeGetImmediateElementByTagName() {
+    struct XMLNode *tree = tlxmlCreateTestXMLNodeTree();
+
+    assert(NULL != tree);
+
+    {
+        struct XMLNode *topNode    = XMLNode_getImmediateElementByTagName(tree, "top"),
+                       *middleNode = XMLNode_getImmediateElementByTagName(tree, "middle"),
+                       *bottomNode = XMLNode_getImmediateElementByTagName(tree, "bottom");
+
+        assert(NULL != topNode && NULL != middleNode && NULL != bottomNode);
+
+        assert(0 == strcmp("top",    topNode->tag));
+        assert(0 == strcmp("middle", middleNode->tag));
+        assert(0 == strcmp("bottom", bottomNode->tag));
+    }
+
+    XMLNode_free(tree);
+    free(tree);
+    tree = NULL;
+
+    return TRUE;
+} /* End of lxmlTestNodeGetImmediateElementByTagName */
+
+static int lxmlTestNodeGetImmediateElementByTagNameNodeNotFound() {
+    struct XMLNode *tree = tlxmlCreateTestXMLNodeTree();
+
+    assert(NULL != tree);
+    assert(NULL == XMLNode_getImmediateElementByTagName(tree, "upper"));
+
+    XMLNode_free(tree);
+    free(tree);
+    tree = NULL;
+
+    return TRUE;
+} /* End of lxmlTestNodeGetImmediateElementByTagNameNodeNotFound */
+
+static int lxmlTestNodeIndex() {
+    struct XMLNode *node = XMLNode_init(), *child = NULL;
+    struct XMLAttribute attr = { 0 };
+    char name[TEST_BUF], value[] = "value";
+    size_t i = 0, matches = 0;
+
+    assert(NULL != node);
+    attr.key = name;
+    attr.value = value;
+
+    for (; i < 2 * LXML_INDEX_MIN_SIZE; ++i) {
+        child = XMLNode_createAndAppend(node);
+        assert(NULL != child);
+        child->tag = tlxmlStrdup((0 == i % 2) ? "even" : "odd");
+
+        sprintf(name, "key%lu", (unsigned long) i);
+        assert(TRUE == XMLAttributeList_add(&node->attributes, attr));
+    }
+
+    /* Built by the first lookup */
+    assert(NULL == node->children.index);
+    assert(node->children.data[1] == XMLNode_getImmediateElementByTagName(node, "odd"));
+    assert(NULL != node->children.index && 2 * LXML_INDEX_MIN_SIZE == node->children.index->count);
+    assert(NULL == XMLNode_getImmediateElementByTagName(node, "missing"));
+
+    for (i = 0; NULL != (child = XMLNode_getNextImmediateElementByTagName(node, "even", &i)); ++matches)
+        assert(node->children.data[i - 1] == child && 0 == (i - 1) % 2);
+    assert(LXML_INDEX_MIN_SIZE == matches);
+
+    /* Children added afterwards are found without dropping the index */
+    child = XMLNode_createAndAppend(node);
+    assert(NULL != child);
+    child->tag = tlxmlStrdup("last");
+    assert(child == XMLNode_getImmediateElementByTagName(node, "last"));
+
+    /* Tags changed in place need the index dropped */
+    free(node->children.data[0]->tag);
+    node->children.data[0]->tag = tlxmlStrdup("first");
+    XMLNode_clearIndex(node);
+    assert(NULL == node->children.index);
+    assert(node->children.data[0] == XMLNode_getImmediateElementByTagName(node, "first"));
+    assert(node->children.data[2] == XMLNode_getImmediateElementByTagName(node, "even"));
+
+    assert(NULL != XMLNode_getAttribute(node, "key0") && NULL != node->attributes.index);
+    assert(&node->attributes.attribute[LXML_INDEX_MIN_SIZE] == XMLNode_getAttribute(node, "key16"));
+    assert(NULL == XMLNode_getAttribute(node, "key"));
+
+    XMLNode_free(node);
+    free(node);
+    node = NULL;
+
+    return TRUE;
+} /* End of lxmlTestNodeIndex */
+
+static int lxmlTestNodeIndexLoad() {
+    char buf[TEST_BUF * 4] = "<root>";
+    size_t i = 0, len = strlen(buf);
+    struct XMLDocument doc = { 0 };
+    struct XMLNameTable *names = NULL;
+    struct XMLNode *root = NULL, *small = NULL;
+
+    for (; i < 2 * LXML_INDEX_MIN_SIZE; ++i)
+        len += sprintf(buf + len, "<item id=\"%lu\" />", (unsigned long) i);
+    len += sprintf(buf + len, "<small><a /></small></root>");
+
+    doc = XMLDocument_loadBufferWithFlags(buf, len, LXML_LOAD_INDEX | LXML_LOAD_IN_SITU | LXML_LOAD_INTERN);
+    assert(TRUE == doc.success);
+
+    /* Only wide nodes are indexed while loading */
+    root = doc.root->children.data[0];
+    small = XMLNode_getImmediateElementByTagName(root, "small");
+    assert(NULL != root->children.index && NULL != small && NULL == small->children.index);
+    assert(2 * LXML_INDEX_MIN_SIZE + 1 == root->children.index->count);
+
+    names = XMLDocument_getNameTable(&doc);
+    assert(root->children.data[0] == XMLNode_getImmediateElementByName(root, XMLNameTable_get(names, "item")));
+    assert(small == XMLNode_getImmediateElementByName(root, XMLNameTable_get(names, "small")));
+
+    assert(TRUE == XMLNode_buildIndex(small));
+    assert(small->children.data[0] == XMLNode_getImmediateElementByTagName(small, "a"));
+
+    doc.free(&doc);
+
+    return TRUE;
+} /* End of lxmlTestNodeIndexLoad */
+
+static int lxmlTestNodeGetAttributeValues() {
+    int success = FALSE;
+
+    struct XMLNode *node = XMLNode_init();
+    assert(NULL != node);
+
+    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&node->attributes);
+    assert(TRUE == success);
+
+    success &= lxmlTestGetDefaultAttributeValuesFromAttributeList(node->attributes);
+    assert(TRUE == success);
+
+    XMLNode_free(node);
+    free(node);
+    node = NULL;
+
+    return success;
+} /* End of lxmlTestNodeGetAttributeValues */
+
+static int lxmlTestNodeGetAttributes() {
+    int success = FALSE;
+
+    struct XMLNode *node = XMLNode_init();
+    assert(NULL != node);
+
+    success = lxmlTestPopulateXmlAttributeListWithDefaultAttributes(&node->attributes);
+    assert(TRUE == success);
 
     success &= lxmlTestGetDefaultAttributesFromAttributeList(node->attributes);
     assert(TRUE == success);
 
-    node->free(node);
+    XMLNode_free(node);
     free(node);
     node = NULL;
 
     return success;
 } /* End of lxmlTestNodeGetAttributes */
 
+/**
+ * @brief Records the order 'XMLNode_walk' visits nodes in, skipping the children of 'skip'
+ *        and stopping at 'stop'
+ */
+struct tlxmlWalkLog {
+    char log[TEST_BUF];
+    const char *skip, *stop;
+};
+
+static enum XMLWalkAction tlxmlWalkEnter(void *ctx, struct XMLNode *node, size_t depth) {
+    struct tlxmlWalkLog *log = ctx;
+    const char *tag = (NULL != node->tag) ? node->tag : "";
+    enum XMLWalkAction action = LXML_WALK_CONTINUE;
+
+    sprintf(log->log + strlen(log->log), "%s%lu ", tag, (unsigned long) depth);
+
+    if (NULL != log->skip && 0 == strcmp(log->skip, tag))
+        action = LXML_WALK_SKIP;
+    else if (NULL != log->stop && 0 == strcmp(log->stop, tag))
+        action = LXML_WALK_STOP;
+
+    return action;
+} /* End of tlxmlWalkEnter */
+
+static enum XMLWalkAction tlxmlWalkLeave(void *ctx, struct XMLNode *node, size_t depth) {
+    struct tlxmlWalkLog *log = ctx;
+
+    (void) depth;
+    sprintf(log->log + strlen(log->log), "/%s ", (NULL != node->tag) ? node->tag : "");
+
+    return LXML_WALK_CONTINUE;
+} /* End of tlxmlWalkLeave */
+
+static int lxmlTestNodeWalk() {
+    struct XMLNode *tree = tlxmlCreateTestXMLNodeTree();
+    struct tlxmlWalkLog log = { { 0 }, NULL, NULL };
+
+    assert(NULL != tree);
+    assert(TRUE == XMLNode_walk(tree, tlxmlWalkEnter, tlxmlWalkLeave, &log));
+    assert(0 == strcmp("0 top1 foo2 /foo bar2 /bar baz2 /baz /top middle1 child2 /child child2 /child child2 /child /middle "
+                       "bottom1 nest2 nest3 nest4 /nest /nest /nest /bottom / ", log.log));
+
+    /* Skipped nodes are still left, stopping leaves nothing else */
+    memset(log.log, '\0', sizeof(log.log));
+    log.skip = "middle";
+    log.stop = "nest";
+    assert(FALSE == XMLNode_walk(tree, tlxmlWalkEnter, tlxmlWalkLeave, &log));
+    assert(0 == strcmp("0 top1 foo2 /foo bar2 /bar baz2 /baz /top middle1 /middle bottom1 nest2 ", log.log));
+
+    memset(log.log, '\0', sizeof(log.log));
+    assert(TRUE == XMLNode_walk(tree->children.data[1], NULL, tlxmlWalkLeave, &log));
+    assert(0 == strcmp("/child /child /child /middle ", log.log));
+    assert(TRUE == XMLNode_walk(NULL, tlxmlWalkEnter, tlxmlWalkLeave, &log));
+
+    XMLNode_free(tree);
+    free(tree);
+
+    return TRUE;
+} /* End of lxmlTestNodeWalk */
+
+static int lxmlTestNodeWalkDeep() {
+    const size_t depth = 300000;
+    char *xml = malloc(depth * 7), *out = NULL;
+    struct XMLDocument doc = { 0 };
+    struct XMLQuery *query = XMLQuery_compile("//a[1]");
+    size_t i = 0, len = 0, count = 0;
+
+    /* Deep enough to exhaust the stack of a recursive walk */
+    assert(NULL != xml && NULL != query);
+    for (; i < depth; ++i) {
+        memcpy(xml + i * 3, "<a>", 3);
+        memcpy(xml + depth * 3 + i * 4, "</a>", 4);
+    }
+
+    doc = XMLDocument_loadBuffer(xml, depth * 7);
+    assert(TRUE == doc.success);
+
+    assert(TRUE == XMLDocument_writeToBuffer(&doc, &out, &len, 0));
+    assert(len == strlen(TEST_XML_HEADER "\n") + XMLNode_serializedLength(doc.root, 0));
+    assert(NULL != XMLDocument_getElementsByTagName(&doc, "a", &count) && depth == count);
+    assert(depth == XMLQuery_eval(query, doc.root, NULL, NULL));
+    assert(TRUE == XMLNode_buildIndex(doc.root));
+
+    doc.free(&doc);
+    XMLQuery_free(query);
+    free(out);
+    free(xml);
+
+    return TRUE;
+} /* End of lxmlTestNodeWalkDeep */
+
 static int lxmlTestNode() {
     int success = lxmlTestNodeInit();
 
@@ -761,6 +3408,11 @@ static int lxmlTestNode() {
     success &= lxmlTestNodeGetImmediateElementByTagName();
 
     success &= lxmlTestNodeGetImmediateElementByTagNameNodeNotFound();
+    success &= lxmlTestNodeFreeFunctions();
+    success &= lxmlTestNodeIndex();
+    success &= lxmlTestNodeIndexLoad();
+    success &= lxmlTestNodeWalk();
+    success &= lxmlTestNodeWalkDeep();
 
     printf("lxmlTestNode: %s\n", (TRUE == success) ? "Pass" : "Fail");
 
@@ -774,8 +3426,10 @@ static int lxmlTestNodeListInit() {
     assert(0    == list.size);
     assert(NULL == list.data);
 
-    assert(NULL != list.add);
-    assert(NULL != list.free);
+#ifndef LXML_COMPACT_NODES
+    assert(XMLNodeList_add == list.add);
+    assert(XMLNodeList_free == list.free);
+#endif
 
     return TRUE;
 } /* End of lxmlTestNodeListInit */
@@ -786,13 +3440,13 @@ static int lxmlTestNodeListAdd() {
     struct XMLNode *child = XMLNode_init();
 
     assert(NULL != child);
-    success = list.add(&list, NULL, child);
+    success = XMLNodeList_add(&list, NULL, child);
     assert(TRUE == success);
 
     assert(1 == list.size && 1 == list.heapSize);
     assert(list.data[0] == child);
 
-    list.free(&list);
+    XMLNodeList_free(&list);
     child = NULL;
 
     return success;
@@ -800,14 +3454,14 @@ static int lxmlTestNodeListAdd() {
 
 static int lxmlTestNodeListCreateAndAppend() {
     struct XMLNodeList list = XMLNodeList_init();
-    struct XMLNode *child = list.createAndAppend(&list);
+    struct XMLNode *child = XMLNodeList_createAndAppend(&list);
 
     assert(NULL != child);
 
     assert(1 == list.size && 1 == list.heapSize);
     assert(list.data[0] == child);
 
-    list.free(&list);
+    XMLNodeList_free(&list);
     child = NULL;
 
     return TRUE;
@@ -834,7 +3488,13 @@ int main() {
     success &= lxmlTestNodeList();
 
     success &= lxmlTestParseAttributes();
-    success &= lxmlTestEndsWith();
+    success &= lxmlTestEndTag();
+    success &= lxmlTestXMLDocumentLoadBuffer();
+    success &= lxmlTestXMLParser();
+    success &= lxmlTestXMLDocumentParseEvents();
+    success &= lxmlTestXMLReader();
+    success &= lxmlTestXMLQuery();
+    success &= lxmlTestXMLDocumentWrite();
 
     #ifdef LXML_HAVE_FMEMOPEN
     success &= lxmlTestReadXmlContentsIntoMemory();